@@ -0,0 +1,181 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parser.hpp"
+#include "../include/parallelParse.hpp"
+#include "../include/incremental.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sys/resource.h>
+
+/**
+ * Front-end benchmark: tokenize + parse a generated source, once through the
+ * fused pull tokenizer and once through the two-pass path that materializes
+ * vector<Token> first.
+ *
+ * quarks_bench_frontend [MiB=100] [fused|two-pass|parallel|incremental|both]
+ *
+ * `parallel` splits the source at top-level statements and parses the
+ * chunks on every core. `incremental` applies single-character edits at
+ * random offsets and reports the latency of each reparse.
+ *
+ * Peak RSS is process-wide and never goes down, so `both` runs the fused
+ * path first; run the modes separately for clean peak numbers.
+ */
+
+static std::string generate_source(const std::size_t bytes) {
+    std::string source;
+    source.reserve(bytes + 256);
+    std::uint64_t state = 0x9e3779b97f4a7c15;
+    std::size_t block = 0;
+    while (source.size() < bytes) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        const auto a = (state >> 33) % 1000;
+        const auto b = (state >> 43) % 97 + 1;
+        source += "-- block " + std::to_string(block++) + "\n";
+        source += "{\n    assign a = " + std::to_string(a) + " * (x + " +
+                  std::to_string(b) + ") - x / " + std::to_string(b) + ";\n";
+        source += "    if (a - " + std::to_string(a) +
+                  ") {\n        a = a + 1;\n    } elif (x) {\n"
+                  "        assign t = a * 2;\n        x = t;\n"
+                  "    } else {\n        x = x - 1;\n    }\n}\n";
+    }
+    return "assign x = 1;\n" + source + "exit(x);\n";
+}
+
+static long peak_rss_kib() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct Measurement {
+    double seconds = 0;
+    std::size_t statements = 0;
+    std::size_t token_bytes = 0;
+};
+
+static Measurement run_fused(const std::string& source) {
+    const auto start = std::chrono::steady_clock::now();
+    Tokenizer tokenizer(source);
+    ArenaAllocator arena(64 * 1024 * 1024);
+    Parser parser(tokenizer, arena);
+    const std::optional<ProgramNode> program = parser.parseProgram();
+    return {.seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+            .statements = program->statements.size(),
+            .token_bytes = Tokenizer::kLookahead * sizeof(Token)};
+}
+
+static Measurement run_two_pass(const std::string& source) {
+    const auto start = std::chrono::steady_clock::now();
+    Tokenizer tokenizer(source);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    const std::size_t token_bytes = tokens.capacity() * sizeof(Token);
+    ArenaAllocator arena(64 * 1024 * 1024);
+    Parser parser(std::move(tokens), arena);
+    const std::optional<ProgramNode> program = parser.parseProgram();
+    return {.seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+            .statements = program->statements.size(),
+            .token_bytes = token_bytes};
+}
+
+static Measurement run_parallel(const std::string& source) {
+    const auto start = std::chrono::steady_clock::now();
+    const ParallelParse parsed =
+        parse_parallel(source, std::thread::hardware_concurrency());
+    return {.seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+            .statements = parsed.program.statements.size(),
+            .token_bytes = Tokenizer::kLookahead * sizeof(Token)};
+}
+
+static std::size_t run_incremental(const std::string& source) {
+    constexpr int kEdits = 2000;
+    IncrementalParse document(source);
+    std::vector<double> micros;
+    micros.reserve(kEdits);
+    std::size_t bytes = 0;
+    int broken = 0;
+    std::size_t offset = 0;
+    std::uint64_t state = 0x2545f4914f6cdd1d;
+    for (int i = 0; i < kEdits; i++) {
+        if (i % 2 == 0) {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            offset = (state >> 16) % document.source().size();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        // type a character, then delete it again; the first may well break
+        // the program, as half-typed code does
+        if (i % 2 == 0) {
+            document.edit(offset, 0, " ");
+        } else {
+            document.edit(offset, 1, "");
+        }
+        const std::optional<CompileError> error = document.diagnostic();
+        micros.push_back(std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+        bytes += document.last_edit().bytes_reparsed;
+        broken += error.has_value() ? 1 : 0;
+    }
+    if (document.source() != source || document.diagnostic().has_value()) {
+        throw CompileError("incremental parse diverged from the source");
+    }
+
+    std::ranges::sort(micros);
+    double total = 0;
+    for (const double us : micros) {
+        total += us;
+    }
+    std::cout << std::fixed << std::setprecision(1) << kEdits
+              << " edits over " << document.unit_count()
+              << " units: mean " << total / kEdits << " us  p50 "
+              << micros[kEdits / 2] << " us  p99 " << micros[kEdits * 99 / 100]
+              << " us  max " << micros.back() << " us  "
+              << bytes / kEdits << " bytes reparsed per edit, " << broken
+              << " left a syntax error\n";
+    return document.unit_count();
+}
+
+static void report(const char* name, const Measurement& m,
+                   const std::size_t bytes) {
+    std::cout << std::fixed << std::setprecision(2) << std::left
+              << std::setw(9) << name << m.seconds << " s  "
+              << bytes / m.seconds / 1e6 << " MB/s  " << m.statements
+              << " statements  token buffer " << m.token_bytes / 1024.0
+              << " KiB  peak RSS " << peak_rss_kib() / 1024.0 << " MiB\n";
+}
+
+int main(int argc, char* argv[]) {
+    const std::size_t mib = argc > 1 ? std::stoul(argv[1]) : 100;
+    const std::string mode = argc > 2 ? argv[2] : "both";
+
+    const std::string source = generate_source(mib << 20);
+    std::cout << "source " << source.size() / 1e6 << " MB, baseline RSS "
+              << peak_rss_kib() / 1024.0 << " MiB\n";
+
+    try {
+        if (mode == "fused" || mode == "both") {
+            report("fused", run_fused(source), source.size());
+        }
+        if (mode == "two-pass" || mode == "both") {
+            report("two-pass", run_two_pass(source), source.size());
+        }
+        if (mode == "parallel") {
+            report("parallel", run_parallel(source), source.size());
+        }
+        if (mode == "incremental") {
+            run_incremental(source);
+        }
+    } catch (const CompileError& error) {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parser.hpp"
+#include "../include/generation.hpp"
+#include "../include/compileStats.hpp"
+#include "../include/quarks.hpp"
+#include "workload.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <limits>
+
+/**
+ * Compiler benchmark suite over generated workloads (see workload.hpp):
+ * tokenizer MB/s, parser AST nodes/s and generator instructions/s on one
+ * large program per workload, and end-to-end files/s compiling many small
+ * ones. Each number is the best of --runs repetitions.
+ *
+ * quarks_bench [--seed=N] [--mib=N] [--files=N] [--runs=N]
+ *              [--baseline=<json>] [--tolerance=<fraction>]
+ *              [--write-baseline=<json>] [--emit=<dir>]
+ *
+ * With --baseline, every metric that is more than --tolerance (default
+ * 0.15) below the baseline is flagged and the exit status is 1. The
+ * baseline records seed, size and file count, and is only compared against
+ * runs with the same ones. --emit writes the large workloads as .qs files
+ * and exits.
+ */
+
+struct Config {
+    std::uint64_t seed = 1;
+    std::size_t mib = 4;
+    std::size_t files = 200;
+    int runs = 3;
+};
+
+/** metric name to value, in the order they were measured */
+using Metrics = std::vector<std::pair<std::string, double>>;
+
+/** best of runs, in seconds */
+template <typename Body> static double best_of(const int runs, Body&& body) {
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count());
+    }
+    return best;
+}
+
+static std::size_t total_nodes(const ProgramNode& program) {
+    std::size_t nodes = 0;
+    for (const auto& [kind, count] : count_nodes(program)) {
+        nodes += count;
+    }
+    return nodes;
+}
+
+static void measure(const WorkloadShape& shape, const Config& config,
+                    Metrics& metrics) {
+    const std::string source = WorkloadGenerator(config.seed).generate(shape);
+
+    const double tokenize = best_of(config.runs, [&] {
+        Tokenizer tokenizer(source);
+        const std::vector<Token> tokens = tokenizer.tokenize();
+    });
+    metrics.emplace_back(shape.name + "/tokenize_mb_s",
+                         static_cast<double>(source.size()) / tokenize / 1e6);
+
+    // one token vector per run, so copying them is not timed
+    std::vector<std::vector<Token>> tokens(static_cast<std::size_t>(config.runs),
+                                           Tokenizer(source).tokenize());
+    ArenaAllocator arena(16 * 1024 * 1024);
+    std::optional<ProgramNode> program;
+    const double parse = best_of(config.runs, [&] {
+        arena.reset();
+        Parser parser(std::move(tokens.back()), arena);
+        tokens.pop_back();
+        program = parser.parseProgram();
+    });
+    metrics.emplace_back(shape.name + "/parse_nodes_s",
+                         static_cast<double>(total_nodes(program.value())) /
+                             parse);
+
+    std::string code;
+    const double generate = best_of(config.runs, [&] {
+        code = Generator(program.value()).generateProgram();
+    });
+    quarks::Stats emitted;
+    count_code(code, emitted);
+    metrics.emplace_back(shape.name + "/generate_instructions_s",
+                         static_cast<double>(emitted.instructions) / generate);
+
+    // end to end through the library, on files of a typical size
+    WorkloadShape small = shape;
+    small.bytes = 4096;
+    std::vector<std::string> files;
+    for (std::size_t i = 0; i < config.files; i++) {
+        files.push_back(WorkloadGenerator(config.seed + i).generate(small));
+    }
+    quarks::Compiler compiler;
+    const double end_to_end = best_of(config.runs, [&] {
+        for (const std::string& file : files) {
+            if (!compiler.compile(file)) {
+                throw CompileError("workload " + shape.name + " failed");
+            }
+        }
+    });
+    metrics.emplace_back(shape.name + "/end_to_end_files_s",
+                         static_cast<double>(files.size()) / end_to_end);
+}
+
+static void write_json(const std::filesystem::path& path,
+                       const Config& config, const Metrics& metrics) {
+    std::ofstream out(path);
+    out << std::setprecision(6) << "{\n  \"seed\": " << config.seed
+        << ",\n  \"mib\": " << config.mib << ",\n  \"files\": " << config.files;
+    for (const auto& [name, value] : metrics) {
+        out << ",\n  \"" << name << "\": " << value;
+    }
+    out << "\n}\n";
+    if (!out) {
+        throw CompileError("Failed to write " + path.string());
+    }
+}
+
+/** reads the flat name-to-number object write_json produces */
+static std::map<std::string, double>
+read_json(const std::filesystem::path& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw CompileError("Failed to open baseline " + path.string());
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string text = buffer.str();
+
+    std::map<std::string, double> values;
+    std::size_t pos = 0;
+    while ((pos = text.find('"', pos)) != std::string::npos) {
+        const std::size_t end = text.find('"', pos + 1);
+        const std::size_t colon = text.find(':', end);
+        if (end == std::string::npos || colon == std::string::npos) {
+            throw CompileError("Malformed baseline " + path.string());
+        }
+        values[text.substr(pos + 1, end - pos - 1)] =
+            std::stod(text.substr(colon + 1));
+        pos = text.find_first_of(",}", colon);
+    }
+    return values;
+}
+
+/** prints the comparison; the number of regressions */
+static int compare(const Metrics& metrics,
+                   const std::map<std::string, double>& baseline,
+                   const double tolerance) {
+    int regressions = 0;
+    std::cout << "\n" << std::left << std::setw(36) << "metric" << std::right
+              << std::setw(14) << "baseline" << std::setw(14) << "now"
+              << std::setw(9) << "change" << "\n";
+    for (const auto& [name, value] : metrics) {
+        const auto it = baseline.find(name);
+        if (it == baseline.end() || it->second <= 0) {
+            continue;
+        }
+        const double change = value / it->second - 1;
+        const bool regressed = change < -tolerance;
+        regressions += regressed ? 1 : 0;
+        std::cout << std::left << std::setw(36) << name << std::right
+                  << std::setw(14) << it->second << std::setw(14) << value
+                  << std::setw(8) << std::showpos << change * 100
+                  << std::noshowpos << "%" << (regressed ? "  REGRESSION" : "")
+                  << "\n";
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    std::filesystem::path baseline;
+    std::filesystem::path write_baseline;
+    std::filesystem::path emit;
+    double tolerance = 0.15;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.starts_with("--seed=")) {
+            config.seed = std::stoull(value);
+        } else if (arg.starts_with("--mib=")) {
+            config.mib = std::stoul(value);
+        } else if (arg.starts_with("--files=")) {
+            config.files = std::stoul(value);
+        } else if (arg.starts_with("--runs=")) {
+            config.runs = std::max(1, std::stoi(value));
+        } else if (arg.starts_with("--baseline=")) {
+            baseline = value;
+        } else if (arg.starts_with("--tolerance=")) {
+            tolerance = std::stod(value);
+        } else if (arg.starts_with("--write-baseline=")) {
+            write_baseline = value;
+        } else if (arg.starts_with("--emit=")) {
+            emit = value;
+        } else {
+            std::cerr << "quarks_bench [--seed=N] [--mib=N] [--files=N] "
+                         "[--runs=N] [--baseline=<json>] "
+                         "[--tolerance=<fraction>] [--write-baseline=<json>] "
+                         "[--emit=<dir>]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        const std::vector<WorkloadShape> workloads =
+            standard_workloads(config.mib << 20);
+        if (!emit.empty()) {
+            std::filesystem::create_directories(emit);
+            for (const WorkloadShape& shape : workloads) {
+                std::ofstream(emit / (shape.name + ".qs"))
+                    << WorkloadGenerator(config.seed).generate(shape);
+            }
+            return EXIT_SUCCESS;
+        }
+
+        Metrics metrics;
+        for (const WorkloadShape& shape : workloads) {
+            measure(shape, config, metrics);
+            std::cout << std::fixed << std::setprecision(1) << std::left
+                      << std::setw(11) << shape.name << std::right;
+            for (auto it = metrics.end() - 4; it != metrics.end(); ++it) {
+                std::cout << "  " << it->first.substr(shape.name.size() + 1)
+                          << " " << it->second;
+            }
+            std::cout << std::endl;
+        }
+
+        if (!write_baseline.empty()) {
+            write_json(write_baseline, config, metrics);
+        }
+        if (!baseline.empty()) {
+            const std::map<std::string, double> stored = read_json(baseline);
+            const auto recorded = [&](const char* key, const double value) {
+                const auto it = stored.find(key);
+                return it != stored.end() && it->second == value;
+            };
+            if (!recorded("seed", static_cast<double>(config.seed)) ||
+                !recorded("mib", static_cast<double>(config.mib)) ||
+                !recorded("files", static_cast<double>(config.files))) {
+                std::cerr << "baseline was recorded with another seed, size "
+                             "or file count; not comparing\n";
+                return EXIT_FAILURE;
+            }
+            const int regressions = compare(metrics, stored, tolerance);
+            std::cout << regressions << " regression(s) beyond "
+                      << tolerance * 100 << "%\n";
+            return regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** what a generated program is made of; every count is per top-level unit */
+struct WorkloadShape {
+    std::string name;
+    /** the program grows until it is at least this large */
+    std::size_t bytes = 1 << 20;
+    /** declarations at the start of every block */
+    int declarations = 4;
+    /** blocks and ifs nested inside each other */
+    int nesting = 2;
+    /** elif branches of every if */
+    int elifs = 1;
+    /** binary operators per expression */
+    int operators = 3;
+};
+
+/** one workload per stress axis, plus a mix of all of them */
+inline std::vector<WorkloadShape> standard_workloads(const std::size_t bytes) {
+    return {
+        {.name = "variables", .bytes = bytes, .declarations = 256,
+         .nesting = 0, .elifs = 0, .operators = 1},
+        {.name = "nesting", .bytes = bytes, .declarations = 1,
+         .nesting = 256, .elifs = 0, .operators = 1},
+        {.name = "elif", .bytes = bytes, .declarations = 1, .nesting = 1,
+         .elifs = 256, .operators = 1},
+        {.name = "arithmetic", .bytes = bytes, .declarations = 2,
+         .nesting = 0, .elifs = 0, .operators = 256},
+        {.name = "mixed", .bytes = bytes, .declarations = 4, .nesting = 4,
+         .elifs = 4, .operators = 6},
+    };
+}
+
+/**
+ * Deterministic generator of valid .qs programs for benchmarks. A shape and
+ * a seed always give the same program on every platform: the generator is a
+ * fixed LCG rather than <random>'s implementation-defined distributions.
+ *
+ * Every top-level unit is a block that declares fresh variables (names are
+ * never reused, so nothing shadows) and nests blocks and if/elif/else
+ * chains inside it. Expressions read only variables in scope and divide
+ * only by non-zero literals.
+ */
+class WorkloadGenerator final {
+  public:
+    explicit WorkloadGenerator(const std::uint64_t seed)
+        : m_state(seed * 6364136223846793005 + 1442695040888963407) {}
+
+    std::string generate(const WorkloadShape& shape) {
+        m_out.clear();
+        m_out.reserve(shape.bytes + 4096);
+        m_out += "assign x = " + std::to_string(next(100)) + ";\n";
+        while (m_out.size() < shape.bytes) {
+            std::vector<std::string> scope{"x"};
+            m_out += "{\n";
+            block(shape, scope, 1, shape.nesting);
+            m_out += "}\n";
+        }
+        m_out += "exit(x);\n";
+        return std::move(m_out);
+    }
+
+  private:
+    std::uint64_t m_state;
+    std::string m_out;
+    std::size_t m_names = 0;
+
+    std::uint64_t next(const std::uint64_t bound) {
+        m_state = m_state * 6364136223846793005 + 1442695040888963407;
+        return (m_state >> 33) % bound;
+    }
+
+    /** deep code is not indented further, like the C backend's output */
+    void indent(const int depth) {
+        m_out.append(4 * static_cast<std::size_t>(std::min(depth, 16)), ' ');
+    }
+
+    std::string term(const std::vector<std::string>& scope) {
+        if (next(2) == 0) {
+            return scope[next(scope.size())];
+        }
+        return std::to_string(next(1000));
+    }
+
+    std::string expression(const int operators,
+                           const std::vector<std::string>& scope) {
+        std::string text = term(scope);
+        for (int i = 0; i < operators; i++) {
+            switch (next(5)) {
+            case 0:
+                text += " + " + term(scope);
+                break;
+            case 1:
+                text += " - " + term(scope);
+                break;
+            case 2:
+                text += " * " + term(scope);
+                break;
+            case 3:
+                text += " / " + std::to_string(next(9) + 1);
+                break;
+            default:
+                text = "(" + text + ") * " + term(scope);
+                break;
+            }
+        }
+        return text;
+    }
+
+    void block(const WorkloadShape& shape, std::vector<std::string> scope,
+               const int depth, const int nesting) {
+        for (int i = 0; i < shape.declarations; i++) {
+            const std::string name = "v" + std::to_string(m_names++);
+            indent(depth);
+            m_out += "assign " + name + " = " +
+                     expression(shape.operators, scope) + ";\n";
+            scope.push_back(name);
+        }
+        indent(depth);
+        m_out += scope[next(scope.size())] + " = " +
+                 expression(shape.operators, scope) + ";\n";
+        if (nesting == 0) {
+            return;
+        }
+
+        // only the first branch nests further, so units grow linearly
+        indent(depth);
+        if (shape.elifs == 0 && next(2) == 0) {
+            m_out += "{\n";
+            block(shape, scope, depth + 1, nesting - 1);
+            indent(depth);
+            m_out += "}\n";
+            return;
+        }
+        m_out += "if (" + expression(shape.operators, scope) + ") {\n";
+        block(shape, scope, depth + 1, nesting - 1);
+        for (int i = 0; i < shape.elifs; i++) {
+            indent(depth);
+            m_out += "} elif (" + expression(shape.operators, scope) + ") {\n";
+            block(shape, scope, depth + 1, 0);
+        }
+        indent(depth);
+        m_out += "} else {\n";
+        block(shape, scope, depth + 1, 0);
+        indent(depth);
+        m_out += "}\n";
+    }
+};
@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Differential check of the two backends: every sample is compiled once
+# through nasm and once through the C backend, and both executables must
+# exit with the same status.
+
+set -u
+
+QUARKS=${QUARKS:-$(pwd)/build/bin/quarks}
+CC=${CC:-cc}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+mkdir -p "$work/run"
+
+failures=0
+for src in sample/*.qs; do
+    path=$(realpath "$src")
+
+    (cd "$work/run" && "$QUARKS" --backend=asm "$path") || {
+        echo "FAIL $src: nasm backend did not compile"
+        failures=$((failures + 1))
+        continue
+    }
+    "$work/out"
+    asm_status=$?
+
+    (cd "$work/run" && "$QUARKS" --backend=c --cc="$CC" "$path") || {
+        echo "FAIL $src: C backend did not compile"
+        failures=$((failures + 1))
+        continue
+    }
+    "$work/out"
+    c_status=$?
+
+    if [ "$asm_status" -ne "$c_status" ]; then
+        echo "FAIL $src: nasm exited $asm_status, C exited $c_status"
+        failures=$((failures + 1))
+    else
+        echo "ok   $src ($asm_status)"
+    fi
+done
+
+exit $((failures != 0))
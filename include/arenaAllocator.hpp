@@ -1,15 +1,28 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
 #include <memory>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+/**
+ * Bump allocator. When the current block is exhausted a new block of the
+ * same size (or larger, for oversized objects) is chained on, so the AST of
+ * an arbitrarily large program fits; earlier blocks stay valid until reset()
+ * or destruction.
+ *
+ * Objects made with emplace() that own memory elsewhere (token strings, the
+ * statement vector of a scope) are destroyed by reset() and the destructor,
+ * newest first; trivially destructible ones cost nothing extra.
+ */
 class ArenaAllocator final {
   public:
-    explicit ArenaAllocator(const std::size_t max_num_bytes)
-        : m_size{max_num_bytes}, m_buffer{new std::byte[max_num_bytes]},
-          m_offset{m_buffer} {}
+    explicit ArenaAllocator(const std::size_t block_num_bytes)
+        : m_size{block_num_bytes}, m_buffer{new std::byte[block_num_bytes]},
+          m_offset{m_buffer}, m_block_size{block_num_bytes} {}
 
     ArenaAllocator(const ArenaAllocator&) = delete;
     ArenaAllocator& operator=(const ArenaAllocator&) = delete;
@@ -17,12 +30,20 @@ class ArenaAllocator final {
     ArenaAllocator(ArenaAllocator&& other) noexcept
         : m_size{std::exchange(other.m_size, 0)},
           m_buffer{std::exchange(other.m_buffer, nullptr)},
-          m_offset{std::exchange(other.m_offset, nullptr)} {}
+          m_offset{std::exchange(other.m_offset, nullptr)},
+          m_block_size{other.m_block_size},
+          m_retired{std::move(other.m_retired)},
+          m_retired_bytes{std::exchange(other.m_retired_bytes, 0)},
+          m_destructors{std::move(other.m_destructors)} {}
 
     ArenaAllocator& operator=(ArenaAllocator&& other) noexcept {
         std::swap(m_size, other.m_size);
         std::swap(m_buffer, other.m_buffer);
         std::swap(m_offset, other.m_offset);
+        std::swap(m_block_size, other.m_block_size);
+        std::swap(m_retired, other.m_retired);
+        std::swap(m_retired_bytes, other.m_retired_bytes);
+        std::swap(m_destructors, other.m_destructors);
         return *this;
     }
 
@@ -30,10 +51,14 @@ class ArenaAllocator final {
         std::size_t remaining_num_bytes =
             m_size - static_cast<std::size_t>(m_offset - m_buffer);
         auto pointer = static_cast<void*>(m_offset);
-        const auto aligned_address =
+        auto aligned_address =
             std::align(alignof(T), sizeof(T), pointer, remaining_num_bytes);
         if (aligned_address == nullptr) {
-            throw std::bad_alloc{};
+            grow(sizeof(T) + alignof(T));
+            remaining_num_bytes = m_size;
+            pointer = static_cast<void*>(m_offset);
+            aligned_address = std::align(alignof(T), sizeof(T), pointer,
+                                         remaining_num_bytes);
         }
         m_offset = static_cast<std::byte*>(aligned_address) + sizeof(T);
         return static_cast<T*>(aligned_address);
@@ -42,15 +67,39 @@ class ArenaAllocator final {
     template <typename T, typename... Args>
     [[nodiscard]] T* emplace(Args&&... args) {
         const auto allocated_memory = alloc<T>();
-        return new (allocated_memory) T{std::forward<Args>(args)...};
+        T* object = new (allocated_memory) T{std::forward<Args>(args)...};
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            m_destructors.push_back(
+                {object, [](void* pointer) { static_cast<T*>(pointer)->~T(); }});
+        }
+        return object;
+    }
+
+    /**
+     * Destroys what emplace() made and rewinds the arena, so a long-lived
+     * process can reuse the buffer for the next compilation.
+     */
+    void reset() {
+        for (auto it = m_destructors.rbegin(); it != m_destructors.rend();
+             ++it) {
+            it->destroy(it->object);
+        }
+        m_destructors.clear();
+        for (std::byte* block : m_retired) {
+            delete[] block;
+        }
+        m_retired.clear();
+        m_retired_bytes = 0;
+        m_offset = m_buffer;
+    }
+
+    /** bytes handed out (including alignment padding) since the last reset */
+    [[nodiscard]] std::size_t used() const {
+        return m_retired_bytes + static_cast<std::size_t>(m_offset - m_buffer);
     }
 
     ~ArenaAllocator() {
-        // No destructors are called for the stored objects. Thus, memory
-        // leaks are possible (e.g. when storing std::vector objects or
-        // other non-trivially destructible objects in the allocator).
-        // Although this could be changed, it would come with additional
-        // runtime overhead and therefore is not implemented.
+        reset();
         delete[] m_buffer;
     }
 
@@ -58,4 +107,22 @@ class ArenaAllocator final {
     std::size_t m_size;
     std::byte* m_buffer;
     std::byte* m_offset;
+    std::size_t m_block_size;
+    std::vector<std::byte*> m_retired{};
+    std::size_t m_retired_bytes = 0;
+
+    /** an object emplace() made that reset() has to destroy */
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+    std::vector<Destructor> m_destructors{};
+
+    void grow(const std::size_t min_num_bytes) {
+        m_retired.push_back(m_buffer);
+        m_retired_bytes += static_cast<std::size_t>(m_offset - m_buffer);
+        m_size = std::max(m_block_size, min_num_bytes);
+        m_buffer = new std::byte[m_size];
+        m_offset = m_buffer;
+    }
 };
\ No newline at end of file
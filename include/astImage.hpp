@@ -0,0 +1,635 @@
+#pragma once
+#include "arenaAllocator.hpp"
+#include "parser.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+/**
+ * A parsed program as a position-independent binary image, so the front end
+ * runs once and every later backend or analysis starts from the image. Nodes
+ * are fixed-size records that name their children by record index instead
+ * of pointing at them, children before parents, so loading is one forward
+ * pass over the records into the arena with no tokenizing or parsing.
+ * Hash-consed subtrees are stored once and load shared.
+ *
+ * On disk it is little-endian: the Header, the records, the record indices
+ * of every statement list as 32-bit words, then the text of all tokens.
+ */
+class AstImage {
+  public:
+    /** "QSAST" */
+    static constexpr std::uint64_t kMagic = 0x5453415351;
+    /** changes with the layout of Header or Record */
+    static constexpr std::uint32_t kVersion = 2;
+    /** a missing child */
+    static constexpr std::uint32_t kNone = 0xffffffff;
+
+    enum class Kind : std::uint8_t {
+        // expressions
+        int_literal,
+        identifier,
+        parenthesis,
+        index,
+        add,
+        subtract,
+        multiply,
+        divide,
+        // what a statement holds
+        exit,
+        let,
+        assign,
+        import,
+        if_,
+        scope,
+        // the rest of an if chain
+        elif,
+        else_,
+        statement,
+    };
+
+    struct Header {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t records;
+        /** BranchProfile::hash of the source, so profiles still apply */
+        std::uint64_t source_hash;
+        std::uint32_t list_words;
+        std::uint32_t text_bytes;
+        /** the top-level statements, a range of the list words */
+        std::uint32_t program_first;
+        std::uint32_t program_count;
+    };
+
+    /**
+     * One node, at the line and column of its token or position. a to d by
+     * kind, where "text" is a and b, the offset and length of the token:
+     * int_literal, identifier and import: text. index: text, c the index.
+     * parenthesis and exit: a the expression. add to divide: a and b the
+     * operands. let: text, c the expression, d the length, and type. assign:
+     * text, c the expression, d the index or kNone. if_ and elif: a the test,
+     * b the scope, c the elif or else after it or kNone. else_: b the scope.
+     * scope: a and b, a range of the list words. statement: a what it holds.
+     */
+    struct Record {
+        Kind kind;
+        /** of a let, i64 otherwise */
+        IntType type;
+        std::uint8_t reserved[2];
+        std::int32_t line;
+        std::int32_t column;
+        std::uint32_t a;
+        std::uint32_t b;
+        std::uint32_t c;
+        std::uint32_t d;
+    };
+
+    static_assert(sizeof(Record) == 28 && sizeof(Header) == 40);
+
+    /** program as an image */
+    [[nodiscard]] static std::string write(const ProgramNode& program,
+                                           std::uint64_t source_hash);
+
+    /** checks the header; throws CompileError unless bytes hold an image */
+    explicit AstImage(const std::string_view bytes) : m_bytes(bytes) {
+        if (bytes.size() < sizeof(Header)) {
+            throw CompileError("Not an AST image");
+        }
+        std::memcpy(&m_header, bytes.data(), sizeof(Header));
+        if (m_header.magic != kMagic) {
+            throw CompileError("Not an AST image");
+        }
+        if (m_header.version != kVersion) {
+            throw CompileError("Unsupported AST image version " +
+                               std::to_string(m_header.version));
+        }
+        if (bytes.size() != sizeof(Header) +
+                                std::uint64_t{m_header.records} * sizeof(Record) +
+                                std::uint64_t{m_header.list_words} * 4 +
+                                m_header.text_bytes ||
+            std::uint64_t{m_header.program_first} + m_header.program_count >
+                m_header.list_words) {
+            throw CompileError("Corrupt AST image");
+        }
+    }
+
+    [[nodiscard]] std::uint64_t source_hash() const {
+        return m_header.source_hash;
+    }
+
+    /** the program, allocated in arena; throws CompileError if corrupt */
+    [[nodiscard]] ProgramNode load(ArenaAllocator& arena) const;
+
+  private:
+    struct Writer;
+    struct Children;
+
+    std::string_view m_bytes;
+    Header m_header{};
+
+    [[nodiscard]] Record record(const std::uint32_t index) const {
+        Record record;
+        std::memcpy(&record,
+                    m_bytes.data() + sizeof(Header) + index * sizeof(Record),
+                    sizeof(Record));
+        return record;
+    }
+
+    [[nodiscard]] std::uint32_t list_word(const std::uint32_t index) const {
+        std::uint32_t word;
+        std::memcpy(&word,
+                    m_bytes.data() + sizeof(Header) +
+                        std::size_t{m_header.records} * sizeof(Record) +
+                        std::size_t{index} * 4,
+                    4);
+        return word;
+    }
+};
+
+/** builds an image one node at a time, children first, see write */
+struct AstImage::Writer {
+    std::vector<Record> records;
+    std::vector<std::uint32_t> lists;
+    std::string text;
+    std::unordered_map<std::string, std::uint32_t> text_offsets;
+    std::unordered_map<const void*, std::uint32_t> indices;
+
+    [[nodiscard]] std::uint32_t index_of(const void* node) const {
+        return node == nullptr ? kNone : indices.at(node);
+    }
+
+    [[nodiscard]] std::uint32_t
+    index_of(const std::optional<nodeIfPredicate*>& next) const {
+        return next.has_value() ? indices.at(next.value()) : kNone;
+    }
+
+    std::uint32_t add(const Kind kind, const int line, const int column,
+                      const std::uint32_t a = kNone,
+                      const std::uint32_t b = kNone,
+                      const std::uint32_t c = kNone,
+                      const std::uint32_t d = kNone) {
+        records.push_back({.kind = kind,
+                           .type = IntType::i64,
+                           .reserved = {},
+                           .line = line,
+                           .column = column,
+                           .a = a,
+                           .b = b,
+                           .c = c,
+                           .d = d});
+        return static_cast<std::uint32_t>(records.size() - 1);
+    }
+
+    /** identifiers repeat, so their text is stored once */
+    std::uint32_t add(const Kind kind, const Token& token,
+                      const std::uint32_t c = kNone,
+                      const std::uint32_t d = kNone) {
+        const std::string& value = token.value.value();
+        const auto [offset, added] = text_offsets.try_emplace(
+            value, static_cast<std::uint32_t>(text.size()));
+        if (added) {
+            text += value;
+        }
+        return add(kind, token.line, token.column, offset->second,
+                   static_cast<std::uint32_t>(value.size()), c, d);
+    }
+
+    // the record of a node whose children have theirs
+
+    std::uint32_t operator()(const ExpressionNode* expression) {
+        if (const auto* binary =
+                std::get_if<BinaryExpressionNode*>(&expression->var)) {
+            static constexpr Kind kKinds[] = {Kind::add, Kind::multiply,
+                                              Kind::divide, Kind::subtract};
+            const auto [lhs, rhs] = operands(*binary);
+            return add(kKinds[(*binary)->ops.index()], -1, -1, index_of(lhs),
+                       index_of(rhs));
+        }
+        const TermNode* term = std::get<TermNode*>(expression->var);
+        if (const auto* literal =
+                std::get_if<TermIntLiteralNode*>(&term->vars)) {
+            return add(Kind::int_literal, (*literal)->int_literals);
+        }
+        if (const auto* id = std::get_if<TermIdentifierNode*>(&term->vars)) {
+            return add(Kind::identifier, (*id)->identifier);
+        }
+        if (const auto* element = std::get_if<TermIndexNode*>(&term->vars)) {
+            return add(Kind::index, (*element)->identifier,
+                       index_of((*element)->index));
+        }
+        return add(
+            Kind::parenthesis, -1, -1,
+            index_of(std::get<TermParenthesisNode*>(term->vars)->expression));
+    }
+
+    std::uint32_t operator()(const nodeScope* scope) {
+        const auto first = static_cast<std::uint32_t>(lists.size());
+        for (const StatementNode* statement : scope->statements) {
+            lists.push_back(index_of(statement));
+        }
+        return add(Kind::scope, scope->position.line, scope->position.column,
+                   first, static_cast<std::uint32_t>(scope->statements.size()));
+    }
+
+    std::uint32_t operator()(const nodeIfPredicate* next) {
+        if (const auto* elif =
+                std::get_if<nodeIfPredicateElif*>(&next->predicate)) {
+            return add(Kind::elif, (*elif)->position.line,
+                       (*elif)->position.column, index_of((*elif)->expression),
+                       index_of((*elif)->scope), index_of((*elif)->ifPredicate));
+        }
+        return add(
+            Kind::else_, -1, -1, kNone,
+            index_of(std::get<nodeIfPredicateElse*>(next->predicate)->scope));
+    }
+
+    std::uint32_t operator()(const StatementNode* statement) {
+        const std::uint32_t held = std::visit(*this, statement->var);
+        return add(Kind::statement, statement->position.line,
+                   statement->position.column, held);
+    }
+
+    std::uint32_t operator()(const StatementExitNode* exit) {
+        return add(Kind::exit, -1, -1, index_of(exit->expr));
+    }
+
+    std::uint32_t operator()(const LetStatementNode* let) {
+        const std::uint32_t index =
+            add(Kind::let, let->identifier, index_of(let->expression),
+                static_cast<std::uint32_t>(let->length));
+        records[index].type = let->type;
+        return index;
+    }
+
+    std::uint32_t operator()(const nodeStatementAssign* assign) {
+        return add(Kind::assign, assign->identifier,
+                   index_of(assign->expression), index_of(assign->index));
+    }
+
+    std::uint32_t operator()(const ImportStatementNode* import) {
+        return add(Kind::import, import->module);
+    }
+
+    std::uint32_t operator()(const nodeIfStatement* statement_if) {
+        return add(Kind::if_, -1, -1, index_of(statement_if->expression),
+                   index_of(statement_if->scope),
+                   index_of(statement_if->ifPredicate));
+    }
+};
+
+/** pushes what must have a record before a node does, see write */
+struct AstImage::Children {
+    using Node = std::variant<const StatementNode*, const ExpressionNode*,
+                              const nodeIfPredicate*, const nodeScope*>;
+
+    std::vector<std::pair<Node, bool>>& pending;
+
+    void operator()(const ExpressionNode* expression) const {
+        if (const auto* binary =
+                std::get_if<BinaryExpressionNode*>(&expression->var)) {
+            const auto [lhs, rhs] = operands(*binary);
+            pending.emplace_back(rhs, false);
+            pending.emplace_back(lhs, false);
+            return;
+        }
+        const TermNode* term = std::get<TermNode*>(expression->var);
+        if (const auto* element = std::get_if<TermIndexNode*>(&term->vars)) {
+            pending.emplace_back((*element)->index, false);
+        } else if (const auto* parenthesis =
+                       std::get_if<TermParenthesisNode*>(&term->vars)) {
+            pending.emplace_back((*parenthesis)->expression, false);
+        }
+    }
+
+    void operator()(const nodeScope* scope) const {
+        statements(scope->statements);
+    }
+
+    void operator()(const nodeIfPredicate* next) const {
+        if (const auto* elif =
+                std::get_if<nodeIfPredicateElif*>(&next->predicate)) {
+            chain((*elif)->expression, (*elif)->scope, (*elif)->ifPredicate);
+        } else {
+            pending.emplace_back(
+                std::get<nodeIfPredicateElse*>(next->predicate)->scope, false);
+        }
+    }
+
+    void operator()(const StatementNode* statement) const {
+        std::visit(*this, statement->var);
+    }
+
+    void operator()(const StatementExitNode* exit) const {
+        pending.emplace_back(exit->expr, false);
+    }
+
+    void operator()(const LetStatementNode* let) const {
+        pending.emplace_back(let->expression, false);
+    }
+
+    void operator()(const nodeStatementAssign* assign) const {
+        if (assign->index != nullptr) {
+            pending.emplace_back(assign->index, false);
+        }
+        pending.emplace_back(assign->expression, false);
+    }
+
+    void operator()(const ImportStatementNode*) const {}
+
+    void operator()(const nodeIfStatement* statement_if) const {
+        chain(statement_if->expression, statement_if->scope,
+              statement_if->ifPredicate);
+    }
+
+    /** in reverse, so they get their records in source order */
+    void statements(const std::vector<StatementNode*>& list) const {
+        for (auto it = list.rbegin(); it != list.rend(); ++it) {
+            pending.emplace_back(*it, false);
+        }
+    }
+
+    void chain(const ExpressionNode* test, const nodeScope* scope,
+               const std::optional<nodeIfPredicate*>& next) const {
+        if (next.has_value()) {
+            pending.emplace_back(next.value(), false);
+        }
+        pending.emplace_back(scope, false);
+        pending.emplace_back(test, false);
+    }
+};
+
+inline std::string AstImage::write(const ProgramNode& program,
+                                   const std::uint64_t source_hash) {
+    // post-order with an explicit stack, like the generators
+    Writer writer;
+    std::vector<std::pair<Children::Node, bool>> pending;
+    const Children children{pending};
+    children.statements(program.statements);
+    while (!pending.empty()) {
+        const auto [node, expanded] = pending.back();
+        pending.pop_back();
+        const void* key =
+            std::visit([](const auto* n) -> const void* { return n; }, node);
+        if (writer.indices.contains(key)) {
+            continue;
+        }
+        if (expanded) {
+            writer.indices.emplace(key, std::visit(writer, node));
+        } else {
+            pending.emplace_back(node, true);
+            std::visit(children, node);
+        }
+    }
+
+    std::vector<std::uint32_t>& lists = writer.lists;
+    const Header header{
+        .magic = kMagic,
+        .version = kVersion,
+        .records = static_cast<std::uint32_t>(writer.records.size()),
+        .source_hash = source_hash,
+        .list_words =
+            static_cast<std::uint32_t>(lists.size() + program.statements.size()),
+        .text_bytes = static_cast<std::uint32_t>(writer.text.size()),
+        .program_first = static_cast<std::uint32_t>(lists.size()),
+        .program_count = static_cast<std::uint32_t>(program.statements.size())};
+    for (const StatementNode* statement : program.statements) {
+        lists.push_back(writer.index_of(statement));
+    }
+    std::string image(sizeof(Header) + writer.records.size() * sizeof(Record) +
+                          lists.size() * 4 + writer.text.size(),
+                      '\0');
+    char* out = image.data();
+    std::memcpy(out, &header, sizeof(Header));
+    out += sizeof(Header);
+    std::memcpy(out, writer.records.data(),
+                writer.records.size() * sizeof(Record));
+    out += writer.records.size() * sizeof(Record);
+    std::memcpy(out, lists.data(), lists.size() * 4);
+    out += lists.size() * 4;
+    std::memcpy(out, writer.text.data(), writer.text.size());
+    return image;
+}
+
+inline ProgramNode AstImage::load(ArenaAllocator& arena) const {
+    enum class Category { expression, held, scope, predicate, statement };
+    const auto category = [](const Kind kind) {
+        if (kind <= Kind::divide) {
+            return Category::expression;
+        }
+        if (kind == Kind::scope) {
+            return Category::scope;
+        }
+        if (kind < Kind::scope) {
+            return Category::held;
+        }
+        return kind == Kind::statement ? Category::statement
+                                       : Category::predicate;
+    };
+    const char* text = m_bytes.data() + (m_bytes.size() - m_header.text_bytes);
+
+    std::vector<void*> nodes(m_header.records);
+    std::vector<Kind> kinds(m_header.records);
+    // children come first, so every one a record names is already built
+    std::uint32_t current = 0;
+    const auto child = [&](const std::uint32_t index,
+                           const Category expected) -> void* {
+        if (index >= current || category(kinds[index]) != expected) {
+            throw CompileError("Corrupt AST image");
+        }
+        return nodes[index];
+    };
+    const auto expression = [&](const std::uint32_t index) {
+        return static_cast<ExpressionNode*>(child(index, Category::expression));
+    };
+    const auto scope = [&](const std::uint32_t index) {
+        return static_cast<nodeScope*>(child(index, Category::scope));
+    };
+    const auto predicate =
+        [&](const std::uint32_t index) -> std::optional<nodeIfPredicate*> {
+        if (index == kNone) {
+            return std::nullopt;
+        }
+        return static_cast<nodeIfPredicate*>(child(index, Category::predicate));
+    };
+    const auto statements = [&](const std::uint32_t first,
+                                const std::uint32_t count) {
+        if (std::uint64_t{first} + count > m_header.list_words) {
+            throw CompileError("Corrupt AST image");
+        }
+        std::vector<StatementNode*> list;
+        list.reserve(count);
+        for (std::uint32_t i = first; i < first + count; i++) {
+            list.push_back(static_cast<StatementNode*>(
+                child(list_word(i), Category::statement)));
+        }
+        return list;
+    };
+
+    for (; current < m_header.records; current++) {
+        const Record node = record(current);
+        const auto token = [&](const TokenType type) {
+            if (std::uint64_t{node.a} + node.b > m_header.text_bytes) {
+                throw CompileError("Corrupt AST image");
+            }
+            return Token{.type = type,
+                         .value = std::string(text + node.a, node.b),
+                         .line = node.line,
+                         .column = node.column};
+        };
+        const auto term = [&](auto* held) -> void* {
+            return arena.emplace<ExpressionNode>(arena.emplace<TermNode>(held));
+        };
+        const auto binary = [&]<typename Op>(std::type_identity<Op>) -> void* {
+            auto* op = arena.emplace<BinaryExpressionNode>();
+            op->ops = arena.emplace<Op>(expression(node.a), expression(node.b));
+            return arena.emplace<ExpressionNode>(op);
+        };
+        void* built = nullptr;
+        switch (node.kind) {
+        case Kind::int_literal:
+            built = term(arena.emplace<TermIntLiteralNode>(
+                token(TokenType::intLiteral)));
+            break;
+        case Kind::identifier:
+            built = term(arena.emplace<TermIdentifierNode>(
+                token(TokenType::identifier)));
+            break;
+        case Kind::parenthesis:
+            built = term(arena.emplace<TermParenthesisNode>(expression(node.a)));
+            break;
+        case Kind::index:
+            built = term(arena.emplace<TermIndexNode>(
+                token(TokenType::identifier), expression(node.c)));
+            break;
+        case Kind::add:
+            built = binary(std::type_identity<BinaryExpressionAddition>{});
+            break;
+        case Kind::subtract:
+            built = binary(std::type_identity<BinaryExpressionSubtraction>{});
+            break;
+        case Kind::multiply:
+            built = binary(std::type_identity<BinaryExpressionMultiplication>{});
+            break;
+        case Kind::divide:
+            built = binary(std::type_identity<BinaryExpressionDivision>{});
+            break;
+        case Kind::exit:
+            built = arena.emplace<StatementExitNode>(expression(node.a));
+            break;
+        case Kind::let:
+            if (static_cast<std::size_t>(node.type) >= kIntTypeNames.size()) {
+                throw CompileError("Corrupt AST image");
+            }
+            built = arena.emplace<LetStatementNode>(
+                token(TokenType::identifier), expression(node.c), node.d,
+                node.type);
+            break;
+        case Kind::assign:
+            built = arena.emplace<nodeStatementAssign>(
+                token(TokenType::identifier), expression(node.c),
+                node.d == kNone ? nullptr : expression(node.d));
+            break;
+        case Kind::import:
+            built = arena.emplace<ImportStatementNode>(
+                token(TokenType::identifier));
+            break;
+        case Kind::if_:
+            built = arena.emplace<nodeIfStatement>(
+                expression(node.a), scope(node.b), predicate(node.c));
+            break;
+        case Kind::scope:
+            built = arena.emplace<nodeScope>(
+                statements(node.a, node.b),
+                SourcePosition{.line = node.line, .column = node.column});
+            break;
+        case Kind::elif:
+            built = arena.emplace<nodeIfPredicate>(
+                arena.emplace<nodeIfPredicateElif>(
+                    expression(node.a), scope(node.b), predicate(node.c),
+                    SourcePosition{.line = node.line, .column = node.column}));
+            break;
+        case Kind::else_:
+            built = arena.emplace<nodeIfPredicate>(
+                arena.emplace<nodeIfPredicateElse>(scope(node.b)));
+            break;
+        case Kind::statement: {
+            auto* statement = arena.emplace<StatementNode>();
+            statement->position = {.line = node.line, .column = node.column};
+            void* held = node.a < current ? nodes[node.a] : nullptr;
+            switch (node.a < current ? kinds[node.a] : Kind::statement) {
+            case Kind::exit:
+                statement->var = static_cast<StatementExitNode*>(held);
+                break;
+            case Kind::let:
+                statement->var = static_cast<LetStatementNode*>(held);
+                break;
+            case Kind::assign:
+                statement->var = static_cast<nodeStatementAssign*>(held);
+                break;
+            case Kind::import:
+                statement->var = static_cast<ImportStatementNode*>(held);
+                break;
+            case Kind::if_:
+                statement->var = static_cast<nodeIfStatement*>(held);
+                break;
+            case Kind::scope:
+                statement->var = static_cast<nodeScope*>(held);
+                break;
+            default:
+                throw CompileError("Corrupt AST image");
+            }
+            built = statement;
+            break;
+        }
+        default:
+            throw CompileError("Corrupt AST image");
+        }
+        nodes[current] = built;
+        kinds[current] = node.kind;
+    }
+    return {.statements =
+                statements(m_header.program_first, m_header.program_count)};
+}
+
+/** a file mapped read-only, so an AST image loads without being copied */
+class MappedFile {
+  public:
+    explicit MappedFile(const std::filesystem::path& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw CompileError("Failed to open file " + path.string());
+        }
+        struct stat status {};
+        if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+            m_size = static_cast<std::size_t>(status.st_size);
+            m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (m_data == MAP_FAILED) {
+            m_data = nullptr;
+            throw CompileError("Failed to map file " + path.string());
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (m_data != nullptr) {
+            ::munmap(m_data, m_size);
+        }
+    }
+
+    [[nodiscard]] std::string_view bytes() const {
+        return {static_cast<const char*>(m_data), m_size};
+    }
+
+  private:
+    void* m_data = nullptr;
+    std::size_t m_size = 0;
+};
@@ -0,0 +1,797 @@
+#pragma once
+#include "elementwise.hpp"
+#include "modules.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+/**
+ * Second backend next to Generator: lowers the same ProgramNode to portable
+ * C so hot programs can be built with an optimizing C compiler.
+ * Locals become int64_t in nested blocks and exit(...) becomes a return from
+ * main. Arithmetic goes through unsigned helpers so overflow wraps exactly
+ * like the 64-bit registers in the nasm output instead of being UB, and
+ * division traps where idiv does.
+ */
+class CGenerator {
+
+  public:
+    inline explicit CGenerator(ProgramNode program)
+        : m_program(std::move(program)) {}
+
+    /** streaming use, same protocol as Generator */
+    CGenerator() = default;
+
+    struct Variable {
+        std::string name;
+        /** elements of an array, 0 for a scalar */
+        std::size_t length = 0;
+        /** a copy of another module's export, which is not exported again */
+        bool imported = false;
+        IntType type = IntType::i64;
+    };
+
+    /** top-level scope state, enough to start generating mid-program */
+    struct Region {
+        std::vector<Variable> vars;
+    };
+
+    [[nodiscard]] Region region() const { return {.vars = m_vars}; }
+
+    /** parallel use, same protocol as Generator; C output has no labels */
+    void enter_region(Region region) {
+        m_vars = std::move(region.vars);
+        m_scopes.clear();
+        m_depth = 1;
+    }
+
+    /**
+     * Branch counters or a recorded profile, see Generator::set_profile.
+     * Recorded counts become __builtin_expect hints and the C compiler
+     * does the layout.
+     */
+    void set_profile(ProfileOptions profile) { m_profile = std::move(profile); }
+
+    /**
+     * Debug info for source, the path of the .qs file: a `#line` directive
+     * before every statement. Compiled with -g, variables and scopes are C
+     * locals and blocks with their own DWARF entries. Empty for none.
+     */
+    void set_debug_source(std::string source) {
+        m_debug_source = std::move(source);
+    }
+
+    /**
+     * The module to compile the program as and the modules it may import,
+     * see ModuleOptions. A module is an init function instead of main, and
+     * exit() in it ends the program with exit().
+     */
+    void set_modules(ModuleOptions modules) { m_modules = std::move(modules); }
+
+    /** advances the top-level state past stmt without emitting code */
+    void declare(const StatementNode* stmt) {
+        if (const auto* let = std::get_if<LetStatementNode*>(&stmt->var)) {
+            m_vars.push_back({.name = (*let)->identifier.value.value(),
+                              .length = (*let)->length,
+                              .type = (*let)->type});
+        } else if (const auto* import =
+                       std::get_if<ImportStatementNode*>(&stmt->var)) {
+            const quarks::Interface* module =
+                m_modules.find((*import)->module.value.value());
+            if (module == nullptr) {
+                return;
+            }
+            for (const quarks::Export& exported : module->exports) {
+                m_vars.push_back({.name = exported.name,
+                                  .length = exported.length,
+                                  .imported = true});
+            }
+        }
+    }
+
+    void generateTerm(const TermNode* term) {
+        struct TermVisitor {
+
+            CGenerator& m_generator;
+
+            void operator()(const TermIdentifierNode* id) const {
+                const Variable& variable = m_generator.lookup(id->identifier);
+                if (variable.type != IntType::i64) {
+                    // as i64, so division mixing types stays signed
+                    m_generator.m_output << "(int64_t)";
+                }
+                m_generator.m_output
+                    << variable_name(id->identifier.value.value());
+                if (variable.length == 0) {
+                    return;
+                }
+                if (!m_generator.m_elementwise ||
+                    m_generator.m_open_elements > 0) {
+                    throw CompileError("Array used as a scalar: " +
+                                           id->identifier.value.value(),
+                                       id->identifier.line);
+                }
+                m_generator.m_output << "[qs_i]";
+            }
+
+            void operator()(const TermIntLiteralNode* it) const {
+                // in decimal: C reads digits with a leading 0 as octal
+                const std::uint64_t value =
+                    literal_value(it->int_literals.value.value());
+                if (value > std::numeric_limits<std::int64_t>::max()) {
+                    m_generator.m_output << "(-INT64_C(" << ~value << ") - 1)";
+                    return;
+                }
+                m_generator.m_output << "INT64_C(" << value << ")";
+            }
+
+            void operator()(const TermParenthesisNode* pn) const {
+                m_generator.generateExpression(pn->expression);
+            }
+
+            void operator()(const TermIndexNode* element) const {
+                m_generator.open_element(element);
+                m_generator.generateExpression(element->index);
+                m_generator.close_element(element);
+            }
+        };
+
+        TermVisitor visitor{.m_generator = *this};
+        std::visit(visitor, term->vars);
+    }
+
+    /**
+     * Pieces of an expression still to be written, see generateExpression;
+     * an index term closes the element access around its index.
+     */
+    using ExpressionPart =
+        std::variant<const ExpressionNode*, const char*, const TermIndexNode*>;
+
+    /** queues the spelling of bns and its operands on the expression walk */
+    void generateBinaryExpression(const BinaryExpressionNode* bns,
+                                  std::vector<ExpressionPart>& pending) {
+
+        struct binaryExpressionVisitor {
+
+            CGenerator& m_generator;
+            std::vector<ExpressionPart>& m_pending;
+
+            void operator()(const BinaryExpressionAddition* add) const {
+                m_generator.binary(m_pending, "qs_add(", add->lhs, ", ", add->rhs,
+                                   ")");
+            }
+
+            void operator()(const BinaryExpressionSubtraction* sub) const {
+                m_generator.binary(m_pending, "qs_sub(", sub->lhs, ", ", sub->rhs,
+                                   ")");
+            }
+
+            void operator()(const BinaryExpressionMultiplication* mul) const {
+                m_generator.binary(m_pending, "qs_mul(", mul->lhs, ", ", mul->rhs,
+                                   ")");
+            }
+
+            void operator()(const BinaryExpressionDivision* div) const {
+                m_generator.binary(m_pending, "qs_div(", div->lhs, ", ",
+                                   div->rhs, ")");
+            }
+        };
+
+        binaryExpressionVisitor visitor{.m_generator = *this,
+                                        .m_pending = pending};
+        std::visit(visitor, bns->ops);
+    }
+
+    /** the C type of a scalar of type */
+    static std::string c_type(const IntType type) {
+        return (type_signed(type) ? "int" : "uint") +
+               std::to_string(type_width(type) * 8) + "_t";
+    }
+
+    /** expression converted to the type of scalar, which keeps its low bits */
+    void generateStored(const Variable& scalar,
+                        const ExpressionNode* expression) {
+        if (scalar.type == IntType::i64) {
+            generateExpression(expression);
+            return;
+        }
+        m_output << "(" << c_type(scalar.type) << ")(";
+        generateExpression(expression);
+        m_output << ")";
+    }
+
+    /** in-order walk with an explicit stack, so depth is unbounded */
+    void generateExpression(const ExpressionNode* expression) {
+
+        std::vector<ExpressionPart> pending{expression};
+        while (!pending.empty()) {
+            const ExpressionPart next = pending.back();
+            pending.pop_back();
+            if (const auto* text = std::get_if<const char*>(&next)) {
+                m_output << *text;
+            } else if (const auto* element =
+                           std::get_if<const TermIndexNode*>(&next)) {
+                close_element(*element);
+            } else if (const auto hoisted = m_hoisted.find(
+                           std::get<const ExpressionNode*>(next));
+                       hoisted != m_hoisted.end()) {
+                m_output << hoisted->second;
+            } else if (const auto* binary = std::get_if<BinaryExpressionNode*>(
+                           &std::get<const ExpressionNode*>(next)->var)) {
+                generateBinaryExpression(*binary, pending);
+            } else {
+                const TermNode* term =
+                    std::get<TermNode*>(std::get<const ExpressionNode*>(next)->var);
+                if (const auto* parenthesis =
+                        std::get_if<TermParenthesisNode*>(&term->vars)) {
+                    pending.emplace_back((*parenthesis)->expression);
+                } else if (const auto* element =
+                               std::get_if<TermIndexNode*>(&term->vars)) {
+                    open_element(*element);
+                    pending.emplace_back(
+                        static_cast<const TermIndexNode*>(*element));
+                    pending.emplace_back((*element)->index);
+                } else {
+                    generateTerm(term);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] std::string generateProgram() {
+
+        begin_program();
+        for (const StatementNode* statement : m_program.statements) {
+            generateStatement(statement);
+        }
+        end_program();
+
+        return m_output.str();
+    }
+
+    void begin_program() {
+        m_output << "#include <signal.h>\n#include <stdint.h>\n\n";
+        m_output << "static inline int64_t qs_add(int64_t a, int64_t b) {\n"
+                    "    return (int64_t)((uint64_t)a + (uint64_t)b);\n}\n";
+        m_output << "static inline int64_t qs_sub(int64_t a, int64_t b) {\n"
+                    "    return (int64_t)((uint64_t)a - (uint64_t)b);\n}\n";
+        m_output << "static inline int64_t qs_mul(int64_t a, int64_t b) {\n"
+                    "    return (int64_t)((uint64_t)a * (uint64_t)b);\n}\n";
+        // idiv raises SIGFPE for both, which C leaves undefined
+        m_output << "static inline int64_t qs_div(int64_t a, int64_t b) {\n"
+                    "    if (b == 0 || (a == INT64_MIN && b == -1)) {\n"
+                    "        raise(SIGFPE);\n"
+                    "        __builtin_trap();\n"
+                    "    }\n"
+                    "    return a / b;\n}\n";
+        m_output << "static inline uint64_t qs_index(int64_t index, "
+                    "uint64_t length) {\n"
+                    "    if ((uint64_t)index >= length) {\n"
+                    "        __builtin_trap();\n"
+                    "    }\n"
+                    "    return (uint64_t)index;\n}\n\n";
+        if (!m_profile.instrument.empty()) {
+            m_output << "#include <stdio.h>\n#include <stdlib.h>\n\n"
+                        "extern uint64_t qs_profile[];\n"
+                        "static void qs_write_profile(void);\n\n"
+                        "static inline int64_t qs_count(uint64_t site, "
+                        "int64_t taken) {\n"
+                        "    qs_profile[2 * site]++;\n"
+                        "    qs_profile[2 * site + 1] += taken != 0;\n"
+                        "    return taken;\n}\n\n";
+        }
+        if (!m_modules.name.empty()) {
+            begin_module();
+            return;
+        }
+        m_output << "int main(void) {\n";
+        m_depth = 1;
+        if (!m_profile.instrument.empty()) {
+            indent();
+            m_output << "atexit(qs_write_profile);\n";
+        }
+    }
+
+    void end_program() {
+        if (!m_modules.name.empty()) {
+            end_module();
+            return;
+        }
+        indent();
+        m_output << "return 0;\n";
+        m_output << "}\n";
+        if (!m_profile.instrument.empty()) {
+            write_profile();
+        }
+    }
+
+    [[nodiscard]] std::string take_output() {
+        std::string output = m_output.str();
+        m_output.str({});
+        return output;
+    }
+
+    /** same explicit-stack walk as Generator::generateStatement */
+    void generateStatement(const StatementNode* stmt) {
+        std::vector<Task> tasks{stmt};
+        while (!tasks.empty()) {
+            const Task task = tasks.back();
+            tasks.pop_back();
+            std::visit(TaskVisitor{.m_generator = *this, .m_tasks = tasks},
+                       task);
+        }
+    }
+
+  private:
+    /** closes the innermost scope */
+    struct CloseScope {};
+
+    /** the next elif/else of a chain */
+    struct NextPredicate {
+        const nodeIfPredicate* predicate;
+    };
+
+    using Task = std::variant<const StatementNode*, const nodeScope*,
+                              CloseScope, NextPredicate, const char*>;
+
+    struct StatementVisitor {
+        CGenerator& m_generator;
+        std::vector<Task>& m_tasks;
+
+        void operator()(const LetStatementNode* stmt_let) const {
+            const std::string& name = stmt_let->identifier.value.value();
+            if (ranges::find(m_generator.m_vars, name, &Variable::name) !=
+                m_generator.m_vars.cend()) {
+                throw CompileError("Identifier already used: " + name,
+                                   stmt_let->identifier.line);
+            }
+            if (stmt_let->length != 0) {
+                const Variable array{.name = name, .length = stmt_let->length};
+                m_generator.indent();
+                m_generator.m_output << "int64_t " << variable_name(name)
+                                     << "[" << array.length << "];\n";
+                m_generator.generateElementwise(array, stmt_let->expression);
+                m_generator.m_vars.push_back(array);
+                return;
+            }
+            m_generator.check_store(stmt_let->expression, stmt_let->type);
+            m_generator.m_vars.push_back({.name = name, .type = stmt_let->type});
+            m_generator.indent();
+            m_generator.m_output << c_type(stmt_let->type) << " "
+                                 << variable_name(name) << " = ";
+            m_generator.generateStored(m_generator.m_vars.back(),
+                                       stmt_let->expression);
+            m_generator.m_output << ";\n";
+        }
+
+        void operator()(const ImportStatementNode* import) const {
+            const quarks::Interface& module =
+                m_generator.m_modules.imported(import->module);
+            const std::string init = ModuleOptions::init_symbol(module.module);
+            const std::string exports =
+                ModuleOptions::exports_symbol(module.module);
+            m_generator.indent();
+            m_generator.m_output << "extern void " << init << "(void);\n";
+            m_generator.indent();
+            m_generator.m_output << "extern int64_t " << exports << "[];\n";
+            m_generator.indent();
+            m_generator.m_output << init << "();\n";
+            std::size_t word = 0;
+            for (const quarks::Export& exported : module.exports) {
+                if (ranges::find(m_generator.m_vars, exported.name,
+                                 &Variable::name) != m_generator.m_vars.cend()) {
+                    throw CompileError("Identifier already used: " +
+                                           exported.name,
+                                       import->module.line);
+                }
+                const std::string name = variable_name(exported.name);
+                const std::string word_at =
+                    exports + "[" + std::to_string(word);
+                m_generator.indent();
+                if (exported.length == 0) {
+                    m_generator.m_output << "int64_t " << name << " = "
+                                         << word_at << "];\n";
+                } else {
+                    m_generator.m_output << "int64_t " << name << "["
+                                         << exported.length << "];\n";
+                    m_generator.copy_array(exported.length, name + "[qs_i]",
+                                           word_at + " + qs_i]");
+                }
+                m_generator.m_vars.push_back({.name = exported.name,
+                                              .length = exported.length,
+                                              .imported = true});
+                word += std::max<std::size_t>(exported.length, 1);
+            }
+        }
+
+        void operator()(const StatementExitNode* stmt_exit) const {
+            m_generator.indent();
+            if (!m_generator.m_modules.name.empty()) {
+                m_generator.m_output << "exit((int)(";
+                m_generator.generateExpression(stmt_exit->expr);
+                m_generator.m_output << "));\n";
+                return;
+            }
+            m_generator.m_output << "return (int)(";
+            m_generator.generateExpression(stmt_exit->expr);
+            m_generator.m_output << ");\n";
+        }
+
+        void operator()(const nodeScope* scope) const {
+            m_generator.indent();
+            m_tasks.emplace_back("\n");
+            m_tasks.emplace_back(scope);
+        }
+
+        void operator()(const nodeIfStatement* statement_if) const {
+            m_generator.indent();
+            m_generator.m_output << "if (";
+            m_generator.generateTest(statement_if->expression);
+            m_generator.m_output << ") ";
+            m_tasks.emplace_back("\n");
+            if (statement_if->ifPredicate.has_value()) {
+                m_tasks.emplace_back(
+                    NextPredicate{statement_if->ifPredicate.value()});
+            }
+            m_tasks.emplace_back(statement_if->scope);
+        }
+
+        void operator()(const nodeStatementAssign* assign) const {
+            const Variable& variable = m_generator.lookup(assign->identifier);
+            if (assign->index != nullptr) {
+                if (variable.length == 0) {
+                    throw CompileError("Not an array: " + variable.name,
+                                       assign->identifier.line);
+                }
+                // the index is checked before the value is computed
+                m_generator.indent();
+                m_generator.m_output << "{\n";
+                m_generator.m_depth++;
+                m_generator.indent();
+                m_generator.m_output << "const uint64_t qs_i = qs_index(";
+                m_generator.generateExpression(assign->index);
+                m_generator.m_output << ", " << variable.length << ");\n";
+                m_generator.indent();
+                m_generator.m_output << variable_name(variable.name)
+                                     << "[qs_i] = ";
+                m_generator.generateExpression(assign->expression);
+                m_generator.m_output << ";\n";
+                m_generator.m_depth--;
+                m_generator.indent();
+                m_generator.m_output << "}\n";
+                return;
+            }
+            if (variable.length != 0) {
+                m_generator.generateElementwise(variable, assign->expression);
+                return;
+            }
+            m_generator.check_store(assign->expression, variable.type);
+            m_generator.indent();
+            m_generator.m_output
+                << variable_name(assign->identifier.value.value()) << " = ";
+            m_generator.generateStored(variable, assign->expression);
+            m_generator.m_output << ";\n";
+        }
+    };
+
+    struct TaskVisitor {
+        CGenerator& m_generator;
+        std::vector<Task>& m_tasks;
+
+        void operator()(const StatementNode* stmt) const {
+            m_generator.mark_line(stmt->position);
+            std::visit(StatementVisitor{.m_generator = m_generator,
+                                        .m_tasks = m_tasks},
+                       stmt->var);
+        }
+
+        void operator()(const nodeScope* scope) const {
+            m_generator.m_output << "{\n";
+            m_generator.begin_scope();
+            m_tasks.emplace_back(CloseScope{});
+            for (auto it = scope->statements.rbegin();
+                 it != scope->statements.rend(); ++it) {
+                m_tasks.emplace_back(*it);
+            }
+        }
+
+        void operator()(const CloseScope&) const {
+            m_generator.end_scope();
+            m_generator.indent();
+            m_generator.m_output << "}";
+        }
+
+        void operator()(const NextPredicate& next) const {
+            if (const auto* elif =
+                    std::get_if<nodeIfPredicateElif*>(&next.predicate->predicate)) {
+                m_generator.m_output << " else if (";
+                m_generator.generateTest((*elif)->expression);
+                m_generator.m_output << ") ";
+                if ((*elif)->ifPredicate.has_value()) {
+                    m_tasks.emplace_back(
+                        NextPredicate{(*elif)->ifPredicate.value()});
+                }
+                m_tasks.emplace_back((*elif)->scope);
+            } else {
+                m_generator.m_output << " else ";
+                m_tasks.emplace_back(
+                    std::get<nodeIfPredicateElse*>(next.predicate->predicate)
+                        ->scope);
+            }
+        }
+
+        void operator()(const char* text) const { m_generator.m_output << text; }
+    };
+
+    const ProgramNode m_program;
+    std::stringstream m_output;
+    size_t m_depth = 0;
+
+    std::vector<Variable> m_vars{};
+    std::vector<size_t> m_scopes{};
+    /** array identifiers stand for element qs_i, outside of any index */
+    bool m_elementwise = false;
+    std::size_t m_open_elements = 0;
+    /** scalar subtrees of the current element-wise loop, by their names */
+    std::unordered_map<const ExpressionNode*, std::string> m_hoisted;
+
+    ProfileOptions m_profile;
+    /** if/elif tests numbered so far, in the same order as Generator */
+    std::size_t m_sites = 0;
+
+    std::string m_debug_source;
+
+    ModuleOptions m_modules;
+
+    /** a loop running `to = from;` for every qs_i below length */
+    void copy_array(const std::size_t length, const std::string& to,
+                    const std::string& from) {
+        m_output << "for (uint64_t qs_i = 0; qs_i < " << length
+                 << "; qs_i++) {\n";
+        m_depth++;
+        indent();
+        m_output << to << " = " << from << ";\n";
+        m_depth--;
+        indent();
+        m_output << "}\n";
+    }
+
+    /** the init function runs the program once, on its first call */
+    void begin_module() {
+        m_output << "#include <stdlib.h>\n\nextern int64_t "
+                 << ModuleOptions::exports_symbol(m_modules.name)
+                 << "[];\n\nvoid " << ModuleOptions::init_symbol(m_modules.name)
+                 << "(void) {\n";
+        m_depth = 1;
+        indent();
+        m_output << "static int qs_initialized;\n";
+        indent();
+        m_output << "if (qs_initialized) {\n";
+        indent();
+        m_output << "    return;\n";
+        indent();
+        m_output << "}\n";
+        indent();
+        m_output << "qs_initialized = 1;\n";
+    }
+
+    /** stores the top-level declarations, which is all the init returns */
+    void end_module() {
+        const std::string exports = ModuleOptions::exports_symbol(m_modules.name);
+        std::size_t words = 0;
+        for (const Variable& variable : m_vars) {
+            if (variable.imported) {
+                continue;
+            }
+            const std::string word_at = exports + "[" + std::to_string(words);
+            indent();
+            if (variable.length == 0) {
+                m_output << word_at << "] = " << variable_name(variable.name)
+                         << ";\n";
+            } else {
+                copy_array(variable.length, word_at + " + qs_i]",
+                           variable_name(variable.name) + "[qs_i]");
+            }
+            words += std::max<std::size_t>(variable.length, 1);
+        }
+        m_output << "}\n\nint64_t " << exports << "["
+                 << std::max<std::size_t>(words, 1) << "];\n";
+    }
+
+    /** the next line of C is the statement at position */
+    void mark_line(const SourcePosition& position) {
+        if (m_debug_source.empty() || position.line < 0) {
+            return;
+        }
+        m_output << "#line " << position.line + 1 << " \"";
+        write_escaped(m_debug_source);
+        m_output << "\"\n";
+    }
+
+    /** text inside a C string literal */
+    void write_escaped(const std::string& text) {
+        for (const char c : text) {
+            if (c == '"' || c == '\\') {
+                m_output << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < ' ') {
+                m_output << '\\' << std::oct << std::setw(3) << std::setfill('0')
+                         << static_cast<int>(c) << std::dec;
+            } else {
+                m_output << c;
+            }
+        }
+    }
+
+    /** an if/elif condition, counted or hinted per the profile options */
+    void generateTest(const ExpressionNode* expression) {
+        const std::size_t site = m_sites++;
+        if (m_profile.use != nullptr) {
+            m_output << "__builtin_expect(!!(";
+        }
+        if (!m_profile.instrument.empty()) {
+            m_output << "qs_count(" << site << ", ";
+        }
+        generateExpression(expression);
+        if (!m_profile.instrument.empty()) {
+            m_output << ")";
+        }
+        if (m_profile.use != nullptr) {
+            m_output << "), " << (m_profile.use->cold(site) ? 0 : 1) << ")";
+        }
+    }
+
+    /** the counters and the atexit handler writing them with their header */
+    void write_profile() {
+        m_output << "\nuint64_t qs_profile[" << std::max<std::size_t>(2 * m_sites, 1)
+                 << "];\n\nstatic void qs_write_profile(void) {\n"
+                 << std::hex << "    const uint64_t header[3] = {UINT64_C(0x"
+                 << BranchProfile::kMagic << "), UINT64_C(0x"
+                 << m_profile.source_hash << ")" << std::dec << ", UINT64_C("
+                 << m_sites << ")};\n    FILE* file = fopen(\"";
+        write_escaped(m_profile.instrument);
+        m_output << "\", \"wb\");\n"
+                    "    if (file == NULL) {\n"
+                    "        return;\n"
+                    "    }\n"
+                    "    fwrite(header, sizeof header, 1, file);\n"
+                    "    fwrite(qs_profile, sizeof qs_profile[0], "
+                 << 2 * m_sites
+                 << ", file);\n"
+                    "    fclose(file);\n"
+                    "}\n";
+    }
+
+    /** prefixed so .qs names can never collide with C keywords or main */
+    static std::string variable_name(const std::string& name) {
+        return "v_" + name;
+    }
+
+    const Variable& lookup(const Token& identifier) const {
+        const auto it =
+            ranges::find(m_vars, identifier.value.value(), &Variable::name);
+        if (it == m_vars.end()) {
+            throw CompileError("Undeclared identifier: " +
+                                   identifier.value.value(),
+                               identifier.line);
+        }
+        return *it;
+    }
+
+    /** ::check_store() against the scalars in scope */
+    void check_store(const ExpressionNode* expression,
+                     const IntType type) const {
+        ::check_store(expression, type,
+                      [&](const Token& identifier) -> std::optional<IntType> {
+                          const auto it =
+                              ranges::find(m_vars, identifier.value.value(),
+                                           &Variable::name);
+                          if (it == m_vars.end() || it->length != 0) {
+                              return std::nullopt;
+                          }
+                          return it->type;
+                      });
+    }
+
+    /** `v_a[qs_index(`, which close_element ends after the index */
+    void open_element(const TermIndexNode* element) {
+        if (lookup(element->identifier).length == 0) {
+            throw CompileError("Not an array: " +
+                                   element->identifier.value.value(),
+                               element->identifier.line);
+        }
+        m_output << variable_name(element->identifier.value.value())
+                 << "[qs_index(";
+        m_open_elements++;
+    }
+
+    void close_element(const TermIndexNode* element) {
+        m_output << ", " << lookup(element->identifier).length << ")]";
+        m_open_elements--;
+    }
+
+    /**
+     * A loop storing expression into every element of array. Scalar
+     * subtrees are computed once before it, like Generator does, so
+     * elements they read are those from before the assignment. It is left
+     * to the C compiler to vectorize; the helpers are inline arithmetic.
+     */
+    void generateElementwise(const Variable& array,
+                             const ExpressionNode* expression) {
+        const std::vector<ElementwiseOp> ops = lower_elementwise(
+            expression, array.length,
+            [&](const Token& identifier) { return lookup(identifier).length; });
+        for (const ElementwiseOp& op : ops) {
+            const auto* term = std::get_if<TermNode*>(&op.expression->var);
+            if (op.kind != ElementwiseOp::Kind::scalar ||
+                m_hoisted.contains(op.expression) ||
+                (term != nullptr &&
+                 (std::holds_alternative<TermIntLiteralNode*>((*term)->vars) ||
+                  std::holds_alternative<TermIdentifierNode*>((*term)->vars)))) {
+                continue;
+            }
+            if (m_hoisted.empty()) {
+                indent();
+                m_output << "{\n";
+                m_depth++;
+            }
+            std::string name = "qs_s" + std::to_string(m_hoisted.size());
+            indent();
+            m_output << "const int64_t " << name << " = ";
+            generateExpression(op.expression);
+            m_output << ";\n";
+            m_hoisted.emplace(op.expression, std::move(name));
+        }
+        indent();
+        m_output << "for (uint64_t qs_i = 0; qs_i < " << array.length
+                 << "; qs_i++) {\n";
+        m_depth++;
+        indent();
+        m_output << variable_name(array.name) << "[qs_i] = ";
+        m_elementwise = true;
+        generateExpression(expression);
+        m_elementwise = false;
+        m_output << ";\n";
+        m_depth--;
+        indent();
+        m_output << "}\n";
+        if (!m_hoisted.empty()) {
+            m_hoisted.clear();
+            m_depth--;
+            indent();
+            m_output << "}\n";
+        }
+    }
+
+    /** queues open lhs sep rhs close, to be written in that order */
+    static void binary(std::vector<ExpressionPart>& pending, const char* open,
+                       const ExpressionNode* lhs, const char* sep,
+                       const ExpressionNode* rhs, const char* close) {
+        pending.emplace_back(close);
+        pending.emplace_back(rhs);
+        pending.emplace_back(sep);
+        pending.emplace_back(lhs);
+        pending.emplace_back(open);
+    }
+
+    /** deeper code is not indented further, keeping the output linear */
+    static constexpr size_t kMaxIndent = 32;
+
+    void indent() {
+        for (size_t i = 0; i < std::min(m_depth, kMaxIndent); i++) {
+            m_output << "    ";
+        }
+    }
+
+    void begin_scope() {
+        m_scopes.push_back(m_vars.size());
+        m_depth++;
+    }
+
+    void end_scope() {
+        m_vars.resize(m_scopes.back());
+        m_scopes.pop_back();
+        m_depth--;
+    }
+};
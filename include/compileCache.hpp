@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#ifndef QUARKS_VERSION
+#define QUARKS_VERSION "0.1.0"
+#endif
+
+/** identifies the compiler build that produced a cached artifact */
+inline constexpr const char* kCompilerBuild =
+    QUARKS_VERSION " " __DATE__ " " __TIME__;
+
+/** 128-bit FNV-1a, enough to address cache entries by content */
+class ContentHash {
+  public:
+    ContentHash& update(const std::string_view bytes) {
+        for (const char c : bytes) {
+            m_state ^= static_cast<unsigned char>(c);
+            m_state *= kPrime;
+        }
+        // separator so ("ab", "c") and ("a", "bc") hash differently
+        m_state ^= 0xff;
+        m_state *= kPrime;
+        return *this;
+    }
+
+    [[nodiscard]] std::string hex() const {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string out(32, '0');
+        unsigned __int128 value = m_state;
+        for (int i = 31; i >= 0; i--) {
+            out[i] = digits[static_cast<int>(value & 0xf)];
+            value >>= 4;
+        }
+        return out;
+    }
+
+  private:
+    static constexpr unsigned __int128 kPrime =
+        (static_cast<unsigned __int128>(0x0000000001000000) << 64) |
+        0x000000000000013B;
+    unsigned __int128 m_state =
+        (static_cast<unsigned __int128>(0x6c62272e07bb0142) << 64) |
+        0x62b821756295c58d;
+};
+
+/**
+ * On-disk cache of finished build artifacts, addressed by the hash of the
+ * source bytes, the compiler build and every option that affects codegen.
+ *
+ * Entries are directories under objects/. A writer fills a private temporary
+ * directory and renames it into place, so concurrent writers and readers
+ * never see a half-written entry; if two writers race the loser's copy is
+ * dropped. Hits refresh the entry's mtime, which drives LRU eviction once
+ * the total size exceeds the limit. Hit/miss counters are kept per process
+ * and accumulated in a stats file guarded by flock.
+ */
+class CompileCache final {
+  public:
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    explicit CompileCache(std::filesystem::path root,
+                          const std::uintmax_t max_bytes = 1024ull << 20)
+        : m_root(std::move(root)), m_max_bytes(max_bytes) {
+        std::filesystem::create_directories(m_root / "objects");
+        std::filesystem::create_directories(m_root / "tmp");
+    }
+
+    /** $QUARKS_CACHE_DIR, else $XDG_CACHE_HOME/quarks, else ~/.cache/quarks */
+    static std::filesystem::path default_root() {
+        if (const char* dir = std::getenv("QUARKS_CACHE_DIR")) {
+            return dir;
+        }
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+            return std::filesystem::path(xdg) / "quarks";
+        }
+        if (const char* home = std::getenv("HOME")) {
+            return std::filesystem::path(home) / ".cache" / "quarks";
+        }
+        return ".quarks-cache";
+    }
+
+    /**
+     * Copies the artifacts stored under key to the given destinations
+     * (artifact file name -> path). Returns false on a miss.
+     */
+    bool lookup(
+        const std::string& key,
+        const std::vector<std::pair<std::string, std::filesystem::path>>&
+            artifacts) {
+        const std::filesystem::path entry = m_root / "objects" / key;
+        std::error_code ec;
+        for (const auto& [name, destination] : artifacts) {
+            std::filesystem::copy_file(
+                entry / name, destination,
+                std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec) {
+                m_stats.misses++;
+                return false;
+            }
+        }
+        std::filesystem::last_write_time(
+            entry, std::filesystem::file_time_type::clock::now(), ec);
+        m_stats.hits++;
+        return true;
+    }
+
+    /** publishes freshly built artifacts (artifact file name -> path) */
+    void store(
+        const std::string& key,
+        const std::vector<std::pair<std::string, std::filesystem::path>>&
+            artifacts) {
+        const std::filesystem::path staging = m_root / "tmp" / unique_name();
+        std::error_code ec;
+        std::filesystem::create_directories(staging, ec);
+        for (const auto& [name, source] : artifacts) {
+            if (!ec) {
+                std::filesystem::copy_file(source, staging / name, ec);
+            }
+        }
+        if (!ec) {
+            std::filesystem::rename(staging, m_root / "objects" / key, ec);
+        }
+        if (ec) {
+            // lost the race against another writer (or the disk is full):
+            // the published entry, if any, is just as good as ours
+            std::filesystem::remove_all(staging, ec);
+        }
+        evict();
+    }
+
+    /** drops least recently used entries until the cache fits the limit */
+    void evict() {
+        struct Entry {
+            std::filesystem::path path;
+            std::filesystem::file_time_type used;
+            std::uintmax_t bytes;
+        };
+        std::vector<Entry> entries;
+        std::uintmax_t total = 0;
+        std::error_code ec;
+        for (const auto& dir :
+             std::filesystem::directory_iterator(m_root / "objects", ec)) {
+            Entry entry{.path = dir.path(),
+                        .used = std::filesystem::last_write_time(dir, ec),
+                        .bytes = entry_size(dir.path())};
+            total += entry.bytes;
+            entries.push_back(std::move(entry));
+        }
+        if (total <= m_max_bytes) {
+            return;
+        }
+        std::ranges::sort(entries, {}, &Entry::used);
+        for (const Entry& entry : entries) {
+            if (total <= m_max_bytes) {
+                break;
+            }
+            if (std::filesystem::remove_all(entry.path, ec) > 0) {
+                total -= entry.bytes;
+                m_stats.evictions++;
+            }
+        }
+    }
+
+    [[nodiscard]] Stats stats() const {
+        return {.hits = m_stats.hits,
+                .misses = m_stats.misses,
+                .evictions = m_stats.evictions};
+    }
+
+    /** adds this process's counters to the persistent totals and returns them */
+    Stats flush_stats() {
+        const std::filesystem::path path = m_root / "stats";
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        Stats totals = stats();
+        if (fd < 0) {
+            return totals;
+        }
+        ::flock(fd, LOCK_EX);
+        std::string text(4096, '\0');
+        const ssize_t size = ::pread(fd, text.data(), text.size(), 0);
+        text.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+        std::istringstream in(text);
+        std::string name;
+        std::uint64_t value = 0;
+        while (in >> name >> value) {
+            if (name == "hits") {
+                totals.hits += value;
+            } else if (name == "misses") {
+                totals.misses += value;
+            } else if (name == "evictions") {
+                totals.evictions += value;
+            }
+        }
+        std::ostringstream out;
+        out << "hits " << totals.hits << "\nmisses " << totals.misses
+            << "\nevictions " << totals.evictions << "\n";
+        const std::string updated = out.str();
+        if (::ftruncate(fd, 0) == 0) {
+            [[maybe_unused]] const ssize_t written =
+                ::pwrite(fd, updated.data(), updated.size(), 0);
+        }
+        ::flock(fd, LOCK_UN);
+        ::close(fd);
+        m_stats.hits = 0;
+        m_stats.misses = 0;
+        m_stats.evictions = 0;
+        return totals;
+    }
+
+    [[nodiscard]] const std::filesystem::path& root() const { return m_root; }
+
+  private:
+    struct Counters {
+        std::atomic<std::uint64_t> hits = 0;
+        std::atomic<std::uint64_t> misses = 0;
+        std::atomic<std::uint64_t> evictions = 0;
+    };
+
+    std::filesystem::path m_root;
+    std::uintmax_t m_max_bytes;
+    Counters m_stats;
+
+    static std::uintmax_t entry_size(const std::filesystem::path& entry) {
+        std::uintmax_t bytes = 0;
+        std::error_code ec;
+        for (const auto& file :
+             std::filesystem::directory_iterator(entry, ec)) {
+            const std::uintmax_t size = file.file_size(ec);
+            bytes += ec ? 0 : size;
+        }
+        return bytes;
+    }
+
+    static std::string unique_name() {
+        thread_local std::mt19937_64 random{std::random_device{}()};
+        std::ostringstream ss;
+        ss << ::getpid() << "-" << std::hex << random();
+        return ss.str();
+    }
+};
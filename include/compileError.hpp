@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+/**
+ * Raised by the tokenizer, parser and generators for invalid programs.
+ * The driver decides what to do with it: the single-file mode prints it and
+ * exits, the batch mode records it against the file and keeps going.
+ */
+class CompileError final : public std::runtime_error {
+  public:
+    explicit CompileError(const std::string& message, const int line = -1)
+        : std::runtime_error(line < 0 ? message
+                                      : message + " at line " +
+                                            std::to_string(line)),
+          m_message(message), m_line(line) {}
+
+    /** the message without the line suffix */
+    [[nodiscard]] const std::string& message() const { return m_message; }
+
+    [[nodiscard]] int line() const { return m_line; }
+
+  private:
+    std::string m_message;
+    int m_line;
+};
@@ -0,0 +1,400 @@
+#pragma once
+#include "driver.hpp"
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/**
+ * Wire format shared by `quarks --server` and `quarks --client`.
+ *
+ * request:  u8 kind, u8 backend, u32 length, payload
+ * response: u8 status, u32 length, payload
+ *
+ * A compile request carries either a source path the server reads itself or
+ * the source bytes. A successful compile answers with the executable bytes,
+ * a failed one with the diagnostics. Lengths are in host byte order since
+ * both ends always live on the same machine. Payloads over kMaxPayload are
+ * answered with an error instead of being read.
+ */
+namespace wire {
+
+enum class Kind : std::uint8_t {
+    compile_path = 'P',
+    compile_source = 'S',
+    stats = 'T',
+    shutdown = 'Q',
+};
+
+enum class Status : std::uint8_t { ok = 0, error = 1 };
+
+/** the largest request payload a server accepts */
+inline constexpr std::uint32_t kMaxPayload = 64u << 20;
+
+inline bool write_all(const int fd, const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+inline bool read_all(const int fd, void* data, std::size_t size) {
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t got = ::recv(fd, bytes, size, 0);
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+inline bool send_frame(const int fd, const std::uint8_t head,
+                       const std::string_view payload) {
+    const auto length = static_cast<std::uint32_t>(payload.size());
+    return write_all(fd, &head, 1) &&
+           write_all(fd, &length, sizeof(length)) &&
+           write_all(fd, payload.data(), payload.size());
+}
+
+inline std::filesystem::path default_socket() {
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR")) {
+        return std::filesystem::path(runtime) / "quarks.sock";
+    }
+    return "/tmp/quarks-" + std::to_string(::getuid()) + ".sock";
+}
+
+inline sockaddr_un address(const std::filesystem::path& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    const std::string native = path.string();
+    if (native.size() >= sizeof(addr.sun_path)) {
+        throw CompileError("Socket path too long: " + native);
+    }
+    std::copy(native.begin(), native.end(), addr.sun_path);
+    return addr;
+}
+
+} // namespace wire
+
+/**
+ * Warm compile process. Each pool worker keeps its own quarks::Compiler,
+ * and with it the AST arena, across requests, so a request pays for
+ * tokenizing, parsing and codegen but not for process startup or a fresh
+ * 4 MiB AST buffer. Identifiers are not interned: tokens own their
+ * spelling, and the arena frees it with the rest of the AST.
+ *
+ * A client that sends nothing for the receive timeout is dropped, so slow
+ * or idle connections cannot hold on to workers, and a request that fails
+ * inside the server is answered with an error instead of ending it.
+ */
+class CompileServer final {
+  public:
+    CompileServer(std::filesystem::path socket_path, CompileOptions options,
+                  const std::size_t jobs)
+        : m_socket_path(std::move(socket_path)), m_options(std::move(options)),
+          m_pool(jobs),
+          m_scratch(std::filesystem::temp_directory_path() /
+                    ("quarks-server-" + std::to_string(::getpid()))) {
+        std::filesystem::create_directories(m_scratch);
+    }
+
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+
+    /** how long a worker waits on a client that sends or reads nothing */
+    void set_receive_timeout(const std::chrono::milliseconds timeout) {
+        m_timeout = timeout;
+    }
+
+    ~CompileServer() {
+        m_pool.wait();
+        std::error_code ec;
+        std::filesystem::remove_all(m_scratch, ec);
+    }
+
+    /** serves until a shutdown request, SIGINT or SIGTERM */
+    int run() {
+        const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            std::cerr << "socket: " << std::strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::filesystem::remove(m_socket_path);
+        const sockaddr_un addr = wire::address(m_socket_path);
+        if (::bind(listener, reinterpret_cast<const sockaddr*>(&addr),
+                   sizeof(addr)) != 0 ||
+            ::listen(listener, 128) != 0) {
+            std::cerr << "bind " << m_socket_path.string() << ": "
+                      << std::strerror(errno) << std::endl;
+            ::close(listener);
+            return EXIT_FAILURE;
+        }
+        ::chmod(m_socket_path.c_str(), 0600);
+
+        s_stop = false;
+        std::signal(SIGINT, [](int) { s_stop = true; });
+        std::signal(SIGTERM, [](int) { s_stop = true; });
+        std::cerr << "quarks server listening on " << m_socket_path.string()
+                  << " with " << m_pool.size() << " workers" << std::endl;
+
+        while (!s_stop) {
+            pollfd pfd{.fd = listener, .events = POLLIN, .revents = 0};
+            if (::poll(&pfd, 1, 200) <= 0) {
+                continue;
+            }
+            const int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            const auto accepted = std::chrono::steady_clock::now();
+            const timeval timeout{
+                .tv_sec = static_cast<time_t>(m_timeout.count() / 1000),
+                .tv_usec = static_cast<suseconds_t>(m_timeout.count() % 1000 *
+                                                    1000)};
+            ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                         sizeof(timeout));
+            ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                         sizeof(timeout));
+            m_pool.submit([this, client, accepted] {
+                try {
+                    serve(client, accepted);
+                } catch (const std::exception& error) {
+                    wire::send_frame(
+                        client, static_cast<std::uint8_t>(wire::Status::error),
+                        std::string("Internal error: ") + error.what());
+                    record(accepted, false);
+                }
+                ::close(client);
+            });
+        }
+
+        ::close(listener);
+        std::filesystem::remove(m_socket_path);
+        m_pool.wait();
+        std::cerr << latency_report();
+        return EXIT_SUCCESS;
+    }
+
+  private:
+    std::filesystem::path m_socket_path;
+    CompileOptions m_options;
+    ThreadPool m_pool;
+    std::filesystem::path m_scratch;
+    std::atomic<std::uint64_t> m_next_id = 0;
+    std::chrono::milliseconds m_timeout{std::chrono::seconds(30)};
+
+    std::mutex m_latency_mutex;
+    std::vector<double> m_latencies;
+    std::uint64_t m_failures = 0;
+
+    static inline volatile std::sig_atomic_t s_stop = false;
+
+    static quarks::Compiler& worker_compiler() {
+        thread_local quarks::Compiler compiler;
+        return compiler;
+    }
+
+    void serve(const int client,
+               const std::chrono::steady_clock::time_point accepted) {
+        std::uint8_t head[2];
+        std::uint32_t length = 0;
+        if (!wire::read_all(client, head, sizeof(head)) ||
+            !wire::read_all(client, &length, sizeof(length))) {
+            return;
+        }
+        if (length > wire::kMaxPayload) {
+            wire::send_frame(client,
+                             static_cast<std::uint8_t>(wire::Status::error),
+                             "Request of " + std::to_string(length) +
+                                 " bytes is over the limit of " +
+                                 std::to_string(wire::kMaxPayload));
+            record(accepted, false);
+            return;
+        }
+        std::string payload(length, '\0');
+        if (!wire::read_all(client, payload.data(), payload.size())) {
+            return;
+        }
+
+        const auto kind = static_cast<wire::Kind>(head[0]);
+        if (kind == wire::Kind::stats) {
+            wire::send_frame(client, 0, latency_report());
+            return;
+        }
+        if (kind == wire::Kind::shutdown) {
+            s_stop = true;
+            wire::send_frame(client, 0, "");
+            return;
+        }
+
+        CompileOptions options = m_options;
+        options.backend = head[1] == 'c' ? Backend::c : Backend::nasm;
+        // the response is the executable, so it has to be built
+        options.in_memory = false;
+        const OutputPaths out{
+            .executable = m_scratch / ("job" + std::to_string(m_next_id++))};
+
+        CompileReport report;
+        if (kind == wire::Kind::compile_path) {
+            report = compile_file(payload, out, options, &worker_compiler());
+        } else {
+            report = compile_source(std::move(payload), "<client>", out,
+                                    options, &worker_compiler());
+        }
+
+        std::string binary;
+        if (report.ok) {
+            try {
+                binary = read_source(out.executable);
+            } catch (const std::exception& error) {
+                report.ok = false;
+                report.diagnostics = error.what();
+            }
+        }
+        for (const char* extension : {"", ".asm", ".o", ".c"}) {
+            std::error_code ec;
+            std::filesystem::remove(out.with(extension), ec);
+        }
+
+        if (report.ok) {
+            wire::send_frame(client,
+                             static_cast<std::uint8_t>(wire::Status::ok),
+                             binary);
+        } else {
+            wire::send_frame(client,
+                             static_cast<std::uint8_t>(wire::Status::error),
+                             report.diagnostics);
+        }
+
+        record(accepted, report.ok);
+    }
+
+    /** adds a finished request to the latency report */
+    void record(const std::chrono::steady_clock::time_point accepted,
+                const bool ok) {
+        const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - accepted)
+                                   .count();
+        std::lock_guard lock(m_latency_mutex);
+        m_latencies.push_back(seconds);
+        m_failures += ok ? 0 : 1;
+    }
+
+    std::string latency_report() {
+        std::vector<double> latencies;
+        std::uint64_t failures = 0;
+        {
+            std::lock_guard lock(m_latency_mutex);
+            latencies = m_latencies;
+            failures = m_failures;
+        }
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3) << latencies.size()
+           << " requests, " << failures << " failed";
+        if (!latencies.empty()) {
+            ranges::sort(latencies);
+            const auto percentile = [&](const double p) {
+                const auto rank = static_cast<std::size_t>(
+                    p * static_cast<double>(latencies.size() - 1) + 0.5);
+                return latencies[rank] * 1e3;
+            };
+            ss << ", p50 " << percentile(0.50) << " ms, p99 "
+               << percentile(0.99) << " ms, max " << latencies.back() * 1e3
+               << " ms";
+        }
+        ss << "\n";
+        return ss.str();
+    }
+};
+
+/**
+ * Thin client: sends one request and writes the executable to output, or
+ * prints the server's diagnostics or statistics.
+ */
+inline int run_client(const std::filesystem::path& socket_path,
+                      const wire::Kind kind, const Backend backend,
+                      const std::string& input,
+                      const std::filesystem::path& output) {
+    std::string payload;
+    try {
+        if (kind == wire::Kind::compile_path) {
+            payload = std::filesystem::absolute(input).string();
+        } else if (kind == wire::Kind::compile_source) {
+            payload = read_source(input);
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const sockaddr_un addr = wire::address(socket_path);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                            sizeof(addr)) != 0) {
+        std::cerr << "connect " << socket_path.string() << ": "
+                  << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    const std::uint8_t head[2] = {static_cast<std::uint8_t>(kind),
+                                  backend == Backend::c ? std::uint8_t{'c'}
+                                                        : std::uint8_t{'a'}};
+    const auto length = static_cast<std::uint32_t>(payload.size());
+    std::uint8_t status = 0;
+    std::uint32_t response_length = 0;
+    std::string response;
+    const bool ok =
+        wire::write_all(fd, head, sizeof(head)) &&
+        wire::write_all(fd, &length, sizeof(length)) &&
+        wire::write_all(fd, payload.data(), payload.size()) &&
+        wire::read_all(fd, &status, 1) &&
+        wire::read_all(fd, &response_length, sizeof(response_length)) &&
+        (response.resize(response_length),
+         wire::read_all(fd, response.data(), response.size()));
+    ::close(fd);
+    if (!ok) {
+        std::cerr << "connection to the compile server failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (static_cast<wire::Status>(status) != wire::Status::ok) {
+        std::cerr << response << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (kind == wire::Kind::stats) {
+        std::cout << response;
+        return EXIT_SUCCESS;
+    }
+    if (kind == wire::Kind::shutdown) {
+        return EXIT_SUCCESS;
+    }
+    {
+        std::ofstream file(output, std::ios::binary | std::ios::trunc);
+        file << response;
+        if (!file) {
+            std::cerr << "Failed to write " << output.string() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::filesystem::permissions(output,
+                                 std::filesystem::perms::owner_exec |
+                                     std::filesystem::perms::group_exec |
+                                     std::filesystem::perms::others_exec,
+                                 std::filesystem::perm_options::add);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include "parser.hpp"
+#include "quarks.hpp"
+#include <chrono>
+#include <sys/resource.h>
+
+/**
+ * Records the wall and CPU time of one pass into a list when it goes out of
+ * scope, also when the pass throws. Does nothing without a list. CPU time is
+ * user plus system time of the whole process and its finished children, so
+ * it includes the workers of a parallel pass and the external toolchain.
+ */
+class PassTimer final {
+  public:
+    PassTimer(std::vector<quarks::PassTiming>* passes, std::string name)
+        : m_passes(passes), m_name(std::move(name)),
+          m_wall(std::chrono::steady_clock::now()), m_cpu(cpu_seconds()) {}
+
+    PassTimer(const PassTimer&) = delete;
+    PassTimer& operator=(const PassTimer&) = delete;
+
+    ~PassTimer() {
+        if (m_passes == nullptr) {
+            return;
+        }
+        m_passes->push_back(
+            {.pass = std::move(m_name),
+             .wall_seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - m_wall)
+                                 .count(),
+             .cpu_seconds = cpu_seconds() - m_cpu});
+    }
+
+  private:
+    std::vector<quarks::PassTiming>* m_passes;
+    std::string m_name;
+    std::chrono::steady_clock::time_point m_wall;
+    double m_cpu;
+
+    static double cpu_seconds() {
+        double seconds = 0;
+        for (const int who : {RUSAGE_SELF, RUSAGE_CHILDREN}) {
+            rusage usage{};
+            getrusage(who, &usage);
+            for (const timeval& time : {usage.ru_utime, usage.ru_stime}) {
+                seconds += static_cast<double>(time.tv_sec) +
+                           static_cast<double>(time.tv_usec) / 1e6;
+            }
+        }
+        return seconds;
+    }
+};
+
+/**
+ * AST nodes by kind, walked with an explicit stack like the generators.
+ * Hash-consed subtrees are counted at every place they occur.
+ */
+inline std::vector<std::pair<std::string, std::size_t>>
+count_nodes(const ProgramNode& program) {
+    enum Kind {
+        exit_,
+        declaration,
+        assignment,
+        scope,
+        if_,
+        elif,
+        else_,
+        int_literal,
+        identifier,
+        parenthesis,
+        addition,
+        subtraction,
+        multiplication,
+        division,
+        index,
+        import_,
+        kinds
+    };
+    std::array<std::size_t, kinds> counts{};
+    using Node = std::variant<const StatementNode*, const ExpressionNode*,
+                              const nodeIfPredicate*>;
+    std::vector<Node> pending(program.statements.rbegin(),
+                              program.statements.rend());
+
+    struct StatementCounter {
+        std::array<std::size_t, kinds>& counts;
+        std::vector<Node>& pending;
+
+        void operator()(const StatementExitNode* exit) const {
+            counts[exit_]++;
+            pending.emplace_back(exit->expr);
+        }
+        void operator()(const LetStatementNode* let) const {
+            counts[declaration]++;
+            pending.emplace_back(let->expression);
+        }
+        void operator()(const ImportStatementNode*) const { counts[import_]++; }
+        void operator()(const nodeStatementAssign* assign) const {
+            counts[assignment]++;
+            pending.emplace_back(assign->expression);
+            if (assign->index != nullptr) {
+                pending.emplace_back(assign->index);
+            }
+        }
+        void operator()(const nodeScope* block) const {
+            counts[scope]++;
+            pending.insert(pending.end(), block->statements.rbegin(),
+                           block->statements.rend());
+        }
+        void operator()(const nodeIfStatement* statement_if) const {
+            counts[if_]++;
+            push_chain(statement_if->expression, statement_if->scope,
+                       statement_if->ifPredicate);
+        }
+        void operator()(const nodeIfPredicateElif* elif_) const {
+            counts[elif]++;
+            push_chain(elif_->expression, elif_->scope, elif_->ifPredicate);
+        }
+        void operator()(const nodeIfPredicateElse* else_node) const {
+            counts[else_]++;
+            pending.insert(pending.end(), else_node->scope->statements.rbegin(),
+                           else_node->scope->statements.rend());
+        }
+
+        void push_chain(const ExpressionNode* expression,
+                        const nodeScope* body,
+                        const std::optional<nodeIfPredicate*>& next) const {
+            if (next.has_value()) {
+                pending.emplace_back(next.value());
+            }
+            pending.insert(pending.end(), body->statements.rbegin(),
+                           body->statements.rend());
+            pending.emplace_back(expression);
+        }
+    };
+
+    struct ExpressionCounter {
+        std::array<std::size_t, kinds>& counts;
+        std::vector<Node>& pending;
+
+        void operator()(const TermNode* term) const {
+            if (std::holds_alternative<TermIntLiteralNode*>(term->vars)) {
+                counts[int_literal]++;
+            } else if (std::holds_alternative<TermIdentifierNode*>(
+                           term->vars)) {
+                counts[identifier]++;
+            } else if (const auto* element =
+                           std::get_if<TermIndexNode*>(&term->vars)) {
+                counts[index]++;
+                pending.emplace_back((*element)->index);
+            } else {
+                counts[parenthesis]++;
+                pending.emplace_back(
+                    std::get<TermParenthesisNode*>(term->vars)->expression);
+            }
+        }
+        void operator()(const BinaryExpressionNode* binary) const {
+            counts[binary->ops.index() == 0   ? addition
+                   : binary->ops.index() == 1 ? multiplication
+                   : binary->ops.index() == 2 ? division
+                                              : subtraction]++;
+            const auto [lhs, rhs] = operands(binary);
+            pending.emplace_back(rhs);
+            pending.emplace_back(lhs);
+        }
+    };
+
+    while (!pending.empty()) {
+        const Node node = pending.back();
+        pending.pop_back();
+        if (const auto* statement = std::get_if<const StatementNode*>(&node)) {
+            std::visit(StatementCounter{counts, pending}, (*statement)->var);
+        } else if (const auto* expression =
+                       std::get_if<const ExpressionNode*>(&node)) {
+            std::visit(ExpressionCounter{counts, pending}, (*expression)->var);
+        } else {
+            std::visit(StatementCounter{counts, pending},
+                       std::get<const nodeIfPredicate*>(node)->predicate);
+        }
+    }
+
+    static constexpr std::array<const char*, kinds> kNames{
+        "exit",       "declaration", "assignment",  "scope",
+        "if",         "elif",        "else",        "int_literal",
+        "identifier", "parenthesis", "addition",    "subtraction",
+        "multiplication", "division",    "index",       "import"};
+    std::vector<std::pair<std::string, std::size_t>> nodes;
+    for (std::size_t kind = 0; kind < kinds; kind++) {
+        nodes.emplace_back(kNames[kind], counts[kind]);
+    }
+    return nodes;
+}
+
+/**
+ * Instructions and labels in generated code: indented lines of assembly
+ * and `labelN:` lines, or the C statements (lines ending in `;`) of main
+ * or a module's init function,
+ * and the statements the SLP pass packed, from its `; packed N` comments,
+ * and the instructions tail merging left out, from its `; merged N` ones.
+ */
+inline void count_code(const std::string_view code, quarks::Stats& stats) {
+    // the C prelude's helpers are not the program's, or the module's
+    std::size_t begin = code.find("\nint main(");
+    if (begin == std::string_view::npos) {
+        begin = code.find("\nvoid qs_");
+    }
+    begin = begin == std::string_view::npos ? 0 : begin + 1;
+    while (begin < code.size()) {
+        std::size_t end = code.find('\n', begin);
+        end = end == std::string_view::npos ? code.size() : end;
+        const std::string_view line = code.substr(begin, end - begin);
+        if (line.starts_with("    ; packed ")) {
+            stats.vectorized += std::stoul(std::string(line.substr(13)));
+        } else if (line.starts_with("    ; merged ")) {
+            stats.merged += std::stoul(std::string(line.substr(13)));
+        } else if (line.starts_with("    ") &&
+            (line.ends_with(";") || line.find_first_of(";{}") ==
+                                        std::string_view::npos)) {
+            stats.instructions++;
+        } else if (line.starts_with("label") && line.ends_with(":")) {
+            stats.labels++;
+        }
+        begin = end + 1;
+    }
+}
@@ -0,0 +1,523 @@
+#pragma once
+#include "astImage.hpp"
+#include "compileCache.hpp"
+#include "compileStats.hpp"
+#include "pipeline.hpp"
+#include "quarks.hpp"
+#include "threadPool.hpp"
+#include "toolchain.hpp"
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+
+using Backend = quarks::Backend;
+
+struct CompileOptions {
+    Backend backend = Backend::nasm;
+    std::string c_compiler = "cc";
+    /** the C compiler's optimization flag */
+    std::string c_optimization = "-O3";
+    /** keep the generated code in memory instead of assembling and linking */
+    bool in_memory = false;
+    /** write the parsed program to <executable>.ast instead of code */
+    bool emit_ast = false;
+    /** overlap tokenizer, parser and generator on separate threads */
+    bool stream = false;
+    /** parse top-level chunks of large sources on this many threads */
+    std::size_t parse_jobs = 1;
+    /** generate code for regions of large programs on this many threads */
+    std::size_t codegen_jobs = 1;
+    /** share identical expression subtrees in the AST */
+    bool hash_cons = false;
+    /** time the passes and count what they produce, see CompileReport */
+    bool collect_stats = false;
+    /** count every if/elif test into the profile file when the program exits */
+    bool instrument = false;
+    /** lay branches out by the profile file an instrumented build wrote */
+    bool profile_use = false;
+    /** the profile file; empty for <executable>.profile */
+    std::filesystem::path profile;
+    /** line tables and symbols for the source file, see quarks::Options */
+    bool debug_info = false;
+    /** vector instructions for array arithmetic of the nasm backend */
+    quarks::Isa isa = quarks::Isa::sse2;
+    /** expression nodes up to which the nasm backend if-converts, 0 for none */
+    std::size_t if_conversion = quarks::kIfConversionCost;
+    /** finished artifacts are looked up here before compiling, if set */
+    CompileCache* cache = nullptr;
+
+    /** every option that changes the produced artifacts, for cache keys */
+    [[nodiscard]] std::string fingerprint() const {
+        std::stringstream ss;
+        ss << "backend=" << static_cast<int>(backend) << ";";
+        if (debug_info) {
+            ss << "debug;";
+        }
+        if (instrument || profile_use) {
+            ss << "instrument=" << instrument << ";profile-use=" << profile_use
+               << ";";
+        }
+        if (backend == Backend::c) {
+            ss << "cc=" << c_compiler << ";" << c_optimization << ";";
+        } else {
+            if (isa != quarks::Isa::sse2) {
+                ss << "isa=" << static_cast<int>(isa) << ";";
+            }
+            if (if_conversion != quarks::kIfConversionCost) {
+                ss << "if-convert=" << if_conversion << ";";
+            }
+        }
+        return ss.str();
+    }
+};
+
+/**
+ * Where one compilation writes its artifacts. Every path is derived from the
+ * executable so concurrent compilations never share a file.
+ */
+struct OutputPaths {
+    std::filesystem::path executable;
+
+    [[nodiscard]] std::filesystem::path with(const char* extension) const {
+        std::filesystem::path path = executable;
+        path += extension;
+        return path;
+    }
+};
+
+struct CompileReport {
+    std::string source;
+    bool ok = false;
+    std::string diagnostics;
+    std::size_t source_bytes = 0;
+    double seconds = 0;
+    bool cached = false;
+    /** generated assembly or C, only kept for in-memory compilations */
+    std::string code;
+    /** AST memory; zero for streaming and cached compilations */
+    quarks::AstStats ast;
+    /** pass timings and counters, with CompileOptions::collect_stats */
+    quarks::Stats stats;
+};
+
+/**
+ * Reads a flag's value as a decimal number into value; false, leaving value
+ * alone, when text is empty, has anything else in it or is out of range.
+ */
+template <typename Number>
+bool parse_number(const std::string_view text, Number& value) {
+    Number parsed{};
+    const auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (error != std::errc{} || end != text.data() + text.size()) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+inline std::string read_source(const std::filesystem::path& path) {
+    std::ifstream fileIn(path, std::ios::binary);
+    if (!fileIn) {
+        throw CompileError("Failed to open file " + path.string());
+    }
+    std::stringstream buffer;
+    buffer << fileIn.rdbuf();
+    return buffer.str();
+}
+
+/** where an instrumented build of out writes its profile */
+inline std::filesystem::path profile_path(const OutputPaths& out,
+                                          const CompileOptions& options) {
+    return std::filesystem::absolute(
+        options.profile.empty() ? out.with(".profile") : options.profile);
+}
+
+/**
+ * The library options generating code for the source file at path.
+ * profile is the profile file, see profile_path.
+ */
+inline quarks::Options library_options(const CompileOptions& options,
+                                       const std::filesystem::path& profile = {},
+                                       const std::filesystem::path& path = {}) {
+    return {.backend = options.backend,
+            .emit = options.emit_ast ? quarks::Emit::ast : quarks::Emit::code,
+            .parse_threads = options.parse_jobs,
+            .codegen_threads = options.codegen_jobs,
+            .hash_cons = options.hash_cons,
+            .collect_stats = options.collect_stats,
+            .instrument = options.instrument ? profile.string() : "",
+            .profile_use = options.profile_use ? profile.string() : "",
+            .debug_source = options.debug_info
+                                ? std::filesystem::absolute(path).string()
+                                : "",
+            .isa = options.isa,
+            .if_conversion = options.if_conversion};
+}
+
+/**
+ * tokenize, parse and generate; throws CompileError on invalid programs.
+ * profile is the profile file, see profile_path, and path the source file
+ * debug info refers to.
+ */
+inline std::string generate_code(const std::string& source,
+                                 const CompileOptions& options,
+                                 quarks::Compiler* compiler = nullptr,
+                                 CompileReport* report = nullptr,
+                                 const std::filesystem::path& profile = {},
+                                 const std::filesystem::path& path = {}) {
+    std::optional<quarks::Compiler> owned_compiler;
+    if (compiler == nullptr) {
+        compiler = &owned_compiler.emplace();
+    }
+    quarks::Result result =
+        compiler->compile(source, library_options(options, profile, path));
+    if (report != nullptr) {
+        report->ast = result.ast;
+        report->stats = std::move(result.stats);
+    }
+    if (!result.ok) {
+        throw CompileError(result.diagnostics.front().message);
+    }
+    return std::move(result.output);
+}
+
+/** streaming counterpart of generate_code, see compile_streaming */
+inline void stream_code(std::string source, const CompileOptions& options,
+                        std::ostream& out) {
+    if (options.backend == Backend::c) {
+        compile_streaming<CGenerator>(std::move(source), out);
+    } else {
+        compile_streaming<Generator>(std::move(source), out, {}, options.isa,
+                                     options.if_conversion);
+    }
+}
+
+/** the generated assembly or C, or the AST image, lives next to the executable */
+inline std::filesystem::path code_path(const OutputPaths& out,
+                                       const CompileOptions& options) {
+    if (options.emit_ast) {
+        return out.with(".ast");
+    }
+    return out.with(options.backend == Backend::c ? ".c" : ".asm");
+}
+
+/** assembles and links (or C-compiles) the code at code_path */
+inline void build_executable(const OutputPaths& out,
+                             const CompileOptions& options,
+                             std::vector<quarks::PassTiming>* passes = nullptr) {
+    const std::filesystem::path source = code_path(out, options);
+    std::vector<std::pair<const char*, toolchain::Command>> steps;
+    if (options.backend == Backend::c) {
+        steps.emplace_back("cc", toolchain::compile_c(
+                                     options.c_compiler, source,
+                                     out.executable, false,
+                                     options.c_optimization,
+                                     options.debug_info));
+    } else {
+        steps.emplace_back("assemble",
+                           toolchain::assemble(source, out.with(".o"),
+                                               options.debug_info));
+        steps.emplace_back("link",
+                           toolchain::link(out.with(".o"), out.executable));
+    }
+    for (const auto& [pass, command] : steps) {
+        const PassTimer timer(passes, pass);
+        if (!toolchain::run(command)) {
+            throw CompileError("Command failed: " +
+                               toolchain::describe(command));
+        }
+    }
+}
+
+/** compiles source text that is already in memory; never throws */
+inline CompileReport compile_source(std::string content, std::string name,
+                                    const OutputPaths& out,
+                                    const CompileOptions& options,
+                                    quarks::Compiler* compiler = nullptr) {
+    CompileReport report{.source = std::move(name)};
+    std::vector<quarks::PassTiming>* passes =
+        options.collect_stats ? &report.stats.passes : nullptr;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        report.source_bytes = content.size();
+        const std::filesystem::path profile = profile_path(out, options);
+
+        std::string key;
+        std::vector<std::pair<std::string, std::filesystem::path>> artifacts;
+        if (options.cache != nullptr && !options.in_memory &&
+            !options.emit_ast) {
+            key = ContentHash()
+                      .update(content)
+                      .update(kCompilerBuild)
+                      .update(options.fingerprint())
+                      .update(options.instrument ? profile.string() : "")
+                      .update(options.profile_use ? read_source(profile) : "")
+                      .update(options.debug_info ? report.source : "")
+                      .hex();
+            artifacts.emplace_back("out", out.executable);
+            if (options.backend == Backend::nasm) {
+                artifacts.emplace_back("out.o", out.with(".o"));
+            }
+            report.cached = options.cache->lookup(key, artifacts);
+        }
+
+        if (!report.cached) {
+            std::stringstream memory;
+            std::ofstream file;
+            if (!options.in_memory) {
+                file.open(code_path(out, options));
+            }
+            std::ostream& sink =
+                options.in_memory ? static_cast<std::ostream&>(memory) : file;
+
+            // profiles, debug info and images need the whole program in the
+            // library
+            if (options.stream && !options.instrument && !options.profile_use &&
+                !options.debug_info && !options.emit_ast) {
+                const PassTimer timer(passes, "stream");
+                stream_code(std::move(content), options, sink);
+            } else {
+                const std::string code =
+                    generate_code(content, options, compiler, &report, profile,
+                                  report.source);
+                const PassTimer timer(passes, "write");
+                sink << code;
+                sink.flush();
+            }
+
+            if (options.in_memory) {
+                report.code = memory.str();
+            } else {
+                file.close();
+                if (!file) {
+                    throw CompileError("Failed to write " +
+                                       code_path(out, options).string());
+                }
+                if (!options.emit_ast) {
+                    build_executable(out, options, passes);
+                }
+            }
+            if (!key.empty()) {
+                options.cache->store(key, artifacts);
+            }
+        }
+        report.ok = true;
+    } catch (const std::exception& error) {
+        report.diagnostics = error.what();
+    }
+    report.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return report;
+}
+
+/**
+ * compile_source for an AST image --emit-ast wrote: the file is mapped and
+ * the generators start from it without tokenizing or parsing. Debug info
+ * then refers to the image. Never throws.
+ */
+inline CompileReport compile_image_file(const std::filesystem::path& image,
+                                        const OutputPaths& out,
+                                        const CompileOptions& options,
+                                        quarks::Compiler* compiler = nullptr) {
+    CompileReport report{.source = image.string()};
+    std::vector<quarks::PassTiming>* passes =
+        options.collect_stats ? &report.stats.passes : nullptr;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        std::vector<quarks::PassTiming> map;
+        std::optional<MappedFile> mapped;
+        {
+            const PassTimer timer(options.collect_stats ? &map : nullptr,
+                                  "map");
+            mapped.emplace(image);
+        }
+        report.source_bytes = mapped->bytes().size();
+        std::optional<quarks::Compiler> owned_compiler;
+        if (compiler == nullptr) {
+            compiler = &owned_compiler.emplace();
+        }
+        quarks::Result result = compiler->compile_image(
+            mapped->bytes(),
+            library_options(options, profile_path(out, options), image));
+        report.ast = result.ast;
+        report.stats = std::move(result.stats);
+        report.stats.passes.insert(report.stats.passes.begin(), map.begin(),
+                                   map.end());
+        if (!result.ok) {
+            throw CompileError(result.diagnostics.front().message);
+        }
+        if (options.in_memory) {
+            report.code = std::move(result.output);
+        } else {
+            std::ofstream file(code_path(out, options), std::ios::binary);
+            file << result.output;
+            file.close();
+            if (!file) {
+                throw CompileError("Failed to write " +
+                                   code_path(out, options).string());
+            }
+            if (!options.emit_ast) {
+                build_executable(out, options, passes);
+            }
+        }
+        report.ok = true;
+    } catch (const std::exception& error) {
+        report.diagnostics = error.what();
+    }
+    report.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return report;
+}
+
+inline CompileReport compile_file(const std::filesystem::path& source,
+                                  const OutputPaths& out,
+                                  const CompileOptions& options,
+                                  quarks::Compiler* compiler = nullptr) {
+    if (source.extension() == ".ast") {
+        return compile_image_file(source, out, options, compiler);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::string content;
+    std::vector<quarks::PassTiming> read;
+    try {
+        const PassTimer timer(options.collect_stats ? &read : nullptr, "read");
+        content = read_source(source);
+    } catch (const std::exception& error) {
+        return {.source = source.string(), .diagnostics = error.what()};
+    }
+    CompileReport report =
+        compile_source(std::move(content), source.string(), out, options,
+                       compiler);
+    report.stats.passes.insert(report.stats.passes.begin(), read.begin(),
+                               read.end());
+    report.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return report;
+}
+
+/**
+ * Expands the batch inputs: plain files, directories (searched recursively
+ * for *.qs) and `@manifest` files listing one source path per line.
+ */
+inline std::vector<std::filesystem::path>
+collect_sources(const std::vector<std::string>& inputs) {
+    std::vector<std::filesystem::path> sources;
+    for (const std::string& input : inputs) {
+        if (input.starts_with("@")) {
+            std::ifstream manifest(input.substr(1));
+            if (!manifest) {
+                throw CompileError("Failed to open manifest " +
+                                   input.substr(1));
+            }
+            std::string line;
+            while (std::getline(manifest, line)) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    sources.emplace_back(line);
+                }
+            }
+        } else if (std::filesystem::is_directory(input)) {
+            std::vector<std::filesystem::path> found;
+            for (const auto& entry :
+                 std::filesystem::recursive_directory_iterator(input)) {
+                if (entry.is_regular_file() &&
+                    entry.path().extension() == ".qs") {
+                    found.push_back(entry.path());
+                }
+            }
+            ranges::sort(found);
+            sources.insert(sources.end(), found.begin(), found.end());
+        } else {
+            sources.emplace_back(input);
+        }
+    }
+    return sources;
+}
+
+/**
+ * Gives every source its own executable path inside out_dir. Sources that
+ * share a file name are told apart by a numeric suffix.
+ */
+inline std::vector<OutputPaths>
+assign_outputs(const std::vector<std::filesystem::path>& sources,
+               const std::filesystem::path& out_dir) {
+    std::map<std::string, int> seen;
+    std::vector<OutputPaths> outputs;
+    for (const std::filesystem::path& source : sources) {
+        std::string stem = source.stem().string();
+        if (const int count = seen[stem]++; count > 0) {
+            stem += "-" + std::to_string(count);
+        }
+        outputs.push_back({.executable = out_dir / stem});
+    }
+    return outputs;
+}
+
+inline int run_batch(const std::vector<std::string>& inputs,
+                     const std::filesystem::path& out_dir,
+                     const std::size_t jobs, const CompileOptions& options) {
+    const std::vector<std::filesystem::path> sources = collect_sources(inputs);
+    if (!options.in_memory) {
+        std::filesystem::create_directories(out_dir);
+    }
+    const std::vector<OutputPaths> outputs = assign_outputs(sources, out_dir);
+    std::vector<CompileReport> reports(sources.size());
+
+    std::mutex print_mutex;
+    std::size_t threads = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(jobs);
+        threads = pool.size();
+        for (std::size_t i = 0; i < sources.size(); i++) {
+            pool.submit([&, i] {
+                reports[i] = compile_file(sources[i], outputs[i], options);
+                const CompileReport& report = reports[i];
+                std::lock_guard lock(print_mutex);
+                std::cout << (report.ok ? (report.cached ? "hit  " : "ok   ")
+                                        : "FAIL ")
+                          << report.source
+                          << "  " << report.source_bytes << " B  "
+                          << std::fixed << std::setprecision(2)
+                          << report.seconds * 1e3 << " ms";
+                if (report.ok && report.seconds > 0) {
+                    std::cout << "  "
+                              << report.source_bytes / report.seconds / 1e6
+                              << " MB/s";
+                }
+                if (!report.ok) {
+                    std::cout << "\n     " << report.diagnostics;
+                }
+                std::cout << "\n";
+            });
+        }
+        pool.wait();
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    std::size_t failures = 0;
+    std::size_t cached = 0;
+    std::size_t bytes = 0;
+    for (const CompileReport& report : reports) {
+        failures += report.ok ? 0 : 1;
+        cached += report.cached ? 1 : 0;
+        bytes += report.source_bytes;
+    }
+    std::cout << std::fixed << std::setprecision(2) << sources.size()
+              << " files, " << failures << " failed, " << cached
+              << " cached, " << bytes << " B in "
+              << seconds << " s (" << sources.size() / seconds << " files/s, "
+              << bytes / seconds / 1e6 << " MB/s, "
+              << threads << " threads)\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "parser.hpp"
+#include "quarks.hpp"
+#include <unordered_map>
+
+/**
+ * One step of an array expression in the order a stack machine evaluates
+ * it, by default the way Generator does scalars: rhs, then lhs, then the
+ * operator. Subtrees without arrays are scalars, computed once and broadcast to every
+ * element.
+ */
+struct ElementwiseOp {
+    enum class Kind { array, scalar, add, subtract, multiply, divide };
+
+    Kind kind;
+    /** the array's identifier term, the scalar subtree, or the operator */
+    const ExpressionNode* expression;
+};
+
+/** the element-wise form of a binary operator */
+inline ElementwiseOp::Kind elementwise_kind(const BinaryExpressionNode* binary) {
+    using Kind = ElementwiseOp::Kind;
+    static constexpr Kind kKinds[] = {Kind::add, Kind::multiply, Kind::divide,
+                                      Kind::subtract};
+    return kKinds[binary->ops.index()];
+}
+
+/**
+ * Lowers expression, assigned element by element to an array of length
+ * elements. length_of(identifier) is the length of a declared array and 0
+ * for a scalar; arrays of any other length are an error. lhs_first puts
+ * lhs before rhs, which keeps left-leaning chains like a + b + c two values
+ * deep. Walked with explicit stacks like the generators.
+ */
+template <typename LengthOf>
+std::vector<ElementwiseOp> lower_elementwise(const ExpressionNode* expression,
+                                             const std::size_t length,
+                                             LengthOf&& length_of,
+                                             const bool lhs_first = false) {
+    // which subtrees read an array, children before their parents
+    std::unordered_map<const ExpressionNode*, bool> arrays;
+    std::vector<std::pair<const ExpressionNode*, bool>> pending{
+        {expression, false}};
+    while (!pending.empty()) {
+        const auto [node, children_done] = pending.back();
+        pending.pop_back();
+        if (arrays.contains(node)) {
+            continue;
+        }
+        if (const auto* binary = std::get_if<BinaryExpressionNode*>(&node->var)) {
+            const auto [lhs, rhs] = operands(*binary);
+            if (children_done) {
+                arrays[node] = arrays.at(lhs) || arrays.at(rhs);
+            } else {
+                pending.emplace_back(node, true);
+                pending.emplace_back(lhs, false);
+                pending.emplace_back(rhs, false);
+            }
+            continue;
+        }
+        const TermNode* term = std::get<TermNode*>(node->var);
+        if (const auto* parenthesis =
+                std::get_if<TermParenthesisNode*>(&term->vars)) {
+            if (children_done) {
+                arrays[node] = arrays.at((*parenthesis)->expression);
+            } else {
+                pending.emplace_back(node, true);
+                pending.emplace_back((*parenthesis)->expression, false);
+            }
+        } else if (const auto* id =
+                       std::get_if<TermIdentifierNode*>(&term->vars)) {
+            const std::size_t elements = length_of((*id)->identifier);
+            if (elements != 0 && elements != length) {
+                throw CompileError("Array length mismatch: " +
+                                       (*id)->identifier.value.value() +
+                                       " has " + std::to_string(elements) +
+                                       " elements, not " +
+                                       std::to_string(length),
+                                   (*id)->identifier.line);
+            }
+            arrays[node] = elements != 0;
+        } else {
+            // literals, and single elements of arrays
+            arrays[node] = false;
+        }
+    }
+
+    std::vector<ElementwiseOp> ops;
+    pending.emplace_back(expression, false);
+    while (!pending.empty()) {
+        const auto [node, combine] = pending.back();
+        pending.pop_back();
+        const auto* binary = std::get_if<BinaryExpressionNode*>(&node->var);
+        if (combine) {
+            ops.push_back({elementwise_kind(*binary), node});
+        } else if (!arrays.at(node)) {
+            ops.push_back({ElementwiseOp::Kind::scalar, node});
+        } else if (binary != nullptr) {
+            const auto [lhs, rhs] = operands(*binary);
+            pending.emplace_back(node, true);
+            pending.emplace_back(lhs_first ? rhs : lhs, false);
+            pending.emplace_back(lhs_first ? lhs : rhs, false);
+        } else if (const auto* parenthesis = std::get_if<TermParenthesisNode*>(
+                       &std::get<TermNode*>(node->var)->vars)) {
+            pending.emplace_back((*parenthesis)->expression, false);
+        } else {
+            ops.push_back({ElementwiseOp::Kind::array, node});
+        }
+    }
+    return ops;
+}
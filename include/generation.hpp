@@ -1,6 +1,13 @@
 #pragma once
+#include "elementwise.hpp"
+#include "modules.hpp"
 #include "parser.hpp"
+#include "profile.hpp"
+#include "structuralHash.hpp"
 #include <algorithm>
+#include <iomanip>
+#include <optional>
+#include <unordered_set>
 
 class Generator {
 
@@ -8,6 +15,171 @@ class Generator {
     inline explicit Generator(ProgramNode program)
         : m_program(std::move(program)) {}
 
+    /**
+     * Streaming use: begin_program(), then generateStatement() for every
+     * top-level statement as it arrives, then end_program(). take_output()
+     * hands over what has been emitted so far, which leaves out statements
+     * held back for packing until flush().
+     */
+    Generator() = default;
+
+    struct Variables {
+        std::string name;
+        size_t stack_location;
+        /** elements of an array, 0 for a scalar */
+        size_t length = 0;
+        /** a copy of another module's export, which is not exported again */
+        bool imported = false;
+        IntType type = IntType::i64;
+        /** offset of a narrow scalar within its slot */
+        size_t byte = 0;
+        /** in the slot of the variable before it, see place() */
+        bool packed = false;
+    };
+
+    /** top-level scope state, enough to start generating mid-program */
+    struct Region {
+        std::vector<Variables> vars;
+        size_t stack_size = 0;
+    };
+
+    [[nodiscard]] Region region() const {
+        return {.vars = m_vars, .stack_size = m_stack_size};
+    }
+
+    /**
+     * Parallel use: continue from a Region snapshot with region-local labels
+     * starting at label0; relocate_labels() shifts them into place later.
+     */
+    void enter_region(Region region) {
+        m_vars = std::move(region.vars);
+        m_stack_size = region.stack_size;
+        m_scopes.clear();
+        m_label_count = 0;
+    }
+
+    /**
+     * Advances the top-level state past stmt without emitting code. Only
+     * declarations change it; every other statement leaves the stack as it
+     * found it. Errors are left to generateStatement.
+     */
+    void declare(const StatementNode* stmt) {
+        if (const auto* let = std::get_if<LetStatementNode*>(&stmt->var)) {
+            if ((*let)->length != 0) {
+                m_vars.push_back({.name = (*let)->identifier.value.value(),
+                                  .stack_location = m_stack_size,
+                                  .length = (*let)->length});
+            } else {
+                m_vars.push_back(
+                    place((*let)->identifier.value.value(), (*let)->type));
+            }
+            m_stack_size += slots(m_vars.back());
+        } else if (const auto* import =
+                       std::get_if<ImportStatementNode*>(&stmt->var)) {
+            const quarks::Interface* module =
+                m_modules.find((*import)->module.value.value());
+            if (module == nullptr) {
+                return;
+            }
+            for (const quarks::Export& exported : module->exports) {
+                m_vars.push_back({.name = exported.name,
+                                  .stack_location = m_stack_size,
+                                  .length = exported.length,
+                                  .imported = true});
+                m_stack_size += slots(m_vars.back());
+            }
+        }
+    }
+
+    [[nodiscard]] int labels_used() const { return m_label_count; }
+
+    /**
+     * Branch counters or a recorded profile, see ProfileOptions. Both need
+     * the whole program in one generator: branch sites are numbered
+     * program-wide and out-of-line code is emitted by end_program().
+     */
+    void set_profile(ProfileOptions profile) { m_profile = std::move(profile); }
+
+    /**
+     * Debug info for source, the path of the .qs file: `%line` directives
+     * that nasm -g -F dwarf turns into a line table, a `scope@L.C` symbol
+     * at every scope, and per variable an absolute `name@L.C` symbol with
+     * the offset of its slot from rsp at _start. Empty for none.
+     */
+    void set_debug_source(std::string source) {
+        m_debug_source = std::move(source);
+    }
+
+    /**
+     * Vector instructions for array arithmetic, see quarks::Isa. AVX2 code
+     * is chosen at run time by a CPUID check begin_program() emits.
+     */
+    void set_isa(const quarks::Isa isa) { m_isa = isa; }
+
+    /**
+     * The module to compile the program as and the modules it may import,
+     * see ModuleOptions.
+     */
+    void set_modules(ModuleOptions modules) { m_modules = std::move(modules); }
+
+    /**
+     * Largest if/elif/else chain of plain assignments lowered to cmov
+     * instead of branches, see if_convert(); 0 keeps every branch.
+     */
+    void set_if_conversion(const std::size_t max_cost) {
+        m_if_conversion = max_cost;
+    }
+
+    /**
+     * Renames every label token labelN in code to label(N + base). Labels
+     * are only ever defined as "labelN:" at the start of a line or jumped
+     * to as the last operand of one; anything else spelling labelN, such as
+     * a longer identifier or a `%line` directive's file name, is left alone.
+     */
+    [[nodiscard]] static std::string relocate_labels(const std::string& code,
+                                                     const int base) {
+        if (base == 0) {
+            return code;
+        }
+        std::string out;
+        out.reserve(code.size() + code.size() / 16);
+        std::size_t begin = 0;
+        while (begin < code.size()) {
+            std::size_t end = code.find('\n', begin);
+            end = end == std::string::npos ? code.size() : end + 1;
+            const std::string_view line(code.data() + begin, end - begin);
+            std::size_t i = line.starts_with("%line ") ? line.size() : 0;
+            out += line.substr(0, i);
+            while (i < line.size()) {
+                const std::size_t found = line.find("label", i);
+                if (found == std::string_view::npos) {
+                    out += line.substr(i);
+                    break;
+                }
+                std::size_t digits = found + 5;
+                while (digits < line.size() &&
+                       std::isdigit(static_cast<unsigned char>(line[digits]))) {
+                    digits++;
+                }
+                out += line.substr(i, found + 5 - i);
+                const bool starts = found == 0 || line[found - 1] == ' ';
+                const bool ends = digits == line.size() ||
+                                  line[digits] == ':' || line[digits] == '\n';
+                if (digits > found + 5 && starts && ends) {
+                    out += std::to_string(
+                        std::stoi(std::string(
+                            line.substr(found + 5, digits - found - 5))) +
+                        base);
+                } else {
+                    out += line.substr(found + 5, digits - found - 5);
+                }
+                i = digits;
+            }
+            begin = end;
+        }
+        return out;
+    }
+
     void generateTerm(const TermNode* expression) {
         struct TermVisitor {
 
@@ -21,75 +193,86 @@ class Generator {
                     });
 
                 if (it == m_generator.m_vars.end()) {
-                    std::cerr << "Undeclared identifier: "
-                              << id->identifier.value.value() << std::endl;
-                    exit(EXIT_FAILURE);
+                    throw CompileError("Undeclared identifier: " +
+                                           id->identifier.value.value(),
+                                       id->identifier.line);
+                }
+                if (it->length != 0) {
+                    throw CompileError("Array used as a scalar: " +
+                                           id->identifier.value.value(),
+                                       id->identifier.line);
                 }
 
-                std::stringstream offset;
-
-                offset << "QWORD [rsp + "
-                       << (m_generator.m_stack_size - it->stack_location - 1) *
-                              8
-                       << "]";
-                m_generator.push(offset.str());
+                m_generator.load_scalar(*it);
             }
 
             void operator()(const TermIntLiteralNode* it) const {
-
-                m_generator.m_output << "    mov rax, "
-                                     << it->int_literals.value.value() << "\n";
+                // 32-bit moves zero the upper half and need no REX prefix
+                const std::uint64_t value =
+                    literal_value(it->int_literals.value.value());
+                if (value > 0xffffffff) {
+                    m_generator.m_output << "    mov rax, " << value << "\n";
+                } else if (value == 0) {
+                    m_generator.m_output << "    xor eax, eax\n";
+                } else {
+                    m_generator.m_output << "    mov eax, " << value << "\n";
+                }
                 m_generator.push("rax");
             }
 
             void operator()(const TermParenthesisNode* pn) const {
                 m_generator.generateExpression(pn->expression);
             }
+
+            void operator()(const TermIndexNode* element) const {
+                m_generator.generateExpression(element->index);
+                m_generator.load_element(element);
+            }
         };
 
         TermVisitor visitor{.m_generator = *this};
         std::visit(visitor, expression->vars);
     }
 
+    /** combines the two operands on top of the stack (lhs on top) */
     void generateBinaryExpression(const BinaryExpressionNode* bns) {
 
         struct binaryExpressionVisitor {
 
             Generator& m_generator;
 
-            void operator()(const BinaryExpressionAddition* add) const {
-                m_generator.generateExpression(add->rhs);
-                m_generator.generateExpression(add->lhs);
+            void operator()(const BinaryExpressionAddition*) const {
                 m_generator.pop("rax");
                 m_generator.pop("rbx");
-                m_generator.m_output << "    ADD rax, rbx\n";
+                m_generator.m_output << (m_generator.m_narrow
+                                             ? "    ADD eax, ebx\n"
+                                             : "    ADD rax, rbx\n");
                 m_generator.push("rax");
             }
 
-            void operator()(const BinaryExpressionSubtraction* sub) const {
-                m_generator.generateExpression(sub->rhs);
-                m_generator.generateExpression(sub->lhs);
+            void operator()(const BinaryExpressionSubtraction*) const {
                 m_generator.pop("rax");
                 m_generator.pop("rbx");
-                m_generator.m_output << "    SUB rax, rbx\n";
+                m_generator.m_output << (m_generator.m_narrow
+                                             ? "    SUB eax, ebx\n"
+                                             : "    SUB rax, rbx\n");
                 m_generator.push("rax");
             }
 
-            void operator()(const BinaryExpressionMultiplication* mul) const {
-                m_generator.generateExpression(mul->rhs);
-                m_generator.generateExpression(mul->lhs);
+            void operator()(const BinaryExpressionMultiplication*) const {
                 m_generator.pop("rax");
                 m_generator.pop("rbx");
-                m_generator.m_output << "    MUL rbx\n";
+                m_generator.m_output << (m_generator.m_narrow
+                                             ? "    IMUL eax, ebx\n"
+                                             : "    MUL rbx\n");
                 m_generator.push("rax");
             }
 
-            void operator()(const BinaryExpressionDivision* div) const {
-                m_generator.generateExpression(div->rhs);
-                m_generator.generateExpression(div->lhs);
+            void operator()(const BinaryExpressionDivision*) const {
                 m_generator.pop("rax");
                 m_generator.pop("rbx");
-                m_generator.m_output << "    DIV rbx\n";
+                m_generator.m_output << "    cqo\n";
+                m_generator.m_output << "    IDIV rbx\n";
                 m_generator.push("rax");
             }
         };
@@ -98,171 +281,602 @@ class Generator {
         std::visit(visitor, bns->ops);
     }
 
+    /**
+     * Post-order walk with an explicit stack: rhs, then lhs, then the
+     * operator. Depth is limited by memory, not by the C++ stack.
+     */
     void generateExpression(const ExpressionNode* expression) {
 
-        struct ExpressionNodeVisitor {
-
-            Generator& m_generator;
-
-            void operator()(const TermNode* term) const {
-                m_generator.generateTerm(term);
-            }
-
-            void operator()(const BinaryExpressionNode* binaryNode) const {
-                m_generator.generateBinaryExpression(binaryNode);
-            }
+        struct Pending {
+            const ExpressionNode* expression;
+            /** set once both operands of this node have been generated */
+            const BinaryExpressionNode* combine = nullptr;
+            /** set once the index of this element has been generated */
+            const TermIndexNode* element = nullptr;
         };
 
-        ExpressionNodeVisitor visitor{.m_generator = *this};
-        std::visit(visitor, expression->var);
+        std::vector<Pending> pending{{.expression = expression}};
+        while (!pending.empty()) {
+            const Pending next = pending.back();
+            pending.pop_back();
+            if (next.combine != nullptr) {
+                generateBinaryExpression(next.combine);
+            } else if (next.element != nullptr) {
+                load_element(next.element);
+            } else if (const auto* binary = std::get_if<BinaryExpressionNode*>(
+                           &next.expression->var)) {
+                const auto [lhs, rhs] = operands(*binary);
+                pending.push_back({.expression = nullptr, .combine = *binary});
+                pending.push_back({.expression = lhs});
+                pending.push_back({.expression = rhs});
+            } else {
+                const TermNode* term = std::get<TermNode*>(next.expression->var);
+                if (const auto* parenthesis =
+                        std::get_if<TermParenthesisNode*>(&term->vars)) {
+                    pending.push_back({.expression = (*parenthesis)->expression});
+                } else if (const auto* element =
+                               std::get_if<TermIndexNode*>(&term->vars)) {
+                    pending.push_back({.expression = nullptr, .element = *element});
+                    pending.push_back({.expression = (*element)->index});
+                } else {
+                    generateTerm(term);
+                }
+            }
+        }
     }
 
     [[nodiscard]] std::string generateProgram() {
 
-        m_output << "global _start\n_start:\n";
+        begin_program();
 
         for (const StatementNode* statement : m_program.statements) {
             generateStatement(statement);
         }
-        m_output << "    mov rax, 60\n";
-        m_output << "    mov rdi, 0\n";
-        m_output << "    syscall\n";
+        end_program();
 
         return m_output.str();
     }
 
-    void generate_scope(const nodeScope* scope) {
-        begin_scope();
-        for (const StatementNode* stmt : scope->statements) {
-            generateStatement(stmt);
+    void begin_program() {
+        if (!m_modules.name.empty()) {
+            begin_module();
+        } else {
+            m_output << "global _start\n_start:\n";
+        }
+        if (m_isa == quarks::Isa::avx2) {
+            detect_avx2();
         }
-        end_scope();
     }
 
-    void generate_if_predicate(const nodeIfPredicate* predicate,
-                               const std::string& end_label) {
+    void end_program() {
+        flush();
+        if (!m_modules.name.empty()) {
+            end_module();
+        } else {
+            m_output << "    mov rax, 60\n";
+            m_output << "    mov rdi, 0\n";
+            before_exit();
+            m_output << "    syscall\n";
+        }
+        m_output << m_cold;
+        m_cold.clear();
+        if (!m_profile.instrument.empty()) {
+            write_profile();
+        }
+        if (m_isa == quarks::Isa::avx2) {
+            m_output << "section .data\nqs_avx2: db 0\n";
+        }
+        if (!m_modules.name.empty()) {
+            m_output << "section .bss\n"
+                     << ModuleOptions::exports_symbol(m_modules.name)
+                     << ": resq " << std::max<size_t>(m_exported_words, 1)
+                     << "\nqs_initialized: resb 1\n";
+        }
+    }
 
-        struct predicateVisitor {
-            Generator& m_generator;
-            const std::string& end_label;
+    [[nodiscard]] std::string take_output() {
+        std::string output = m_output.str();
+        m_output.str({});
+        return output;
+    }
 
-            void operator()(const nodeIfPredicateElif* elif) const {
-                m_generator.generateExpression(elif->expression);
-                m_generator.pop("rax");
-                const std::string label = m_generator.create_label();
-                m_generator.m_output << "    test rax, rax\n";
-                m_generator.m_output << "    jz " << label << "\n";
-                m_generator.generate_scope(elif->scope);
-                m_generator.m_output << "    jmp " << end_label << "\n";
-                if (elif->ifPredicate.has_value()) {
-                    m_generator.m_output << label << ":\n";
-                    m_generator.generate_if_predicate(elif->ifPredicate.value(),
-                                                      end_label);
-                }
+    /**
+     * Generates stmt and everything nested in it. Scopes and if/elif/else
+     * chains become work items on an explicit stack, so nesting depth and
+     * chain length are unbounded.
+     *
+     * A statement the SLP pass may pack with the next one is held back
+     * until its run ends, unless generating it would fail: errors surface
+     * at the statement that causes them.
+     */
+    void generateStatement(const StatementNode* stmt) {
+        if (!m_run.empty() && !continues_run(m_run.back(), stmt)) {
+            flush();
+        }
+        if (packing() && packable(stmt) != nullptr && run_accepts(stmt)) {
+            m_run.push_back(stmt);
+            if (const auto* let = std::get_if<LetStatementNode*>(&stmt->var)) {
+                m_run_names.insert((*let)->identifier.value.value());
             }
+            return;
+        }
+        flush();
+        generate_tasks(stmt);
+    }
 
-            void operator()(const nodeIfPredicateElse* _else) const {
-                m_generator.generate_scope(_else->scope);
-            }
-        };
+    /** statements are held back, see flush() */
+    [[nodiscard]] bool holding() const { return !m_run.empty(); }
 
-        predicateVisitor visitor{.m_generator = *this, .end_label = end_label};
-        std::visit(visitor, predicate->predicate);
+    /** generates the top-level statements held back for packing */
+    void flush() {
+        if (m_run.empty()) {
+            return;
+        }
+        const std::vector<const StatementNode*> run = std::move(m_run);
+        m_run.clear();
+        m_run_names.clear();
+        generate_run(run);
     }
 
-    void generateStatement(const StatementNode* stmt) {
+    /**
+     * a and b are isomorphic `x = y op z` statements, so the SLP pass may
+     * pack them if their slots line up: both declarations or both
+     * assignments, with the same operator and the same kinds of operands
+     */
+    [[nodiscard]] static bool continues_run(const StatementNode* a,
+                                            const StatementNode* b) {
+        const BinaryExpressionNode* first = packable(a);
+        const BinaryExpressionNode* second = packable(b);
+        if (first == nullptr || second == nullptr ||
+            a->var.index() != b->var.index() ||
+            first->ops.index() != second->ops.index()) {
+            return false;
+        }
+        const auto [lhs, rhs] = operands(first);
+        const auto [next_lhs, next_rhs] = operands(second);
+        return std::get<TermNode*>(lhs->var)->vars.index() ==
+                   std::get<TermNode*>(next_lhs->var)->vars.index() &&
+               std::get<TermNode*>(rhs->var)->vars.index() ==
+                   std::get<TermNode*>(next_rhs->var)->vars.index();
+    }
 
-        struct StatementVisitor {
-            Generator& m_generator;
+  private:
+    void generate_tasks(const StatementNode* stmt) {
+        std::vector<Task> tasks{stmt};
+        while (!tasks.empty()) {
+            Task task = std::move(tasks.back());
+            tasks.pop_back();
+            std::visit(TaskVisitor{.m_generator = *this, .m_tasks = tasks},
+                       task);
+        }
+        // chains only share code within one top-level statement, whose
+        // nodes a streaming caller may free and reuse the addresses of
+        m_structure.clear();
+    }
 
-            void operator()(const LetStatementNode* stmt_let) const {
+    /** closes the innermost scope */
+    struct EndScope {};
 
-                const auto it = ranges::find_if(
-                    m_generator.m_vars, [&](const Variables& variables) {
-                        return variables.name ==
-                               stmt_let->identifier.value.value();
-                    });
-                if (it != m_generator.m_vars.cend()) {
-                    std::cerr << "Identifier already used: "
-                              << stmt_let->identifier.value.value()
-                              << std::endl;
-                    exit(EXIT_FAILURE);
+    /** the if scope is done; label skips it */
+    struct AfterIf {
+        const nodeIfStatement* statement_if;
+        std::string label;
+    };
+
+    /** the next elif/else of a chain ending at end_label */
+    struct NextPredicate {
+        const nodeIfPredicate* predicate;
+        std::string end_label;
+    };
+
+    /** the elif scope is done; label skips it */
+    struct AfterElif {
+        const nodeIfPredicateElif* elif;
+        std::string label;
+        std::string end_label;
+        /** the scope ends in a MergeJump, so nothing falls through */
+        bool merged = false;
+    };
+
+    struct EmitLabel {
+        std::string label;
+    };
+
+    /**
+     * An arm whose statements from from on are shared code at label, see
+     * plan_merges(); as a task, the jump there that ends the arm
+     */
+    struct MergeJump {
+        const nodeScope* scope;
+        std::size_t from;
+        std::string label;
+        /** not the else, so the jump past the rest of the chain goes too */
+        bool test;
+    };
+
+    /** a cold arm starts at label, written aside until end_program */
+    struct BeginColdArm {
+        std::string label;
+        std::size_t site;
+    };
+
+    /** the cold arm is done and jumps back to end_label */
+    struct EndColdArm {
+        std::string end_label;
+    };
+
+    /** consecutive statements of a scope the SLP pass may pack */
+    struct Run {
+        std::vector<const StatementNode*> statements;
+    };
+
+    using Task = std::variant<const StatementNode*, const nodeScope*, EndScope,
+                              AfterIf, NextPredicate, AfterElif, EmitLabel,
+                              BeginColdArm, EndColdArm, Run, MergeJump>;
+
+    struct StatementVisitor {
+        Generator& m_generator;
+        std::vector<Task>& m_tasks;
+
+        void operator()(const LetStatementNode* stmt_let) const {
+
+            const auto it = ranges::find_if(
+                m_generator.m_vars, [&](const Variables& variables) {
+                    return variables.name == stmt_let->identifier.value.value();
+                });
+            if (it != m_generator.m_vars.cend()) {
+                throw CompileError("Identifier already used: " +
+                                       stmt_let->identifier.value.value(),
+                                   stmt_let->identifier.line);
+            }
+            if (stmt_let->length != 0) {
+                // the elements are reserved first and filled in place
+                const Variables array{.name = stmt_let->identifier.value.value(),
+                                      .stack_location = m_generator.m_stack_size,
+                                      .length = stmt_let->length};
+                m_generator.m_output << "    sub rsp, " << array.length * 8
+                                     << "\n";
+                m_generator.m_stack_size += array.length;
+                m_generator.generateElementwise(array, stmt_let->expression);
+                m_generator.m_vars.push_back(array);
+            } else {
+                m_generator.check_store(stmt_let->expression, stmt_let->type);
+                const Variables declared = m_generator.place(
+                    stmt_let->identifier.value.value(), stmt_let->type);
+                m_generator.m_vars.push_back(declared);
+                m_generator.generate_stored(declared, stmt_let->expression);
+                if (declared.packed) {
+                    m_generator.pop("rax");
+                    m_generator.store_scalar(declared);
                 }
-                m_generator.m_vars.push_back(
-                    {Variables{.name = stmt_let->identifier.value.value(),
-                               .stack_location = m_generator.m_stack_size}});
-                m_generator.generateExpression(stmt_let->expression);
             }
-            void operator()(const StatementExitNode* stmt_exit) const {
-                m_generator.generateExpression(stmt_exit->expr);
-                m_generator.m_output << "    mov rax, 60\n";
-                m_generator.pop("rdi");
-                m_generator.m_output << "    syscall\n";
+            if (!m_generator.m_debug_source.empty()) {
+                const Variables& declared = m_generator.m_vars.back();
+                m_generator.m_output
+                    << stmt_let->identifier.value.value() << "@"
+                    << stmt_let->identifier.line + 1 << "."
+                    << stmt_let->identifier.column + 1 << " equ -"
+                    << (declared.stack_location +
+                        std::max<size_t>(declared.length, 1)) *
+                               8 -
+                           declared.byte
+                    << "\n";
             }
-
-            void operator()(const nodeScope* scope) const {
-                m_generator.generate_scope(scope);
+        }
+        void operator()(const ImportStatementNode* import) const {
+            const quarks::Interface& module =
+                m_generator.m_modules.imported(import->module);
+            const std::string exports =
+                ModuleOptions::exports_symbol(module.module);
+            m_generator.m_output
+                << "extern " << ModuleOptions::init_symbol(module.module)
+                << ", " << exports << "\n    call "
+                << ModuleOptions::init_symbol(module.module) << "\n";
+            size_t word = 0;
+            for (const quarks::Export& exported : module.exports) {
+                if (m_generator.find_variable(exported.name) != nullptr) {
+                    throw CompileError("Identifier already used: " +
+                                           exported.name,
+                                       import->module.line);
+                }
+                const Variables copy{.name = exported.name,
+                                     .stack_location = m_generator.m_stack_size,
+                                     .length = exported.length,
+                                     .imported = true};
+                const std::string address =
+                    "[rel " + exports + " + " + std::to_string(word * 8) + "]";
+                if (copy.length == 0) {
+                    m_generator.push("QWORD " + address);
+                } else {
+                    m_generator.m_output << "    sub rsp, " << copy.length * 8
+                                         << "\n    lea rsi, " << address
+                                         << "\n    mov rdi, rsp\n";
+                    m_generator.m_stack_size += copy.length;
+                    m_generator.copy_words(copy.length);
+                }
+                m_generator.m_vars.push_back(copy);
+                word += slots(copy);
             }
+        }
 
-            void operator()(const nodeIfStatement* statement_if) const {
-                m_generator.generateExpression(statement_if->expression);
-                m_generator.pop("rax");
-                const std::string label = m_generator.create_label();
-                m_generator.m_output << "    test rax, rax\n";
-                m_generator.m_output << "    jz " << label << "\n";
-                m_generator.generate_scope(statement_if->scope);
-                std::optional<std::string> end_label;
-                if (statement_if->ifPredicate.has_value()) {
-                    end_label = m_generator.create_label();
-                    m_generator.m_output << "    jmp " << end_label.value()
-                                         << "\n";
-                }
-                m_generator.m_output << label << ":\n";
+        void operator()(const StatementExitNode* stmt_exit) const {
+            m_generator.generateExpression(stmt_exit->expr);
+            m_generator.m_output << "    mov rax, 60\n";
+            m_generator.pop("rdi");
+            m_generator.before_exit();
+            m_generator.m_output << "    syscall\n";
+        }
+
+        void operator()(const nodeScope* scope) const {
+            m_tasks.emplace_back(scope);
+        }
+
+        void operator()(const nodeIfStatement* statement_if) const {
+            if (m_generator.if_convert(statement_if)) {
+                return;
+            }
+            m_generator.plan_merges(statement_if);
+            const std::size_t site = m_generator.begin_test();
+            m_generator.generateExpression(statement_if->expression);
+            m_generator.pop("rax");
+            m_generator.m_output << "    test rax, rax\n";
+            if (m_generator.cold(site)) {
+                std::string end_label = m_generator.create_label();
+                m_tasks.emplace_back(EmitLabel{.label = end_label});
                 if (statement_if->ifPredicate.has_value()) {
-                    m_generator.generate_if_predicate(
-                        statement_if->ifPredicate.value(), end_label.value());
-                    m_generator.m_output << end_label.value() << ":\n";
+                    m_tasks.emplace_back(
+                        NextPredicate{.predicate = statement_if->ifPredicate.value(),
+                                      .end_label = end_label});
                 }
+                m_generator.out_of_line(site, statement_if->scope, end_label,
+                                        m_tasks);
+                return;
             }
+            std::string label = m_generator.create_label();
+            m_generator.m_output << "    jz " << label << "\n";
+            m_generator.count(site, true);
+            m_tasks.emplace_back(AfterIf{.statement_if = statement_if,
+                                         .label = std::move(label)});
+            m_tasks.emplace_back(statement_if->scope);
+        }
 
-            void operator()(const nodeStatementAssign* assign) const {
-                const auto it = std::ranges::find_if(
-                    m_generator.m_vars, [&](const Variables& variables) {
-                        return variables.name ==
-                               assign->identifier.value.value();
-                    });
+        void operator()(const nodeStatementAssign* assign) const {
+            const auto it = std::ranges::find_if(
+                m_generator.m_vars, [&](const Variables& variables) {
+                    return variables.name == assign->identifier.value.value();
+                });
 
-                if (it == m_generator.m_vars.end()) {
-                    std::cerr << "Undeclared identifier: "
-                              << assign->identifier.value.value() << std::endl;
-                    exit(EXIT_FAILURE);
-                }
+            if (it == m_generator.m_vars.end()) {
+                throw CompileError("Undeclared identifier: " +
+                                       assign->identifier.value.value(),
+                                   assign->identifier.line);
+            }
+            if (assign->index != nullptr) {
+                const Variables& array =
+                    m_generator.array_variable(assign->identifier);
+                m_generator.generateExpression(assign->index);
+                m_generator.m_output << "    mov rax, [rsp]\n";
+                m_generator.check_index("rax", array);
                 m_generator.generateExpression(assign->expression);
                 m_generator.pop("rax");
-                m_generator.m_output
-                    << "    mov [rsp + "
-                    << (m_generator.m_stack_size - it->stack_location - 1) * 8
-                    << "], rax\n";
+                m_generator.pop("rbx");
+                m_generator.m_output << "    mov [rsp + rbx*8 + "
+                                     << m_generator.element_offset(array)
+                                     << "], rax\n";
+                return;
             }
-        };
-        StatementVisitor visitor{.m_generator = *this};
-        std::visit(visitor, stmt->var);
-    }
+            if (it->length != 0) {
+                m_generator.generateElementwise(*it, assign->expression);
+                return;
+            }
+            m_generator.check_store(assign->expression, it->type);
+            m_generator.generate_stored(*it, assign->expression);
+            m_generator.pop("rax");
+            m_generator.store_scalar(*it);
+        }
+    };
+
+    struct TaskVisitor {
+        Generator& m_generator;
+        std::vector<Task>& m_tasks;
+
+        void operator()(const StatementNode* stmt) const {
+            m_generator.mark_line(stmt->position);
+            std::visit(StatementVisitor{.m_generator = m_generator,
+                                        .m_tasks = m_tasks},
+                       stmt->var);
+        }
+
+        void operator()(const nodeScope* scope) const {
+            if (!m_generator.m_debug_source.empty() &&
+                scope->position.line >= 0) {
+                m_generator.m_output << "scope@" << scope->position.line + 1
+                                     << "." << scope->position.column + 1
+                                     << ":\n";
+            }
+            m_generator.begin_scope();
+            std::size_t end = scope->statements.size();
+            if (const auto merge = m_generator.m_merge_jumps.find(scope);
+                merge != m_generator.m_merge_jumps.end()) {
+                end = merge->second.from;
+                m_tasks.emplace_back(std::move(merge->second));
+                m_generator.m_merge_jumps.erase(merge);
+            } else {
+                m_tasks.emplace_back(EndScope{});
+            }
+            std::vector<std::pair<std::size_t, std::string>> labels;
+            if (const auto target = m_generator.m_merge_labels.find(scope);
+                target != m_generator.m_merge_labels.end()) {
+                labels = std::move(target->second);
+                m_generator.m_merge_labels.erase(target);
+            }
+            m_generator.push_statements(m_tasks, scope->statements, 0, end,
+                                        labels);
+        }
+
+        void operator()(const Run& run) const {
+            m_generator.generate_run(run.statements);
+        }
+
+        void operator()(const MergeJump& merge) const {
+            std::size_t saved = 0;
+            if (m_generator.m_asides == 0) {
+                std::vector<Task> tail{EndScope{}};
+                m_generator.push_statements(tail, merge.scope->statements,
+                                            merge.from,
+                                            merge.scope->statements.size(), {});
+                saved = m_generator.instructions(std::move(tail)) +
+                        (merge.test ? 1 : 0) - 1;
+            }
+            m_generator.m_output << "    ; merged " << saved
+                                 << " instructions\n    jmp " << merge.label
+                                 << "\n";
+            // the statements before the shared ones declare nothing
+            m_generator.m_scopes.pop_back();
+        }
+
+        void operator()(const EndScope&) const { m_generator.end_scope(); }
+
+        void operator()(const AfterIf& after) const {
+            const std::optional<nodeIfPredicate*>& predicate =
+                after.statement_if->ifPredicate;
+            if (!predicate.has_value()) {
+                m_generator.m_output << after.label << ":\n";
+                return;
+            }
+            std::string end_label = m_generator.create_label();
+            m_generator.m_output << "    jmp " << end_label << "\n";
+            m_generator.m_output << after.label << ":\n";
+            m_tasks.emplace_back(EmitLabel{.label = end_label});
+            m_tasks.emplace_back(NextPredicate{
+                .predicate = predicate.value(), .end_label = end_label});
+        }
+
+        void operator()(const NextPredicate& next) const {
+            if (const auto* elif =
+                    std::get_if<nodeIfPredicateElif*>(&next.predicate->predicate)) {
+                m_generator.mark_line((*elif)->position);
+                const std::size_t site = m_generator.begin_test();
+                m_generator.generateExpression((*elif)->expression);
+                m_generator.pop("rax");
+                m_generator.m_output << "    test rax, rax\n";
+                if (m_generator.cold(site)) {
+                    if ((*elif)->ifPredicate.has_value()) {
+                        m_tasks.emplace_back(
+                            NextPredicate{.predicate = (*elif)->ifPredicate.value(),
+                                          .end_label = next.end_label});
+                    }
+                    m_generator.out_of_line(site, (*elif)->scope, next.end_label,
+                                            m_tasks);
+                    return;
+                }
+                if (m_generator.shares_arm((*elif)->scope, "jnz")) {
+                    if ((*elif)->ifPredicate.has_value()) {
+                        m_tasks.emplace_back(
+                            NextPredicate{.predicate = (*elif)->ifPredicate.value(),
+                                          .end_label = next.end_label});
+                    }
+                    return;
+                }
+                std::string label = m_generator.create_label();
+                m_generator.m_output << "    jz " << label << "\n";
+                m_generator.count(site, true);
+                m_tasks.emplace_back(AfterElif{
+                    .elif = *elif,
+                    .label = std::move(label),
+                    .end_label = next.end_label,
+                    .merged = m_generator.m_merge_jumps.contains((*elif)->scope)});
+                m_tasks.emplace_back((*elif)->scope);
+            } else {
+                const nodeScope* scope =
+                    std::get<nodeIfPredicateElse*>(next.predicate->predicate)
+                        ->scope;
+                if (!m_generator.shares_arm(scope, "jmp")) {
+                    m_tasks.emplace_back(scope);
+                }
+            }
+        }
+
+        void operator()(const AfterElif& after) const {
+            if (!after.merged) {
+                m_generator.m_output << "    jmp " << after.end_label << "\n";
+            }
+            m_generator.m_output << after.label << ":\n";
+            if (after.elif->ifPredicate.has_value()) {
+                m_tasks.emplace_back(
+                    NextPredicate{.predicate = after.elif->ifPredicate.value(),
+                                  .end_label = after.end_label});
+            }
+        }
+
+        void operator()(const EmitLabel& emit) const {
+            m_generator.m_output << emit.label << ":\n";
+        }
+
+        void operator()(const BeginColdArm& begin) const {
+            m_generator.m_hot.emplace_back();
+            std::swap(m_generator.m_output, m_generator.m_hot.back());
+            m_generator.m_marked_line = -1;
+            m_generator.m_output << begin.label << ":\n";
+            m_generator.count(begin.site, true);
+        }
+
+        void operator()(const EndColdArm& end) const {
+            m_generator.m_output << "    jmp " << end.end_label << "\n";
+            m_generator.m_cold += m_generator.m_output.str();
+            std::swap(m_generator.m_output, m_generator.m_hot.back());
+            m_generator.m_hot.pop_back();
+            m_generator.m_marked_line = -1;
+        }
+    };
 
-  private:
     const ProgramNode m_program;
     std::stringstream m_output;
     size_t m_stack_size = 0;
     int m_label_count = 0;
 
-    struct Variables {
-        std::string name;
-        size_t stack_location;
-    };
-
     std::vector<Variables> m_vars{};
     std::vector<size_t> m_scopes{};
 
+    ProfileOptions m_profile;
+    /** if/elif tests numbered so far */
+    std::size_t m_sites = 0;
+    /** the outputs a cold arm interrupted, innermost last */
+    std::vector<std::stringstream> m_hot;
+    /** finished cold arms, placed after the final exit */
+    std::string m_cold;
+
+    std::string m_debug_source;
+    /** source line the code emitted now is attributed to */
+    int m_marked_line = -1;
+
+    quarks::Isa m_isa = quarks::Isa::sse2;
+
+    std::size_t m_if_conversion = quarks::kIfConversionCost;
+
+    /** 32-bit arithmetic, see generate_stored() */
+    bool m_narrow = false;
+
+    /** of the arms of chains, see plan_merges(); per top-level statement */
+    StructuralHash m_structure;
+    /** labels of shared code before statement N of a scope */
+    std::unordered_map<const nodeScope*,
+                       std::vector<std::pair<std::size_t, std::string>>>
+        m_merge_labels;
+    /** arms that end in shared code, by scope */
+    std::unordered_map<const nodeScope*, MergeJump> m_merge_jumps;
+    /** nesting of instructions(), whose output is thrown away */
+    std::size_t m_asides = 0;
+
+    ModuleOptions m_modules;
+    /** words of qs_<module>_exports, known once end_module() ran */
+    size_t m_exported_words = 0;
+
+    /** top-level statements held back for packing, see generateStatement */
+    std::vector<const StatementNode*> m_run;
+    /** the variables they declare */
+    std::unordered_set<std::string> m_run_names;
+
     void push(const std::string& reg) {
         m_output << "    push " << reg << "\n";
         m_stack_size++;
@@ -275,16 +889,1184 @@ class Generator {
 
     void begin_scope() { m_scopes.push_back(m_vars.size()); }
 
+    /** copies words 64-bit words from [rsi] to [rdi] */
+    void copy_words(const size_t words) {
+        m_output << "    mov rcx, " << words << "\n    rep movsq\n";
+    }
+
+    /** the init function runs the program once, on its first call */
+    void begin_module() {
+        const std::string init = ModuleOptions::init_symbol(m_modules.name);
+        m_output << "global " << init << ", "
+                 << ModuleOptions::exports_symbol(m_modules.name) << "\n"
+                 << init << ":\n"
+                 << "    cmp byte [rel qs_initialized], 0\n"
+                 << "    je qs_initialize\n"
+                 << "    ret\n"
+                 << "qs_initialize:\n"
+                 << "    mov byte [rel qs_initialized], 1\n";
+    }
+
+    /** stores the top-level declarations and returns to the importer */
+    void end_module() {
+        const std::string exports = ModuleOptions::exports_symbol(m_modules.name);
+        m_exported_words = 0;
+        for (const Variables& variable : m_vars) {
+            if (variable.imported) {
+                continue;
+            }
+            const std::string address =
+                "[rel " + exports + " + " +
+                std::to_string(m_exported_words * 8) + "]";
+            if (variable.length == 0) {
+                // one word per scalar: importers read them as i64
+                load_rax(variable);
+                m_output << "    mov " << address << ", rax\n";
+            } else {
+                m_output << "    lea rsi, [rsp + " << element_offset(variable)
+                         << "]\n    lea rdi, " << address << "\n";
+                copy_words(variable.length);
+            }
+            m_exported_words += std::max<size_t>(variable.length, 1);
+        }
+        m_output << "    add rsp, " << m_stack_size * 8 << "\n    ret\n";
+    }
+
     void end_scope() {
-        const size_t pop_count = m_vars.size() - m_scopes.back();
-        m_output << "    add rsp, " << pop_count * 8 << "\n";
-        m_stack_size -= pop_count;
-        for (int i = 0; i < pop_count; i++) {
+        size_t pop_count = 0;
+        while (m_vars.size() > m_scopes.back()) {
+            pop_count += slots(m_vars.back());
             m_vars.pop_back();
         }
+        m_output << "    add rsp, " << pop_count * 8 << "\n";
+        m_stack_size -= pop_count;
         m_scopes.pop_back();
     }
 
+    /** stack slots of a variable, 0 for one packed into another's */
+    static size_t slots(const Variables& variable) {
+        return variable.packed ? 0 : std::max<size_t>(variable.length, 1);
+    }
+
+    /**
+     * A new scalar of type. A narrow one declared right after another
+     * narrow scalar, whose slot is still on top of the stack, goes into the
+     * free bytes of that slot when it fits there naturally aligned;
+     * otherwise, and for i64, it takes a slot of its own.
+     */
+    [[nodiscard]] Variables place(std::string name, const IntType type) const {
+        Variables placed{.name = std::move(name),
+                         .stack_location = m_stack_size,
+                         .type = type};
+        if (type == IntType::i64 || m_vars.empty()) {
+            return placed;
+        }
+        const Variables& last = m_vars.back();
+        if (last.length != 0 || last.type == IntType::i64 ||
+            last.stack_location + 1 != m_stack_size) {
+            return placed;
+        }
+        const size_t width = type_width(type);
+        const size_t byte =
+            (last.byte + type_width(last.type) + width - 1) / width * width;
+        if (byte + width <= 8) {
+            placed.stack_location = last.stack_location;
+            placed.byte = byte;
+            placed.packed = true;
+        }
+        return placed;
+    }
+
+    [[nodiscard]] std::string scalar_address(const Variables& scalar) const {
+        return "[rsp + " +
+               std::to_string((m_stack_size - scalar.stack_location - 1) * 8 +
+                              scalar.byte) +
+               "]";
+    }
+
+    /** rax = scalar, sign- or zero-extended to 64 bits */
+    void load_rax(const Variables& scalar) {
+        static constexpr std::array<std::string_view, 7> kLoads{
+            "mov rax, ",         "movsxd rax, DWORD ", "movsx rax, WORD ",
+            "movsx rax, BYTE ",  "mov eax, DWORD ",    "movzx eax, WORD ",
+            "movzx eax, BYTE "};
+        m_output << "    " << kLoads[static_cast<size_t>(scalar.type)]
+                 << scalar_address(scalar) << "\n";
+    }
+
+    /** pushes scalar as 64 bits */
+    void load_scalar(const Variables& scalar) {
+        if (scalar.type == IntType::i64) {
+            push("QWORD " + scalar_address(scalar));
+            return;
+        }
+        load_rax(scalar);
+        push("rax");
+    }
+
+    /** stores the low bits of rax that scalar keeps */
+    void store_scalar(const Variables& scalar) {
+        const size_t width = type_width(scalar.type);
+        m_output << "    mov " << scalar_address(scalar) << ", "
+                 << (width == 1   ? "al"
+                     : width == 2 ? "ax"
+                     : width == 4 ? "eax"
+                                  : "rax")
+                 << "\n";
+    }
+
+    /**
+     * Pushes expression to store to scalar. A scalar of 32 bits or fewer
+     * keeps only low bits, and those of sums, differences and products
+     * depend only on the low bits of their operands, so such expressions
+     * use the 32-bit instructions: no REX prefix, and a multiply that
+     * leaves rdx alone. Division and element indices need every bit.
+     */
+    void generate_stored(const Variables& scalar,
+                         const ExpressionNode* expression) {
+        m_narrow = type_width(scalar.type) <= 4 && low_bits_only(expression);
+        generateExpression(expression);
+        m_narrow = false;
+    }
+
+    /** expression has no division and no element */
+    [[nodiscard]] static bool low_bits_only(const ExpressionNode* expression) {
+        std::vector<const ExpressionNode*> pending{expression};
+        while (!pending.empty()) {
+            const ExpressionNode* next = pending.back();
+            pending.pop_back();
+            if (const auto* binary =
+                    std::get_if<BinaryExpressionNode*>(&next->var)) {
+                if (std::holds_alternative<BinaryExpressionDivision*>(
+                        (*binary)->ops)) {
+                    return false;
+                }
+                pending.push_back(operands(*binary).first);
+                pending.push_back(operands(*binary).second);
+                continue;
+            }
+            const TermNode* term = std::get<TermNode*>(next->var);
+            if (const auto* parenthesis =
+                    std::get_if<TermParenthesisNode*>(&term->vars)) {
+                pending.push_back((*parenthesis)->expression);
+            } else if (std::holds_alternative<TermIndexNode*>(term->vars)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] const Variables* find_variable(const std::string_view name) const {
+        const auto it = ranges::find_if(m_vars, [&](const Variables& variables) {
+            return variables.name == name;
+        });
+        return it == m_vars.end() ? nullptr : &*it;
+    }
+
+    /** ::check_store() against the scalars in scope */
+    void check_store(const ExpressionNode* expression,
+                     const IntType type) const {
+        ::check_store(expression, type,
+                      [&](const Token& identifier) -> std::optional<IntType> {
+                          const Variables* found =
+                              find_variable(identifier.value.value());
+                          if (found == nullptr || found->length != 0) {
+                              return std::nullopt;
+                          }
+                          return found->type;
+                      });
+    }
+
+    const Variables& variable(const Token& identifier) const {
+        const Variables* found = find_variable(identifier.value.value());
+        if (found == nullptr) {
+            throw CompileError("Undeclared identifier: " +
+                                   identifier.value.value(),
+                               identifier.line);
+        }
+        return *found;
+    }
+
+    const Variables& array_variable(const Token& identifier) const {
+        const Variables& array = variable(identifier);
+        if (array.length == 0) {
+            throw CompileError("Not an array: " + identifier.value.value(),
+                               identifier.line);
+        }
+        return array;
+    }
+
+    /** offset from rsp of the first element of array; the rest follow */
+    [[nodiscard]] size_t element_offset(const Variables& array) const {
+        return (m_stack_size - array.stack_location - array.length) * 8;
+    }
+
+    /** traps unless reg holds an index into array, negative ones included */
+    void check_index(const std::string& reg, const Variables& array) {
+        const std::string label = create_label();
+        m_output << "    cmp " << reg << ", " << array.length << "\n";
+        m_output << "    jb " << label << "\n";
+        m_output << "    ud2\n";
+        m_output << label << ":\n";
+    }
+
+    /** replaces the index on top of the stack with that element */
+    void load_element(const TermIndexNode* element) {
+        const Variables& array = array_variable(element->identifier);
+        pop("rax");
+        check_index("rax", array);
+        push("QWORD [rsp + rax*8 + " + std::to_string(element_offset(array)) +
+             "]");
+    }
+
+    /** vector registers an element-wise expression may keep live */
+    static constexpr size_t kVectorRegisters = 14;
+
+    /**
+     * Stores expression into every element of array. Scalar subtrees are
+     * pushed once; then a vector loop covers as many elements as the ISA
+     * allows and a scalar loop the rest. Division has no vector form, so
+     * expressions with it, or with too many live values, run the scalar
+     * loop over every element.
+     */
+    void generateElementwise(const Variables& array,
+                             const ExpressionNode* expression) {
+        const auto length_of = [&](const Token& identifier) {
+            return variable(identifier).length;
+        };
+        std::unordered_map<const ExpressionNode*, size_t> scalars;
+        for (const ElementwiseOp& op :
+             lower_elementwise(expression, array.length, length_of)) {
+            if (op.kind == ElementwiseOp::Kind::scalar &&
+                !scalars.contains(op.expression)) {
+                generateExpression(op.expression);
+                scalars.emplace(op.expression, m_stack_size - 1);
+            }
+        }
+
+        const std::vector<ElementwiseOp> ops =
+            lower_elementwise(expression, array.length, length_of, true);
+        size_t depth = 0;
+        size_t registers = 0;
+        bool divides = false;
+        for (const ElementwiseOp& op : ops) {
+            if (op.kind == ElementwiseOp::Kind::array ||
+                op.kind == ElementwiseOp::Kind::scalar) {
+                registers = std::max(registers, ++depth);
+            } else {
+                depth--;
+                divides |= op.kind == ElementwiseOp::Kind::divide;
+            }
+        }
+        const bool vector = m_isa != quarks::Isa::scalar && !divides &&
+                            registers <= kVectorRegisters && array.length >= 2;
+        const bool avx2 =
+            vector && m_isa == quarks::Isa::avx2 && array.length >= 4;
+
+        m_output << "    xor ecx, ecx\n";
+        if (avx2) {
+            const std::string sse2 = create_label();
+            const std::string done = create_label();
+            m_output << "    cmp byte [rel qs_avx2], 0\n";
+            m_output << "    je " << sse2 << "\n";
+            vector_loop(ops, scalars, array, 4);
+            m_output << "    jmp " << done << "\n";
+            m_output << sse2 << ":\n";
+            vector_loop(ops, scalars, array, 2);
+            m_output << done << ":\n";
+        } else if (vector) {
+            vector_loop(ops, scalars, array, 2);
+        }
+        if (!vector || array.length % (avx2 ? 4 : 2) != 0) {
+            scalar_loop(lower_elementwise(expression, array.length, length_of),
+                        scalars, array);
+        }
+        if (!scalars.empty()) {
+            m_output << "    add rsp, " << scalars.size() * 8 << "\n";
+            m_stack_size -= scalars.size();
+        }
+    }
+
+    /** the variable an ElementwiseOp::Kind::array op reads */
+    const Variables& operand_array(const ElementwiseOp& op) const {
+        return variable(std::get<TermIdentifierNode*>(
+                            std::get<TermNode*>(op.expression->var)->vars)
+                            ->identifier);
+    }
+
+    /**
+     * Elements from rcx up to the last multiple of width, width at a time:
+     * 2 in xmm registers with SSE2, 4 in ymm registers with AVX2. ops are
+     * lhs first, each value in the next register.
+     */
+    void vector_loop(const std::vector<ElementwiseOp>& ops,
+                     const std::unordered_map<const ExpressionNode*, size_t>& scalars,
+                     const Variables& array, const size_t width) {
+        const bool avx = width == 4;
+        const auto reg = [&](const size_t index) {
+            return (avx ? "ymm" : "xmm") + std::to_string(index);
+        };
+        const std::string loop = create_label();
+        m_output << loop << ":\n";
+        size_t depth = 0;
+        for (const ElementwiseOp& op : ops) {
+            if (op.kind == ElementwiseOp::Kind::array) {
+                m_output << (avx ? "    vmovdqu " : "    movdqu ") << reg(depth++)
+                         << ", [rsp + rcx*8 + "
+                         << element_offset(operand_array(op)) << "]\n";
+            } else if (op.kind == ElementwiseOp::Kind::scalar) {
+                const size_t offset =
+                    (m_stack_size - scalars.at(op.expression) - 1) * 8;
+                if (avx) {
+                    m_output << "    vpbroadcastq " << reg(depth)
+                             << ", qword [rsp + " << offset << "]\n";
+                } else {
+                    m_output << "    movq " << reg(depth) << ", qword [rsp + "
+                             << offset << "]\n";
+                    m_output << "    punpcklqdq " << reg(depth) << ", "
+                             << reg(depth) << "\n";
+                }
+                depth++;
+            } else {
+                depth--;
+                vector_binary(op.kind, reg(depth - 1), reg(depth), reg(14),
+                              reg(15), avx);
+            }
+        }
+        m_output << (avx ? "    vmovdqu [rsp + rcx*8 + " : "    movdqu [rsp + rcx*8 + ")
+                 << element_offset(array) << "], " << reg(0) << "\n";
+        m_output << "    add rcx, " << width << "\n";
+        m_output << "    cmp rcx, " << array.length - array.length % width
+                 << "\n";
+        m_output << "    jb " << loop << "\n";
+        if (avx) {
+            m_output << "    vzeroupper\n";
+        }
+    }
+
+    /**
+     * lhs op= rhs on every 64-bit lane. There is no 64-bit vector multiply
+     * before AVX-512, so the low half of the product is put together from
+     * 32-bit pmuludq products in t1 and t2.
+     */
+    void vector_binary(const ElementwiseOp::Kind kind, const std::string& lhs,
+                       const std::string& rhs, const std::string& t1,
+                       const std::string& t2, const bool avx) {
+        const auto emit = [&](const char* op, const std::string& dst,
+                              const std::string& src) {
+            if (avx) {
+                m_output << "    v" << op << " " << dst << ", " << dst << ", "
+                         << src << "\n";
+            } else {
+                m_output << "    " << op << " " << dst << ", " << src << "\n";
+            }
+        };
+        const auto copy_shifted = [&](const std::string& dst,
+                                      const std::string& src) {
+            if (avx) {
+                m_output << "    vpsrlq " << dst << ", " << src << ", 32\n";
+            } else {
+                m_output << "    movdqa " << dst << ", " << src << "\n";
+                m_output << "    psrlq " << dst << ", 32\n";
+            }
+        };
+        switch (kind) {
+        case ElementwiseOp::Kind::add:
+            emit("paddq", lhs, rhs);
+            break;
+        case ElementwiseOp::Kind::subtract:
+            emit("psubq", lhs, rhs);
+            break;
+        case ElementwiseOp::Kind::multiply:
+            copy_shifted(t1, lhs);
+            emit("pmuludq", t1, rhs);
+            copy_shifted(t2, rhs);
+            emit("pmuludq", t2, lhs);
+            emit("paddq", t1, t2);
+            emit("psllq", t1, "32");
+            emit("pmuludq", lhs, rhs);
+            emit("paddq", lhs, t1);
+            break;
+        default:
+            assert(false); // division never takes the vector loop
+        }
+    }
+
+    /** elements from rcx to the end one at a time, on the stack machine */
+    void scalar_loop(const std::vector<ElementwiseOp>& ops,
+                     const std::unordered_map<const ExpressionNode*, size_t>& scalars,
+                     const Variables& array) {
+        const std::string loop = create_label();
+        const std::string done = create_label();
+        m_output << loop << ":\n";
+        m_output << "    cmp rcx, " << array.length << "\n";
+        m_output << "    jae " << done << "\n";
+        for (const ElementwiseOp& op : ops) {
+            if (op.kind == ElementwiseOp::Kind::array) {
+                push("QWORD [rsp + rcx*8 + " +
+                     std::to_string(element_offset(operand_array(op))) + "]");
+            } else if (op.kind == ElementwiseOp::Kind::scalar) {
+                push("QWORD [rsp + " +
+                     std::to_string(
+                         (m_stack_size - scalars.at(op.expression) - 1) * 8) +
+                     "]");
+            } else {
+                generateBinaryExpression(
+                    std::get<BinaryExpressionNode*>(op.expression->var));
+            }
+        }
+        pop("rax");
+        m_output << "    mov [rsp + rcx*8 + " << element_offset(array)
+                 << "], rax\n";
+        m_output << "    inc rcx\n";
+        m_output << "    jmp " << loop << "\n";
+        m_output << done << ":\n";
+    }
+
+    /** sets qs_avx2 when the CPU and the OS support AVX2 */
+    void detect_avx2() {
+        m_output << "    mov eax, 1\n"
+                    "    cpuid\n"
+                    "    and ecx, 0x18000000\n"
+                    "    cmp ecx, 0x18000000\n"
+                    "    jne qs_no_avx2\n"
+                    "    xor ecx, ecx\n"
+                    "    xgetbv\n"
+                    "    and eax, 6\n"
+                    "    cmp eax, 6\n"
+                    "    jne qs_no_avx2\n"
+                    "    mov eax, 7\n"
+                    "    xor ecx, ecx\n"
+                    "    cpuid\n"
+                    "    shr ebx, 5\n"
+                    "    and ebx, 1\n"
+                    "    mov [rel qs_avx2], bl\n"
+                    "qs_no_avx2:\n";
+    }
+
+    [[nodiscard]] bool packing() const { return m_isa != quarks::Isa::scalar; }
+
+    /**
+     * The operation of a scalar `x = y op z` or `assign x = y op z` whose
+     * operands are variables or literals and whose operator has a vector
+     * form; null for every other statement.
+     */
+    [[nodiscard]] static const BinaryExpressionNode*
+    packable(const StatementNode* stmt) {
+        const ExpressionNode* expression = nullptr;
+        if (const auto* let = std::get_if<LetStatementNode*>(&stmt->var)) {
+            expression = (*let)->length == 0 && (*let)->type == IntType::i64
+                             ? (*let)->expression
+                             : nullptr;
+        } else if (const auto* assign =
+                       std::get_if<nodeStatementAssign*>(&stmt->var)) {
+            expression = (*assign)->index == nullptr ? (*assign)->expression
+                                                     : nullptr;
+        }
+        const auto* binary =
+            expression == nullptr
+                ? nullptr
+                : std::get_if<BinaryExpressionNode*>(&expression->var);
+        if (binary == nullptr ||
+            std::holds_alternative<BinaryExpressionDivision*>((*binary)->ops)) {
+            return nullptr;
+        }
+        for (const ExpressionNode* operand :
+             {operands(*binary).first, operands(*binary).second}) {
+            const auto* term = std::get_if<TermNode*>(&operand->var);
+            if (term == nullptr ||
+                !(std::holds_alternative<TermIdentifierNode*>((*term)->vars) ||
+                  std::holds_alternative<TermIntLiteralNode*>((*term)->vars))) {
+                return nullptr;
+            }
+        }
+        return *binary;
+    }
+
+    /** the variable stmt, a packable statement, stores to */
+    [[nodiscard]] static const Token& destination(const StatementNode* stmt) {
+        if (const auto* let = std::get_if<LetStatementNode*>(&stmt->var)) {
+            return (*let)->identifier;
+        }
+        return std::get<nodeStatementAssign*>(stmt->var)->identifier;
+    }
+
+    /**
+     * stmt generates without errors after the held-back run: the variables
+     * it names are declared scalars, and a declaration's name is new
+     */
+    [[nodiscard]] bool run_accepts(const StatementNode* stmt) const {
+        const auto declared = [&](const Token& identifier) {
+            const Variables* found = find_variable(identifier.value.value());
+            return (found != nullptr && found->length == 0) ||
+                   m_run_names.contains(identifier.value.value());
+        };
+        const Token& name = destination(stmt);
+        if (std::holds_alternative<LetStatementNode*>(stmt->var)
+                ? find_variable(name.value.value()) != nullptr ||
+                      m_run_names.contains(name.value.value())
+                : !declared(name)) {
+            return false;
+        }
+        const auto [lhs, rhs] = operands(packable(stmt));
+        for (const ExpressionNode* operand : {lhs, rhs}) {
+            const auto* id = std::get_if<TermIdentifierNode*>(
+                &std::get<TermNode*>(operand->var)->vars);
+            if (id != nullptr && !declared((*id)->identifier)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** where the operands of a pack come from, see pack() */
+    struct PackOperand {
+        /** the literal every statement uses, if not a variable */
+        std::optional<std::string> literal;
+        /** slot of the first statement's variable */
+        size_t slot = 0;
+        /** statement j reads slot + j; else all read slot */
+        bool consecutive = false;
+    };
+
+    struct Pack {
+        ElementwiseOp::Kind kind;
+        PackOperand lhs;
+        PackOperand rhs;
+        /** slot the first statement stores to; statement j stores to +j */
+        size_t destination = 0;
+    };
+
+    /**
+     * Whether the width statements of run from first on can run as one
+     * vector operation: they store to consecutive slots, each operand is
+     * the same literal or variable in all of them or sits in consecutive
+     * slots, and none reads what another one stores.
+     */
+    [[nodiscard]] std::optional<Pack>
+    pack(const std::vector<const StatementNode*>& run, const size_t first,
+         const size_t width) const {
+        if (first + width > run.size()) {
+            return std::nullopt;
+        }
+        const bool declares =
+            std::holds_alternative<LetStatementNode*>(run[first]->var);
+        std::vector<std::string_view> names;
+        for (size_t j = 0; j < width; j++) {
+            const std::string& name =
+                destination(run[first + j]).value.value();
+            const Variables* stored = find_variable(name);
+            if (declares ? stored != nullptr || ranges::find(names, name) !=
+                                                    names.end()
+                         : stored == nullptr || stored->length != 0 ||
+                               stored->type != IntType::i64 ||
+                               stored->stack_location !=
+                                   find_variable(names.empty() ? name
+                                                               : names[0])
+                                           ->stack_location +
+                                       j) {
+                return std::nullopt;
+            }
+            names.emplace_back(name);
+        }
+
+        Pack pack{.kind = elementwise_kind(packable(run[first])),
+                  .destination = declares
+                                     ? m_stack_size
+                                     : find_variable(names[0])->stack_location};
+        for (const bool left : {true, false}) {
+            PackOperand& operand = left ? pack.lhs : pack.rhs;
+            bool uniform = true;
+            bool consecutive = true;
+            for (size_t j = 0; j < width; j++) {
+                const auto [lhs, rhs] = operands(packable(run[first + j]));
+                const TermNode* term = std::get<TermNode*>((left ? lhs : rhs)->var);
+                if (const auto* literal =
+                        std::get_if<TermIntLiteralNode*>(&term->vars)) {
+                    const std::string value = std::to_string(
+                        literal_value((*literal)->int_literals.value.value()));
+                    if (j > 0 && value != operand.literal) {
+                        return std::nullopt;
+                    }
+                    operand.literal = value;
+                    continue;
+                }
+                const std::string& name =
+                    std::get<TermIdentifierNode*>(term->vars)->identifier.value.value();
+                // a statement may read only the variable it stores to itself
+                for (size_t k = 0; k < width; k++) {
+                    if (k != j && names[k] == name) {
+                        return std::nullopt;
+                    }
+                }
+                const Variables* read = find_variable(name);
+                if (read == nullptr || read->length != 0 ||
+                    read->type != IntType::i64) {
+                    return std::nullopt;
+                }
+                if (j == 0) {
+                    operand.slot = read->stack_location;
+                }
+                uniform &= read->stack_location == operand.slot;
+                consecutive &= read->stack_location == operand.slot + j;
+            }
+            if (!operand.literal.has_value() && !uniform && !consecutive) {
+                return std::nullopt;
+            }
+            operand.consecutive = !operand.literal.has_value() && !uniform;
+        }
+        return pack;
+    }
+
+    /**
+     * Superword-level parallelism: packs of 2 statements of a run, or 4
+     * with AVX2, that pass pack() become one vector operation. The others
+     * are generated one at a time.
+     */
+    void generate_run(const std::vector<const StatementNode*>& run) {
+        size_t first = 0;
+        while (first < run.size()) {
+            std::optional<Pack> packed;
+            size_t width = 4;
+            if (m_isa == quarks::Isa::avx2) {
+                packed = pack(run, first, width);
+            }
+            if (!packed.has_value()) {
+                width = 2;
+                packed = pack(run, first, width);
+            }
+            if (!packed.has_value()) {
+                generate_tasks(run[first]);
+                first++;
+                continue;
+            }
+            generate_pack(run, first, width, packed.value());
+            first += width;
+        }
+    }
+
+    void generate_pack(const std::vector<const StatementNode*>& run,
+                       const size_t first, const size_t width,
+                       const Pack& pack) {
+        mark_line(run[first]->position);
+        m_output << "    ; packed " << width << " statements\n";
+        const bool declares =
+            std::holds_alternative<LetStatementNode*>(run[first]->var);
+        if (declares) {
+            m_output << "    sub rsp, " << width * 8 << "\n";
+            for (size_t j = 0; j < width; j++) {
+                m_vars.push_back(
+                    {.name = destination(run[first + j]).value.value(),
+                     .stack_location = m_stack_size + j});
+            }
+            m_stack_size += width;
+        }
+        if (width == 4) {
+            const std::string sse2 = create_label();
+            const std::string done = create_label();
+            m_output << "    cmp byte [rel qs_avx2], 0\n";
+            m_output << "    je " << sse2 << "\n";
+            pack_lanes(pack, width, 0, 4);
+            m_output << "    jmp " << done << "\n";
+            m_output << sse2 << ":\n";
+            pack_lanes(pack, width, 0, 2);
+            pack_lanes(pack, width, 2, 2);
+            m_output << done << ":\n";
+        } else {
+            pack_lanes(pack, width, 0, 2);
+        }
+        if (declares && !m_debug_source.empty()) {
+            for (size_t j = 0; j < width; j++) {
+                const Token& name = destination(run[first + j]);
+                m_output << name.value.value() << "@" << name.line + 1 << "."
+                         << name.column + 1 << " equ -"
+                         << (pack.destination + j + 1) * 8 << "\n";
+            }
+        }
+    }
+
+    /**
+     * lanes lanes of a pack of width statements, from lane on: 2 in xmm
+     * registers, 4 in ymm registers. Lane 0 is the last statement, whose
+     * slots have the lowest address.
+     */
+    void pack_lanes(const Pack& pack, const size_t width, const size_t lane,
+                    const size_t lanes) {
+        const bool avx = lanes == 4;
+        const auto reg = [&](const size_t index) {
+            return (avx ? "ymm" : "xmm") + std::to_string(index);
+        };
+        const auto address = [&](const size_t slot, const bool consecutive) {
+            const size_t lane_slot = consecutive ? slot + width - 1 - lane : slot;
+            return (m_stack_size - lane_slot - 1) * 8;
+        };
+        for (const bool left : {true, false}) {
+            const PackOperand& operand = left ? pack.lhs : pack.rhs;
+            const std::string target = reg(left ? 0 : 1);
+            if (operand.literal.has_value()) {
+                m_output << "    mov rax, " << operand.literal.value() << "\n";
+                if (avx) {
+                    m_output << "    vmovq xmm" << (left ? 0 : 1) << ", rax\n";
+                    m_output << "    vpbroadcastq " << target << ", xmm"
+                             << (left ? 0 : 1) << "\n";
+                } else {
+                    m_output << "    movq " << target << ", rax\n";
+                    m_output << "    punpcklqdq " << target << ", " << target
+                             << "\n";
+                }
+            } else if (operand.consecutive) {
+                m_output << (avx ? "    vmovdqu " : "    movdqu ") << target
+                         << ", [rsp + " << address(operand.slot, true)
+                         << "]\n";
+            } else if (avx) {
+                m_output << "    vpbroadcastq " << target << ", qword [rsp + "
+                         << address(operand.slot, false) << "]\n";
+            } else {
+                m_output << "    movq " << target << ", qword [rsp + "
+                         << address(operand.slot, false) << "]\n";
+                m_output << "    punpcklqdq " << target << ", " << target
+                         << "\n";
+            }
+        }
+        vector_binary(pack.kind, reg(0), reg(1), reg(14), reg(15), avx);
+        m_output << (avx ? "    vmovdqu [rsp + " : "    movdqu [rsp + ")
+                 << address(pack.destination, true) << "], " << reg(0)
+                 << "\n";
+        if (avx) {
+            m_output << "    vzeroupper\n";
+        }
+    }
+
+    /** attributes the code that follows to the source line at position */
+    void mark_line(const SourcePosition& position) {
+        if (m_debug_source.empty() || position.line < 0 ||
+            position.line == m_marked_line) {
+            return;
+        }
+        m_marked_line = position.line;
+        m_output << "%line " << position.line + 1 << "+0 " << m_debug_source
+                 << "\n";
+    }
+
+    /** numbers the next if/elif test and counts it when instrumenting */
+    std::size_t begin_test() {
+        const std::size_t site = m_sites++;
+        count(site, false);
+        return site;
+    }
+
+    void count(const std::size_t site, const bool taken) {
+        if (!m_profile.instrument.empty()) {
+            m_output << "    inc qword [rel qs_profile + "
+                     << (2 * site + (taken ? 1 : 0)) * 8 << "]\n";
+        }
+    }
+
+    [[nodiscard]] bool cold(const std::size_t site) const {
+        return m_profile.use != nullptr && m_profile.use->cold(site);
+    }
+
+    /** an arm of an if/elif/else chain; test is null for the else */
+    struct Arm {
+        const ExpressionNode* test;
+        const nodeScope* scope;
+    };
+
+    [[nodiscard]] static std::vector<Arm>
+    chain_arms(const nodeIfStatement* statement_if) {
+        std::vector<Arm> arms{{statement_if->expression, statement_if->scope}};
+        std::optional<nodeIfPredicate*> next = statement_if->ifPredicate;
+        while (next.has_value()) {
+            if (const auto* elif =
+                    std::get_if<nodeIfPredicateElif*>(&next.value()->predicate)) {
+                arms.push_back({(*elif)->expression, (*elif)->scope});
+                next = (*elif)->ifPredicate;
+            } else {
+                arms.push_back(
+                    {nullptr,
+                     std::get<nodeIfPredicateElse*>(next.value()->predicate)
+                         ->scope});
+                next.reset();
+            }
+        }
+        return arms;
+    }
+
+    /**
+     * Adds the nodes of expression to cost and checks it can be evaluated
+     * whether or not its arm runs: no division, which may trap, no array
+     * elements, and only declared scalars not in assigned, the variables
+     * its arm has already changed.
+     */
+    [[nodiscard]] bool speculable(const ExpressionNode* expression,
+                                  std::size_t& cost,
+                                  const std::vector<std::string_view>& assigned) const {
+        std::vector<const ExpressionNode*> pending{expression};
+        while (!pending.empty()) {
+            const ExpressionNode* next = pending.back();
+            pending.pop_back();
+            if (++cost > m_if_conversion) {
+                return false;
+            }
+            if (const auto* binary =
+                    std::get_if<BinaryExpressionNode*>(&next->var)) {
+                if (std::holds_alternative<BinaryExpressionDivision*>(
+                        (*binary)->ops)) {
+                    return false;
+                }
+                const auto [lhs, rhs] = operands(*binary);
+                pending.push_back(lhs);
+                pending.push_back(rhs);
+                continue;
+            }
+            const TermNode* term = std::get<TermNode*>(next->var);
+            if (const auto* parenthesis =
+                    std::get_if<TermParenthesisNode*>(&term->vars)) {
+                pending.push_back((*parenthesis)->expression);
+            } else if (const auto* id =
+                           std::get_if<TermIdentifierNode*>(&term->vars)) {
+                const std::string& name = (*id)->identifier.value.value();
+                const Variables* read = find_variable(name);
+                if (read == nullptr || read->length != 0 ||
+                    ranges::find(assigned, name) != assigned.end()) {
+                    return false;
+                }
+            } else if (std::holds_alternative<TermIndexNode*>(term->vars)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * If-conversion: a chain whose arms only assign scalars, with at most
+     * m_if_conversion expression nodes in its tests and right-hand sides,
+     * becomes straight-line code. Every test and right-hand side is
+     * evaluated, then each assigned variable picks its value with cmov,
+     * from the last arm to the first so the first true test wins. Random
+     * tests then cost a few instructions instead of a mispredicted branch.
+     * Instrumented builds keep every branch to count it, and a profile
+     * with a biased test keeps the chain's branches, which predict well,
+     * so the cold arm can move out of line; the tests are
+     * numbered either way, so profiles line up. False, having emitted
+     * nothing, for chains that do not qualify.
+     */
+    bool if_convert(const nodeIfStatement* statement_if) {
+        if (m_if_conversion == 0 || !m_profile.instrument.empty()) {
+            return false;
+        }
+        const std::vector<Arm> arms = chain_arms(statement_if);
+        const std::size_t tests =
+            arms.size() - (arms.back().test == nullptr ? 1 : 0);
+        for (std::size_t k = 0; k < tests; k++) {
+            if (m_profile.use != nullptr && m_profile.use->biased(m_sites + k)) {
+                return false;
+            }
+        }
+
+        // per arm, the right-hand side of every variable it assigns
+        std::vector<std::unordered_map<std::string_view, const ExpressionNode*>>
+            values(arms.size());
+        std::vector<std::string_view> targets;
+        std::size_t cost = 0;
+        for (std::size_t k = 0; k < arms.size(); k++) {
+            std::vector<std::string_view> assigned;
+            if (arms[k].test != nullptr &&
+                !speculable(arms[k].test, cost, assigned)) {
+                return false;
+            }
+            for (const StatementNode* stmt : arms[k].scope->statements) {
+                const auto* assign = std::get_if<nodeStatementAssign*>(&stmt->var);
+                if (assign == nullptr || (*assign)->index != nullptr) {
+                    return false;
+                }
+                const std::string& name = (*assign)->identifier.value.value();
+                const Variables* target = find_variable(name);
+                if (target != nullptr) {
+                    check_store((*assign)->expression, target->type);
+                }
+                if (target == nullptr || target->length != 0 ||
+                    ranges::find(assigned, name) != assigned.end() ||
+                    !speculable((*assign)->expression, cost, assigned)) {
+                    return false;
+                }
+                assigned.push_back(name);
+                values[k].emplace(name, (*assign)->expression);
+                if (ranges::find(targets, name) == targets.end()) {
+                    targets.push_back(name);
+                }
+            }
+        }
+        if (targets.empty()) {
+            return false;
+        }
+
+        const size_t first_test = m_stack_size;
+        for (std::size_t k = 0; k < tests; k++) {
+            begin_test();
+            generateExpression(arms[k].test);
+        }
+        const auto slot = [&](const size_t location) {
+            return "[rsp + " +
+                   std::to_string((m_stack_size - location - 1) * 8) + "]";
+        };
+        for (const std::string_view name : targets) {
+            // an arm that leaves the variable alone picks its old value
+            const Variables& old = *find_variable(name);
+            const auto initial = values.back().find(name);
+            bool changed = tests < arms.size() && initial != values.back().end();
+            if (changed) {
+                generateExpression(initial->second);
+            } else {
+                load_scalar(old);
+            }
+            for (std::size_t k = tests; k-- > 0;) {
+                const auto value = values[k].find(name);
+                if (value != values[k].end()) {
+                    generateExpression(value->second);
+                    changed = true;
+                } else if (changed) {
+                    load_scalar(old);
+                } else {
+                    continue;
+                }
+                pop("rbx");
+                pop("rax");
+                m_output << "    cmp QWORD " << slot(first_test + k)
+                         << ", 0\n    cmovnz rax, rbx\n";
+                push("rax");
+            }
+        }
+        for (std::size_t i = targets.size(); i-- > 0;) {
+            pop("rax");
+            store_scalar(*find_variable(targets[i]));
+        }
+        m_output << "    add rsp, " << tests * 8 << "\n";
+        m_stack_size -= tests;
+        return true;
+    }
+
+    /**
+     * Tail merging: an arm of a chain that ends in the same statements as
+     * an earlier arm jumps into the earlier arm's code for them instead of
+     * repeating them, before the shared end label; an arm identical to an
+     * earlier one shrinks to its test and a jump. Statements are matched by
+     * structural hash and then compared. Neither arm may declare anything
+     * before the shared statements, so those run with the same variables
+     * at the same stack depth either way, and an arm is only jumped into
+     * if it is generated in full. Profiles count per copy and debug info
+     * maps every copy to its line, so they keep all copies.
+     */
+    void plan_merges(const nodeIfStatement* statement_if) {
+        if (!m_profile.instrument.empty() || m_profile.use != nullptr ||
+            !m_debug_source.empty()) {
+            return;
+        }
+        const auto declares = [](const std::vector<StatementNode*>& statements,
+                                 const std::size_t end) {
+            return std::any_of(
+                statements.begin(), statements.begin() + static_cast<long>(end),
+                [](const StatementNode* stmt) {
+                    return std::holds_alternative<LetStatementNode*>(stmt->var) ||
+                           std::holds_alternative<ImportStatementNode*>(stmt->var);
+                });
+        };
+        const std::vector<Arm> arms = chain_arms(statement_if);
+        std::vector<char> merged(arms.size(), false);
+        for (std::size_t k = 1; k < arms.size(); k++) {
+            const std::vector<StatementNode*>& later = arms[k].scope->statements;
+            std::size_t best = 0;
+            std::size_t from = 0;
+            for (std::size_t j = 0; j < k; j++) {
+                const std::vector<StatementNode*>& earlier =
+                    arms[j].scope->statements;
+                std::size_t shared = 0;
+                while (shared < std::min(later.size(), earlier.size())) {
+                    const StatementNode* a = later[later.size() - shared - 1];
+                    const StatementNode* b = earlier[earlier.size() - shared - 1];
+                    if (m_structure(a) != m_structure(b) ||
+                        !StructuralHash::same(a, b)) {
+                        break;
+                    }
+                    shared++;
+                }
+                if (!merged[j] && shared > best &&
+                    !declares(later, later.size() - shared) &&
+                    !declares(earlier, earlier.size() - shared)) {
+                    best = shared;
+                    from = j;
+                }
+            }
+            if (best == 0) {
+                continue;
+            }
+            merged[k] = true;
+            const std::size_t at = arms[from].scope->statements.size() - best;
+            auto& labels = m_merge_labels[arms[from].scope];
+            auto label = ranges::find(labels, at, &std::pair<std::size_t, std::string>::first);
+            if (label == labels.end()) {
+                labels.emplace_back(at, create_label());
+                label = labels.end() - 1;
+            }
+            m_merge_jumps.emplace(arms[k].scope,
+                                  MergeJump{.scope = arms[k].scope,
+                                            .from = later.size() - best,
+                                            .label = label->second,
+                                            .test = arms[k].test != nullptr});
+        }
+    }
+
+    /**
+     * An arm identical to an earlier one, its test if any in rax, becomes
+     * jump, jnz or jmp, to that arm's code; false for other arms.
+     */
+    bool shares_arm(const nodeScope* scope, const char* jump) {
+        const auto merge = m_merge_jumps.find(scope);
+        if (merge == m_merge_jumps.end() || merge->second.from != 0) {
+            return false;
+        }
+        const MergeJump shared = std::move(merge->second);
+        m_merge_jumps.erase(merge);
+        std::size_t saved = 0;
+        if (m_asides == 0) {
+            // a tested arm also had a jz over it and a jmp past the chain
+            saved = instructions({scope}) + (shared.test ? 2 : 0) - 1;
+        }
+        m_output << "    ; merged " << saved << " instructions\n    " << jump
+                 << " " << shared.label << "\n";
+        return true;
+    }
+
+    /**
+     * Statements from begin to end as tasks, in runs the SLP pass may pack
+     * where it is on; labels go before the statements they name, and runs
+     * do not span them.
+     */
+    void push_statements(
+        std::vector<Task>& tasks, const std::vector<StatementNode*>& statements,
+        const std::size_t first, std::size_t end,
+        const std::vector<std::pair<std::size_t, std::string>>& labels) const {
+        const auto labelled = [&](const std::size_t at) {
+            for (const auto& [position, label] : labels) {
+                if (position == at) {
+                    tasks.emplace_back(EmitLabel{.label = label});
+                    return true;
+                }
+            }
+            return false;
+        };
+        labelled(end);
+        while (end > first) {
+            std::size_t begin = end - 1;
+            while (packing() && begin > first &&
+                   continues_run(statements[begin - 1], statements[begin]) &&
+                   ranges::find(labels, begin,
+                                &std::pair<std::size_t, std::string>::first) ==
+                       labels.end()) {
+                begin--;
+            }
+            if (end - begin > 1) {
+                tasks.emplace_back(
+                    Run{{statements.begin() + static_cast<long>(begin),
+                         statements.begin() + static_cast<long>(end)}});
+            } else {
+                tasks.emplace_back(statements[begin]);
+            }
+            end = begin;
+            labelled(end);
+        }
+    }
+
+    /**
+     * Instructions tasks would emit from here, for the report of what tail
+     * merging saved: they are generated aside and the state is restored.
+     */
+    std::size_t instructions(std::vector<Task> tasks) {
+        std::stringstream aside;
+        std::swap(m_output, aside);
+        const std::vector<Variables> vars = m_vars;
+        const std::vector<size_t> scopes = m_scopes;
+        const size_t stack_size = m_stack_size;
+        const int labels = m_label_count;
+        const std::size_t sites = m_sites;
+        m_asides++;
+        while (!tasks.empty()) {
+            Task task = std::move(tasks.back());
+            tasks.pop_back();
+            std::visit(TaskVisitor{.m_generator = *this, .m_tasks = tasks},
+                       task);
+        }
+        m_asides--;
+        std::swap(m_output, aside);
+        m_vars = vars;
+        m_scopes = scopes;
+        m_stack_size = stack_size;
+        m_label_count = labels;
+        m_sites = sites;
+
+        std::size_t count = 0;
+        std::string line;
+        while (std::getline(aside, line)) {
+            count += line.starts_with("    ") && !line.starts_with("    ;");
+        }
+        return count;
+    }
+
+    /**
+     * Jumps to the arm when the test in rax is true and generates its scope
+     * aside, so the fall-through path goes on with the rest of the chain.
+     */
+    void out_of_line(const std::size_t site, const nodeScope* scope,
+                     const std::string& end_label, std::vector<Task>& tasks) {
+        std::string label = create_label();
+        m_output << "    jnz " << label << "\n";
+        tasks.emplace_back(EndColdArm{.end_label = end_label});
+        tasks.emplace_back(scope);
+        tasks.emplace_back(BeginColdArm{.label = std::move(label), .site = site});
+    }
+
+    /** rdi holds the exit status and rax is 60 again afterwards */
+    void before_exit() {
+        if (!m_profile.instrument.empty()) {
+            m_output << "    call qs_write_profile\n";
+            m_output << "    mov rax, 60\n";
+        }
+    }
+
+    /** open, write and close the counters with their header, keeping rdi */
+    void write_profile() {
+        m_output << "qs_write_profile:\n"
+                    "    push rdi\n"
+                    "    mov rax, 2\n"
+                    "    lea rdi, [rel qs_profile_path]\n"
+                    "    mov rsi, 577\n"
+                    "    mov rdx, 420\n"
+                    "    syscall\n"
+                    "    test rax, rax\n"
+                    "    js qs_write_profile_done\n"
+                    "    mov rdi, rax\n"
+                    "    mov rax, 1\n"
+                    "    lea rsi, [rel qs_profile_header]\n"
+                    "    mov rdx, "
+                 << 24 + 16 * m_sites
+                 << "\n"
+                    "    syscall\n"
+                    "    mov rax, 3\n"
+                    "    syscall\n"
+                    "qs_write_profile_done:\n"
+                    "    pop rdi\n"
+                    "    ret\n"
+                    "section .data\n"
+                    "qs_profile_path: db ";
+        for (const char c : m_profile.instrument) {
+            m_output << static_cast<int>(static_cast<unsigned char>(c)) << ", ";
+        }
+        m_output << "0\n"
+                 << std::hex << "qs_profile_header: dq 0x" << BranchProfile::kMagic
+                 << ", 0x" << m_profile.source_hash << std::dec << ", " << m_sites
+                 << "\nqs_profile: times " << 2 * m_sites << " dq 0\n";
+    }
+
     std::string create_label() {
         std::stringstream ss;
         ss << "label" << m_label_count++;
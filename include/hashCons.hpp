@@ -0,0 +1,98 @@
+#pragma once
+#include "tokenization.hpp"
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+struct ExpressionNode;
+
+/**
+ * Interning table for expression nodes, so structurally identical subtrees
+ * are built once and shared. Children are interned before their parents,
+ * which makes two subtrees identical exactly when their kind, leaf text and
+ * child pointers are; a lookup never looks deeper than one level.
+ *
+ * Shared nodes are immutable and keep the tokens of their first occurrence,
+ * including its line. The table refers into the arena the nodes live in and
+ * must be cleared when that arena is reset or replaced.
+ */
+class HashCons final {
+  public:
+    struct Stats {
+        /** expression nodes the source spells out */
+        std::size_t expressions = 0;
+        /** of those, reused from an identical earlier subtree */
+        std::size_t shared = 0;
+        /** arena bytes the shared nodes would have taken */
+        std::size_t bytes_saved = 0;
+
+        Stats& operator+=(const Stats& other) {
+            expressions += other.expressions;
+            shared += other.shared;
+            bytes_saved += other.bytes_saved;
+            return *this;
+        }
+    };
+
+    /**
+     * The node for (kind, text, lhs, rhs), built by make() the first time.
+     * kind is the token that introduces the node: a literal, an identifier,
+     * `(` for a parenthesized expression, `[` for an array element (text is
+     * the array's name), or a binary operator. bytes is what make()
+     * allocates, counted as saved on every reuse.
+     */
+    template <typename Make>
+    ExpressionNode* intern(const TokenType kind, const std::string_view text,
+                           const ExpressionNode* lhs, const ExpressionNode* rhs,
+                           const std::size_t bytes, Make&& make) {
+        m_stats.expressions++;
+        Key key{.kind = kind, .text = text, .lhs = lhs, .rhs = rhs};
+        if (const auto it = m_nodes.find(key); it != m_nodes.end()) {
+            m_stats.shared++;
+            m_stats.bytes_saved += bytes;
+            return it->second;
+        }
+        ExpressionNode* node = make();
+        if (!text.empty()) {
+            key.text = *m_text.emplace(text).first;
+        }
+        m_nodes.emplace(key, node);
+        return node;
+    }
+
+    /** forgets every node; the counters keep running */
+    void clear() {
+        m_nodes.clear();
+        m_text.clear();
+    }
+
+    [[nodiscard]] const Stats& stats() const { return m_stats; }
+
+  private:
+    struct Key {
+        TokenType kind;
+        /** views into m_text once stored */
+        std::string_view text;
+        const ExpressionNode* lhs;
+        const ExpressionNode* rhs;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            std::size_t hash = std::hash<std::string_view>{}(key.text);
+            for (const std::size_t part :
+                 {static_cast<std::size_t>(key.kind),
+                  std::hash<const void*>{}(key.lhs),
+                  std::hash<const void*>{}(key.rhs)}) {
+                hash ^= part + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    std::unordered_map<Key, ExpressionNode*, KeyHash> m_nodes;
+    std::unordered_set<std::string> m_text;
+    Stats m_stats;
+};
@@ -0,0 +1,222 @@
+#pragma once
+#include "parallelParse.hpp"
+#include "profile.hpp"
+#include "quarks.hpp"
+
+/**
+ * A source and its AST kept up to date under text edits, for editor
+ * integrations that re-check on every keystroke.
+ *
+ * The AST is held per top-level statement ("unit"), each in its own small
+ * arena. An edit re-lexes and re-parses only the units it touches: the scan
+ * restarts at the unit before the edit and stops at the first statement
+ * start after it that coincides with an old one. Everything from there on
+ * is reused as is, with offsets and lines shifted. Tokens inside reused
+ * units keep the line they were parsed at; diagnostic() and generate()
+ * correct for the shift.
+ *
+ * Only syntax is checked incrementally; semantic errors such as undeclared
+ * identifiers come from generate(). While a `{` is unclosed the rest of the
+ * file is one unit and is reparsed on every edit.
+ */
+class IncrementalParse final {
+  public:
+    explicit IncrementalParse(std::string source)
+        : m_source(std::move(source)) {
+        m_units = parse_units(0, 0, m_source.size());
+    }
+
+    struct EditStats {
+        std::size_t units_reparsed = 0;
+        std::size_t bytes_reparsed = 0;
+    };
+
+    /** replaces length bytes at offset with text and reparses around it */
+    void edit(const std::size_t offset, const std::size_t length,
+              const std::string_view text) {
+        if (offset + length > m_source.size()) {
+            throw std::out_of_range("edit past the end of the source");
+        }
+        // the unit before the edit too: the edit may turn the start of its
+        // successor into an elif/else that continues it
+        std::size_t first = unit_at(offset);
+        first -= first > 0 ? 1 : 0;
+        const std::size_t last = unit_at(offset + length);
+
+        const auto line_delta = static_cast<int>(
+            ranges::count(text, '\n') -
+            std::count(m_source.begin() + static_cast<long>(offset),
+                       m_source.begin() + static_cast<long>(offset + length),
+                       '\n'));
+        const auto delta = static_cast<std::ptrdiff_t>(text.size()) -
+                           static_cast<std::ptrdiff_t>(length);
+        m_source.replace(offset, length, text);
+        const std::size_t edit_end = offset + text.size();
+        const auto shifted = [delta](const Unit& unit) {
+            return static_cast<std::size_t>(
+                static_cast<std::ptrdiff_t>(unit.begin) + delta);
+        };
+
+        // rescan until a statement start lines up with an unchanged unit
+        const std::size_t begin = m_units[first].begin;
+        std::size_t resync = last + 1;
+        bool synced = false;
+        scan_top_level(m_source, begin, m_units[first].first_line,
+                       [&](const std::size_t start, int) {
+                           if (start < edit_end) {
+                               return true;
+                           }
+                           while (resync < m_units.size() &&
+                                  shifted(m_units[resync]) < start) {
+                               resync++;
+                           }
+                           synced = resync < m_units.size() &&
+                                    shifted(m_units[resync]) == start;
+                           return !synced;
+                       });
+        if (!synced) {
+            resync = m_units.size();
+        }
+
+        const std::size_t end =
+            synced ? shifted(m_units[resync]) : m_source.size();
+        std::vector<Unit> reparsed =
+            parse_units(begin, m_units[first].first_line, end);
+        m_last_edit = {.units_reparsed = reparsed.size(),
+                       .bytes_reparsed = end - begin};
+
+        for (std::size_t i = resync; i < m_units.size(); i++) {
+            m_units[i].begin = shifted(m_units[i]);
+            m_units[i].first_line += line_delta;
+        }
+        m_units.erase(m_units.begin() + static_cast<long>(first),
+                      m_units.begin() + static_cast<long>(resync));
+        m_units.insert(m_units.begin() + static_cast<long>(first),
+                       std::make_move_iterator(reparsed.begin()),
+                       std::make_move_iterator(reparsed.end()));
+    }
+
+    /** the first syntax error, as a full parse would report it */
+    [[nodiscard]] std::optional<CompileError> diagnostic() const {
+        for (const Unit& unit : m_units) {
+            if (unit.error.has_value()) {
+                return relocate(unit.error.value(), unit);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /** generates code from the current AST; throws like a full compile */
+    template <typename CodeGenerator>
+    [[nodiscard]] std::string
+    generate(const ProfileOptions& profile = {},
+             const quarks::Isa isa = quarks::Isa::sse2,
+             const std::size_t if_conversion = quarks::kIfConversionCost) const {
+        if (std::optional<CompileError> error = diagnostic()) {
+            throw error.value();
+        }
+        CodeGenerator generator;
+        generator.set_profile(profile);
+        if constexpr (requires { generator.set_isa(isa); }) {
+            generator.set_isa(isa);
+        }
+        if constexpr (requires { generator.set_if_conversion(if_conversion); }) {
+            generator.set_if_conversion(if_conversion);
+        }
+        generator.begin_program();
+        for (const Unit& unit : m_units) {
+            try {
+                for (const StatementNode* statement : unit.statements) {
+                    generator.generateStatement(statement);
+                }
+            } catch (const CompileError& error) {
+                throw relocate(error, unit);
+            }
+        }
+        generator.end_program();
+        return generator.take_output();
+    }
+
+    [[nodiscard]] const std::string& source() const { return m_source; }
+
+    [[nodiscard]] std::size_t unit_count() const { return m_units.size(); }
+
+    [[nodiscard]] const EditStats& last_edit() const { return m_last_edit; }
+
+  private:
+    /** one top-level statement and the arena its AST lives in */
+    struct Unit {
+        std::size_t begin = 0;
+        int first_line = 0;
+        /** first_line when parsed; the unit's tokens are relative to it */
+        int parsed_line = 0;
+        std::unique_ptr<ArenaAllocator> arena;
+        std::vector<StatementNode*> statements;
+        std::optional<CompileError> error;
+    };
+
+    std::string m_source;
+    std::vector<Unit> m_units;
+    EditStats m_last_edit;
+
+    /** index of the unit containing offset; the end maps to the last unit */
+    [[nodiscard]] std::size_t unit_at(const std::size_t offset) const {
+        const auto it = std::upper_bound(
+            m_units.begin() + 1, m_units.end(), offset,
+            [](const std::size_t value, const Unit& unit) {
+                return value < unit.begin;
+            });
+        return static_cast<std::size_t>(it - m_units.begin()) - 1;
+    }
+
+    /** splits [begin, end) into statements and parses each on its own */
+    std::vector<Unit> parse_units(const std::size_t begin, const int line,
+                                  const std::size_t end) const {
+        const std::string_view source =
+            std::string_view(m_source).substr(0, end);
+        std::vector<std::pair<std::size_t, int>> starts{{begin, line}};
+        scan_top_level(source, begin, line,
+                       [&](const std::size_t start, const int start_line) {
+                           starts.emplace_back(start, start_line);
+                           return true;
+                       });
+
+        std::vector<Unit> units;
+        for (std::size_t i = 0; i < starts.size(); i++) {
+            const std::size_t unit_end =
+                i + 1 < starts.size() ? starts[i + 1].first : end;
+            units.push_back(parse_unit(starts[i].first, unit_end,
+                                       starts[i].second));
+        }
+        return units;
+    }
+
+    Unit parse_unit(const std::size_t begin, const std::size_t end,
+                    const int line) const {
+        Unit unit{.begin = begin,
+                  .first_line = line,
+                  .parsed_line = line,
+                  .arena = std::make_unique<ArenaAllocator>(
+                      std::clamp<std::size_t>((end - begin) * 8, 256,
+                                              64 * 1024))};
+        try {
+            Tokenizer tokenizer(m_source.substr(begin, end - begin), line);
+            Parser parser(tokenizer, *unit.arena);
+            while (std::optional<StatementNode*> stmt =
+                       parser.parseTopLevel()) {
+                unit.statements.push_back(stmt.value());
+            }
+        } catch (const CompileError& error) {
+            unit.error = error;
+        }
+        return unit;
+    }
+
+    static CompileError relocate(const CompileError& error, const Unit& unit) {
+        if (error.line() < 0 || unit.first_line == unit.parsed_line) {
+            return error;
+        }
+        return CompileError(error.message(),
+                            error.line() + unit.first_line - unit.parsed_line);
+    }
+};
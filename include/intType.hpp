@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/**
+ * The type of a scalar, `assign x: u8 = ...;`. Expressions are evaluated in
+ * 64 bits whatever the types of the variables they read; a variable keeps
+ * the low bits of what is stored to it and reads back sign- or
+ * zero-extended to 64 bits. Operands of a stored value must fit the type,
+ * see type_holds(). A variable without a type is an i64.
+ */
+enum class IntType : std::uint8_t { i64, i32, i16, i8, u32, u16, u8 };
+
+inline constexpr std::array<std::string_view, 7> kIntTypeNames{
+    "i64", "i32", "i16", "i8", "u32", "u16", "u8"};
+
+constexpr std::optional<IntType> parse_int_type(const std::string_view name) {
+    for (std::size_t i = 0; i < kIntTypeNames.size(); i++) {
+        if (kIntTypeNames[i] == name) {
+            return static_cast<IntType>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+constexpr std::string_view type_name(const IntType type) {
+    return kIntTypeNames[static_cast<std::size_t>(type)];
+}
+
+/** bytes a variable of type takes */
+constexpr std::size_t type_width(const IntType type) {
+    switch (type) {
+    case IntType::i8:
+    case IntType::u8:
+        return 1;
+    case IntType::i16:
+    case IntType::u16:
+        return 2;
+    case IntType::i32:
+    case IntType::u32:
+        return 4;
+    default:
+        return 8;
+    }
+}
+
+constexpr bool type_signed(const IntType type) {
+    return type == IntType::i64 || type == IntType::i32 ||
+           type == IntType::i16 || type == IntType::i8;
+}
+
+/** every value of type from is one of type to, so storing one never wraps */
+constexpr bool type_holds(const IntType to, const IntType from) {
+    const std::size_t to_bits = type_width(to) * 8;
+    const std::size_t from_bits = type_width(from) * 8;
+    if (type_signed(to) == type_signed(from)) {
+        return from_bits <= to_bits;
+    }
+    return type_signed(to) && from_bits < to_bits;
+}
+
+/** what a variable of type reads back after value was stored to it */
+constexpr std::int64_t wrap(const std::int64_t value, const IntType type) {
+    const std::size_t bits = type_width(type) * 8;
+    if (bits == 64) {
+        return value;
+    }
+    const std::uint64_t low =
+        static_cast<std::uint64_t>(value) & ((std::uint64_t{1} << bits) - 1);
+    if (type_signed(type) && (low >> (bits - 1)) != 0) {
+        return static_cast<std::int64_t>(low | ~((std::uint64_t{1} << bits) - 1));
+    }
+    return static_cast<std::int64_t>(low);
+}
+
+/**
+ * The literal digits keep their value in a variable of type. Literals are
+ * never negative; i64 takes any literal, which wraps like the arithmetic.
+ */
+constexpr bool literal_fits(const std::string_view digits, const IntType type) {
+    if (type == IntType::i64) {
+        return true;
+    }
+    const std::size_t bits = type_width(type) * 8 - (type_signed(type) ? 1 : 0);
+    const std::uint64_t max = (std::uint64_t{1} << bits) - 1;
+    std::uint64_t value = 0;
+    for (const char digit : digits) {
+        value = value * 10 + static_cast<std::uint64_t>(digit - '0');
+        if (value > max) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,350 @@
+#pragma once
+#include "driver.hpp"
+#include "modules.hpp"
+#include "threadPool.hpp"
+#include "tokenization.hpp"
+#include <exception>
+#include <map>
+
+/**
+ * What <name>.qsi next to a module's object records about its last build:
+ * the key of the source and options it was compiled from, the exports hash
+ * of every module it imported then, and its own exports. On disk it is text:
+ *
+ *     quarks-module 1
+ *     key <hex>
+ *     import <module> <exports hash>
+ *     export <name> <length>
+ */
+struct ModuleRecord {
+    static constexpr std::string_view kMagic = "quarks-module 1";
+
+    std::string key;
+    std::vector<std::pair<std::string, std::string>> imports;
+    std::vector<quarks::Export> exports;
+
+    /** changes exactly when importers of the module must be recompiled */
+    [[nodiscard]] static std::string
+    exports_hash(const std::vector<quarks::Export>& exports) {
+        ContentHash hash;
+        for (const quarks::Export& exported : exports) {
+            hash.update(exported.name).update(std::to_string(exported.length));
+        }
+        return hash.hex();
+    }
+
+    /** nullopt when the record is missing or unreadable */
+    [[nodiscard]] static std::optional<ModuleRecord>
+    read(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        std::string line;
+        if (!std::getline(file, line) || line != kMagic) {
+            return std::nullopt;
+        }
+        ModuleRecord record;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string kind;
+            fields >> kind;
+            if (kind == "key") {
+                fields >> record.key;
+            } else if (kind == "import") {
+                auto& [module, hash] = record.imports.emplace_back();
+                fields >> module >> hash;
+            } else if (kind == "export") {
+                quarks::Export& exported = record.exports.emplace_back();
+                fields >> exported.name >> exported.length;
+            } else {
+                return std::nullopt;
+            }
+            if (!fields) {
+                return std::nullopt;
+            }
+        }
+        return record;
+    }
+
+    /** written to a temporary and renamed, so a record is never torn */
+    void write(const std::filesystem::path& path) const {
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary);
+            file << kMagic << "\nkey " << key << "\n";
+            for (const auto& [module, hash] : imports) {
+                file << "import " << module << " " << hash << "\n";
+            }
+            for (const quarks::Export& exported : exports) {
+                file << "export " << exported.name << " " << exported.length
+                     << "\n";
+            }
+            if (!file.flush()) {
+                throw CompileError("Failed to write " + path.string());
+            }
+        }
+        std::filesystem::rename(temporary, path);
+    }
+};
+
+/** the modules source imports, in order, found without parsing it */
+inline std::vector<Token> scan_imports(std::string source) {
+    std::vector<Token> imports;
+    Tokenizer tokenizer(std::move(source));
+    while (const std::optional<Token> token = tokenizer.next()) {
+        if (token->type != TokenType::import) {
+            continue;
+        }
+        const std::optional<Token> module = tokenizer.next();
+        if (!module.has_value() || module->type != TokenType::identifier) {
+            throw CompileError("Expected module name", token->line);
+        }
+        imports.push_back(module.value());
+    }
+    return imports;
+}
+
+struct ModuleBuildReport {
+    bool ok = false;
+    std::string diagnostics;
+    std::size_t modules = 0;
+    /** modules compiled again; the rest reused their objects */
+    std::size_t rebuilt = 0;
+    bool linked = false;
+    double seconds = 0;
+};
+
+/**
+ * Builds the program at root and every module it imports, directly or not,
+ * into out.executable. A module is the .qs file of its name next to root.
+ * Each one compiles separately to <name>.o in out.with(".modules"), with its
+ * ModuleRecord beside it, and is only compiled again when its source or the
+ * options changed, or when a module it imports now exports something else.
+ * Modules whose imports are built compile concurrently on jobs threads; the
+ * executable is relinked when any object changed. Never throws.
+ */
+inline ModuleBuildReport build_modules(const std::filesystem::path& root,
+                                       const OutputPaths& out,
+                                       const CompileOptions& options,
+                                       const std::size_t jobs) {
+    struct Unit {
+        std::string name;
+        std::filesystem::path source;
+        std::string text;
+        std::string key;
+        std::vector<Token> imports;
+        std::optional<ModuleRecord> record;
+        /** 0 for modules without imports, one more than the deepest import */
+        std::size_t level = 0;
+        std::vector<quarks::Export> exports;
+        std::string exports_hash;
+    };
+
+    ModuleBuildReport report;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        if (options.instrument || options.profile_use) {
+            throw CompileError("Profiles cover whole programs, not modules");
+        }
+        const std::filesystem::path directory = out.with(".modules");
+        std::filesystem::create_directories(directory);
+        const auto artifact = [&](const Unit& unit, const char* extension) {
+            return directory / (unit.name + extension);
+        };
+
+        std::vector<Unit> units;
+        std::map<std::string, std::size_t> index;
+        const auto load = [&](std::string name, std::filesystem::path source) {
+            Unit& unit = units.emplace_back();
+            unit.name = std::move(name);
+            unit.source = std::move(source);
+            unit.text = read_source(unit.source);
+            unit.key = ContentHash()
+                           .update(unit.text)
+                           .update(kCompilerBuild)
+                           .update(options.fingerprint())
+                           .update(units.size() == 1 ? "program" : "module")
+                           .update(options.debug_info
+                                       ? std::filesystem::absolute(unit.source)
+                                             .string()
+                                       : "")
+                           .hex();
+            unit.record = ModuleRecord::read(artifact(unit, ".qsi"));
+            if (unit.record.has_value() && unit.record->key == unit.key) {
+                // the source is unchanged, and so are its imports
+                for (const auto& [module, hash] : unit.record->imports) {
+                    unit.imports.push_back({.type = TokenType::identifier,
+                                            .value = module,
+                                            .line = -1});
+                }
+            } else {
+                try {
+                    unit.imports = scan_imports(unit.text);
+                } catch (const CompileError& error) {
+                    throw CompileError(unit.source.string() + ": " +
+                                       error.what());
+                }
+            }
+            index.emplace(unit.name, units.size() - 1);
+            return units.size() - 1;
+        };
+
+        // depth first from root; the path being walked catches cycles
+        std::vector<std::pair<std::size_t, std::size_t>> path{
+            {load(root.stem().string(), root), 0}};
+        while (!path.empty()) {
+            auto& [current, next] = path.back();
+            if (next == units[current].imports.size()) {
+                for (const Token& module : units[current].imports) {
+                    units[current].level =
+                        std::max(units[current].level,
+                                 units[index.at(module.value.value())].level + 1);
+                }
+                path.pop_back();
+                continue;
+            }
+            const Token module = units[current].imports[next++];
+            const std::string& name = module.value.value();
+            const auto walking = std::find_if(
+                path.begin(), path.end(),
+                [&](const auto& frame) { return units[frame.first].name == name; });
+            if (walking != path.end()) {
+                std::string cycle;
+                for (auto frame = walking; frame != path.end(); ++frame) {
+                    cycle += units[frame->first].name + " -> ";
+                }
+                throw CompileError(units[current].source.string() +
+                                   ": Import cycle: " + cycle + name);
+            }
+            if (index.contains(name)) {
+                continue;
+            }
+            const std::filesystem::path source =
+                root.parent_path() / (name + ".qs");
+            if (!std::filesystem::exists(source)) {
+                throw CompileError(units[current].source.string() + ": " +
+                                   CompileError("Unknown module: " + name,
+                                                module.line)
+                                       .what());
+            }
+            const std::size_t loaded = load(name, source);
+            path.emplace_back(loaded, 0);
+        }
+        report.modules = units.size();
+
+        std::size_t levels = 0;
+        for (const Unit& unit : units) {
+            levels = std::max(levels, unit.level + 1);
+        }
+        std::vector<std::exception_ptr> errors(units.size());
+        std::vector<char> rebuilt(units.size(), false);
+        const auto build = [&](const std::size_t id) {
+            Unit& unit = units[id];
+            const bool program = id == 0;
+            const std::filesystem::path object = artifact(unit, ".o");
+            std::vector<quarks::Interface> interfaces;
+            bool stale = !unit.record.has_value() ||
+                         unit.record->key != unit.key ||
+                         unit.record->imports.size() != unit.imports.size() ||
+                         !std::filesystem::exists(object);
+            for (std::size_t i = 0; i < unit.imports.size(); i++) {
+                const Unit& imported =
+                    units[index.at(unit.imports[i].value.value())];
+                interfaces.push_back(
+                    {.module = imported.name, .exports = imported.exports});
+                stale = stale ||
+                        unit.record->imports[i].second != imported.exports_hash;
+            }
+            if (!stale) {
+                unit.exports = unit.record->exports;
+                unit.exports_hash = ModuleRecord::exports_hash(unit.exports);
+                return;
+            }
+
+            quarks::Options library = library_options(options, {}, unit.source);
+            library.module = program ? "" : unit.name;
+            library.imports = std::move(interfaces);
+            quarks::Compiler compiler;
+            const quarks::Result result = compiler.compile(unit.text, library);
+            if (!result.ok) {
+                throw CompileError(unit.source.string() + ": " +
+                                   result.diagnostics.front().message);
+            }
+            const std::filesystem::path code =
+                artifact(unit, options.backend == Backend::c ? ".c" : ".asm");
+            {
+                std::ofstream file(code, std::ios::binary);
+                file << result.output;
+                if (!file.flush()) {
+                    throw CompileError("Failed to write " + code.string());
+                }
+            }
+            const toolchain::Command command =
+                options.backend == Backend::c
+                    ? toolchain::compile_c(options.c_compiler, code, object,
+                                           true, options.c_optimization,
+                                           options.debug_info)
+                    : toolchain::assemble(code, object, options.debug_info);
+            if (!toolchain::run(command)) {
+                throw CompileError("Command failed: " +
+                                   toolchain::describe(command));
+            }
+
+            unit.exports = result.exports;
+            unit.exports_hash = ModuleRecord::exports_hash(unit.exports);
+            ModuleRecord record{.key = unit.key, .exports = unit.exports};
+            for (const quarks::Interface& interface : library.imports) {
+                record.imports.emplace_back(
+                    interface.module, ModuleRecord::exports_hash(interface.exports));
+            }
+            record.write(artifact(unit, ".qsi"));
+            rebuilt[id] = true;
+        };
+
+        // a level only imports lower ones, which are built by the time it runs
+        ThreadPool pool(jobs);
+        for (std::size_t level = 0; level < levels; level++) {
+            for (std::size_t id = 0; id < units.size(); id++) {
+                if (units[id].level == level) {
+                    pool.submit([&, id] {
+                        try {
+                            build(id);
+                        } catch (...) {
+                            errors[id] = std::current_exception();
+                        }
+                    });
+                }
+            }
+            pool.wait();
+            for (const std::exception_ptr& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+        report.rebuilt = std::count(rebuilt.begin(), rebuilt.end(), true);
+
+        if (report.rebuilt != 0 || !std::filesystem::exists(out.executable)) {
+            std::vector<std::filesystem::path> objects;
+            for (const Unit& unit : units) {
+                objects.push_back(artifact(unit, ".o"));
+            }
+            const toolchain::Command command =
+                options.backend == Backend::c
+                    ? toolchain::link_c(options.c_compiler, objects,
+                                        out.executable)
+                    : toolchain::link(objects, out.executable);
+            if (!toolchain::run(command)) {
+                throw CompileError("Command failed: " +
+                                   toolchain::describe(command));
+            }
+            report.linked = true;
+        }
+        report.ok = true;
+    } catch (const std::exception& error) {
+        report.diagnostics = error.what();
+    }
+    report.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return report;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "parser.hpp"
+#include "quarks.hpp"
+#include <algorithm>
+#include <string_view>
+
+/**
+ * How a generator fits a source into a program built from modules, see
+ * quarks::Options::module. A module compiles to an init function,
+ * qs_<name>_init, that runs its top-level statements the first time it is
+ * called and then stores its top-level declarations, in order, in the
+ * 64-bit words of qs_<name>_exports. `import name;` calls the init
+ * function and declares copies of the exports, as if they were assigned
+ * there.
+ */
+struct ModuleOptions {
+    /** the module being compiled; empty for a program */
+    std::string name;
+    /** the modules the source may import */
+    std::vector<quarks::Interface> imports;
+
+    /** the interface of module; null if it cannot be imported */
+    [[nodiscard]] const quarks::Interface*
+    find(const std::string_view module) const {
+        for (const quarks::Interface& interface : imports) {
+            if (interface.module == module) {
+                return &interface;
+            }
+        }
+        return nullptr;
+    }
+
+    /** find() for the module an import names, which must exist */
+    [[nodiscard]] const quarks::Interface& imported(const Token& module) const {
+        const quarks::Interface* interface = find(module.value.value());
+        if (interface == nullptr) {
+            throw CompileError("Unknown module: " + module.value.value(),
+                               module.line);
+        }
+        return *interface;
+    }
+
+    [[nodiscard]] static std::string init_symbol(const std::string_view module) {
+        return "qs_" + std::string(module) + "_init";
+    }
+
+    [[nodiscard]] static std::string
+    exports_symbol(const std::string_view module) {
+        return "qs_" + std::string(module) + "_exports";
+    }
+
+    /** 64-bit words of the exports */
+    [[nodiscard]] static std::size_t
+    words(const std::vector<quarks::Export>& exports) {
+        std::size_t words = 0;
+        for (const quarks::Export& exported : exports) {
+            words += std::max<std::size_t>(exported.length, 1);
+        }
+        return words;
+    }
+};
+
+/** the top-level declarations of program, which are its exports */
+inline std::vector<quarks::Export> module_exports(const ProgramNode& program) {
+    std::vector<quarks::Export> exports;
+    for (const StatementNode* statement : program.statements) {
+        if (const auto* let = std::get_if<LetStatementNode*>(&statement->var)) {
+            exports.push_back({.name = (*let)->identifier.value.value(),
+                               .length = (*let)->length});
+        }
+    }
+    return exports;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "cGeneration.hpp"
+#include "generation.hpp"
+#include "threadPool.hpp"
+#include <exception>
+
+/**
+ * Generates code for program with the top-level statements split into
+ * contiguous regions, one worker per region.
+ *
+ * A sequential pre-pass walks the top-level statements with declare() and
+ * snapshots the scope state at every region entry; only top-level
+ * declarations change it, so this is cheap. Each worker then generates its
+ * region from that snapshot with region-local labels. The outputs are
+ * concatenated in order with the labels shifted past those of the earlier
+ * regions, so the result is byte-for-byte what generateProgram() produces.
+ * Errors are those of the first failing region in program order.
+ * Debug symbols are named by source position, so regions cannot clash.
+ * isa only applies to generators that vectorize, see Generator::set_isa,
+ * and if_conversion to those that lower branches to cmov.
+ * A module's exports are stored by the generator that ends the program,
+ * which starts from the scope state after the last region.
+ */
+template <typename CodeGenerator>
+std::string generate_parallel(const ProgramNode& program,
+                              const std::size_t jobs,
+                              const std::string& debug_source = {},
+                              const quarks::Isa isa = quarks::Isa::sse2,
+                              const std::size_t if_conversion =
+                                  quarks::kIfConversionCost,
+                              const ModuleOptions& modules = {},
+                              const std::size_t min_region = 4096) {
+    const auto configure = [&](CodeGenerator& generator) {
+        generator.set_debug_source(debug_source);
+        if constexpr (requires { generator.set_isa(isa); }) {
+            generator.set_isa(isa);
+        }
+        if constexpr (requires { generator.set_if_conversion(if_conversion); }) {
+            generator.set_if_conversion(if_conversion);
+        }
+        generator.set_modules(modules);
+    };
+    const std::vector<StatementNode*>& statements = program.statements;
+    const std::size_t region_size = std::max(
+        min_region, statements.size() / (std::max<std::size_t>(jobs, 1) * 4));
+    if (jobs <= 1 || statements.size() <= region_size) {
+        CodeGenerator generator(program);
+        configure(generator);
+        return generator.generateProgram();
+    }
+
+    struct Region {
+        std::size_t begin;
+        std::size_t end;
+        typename CodeGenerator::Region entry;
+        std::string output;
+        int labels = 0;
+        std::exception_ptr error;
+    };
+
+    std::vector<Region> regions;
+    CodeGenerator tracker;
+    configure(tracker);
+    for (std::size_t begin = 0, end = 0; begin < statements.size();
+         begin = end) {
+        end = std::min(begin + region_size, statements.size());
+        // statements the generator may pack together stay in one region
+        if constexpr (requires { CodeGenerator::continues_run(nullptr, nullptr); }) {
+            while (end < statements.size() &&
+                   CodeGenerator::continues_run(statements[end - 1],
+                                                statements[end])) {
+                end++;
+            }
+        }
+        regions.push_back(
+            {.begin = begin, .end = end, .entry = tracker.region()});
+        for (std::size_t i = begin; i < end; i++) {
+            tracker.declare(statements[i]);
+        }
+    }
+
+    ThreadPool pool(std::min(jobs, regions.size()));
+    for (Region& region : regions) {
+        pool.submit([&statements, &region, &configure] {
+            try {
+                CodeGenerator generator;
+                configure(generator);
+                generator.enter_region(std::move(region.entry));
+                for (std::size_t i = region.begin; i < region.end; i++) {
+                    generator.generateStatement(statements[i]);
+                }
+                if constexpr (requires { generator.flush(); }) {
+                    generator.flush();
+                }
+                region.output = generator.take_output();
+                if constexpr (requires { generator.labels_used(); }) {
+                    region.labels = generator.labels_used();
+                }
+            } catch (...) {
+                region.error = std::current_exception();
+            }
+        });
+    }
+    pool.wait();
+
+    int base = 0;
+    for (Region& region : regions) {
+        if (region.error) {
+            std::rethrow_exception(region.error);
+        }
+        if constexpr (requires { CodeGenerator::relocate_labels("", 0); }) {
+            if (base > 0) {
+                pool.submit([&region, base] {
+                    region.output =
+                        CodeGenerator::relocate_labels(region.output, base);
+                });
+            }
+        }
+        base += region.labels;
+    }
+    pool.wait();
+
+    CodeGenerator generator;
+    configure(generator);
+    generator.begin_program();
+    std::string output = generator.take_output();
+    for (const Region& region : regions) {
+        output += region.output;
+    }
+    generator.enter_region(tracker.region());
+    generator.end_program();
+    output += generator.take_output();
+    return output;
+}
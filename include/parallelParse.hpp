@@ -0,0 +1,199 @@
+#pragma once
+#include "arenaAllocator.hpp"
+#include "parser.hpp"
+#include "threadPool.hpp"
+#include <exception>
+#include <string_view>
+
+/** a run of whole top-level statements and where it starts */
+struct SourceChunk {
+    std::string_view text;
+    int first_line = 0;
+    std::size_t first_column = 0;
+};
+
+/**
+ * Calls on_start(offset, line) at the first token of every top-level
+ * statement but the first, scanning source from begin (a statement start,
+ * on the given line). A statement ends at a `;` or a `}` at brace depth 0
+ * that is not followed by `elif`/`else`. The scan skips comments and counts
+ * lines the same way the tokenizer does; input the tokenizer would reject
+ * is passed through. Stops early once on_start returns false.
+ */
+template <typename OnStart>
+void scan_top_level(const std::string_view source, const std::size_t begin,
+                    int line, OnStart&& on_start) {
+    int depth = 0;
+    bool at_boundary = false;
+
+    std::size_t i = begin;
+    while (i < source.size()) {
+        const char c = source[i];
+        if (c == '\n') {
+            line++;
+            i++;
+            continue;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+            continue;
+        }
+        if (c == '-' && i + 1 < source.size() && source[i + 1] == '-') {
+            while (i < source.size() && source[i] != '\n') {
+                i++;
+            }
+            continue;
+        }
+        if (c == '-' && i + 1 < source.size() && source[i + 1] == '*') {
+            // the tokenizer's block comment: the marker plus two characters
+            i = std::min(i + 4, source.size());
+            continue;
+        }
+
+        // c starts a token
+        std::size_t end = i + 1;
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            while (end < source.size() &&
+                   std::isalnum(static_cast<unsigned char>(source[end]))) {
+                end++;
+            }
+        }
+        const std::string_view token = source.substr(i, end - i);
+
+        if (at_boundary && depth == 0 && token != "elif" && token != "else" &&
+            !on_start(i, line)) {
+            return;
+        }
+
+        at_boundary = false;
+        if (c == '{') {
+            depth++;
+        } else if (c == '}') {
+            depth--;
+            at_boundary = depth == 0;
+        } else if (c == ';') {
+            at_boundary = depth == 0;
+        }
+        i = end;
+    }
+}
+
+/**
+ * Cuts source into chunks of at least target_bytes, each made of whole
+ * top-level statements, so every chunk parses on its own and knows its
+ * first line.
+ */
+inline std::vector<SourceChunk>
+split_top_level(const std::string_view source, const std::size_t target_bytes) {
+    std::vector<SourceChunk> chunks;
+    std::size_t chunk_start = 0;
+    int chunk_line = 0;
+    std::size_t chunk_column = 0;
+    scan_top_level(source, 0, 0, [&](const std::size_t start, const int line) {
+        if (start - chunk_start >= target_bytes) {
+            chunks.push_back(
+                {.text = source.substr(chunk_start, start - chunk_start),
+                 .first_line = chunk_line,
+                 .first_column = chunk_column});
+            const std::size_t newline = source.rfind('\n', start - 1);
+            chunk_start = start;
+            chunk_line = line;
+            chunk_column =
+                newline == std::string_view::npos ? start : start - newline - 1;
+        }
+        return true;
+    });
+    if (chunk_start < source.size() || chunks.empty()) {
+        chunks.push_back({.text = source.substr(chunk_start),
+                          .first_line = chunk_line,
+                          .first_column = chunk_column});
+    }
+    return chunks;
+}
+
+/** a program parsed in pieces; the AST lives in the per-chunk arenas */
+struct ParallelParse {
+    ProgramNode program;
+    std::vector<std::unique_ptr<ArenaAllocator>> arenas;
+    /** summed over the chunks, which are hash-consed separately */
+    HashCons::Stats hash_cons;
+    std::size_t tokens = 0;
+
+    [[nodiscard]] std::size_t arena_bytes() const {
+        std::size_t bytes = 0;
+        for (const std::unique_ptr<ArenaAllocator>& arena : arenas) {
+            bytes += arena->used();
+        }
+        return bytes;
+    }
+};
+
+/**
+ * Parses the top-level chunks of source concurrently, each into its own
+ * arena, and stitches the statements back together in source order. Sources
+ * too small to split are parsed on the calling thread. Errors are the same
+ * as a sequential parse: the first failing chunk in source order wins, and
+ * its line numbers are absolute. With hash_cons, each chunk shares
+ * identical expression subtrees within itself.
+ */
+inline ParallelParse
+parse_parallel(const std::string_view source, const std::size_t jobs,
+               const std::size_t min_chunk_bytes = 1 << 20,
+               const bool hash_cons = false) {
+    // a few chunks per thread so one slow chunk does not idle the others
+    const std::size_t target = std::max(
+        min_chunk_bytes, source.size() / (std::max<std::size_t>(jobs, 1) * 4));
+    const std::vector<SourceChunk> chunks = split_top_level(source, target);
+
+    std::vector<std::vector<StatementNode*>> statements(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size());
+    std::vector<std::size_t> tokens(chunks.size());
+    std::vector<HashCons> tables(hash_cons ? chunks.size() : 0);
+    ParallelParse result;
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        result.arenas.push_back(std::make_unique<ArenaAllocator>(std::clamp(
+            chunks[i].text.size(), std::size_t{64} << 10, std::size_t{16} << 20)));
+    }
+
+    const auto parse_chunk = [&](const std::size_t i) {
+        try {
+            Tokenizer tokenizer(std::string(chunks[i].text),
+                                chunks[i].first_line, chunks[i].first_column);
+            Parser parser(tokenizer, *result.arenas[i]);
+            if (hash_cons) {
+                parser.set_hash_cons(tables[i]);
+            }
+            while (std::optional<StatementNode*> stmt =
+                       parser.parseTopLevel()) {
+                statements[i].push_back(stmt.value());
+            }
+            tokens[i] = parser.tokens_consumed();
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    if (chunks.size() == 1) {
+        parse_chunk(0);
+    } else {
+        ThreadPool pool(std::min(jobs, chunks.size()));
+        for (std::size_t i = 0; i < chunks.size(); i++) {
+            pool.submit([&, i] { parse_chunk(i); });
+        }
+        pool.wait();
+    }
+
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+        result.program.statements.insert(result.program.statements.end(),
+                                         statements[i].begin(),
+                                         statements[i].end());
+        result.tokens += tokens[i];
+    }
+    for (const HashCons& table : tables) {
+        result.hash_cons += table.stats();
+    }
+    return result;
+}
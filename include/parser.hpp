@@ -2,7 +2,11 @@
 // Created by roy varghese on 27-10-2025.
 //
 #pragma once
+#include "hashCons.hpp"
+#include "intType.hpp"
 #include "tokenization.hpp"
+#include <cstdint>
+#include <string_view>
 
 struct ExpressionNode;
 
@@ -10,6 +14,18 @@ struct TermIntLiteralNode {
     Token int_literals;
 };
 
+/**
+ * The value of literal digits, which are decimal even with leading zeros;
+ * literals too large for 64 bits wrap like the arithmetic.
+ */
+constexpr std::uint64_t literal_value(const std::string_view digits) {
+    std::uint64_t value = 0;
+    for (const char digit : digits) {
+        value = value * 10 + static_cast<std::uint64_t>(digit - '0');
+    }
+    return value;
+}
+
 struct TermIdentifierNode {
     Token identifier;
 };
@@ -18,6 +34,12 @@ struct TermParenthesisNode {
     ExpressionNode* expression;
 };
 
+/** `name[index]`, one element of an array */
+struct TermIndexNode {
+    Token identifier;
+    ExpressionNode* index;
+};
+
 struct BinaryExpressionAddition {
     ExpressionNode* lhs;
     ExpressionNode* rhs;
@@ -44,8 +66,16 @@ struct BinaryExpressionNode {
         ops;
 };
 
+/** lhs and rhs of any binary operator */
+inline std::pair<ExpressionNode*, ExpressionNode*>
+operands(const BinaryExpressionNode* node) {
+    return std::visit(
+        [](const auto* op) { return std::pair{op->lhs, op->rhs}; }, node->ops);
+}
+
 struct TermNode {
-    std::variant<TermIdentifierNode*, TermIntLiteralNode*, TermParenthesisNode*>
+    std::variant<TermIdentifierNode*, TermIntLiteralNode*, TermParenthesisNode*,
+                 TermIndexNode*>
         vars;
 };
 
@@ -54,6 +84,58 @@ struct ExpressionNode {
     std::variant<TermNode*, BinaryExpressionNode*> var;
 };
 
+/**
+ * Throws when expression, stored to a variable of type, has an operand the
+ * variable cannot hold every value of: a literal too large, or a scalar or
+ * array element (i64) of a wider type. type_of gives the type of a declared
+ * scalar and nullopt for anything else, which generation reports. What the
+ * arithmetic computes from operands that fit still wraps silently. Indices
+ * are not stored, so they may have any type.
+ */
+template <typename TypeOf>
+void check_store(const ExpressionNode* expression, const IntType type,
+                 const TypeOf& type_of) {
+    if (type == IntType::i64) {
+        return;
+    }
+    if (const auto* binary =
+            std::get_if<BinaryExpressionNode*>(&expression->var)) {
+        const auto [lhs, rhs] = operands(*binary);
+        check_store(lhs, type, type_of);
+        check_store(rhs, type, type_of);
+        return;
+    }
+    const TermNode* term = std::get<TermNode*>(expression->var);
+    if (const auto* parenthesis =
+            std::get_if<TermParenthesisNode*>(&term->vars)) {
+        check_store((*parenthesis)->expression, type, type_of);
+        return;
+    }
+    if (const auto* literal = std::get_if<TermIntLiteralNode*>(&term->vars)) {
+        if (!literal_fits((*literal)->int_literals.value.value(), type)) {
+            throw CompileError(
+                "Literal " + (*literal)->int_literals.value.value() +
+                    " does not fit " + std::string(type_name(type)),
+                (*literal)->int_literals.line);
+        }
+        return;
+    }
+    const auto* element = std::get_if<TermIndexNode*>(&term->vars);
+    const Token& identifier =
+        element != nullptr
+            ? (*element)->identifier
+            : std::get<TermIdentifierNode*>(term->vars)->identifier;
+    const std::optional<IntType> from =
+        element != nullptr ? std::optional(IntType::i64) : type_of(identifier);
+    if (from.has_value() && !type_holds(type, from.value())) {
+        throw CompileError("Type " + std::string(type_name(from.value())) +
+                               " does not fit " +
+                               std::string(type_name(type)) + ": " +
+                               identifier.value.value(),
+                           identifier.line);
+    }
+}
+
 struct StatementExitNode {
     ExpressionNode* expr;
 };
@@ -61,12 +143,24 @@ struct StatementExitNode {
 struct LetStatementNode {
     Token identifier;
     ExpressionNode* expression{};
+    /** elements of `assign name[length] = ...`; 0 declares a scalar */
+    std::size_t length = 0;
+    /** from `assign name: type = ...` */
+    IntType type = IntType::i64;
+};
+
+/** where a statement or scope starts in the source, for debug info */
+struct SourcePosition {
+    int line = -1;
+    int column = -1;
 };
 
 struct StatementNode;
 
 struct nodeScope {
     std::vector<StatementNode*> statements;
+    /** of the opening `{` */
+    SourcePosition position;
 };
 
 struct nodeIfPredicate;
@@ -75,6 +169,7 @@ struct nodeIfPredicateElif {
     ExpressionNode* expression{};
     nodeScope* scope{};
     std::optional<nodeIfPredicate*> ifPredicate;
+    SourcePosition position;
 };
 
 struct nodeIfPredicateElse {
@@ -94,12 +189,21 @@ struct nodeIfStatement {
 struct nodeStatementAssign {
     Token identifier;
     ExpressionNode* expression{};
+    /** set for `name[index] = ...`, which stores one array element */
+    ExpressionNode* index = nullptr;
+};
+
+/** `import name;`, declares copies of the exports of module name */
+struct ImportStatementNode {
+    Token module;
 };
 
 struct StatementNode {
     std::variant<
         StatementExitNode*, LetStatementNode*,
-        nodeScope*, nodeIfStatement*, nodeStatementAssign*>  var;
+        nodeScope*, nodeIfStatement*, nodeStatementAssign*,
+        ImportStatementNode*>  var;
+    SourcePosition position;
 };
 
 struct ProgramNode {
@@ -110,300 +214,603 @@ struct intLiteral {};
 
 class Parser {
   public:
+    /** pulls the next batch of tokens into the buffer; false at the end */
+    using TokenFeed = std::function<bool(std::vector<Token>&)>;
+
     inline explicit Parser(std::vector<Token> tokens)
-        : m_tokens(std::move(tokens)), m_allocator(1024 * 1024 * 4) {}
+        : m_tokens(std::move(tokens)), m_owned_allocator(std::in_place,
+                                                         1024 * 1024 * 4),
+          m_allocator(&m_owned_allocator.value()) {}
+
+    /** allocates the AST in a caller-owned arena that outlives the parser */
+    inline Parser(std::vector<Token> tokens, ArenaAllocator& allocator)
+        : m_tokens(std::move(tokens)), m_allocator(&allocator) {}
+
+    /**
+     * Streaming parser: tokens arrive in batches from feed and consumed ones
+     * are dropped, so only a small window of the token stream is resident.
+     */
+    inline Parser(TokenFeed feed, ArenaAllocator& allocator)
+        : m_feed(std::move(feed)), m_allocator(&allocator) {}
+
+    /**
+     * Fused front end: tokens are pulled from the tokenizer's lookahead
+     * window as the parser needs them and no token vector is built.
+     */
+    inline Parser(Tokenizer& tokenizer, ArenaAllocator& allocator)
+        : m_tokenizer(&tokenizer), m_allocator(&allocator) {}
+
+    /** nodes parsed from now on go into allocator */
+    void set_allocator(ArenaAllocator& allocator) {
+        m_allocator = &allocator;
+        if (m_hash_cons != nullptr) {
+            m_hash_cons->clear();
+        }
+    }
 
-    static void error_expected(const std::string& str, const int line) {
-        std::cerr << str << " at line " << line << std::endl;
-        exit(EXIT_FAILURE);
+    /**
+     * Shares structurally identical expression subtrees through table,
+     * which must be empty or hold nodes of the current allocator.
+     */
+    void set_hash_cons(HashCons& table) { m_hash_cons = &table; }
+
+    [[noreturn]] static void error_expected(const std::string& str,
+                                            const int line) {
+        throw CompileError(str, line);
     }
 
+    /** an integer literal or identifier; parentheses are parseExpression's */
     std::optional<TermNode*> parseTerm() {
 
         if (peek().has_value() &&
-            peek().value().type == TokenType::intLiteral) {
-            auto* int_literal = m_allocator.alloc<TermIntLiteralNode>();
-            int_literal->int_literals = eat();
-            auto* node = m_allocator.alloc<TermNode>();
-            node->vars = int_literal;
-            return node;
-        } else if (peek().has_value() &&
-                   peek().value().type == TokenType::identifier) {
-            auto* identifier = m_allocator.alloc<TermIdentifierNode>();
-            identifier->identifier = eat();
-            auto* node = m_allocator.alloc<TermNode>();
-            node->vars = identifier;
-            return node;
-        } else if (peek().has_value() &&
-                   peek().value().type == TokenType::openParentheses) {
-            eat();
-            std::optional<ExpressionNode*> expr = parseExpression();
-            if (!expr.has_value()) {
-                error_expected("Expected expression",peek().value().line);
-            }
-            if (!peek().has_value() &&
-                peek().value().type == TokenType::closeParentheses) {
-                error_expected("Expected close parenthesis",peek().value().line);
-            }
-            eat();
-            auto* nodeTermParenthesis =
-                m_allocator.alloc<TermParenthesisNode>();
-            nodeTermParenthesis->expression = expr.value();
-            auto* node = m_allocator.alloc<TermNode>();
-            node->vars = nodeTermParenthesis;
-            return node;
-        } else {
-            return std::nullopt;
+            (peek().value().type == TokenType::intLiteral ||
+             peek().value().type == TokenType::identifier)) {
+            return term(eat());
         }
+        return std::nullopt;
     }
 
-    std::optional<ExpressionNode*>
-    parseExpression(const int minPrecedence = 0) {
-
-        std::optional<TermNode*> termLhs = parseTerm();
-        if (!termLhs.has_value()) {
-            return std::nullopt;
-        }
-        auto* expressionLhs = m_allocator.alloc<ExpressionNode>();
-        expressionLhs->var = termLhs.value();
+    /**
+     * Operator precedence parsing with explicit operand and operator stacks
+     * (shunting-yard), so nesting depth is bounded by memory rather than the
+     * C++ stack. Builds the same left-associative trees as precedence
+     * climbing.
+     */
+    std::optional<ExpressionNode*> parseExpression() {
+
+        std::vector<ExpressionNode*> operands;
+        // pending binary operators, and open parentheses and brackets as
+        // markers; a bracket marker carries the name of the indexed array
+        std::vector<Token> operators;
+        std::vector<TokenType> groups;
+        bool expect_operand = true;
 
         while (true) {
-            std::optional<Token> currentToken = peek();
-            std::optional<int> precedence;
-            if (currentToken.has_value()) {
-                precedence = isBinaryOperator(currentToken.value().type);
-                if (!precedence.has_value() || precedence < minPrecedence) {
-                    break;
+            if (expect_operand) {
+                if (peek().has_value() &&
+                    peek().value().type == TokenType::identifier &&
+                    peek(1).has_value() &&
+                    peek(1).value().type == TokenType::open_bracket) {
+                    Token array = eat();
+                    eat();
+                    array.type = TokenType::open_bracket;
+                    operators.push_back(std::move(array));
+                    groups.push_back(TokenType::open_bracket);
+                } else if (std::optional<ExpressionNode*> operand =
+                               parseOperand()) {
+                    operands.push_back(operand.value());
+                    expect_operand = false;
+                } else if (std::optional<Token> open =
+                               try_consume(TokenType::openParentheses)) {
+                    operators.push_back(open.value());
+                    groups.push_back(TokenType::openParentheses);
+                } else if (operators.empty()) {
+                    return std::nullopt;
+                } else if (operators.back().type ==
+                               TokenType::openParentheses ||
+                           operators.back().type == TokenType::open_bracket) {
+                    error_expected("Expected expression", current_line());
+                } else {
+                    error_expected("Unable to parse expression",
+                                   operators.back().line);
                 }
+                continue;
+            }
+
+            const std::optional<Token> current = peek();
+            if (!current.has_value()) {
+                break;
+            }
+            if (const std::optional<int> precedence =
+                    isBinaryOperator(current.value().type)) {
+                while (!operators.empty() &&
+                       isBinaryOperator(operators.back().type) >= precedence) {
+                    reduce(operands, operators);
+                }
+                operators.push_back(eat());
+                expect_operand = true;
+            } else if (current.value().type == TokenType::closeParentheses &&
+                       !groups.empty() &&
+                       groups.back() == TokenType::openParentheses) {
+                eat();
+                while (operators.back().type != TokenType::openParentheses) {
+                    reduce(operands, operators);
+                }
+                operators.pop_back();
+                groups.pop_back();
+                operands.back() = intern(
+                    TokenType::openParentheses, {}, operands.back(), nullptr,
+                    sizeof(TermParenthesisNode), [&] {
+                        return m_allocator->emplace<TermParenthesisNode>(
+                            operands.back());
+                    });
+            } else if (current.value().type == TokenType::close_bracket &&
+                       !groups.empty() &&
+                       groups.back() == TokenType::open_bracket) {
+                eat();
+                while (operators.back().type != TokenType::open_bracket) {
+                    reduce(operands, operators);
+                }
+                Token array = std::move(operators.back());
+                operators.pop_back();
+                groups.pop_back();
+                array.type = TokenType::identifier;
+                operands.back() = intern(
+                    TokenType::open_bracket, array.value.value(),
+                    operands.back(), nullptr, sizeof(TermIndexNode), [&] {
+                        return m_allocator->emplace<TermIndexNode>(
+                            array, operands.back());
+                    });
             } else {
                 break;
             }
-            Token ops = eat();
-            int currentPrecedence = precedence.value() + 1;
-            auto expressionRhs = parseExpression(currentPrecedence);
-            if (!expressionRhs.has_value()) {
-                error_expected("Unable to parse expression",currentToken.value().line);
+        }
+
+        if (!groups.empty()) {
+            error_expected(groups.back() == TokenType::openParentheses
+                               ? "Expected close parenthesis"
+                               : "Expected `]`",
+                           current_line());
+        }
+        while (!operators.empty()) {
+            reduce(operands, operators);
+        }
+        return operands.back();
+    }
+
+    /**
+     * Parses one statement. Nested scopes and if/elif/else chains are kept
+     * on an explicit stack of open scopes instead of recursing, so the
+     * nesting depth and the length of elif chains are unbounded.
+     */
+    std::optional<StatementNode*> parseStatement() {
+
+        std::vector<OpenScope> open;
+        while (true) {
+            std::optional<StatementNode*> stmt = parseSimpleStatement();
+
+            if (!stmt.has_value()) {
+                if (const std::optional<Token> curly =
+                        try_consume(TokenType::open_curly)) {
+                    auto* scope = m_allocator->emplace<nodeScope>();
+                    scope->position = position(curly.value());
+                    open.push_back({.scope = scope,
+                                    .owner = OpenScope::Owner::block,
+                                    .position = scope->position});
+                    continue;
+                }
+                if (const std::optional<Token> if_ = try_consume(TokenType::if_)) {
+                    auto* statement_if = m_allocator->emplace<nodeIfStatement>();
+                    try_consume(TokenType::openParentheses, "Expected `(`",
+                                current_line());
+                    if (auto expr = parseExpression()) {
+                        statement_if->expression = expr.value();
+                    } else {
+                        error_expected("Invalid Expression", current_line());
+                    }
+                    try_consume(TokenType::closeParentheses, "Expected `)`",
+                                current_line());
+                    const std::optional<Token> curly =
+                        try_consume(TokenType::open_curly);
+                    if (!curly.has_value()) {
+                        error_expected("Invalid scope", current_line());
+                    }
+                    statement_if->scope = m_allocator->emplace<nodeScope>();
+                    statement_if->scope->position = position(curly.value());
+                    open.push_back({.scope = statement_if->scope,
+                                    .owner = OpenScope::Owner::if_chain,
+                                    .statement_if = statement_if,
+                                    .next_predicate =
+                                        &statement_if->ifPredicate,
+                                    .position = position(if_.value())});
+                    continue;
+                }
+                if (open.empty()) {
+                    return std::nullopt;
+                }
+
+                // nothing else starts here: the innermost scope must end
+                try_consume(TokenType::close_curly, "Expected `}`",
+                            current_line());
+                const OpenScope done = open.back();
+                open.pop_back();
+                if (done.owner == OpenScope::Owner::block) {
+                    stmt = m_allocator->emplace<StatementNode>(done.scope,
+                                                               done.position);
+                } else if (done.next_predicate == nullptr ||
+                           !parse_if_predicate(done, open)) {
+                    stmt = m_allocator->emplace<StatementNode>(
+                        done.statement_if, done.position);
+                }
             }
 
-            auto* expression = m_allocator.alloc<BinaryExpressionNode>();
-            auto* expressionLhs2 = m_allocator.alloc<ExpressionNode>();
-            if (ops.type == TokenType::addition) {
-                auto* add = m_allocator.alloc<BinaryExpressionAddition>();
-                expressionLhs2->var = expressionLhs->var;
-                add->lhs = expressionLhs2;
-                add->rhs = expressionRhs.value();
-                expression->ops = add;
-            } else if (ops.type == TokenType::multiplication) {
-                auto* mul = m_allocator.alloc<BinaryExpressionMultiplication>();
-                expressionLhs2->var = expressionLhs->var;
-                mul->lhs = expressionLhs2;
-                mul->rhs = expressionRhs.value();
-                expression->ops = mul;
-            } else if (ops.type == TokenType::division) {
-                auto* div = m_allocator.alloc<BinaryExpressionDivision>();
-                expressionLhs2->var = expressionLhs->var;
-                div->lhs = expressionLhs2;
-                div->rhs = expressionRhs.value();
-                expression->ops = div;
-            } else if (ops.type == TokenType::substraction) {
-                auto* sub = m_allocator.alloc<BinaryExpressionSubtraction>();
-                expressionLhs2->var = expressionLhs->var;
-                sub->lhs = expressionLhs2;
-                sub->rhs = expressionRhs.value();
-                expression->ops = sub;
-            } else {
-                assert(false); // unreachable
+            if (stmt.has_value()) {
+                if (open.empty()) {
+                    return stmt;
+                }
+                open.back().scope->statements.push_back(stmt.value());
             }
-            expressionLhs->var = expression;
         }
-        return expressionLhs;
     }
 
-    std::optional<nodeScope*> parse_scope() {
-
-        if (!try_consume(TokenType::open_curly).has_value()) {
+    /** the next top-level statement, or nullopt at the end of the input */
+    std::optional<StatementNode*> parseTopLevel() {
+        if (!peek().has_value()) {
             return std::nullopt;
         }
-        auto scope = m_allocator.alloc<nodeScope>();
-        while (auto stmt = parseStatement()) {
-            scope->statements.push_back(stmt.value());
+        if (std::optional<StatementNode*> stmt = parseStatement()) {
+            return stmt;
         }
-
-        try_consume(TokenType::close_curly, "Expected `}`",peek().value().line);
-        return scope;
+        error_expected("Invalid statement", current_line());
     }
 
-    std::optional<nodeIfPredicate*> parse_if_predicate() {
-        if (try_consume(TokenType::elif)) {
-            try_consume(TokenType::openParentheses, "Expected `(`",peek().value().line);
-            const auto elif = m_allocator.alloc<nodeIfPredicateElif>();
-            if (const auto expression = parseExpression()) {
-                elif->expression = expression.value();
-            } else {
-                error_expected("Expected Expression",peek().value().line);
-            }
-            try_consume(TokenType::closeParentheses, "Expected `)`",peek().value().line);
-            if (const auto scope = parse_scope()) {
-                elif->scope = scope.value();
-            } else {
-                error_expected("Expected Scope",peek().value().line);
-            }
+    /** tokens consumed so far */
+    [[nodiscard]] std::size_t tokens_consumed() const { return m_consumed; }
 
-            elif->ifPredicate = parse_if_predicate();
-            auto predicate = m_allocator.emplace<nodeIfPredicate>(elif);
-            return predicate;
+    std::optional<ProgramNode> parseProgram() {
+        ProgramNode program;
+        while (std::optional<StatementNode*> stmt = parseTopLevel()) {
+            program.statements.push_back(stmt.value());
         }
+        return program;
+    }
 
-        if (try_consume(TokenType::else_)) {
-            auto else_ = m_allocator.alloc<nodeIfPredicateElse>();
-            if (const auto scope = parse_scope()) {
-                else_->scope = scope.value();
-            } else {
-                error_expected("Expected Scope",peek().value().line);
-            }
-            auto predicate = m_allocator.emplace<nodeIfPredicate>(else_);
-            return predicate;
-        }
-        return std::nullopt;
+  private:
+    /** a scope whose closing `}` has not been reached yet */
+    struct OpenScope {
+        enum class Owner { block, if_chain };
+
+        nodeScope* scope;
+        Owner owner;
+        nodeIfStatement* statement_if = nullptr;
+        /** where the next elif/else attaches; null once else is open */
+        std::optional<nodeIfPredicate*>* next_predicate = nullptr;
+        /** of the statement the scope closes */
+        SourcePosition position;
+    };
+
+    static SourcePosition position(const Token& token) {
+        return {.line = token.line, .column = token.column};
     }
 
-    std::optional<StatementNode*> parseStatement() {
+    /** exit, declaration, assignment or import: statements without a scope */
+    std::optional<StatementNode*> parseSimpleStatement() {
+
+        if (const std::optional<Token> import = try_consume(TokenType::import)) {
+            auto* statement_import = m_allocator->emplace<ImportStatementNode>();
+            statement_import->module = try_consume(
+                TokenType::identifier, "Expected module name", current_line());
+            try_consume(TokenType::semicolon, "Expected `;`", current_line());
+            return m_allocator->emplace<StatementNode>(statement_import,
+                                                       position(import.value()));
+        }
 
-        // if (peek().has_value() ) {
-        //     std::cout << peek().value().value.value() << std::endl;
-        // }
         if (peek().has_value() && peek().value().type == TokenType::exit && peek(1).has_value() &&
             peek(1).value().type == TokenType::openParentheses) {
-            eat();
+            const Token exit = eat();
             eat();
 
-            auto* exitNode = m_allocator.alloc<StatementExitNode>();
+            auto* exitNode = m_allocator->emplace<StatementExitNode>();
             if (const std::optional<ExpressionNode*> node_expression =
                     parseExpression()) {
                 exitNode->expr = node_expression.value();
             } else {
-                error_expected("Expected Scope",peek().value().line);
+                error_expected("Expected Scope",current_line());
             }
 
             if (peek().has_value() &&
                 peek().value().type == TokenType::closeParentheses) {
                 eat();
             } else {
-                error_expected("Expected Scope",peek().value().line);
+                error_expected("Expected Scope",current_line());
             }
 
             if (peek().has_value() &&
                 peek().value().type == TokenType::semicolon) {
                 eat();
             } else {
-                error_expected("Expected `;`",peek().value().line);
+                error_expected("Expected `;`",current_line());
             }
-            auto* statement = m_allocator.alloc<StatementNode>();
+            auto* statement = m_allocator->emplace<StatementNode>();
             statement->var = exitNode;
+            statement->position = position(exit);
             return statement;
         }
 
         if (peek().has_value() && peek().value().type == TokenType::assign &&
             peek(1).has_value() &&
             peek(1).value().type == TokenType::identifier &&
-            peek(2).has_value() && peek(2).value().type == TokenType::equals) {
+            peek(2).has_value() &&
+            (peek(2).value().type == TokenType::equals ||
+             peek(2).value().type == TokenType::open_bracket ||
+             peek(2).value().type == TokenType::colon)) {
             // assign(variable declaration) since we don't need it.
-            eat();
+            const Token assign = eat();
             // identifier we eat
-            auto* statement_let = m_allocator.alloc<LetStatementNode>();
+            auto* statement_let = m_allocator->emplace<LetStatementNode>();
             statement_let->identifier = eat();
-            eat();
+            if (try_consume(TokenType::open_bracket)) {
+                statement_let->length = array_length(try_consume(
+                    TokenType::intLiteral, "Expected array length",
+                    current_line()));
+                try_consume(TokenType::close_bracket, "Expected `]`",
+                            current_line());
+            }
+            if (try_consume(TokenType::colon)) {
+                statement_let->type = int_type(try_consume(
+                    TokenType::identifier, "Expected type", current_line()));
+                if (statement_let->length != 0 &&
+                    statement_let->type != IntType::i64) {
+                    error_expected("Array elements are i64",
+                                   statement_let->identifier.line);
+                }
+            }
+            try_consume(TokenType::equals, "Expected `=`", current_line());
             if (std::optional<ExpressionNode*> node_expression =
                     parseExpression()) {
                 statement_let->expression = node_expression.value();
             } else {
-                error_expected("Invalid expression",peek().value().line);
+                error_expected("Invalid expression",current_line());
             }
 
             if (peek().has_value() &&
                 peek().value().type == TokenType::semicolon) {
                 eat();
             } else {
-                error_expected("Expected `;`",peek().value().line);
+                error_expected("Expected `;`",current_line());
             }
 
-            auto* statement = m_allocator.alloc<StatementNode>();
+            auto* statement = m_allocator->emplace<StatementNode>();
             statement->var = statement_let;
+            statement->position = position(assign);
             return statement;
         }
 
         if (peek().has_value() &&
             peek().value().type == TokenType::identifier &&
-            peek(1).has_value() && peek(1).value().type == TokenType::equals) {
-            auto* assign = m_allocator.alloc<nodeStatementAssign>();
+            peek(1).has_value() &&
+            (peek(1).value().type == TokenType::equals ||
+             peek(1).value().type == TokenType::open_bracket)) {
+            auto* assign = m_allocator->emplace<nodeStatementAssign>();
             assign->identifier = eat();
-            eat();
+            if (try_consume(TokenType::open_bracket)) {
+                if (const auto index = parseExpression()) {
+                    assign->index = index.value();
+                } else {
+                    error_expected("Expected Expression", current_line());
+                }
+                try_consume(TokenType::close_bracket, "Expected `]`",
+                            current_line());
+            }
+            try_consume(TokenType::equals, "Expected `=`", current_line());
             if (const auto expression = parseExpression()) {
                 assign->expression = expression.value();
             } else {
-                error_expected("Expected Expression",peek().value().line);
+                error_expected("Expected Expression",current_line());
             }
 
-            try_consume(TokenType::semicolon, "Expected semicolon",peek().value().line);
-            auto stmt = m_allocator.emplace<StatementNode>(assign);
+            try_consume(TokenType::semicolon, "Expected semicolon",current_line());
+            auto stmt = m_allocator->emplace<StatementNode>(
+                assign, position(assign->identifier));
             return stmt;
         }
 
-        if (peek().has_value() &&
-            peek().value().type == TokenType::open_curly) {
-            if (auto scope = parse_scope()) {
-                auto stmt = m_allocator.alloc<StatementNode>();
-                stmt->var = scope.value();
-                return stmt;
+        return {};
+    }
+
+    /**
+     * After the scope of an if or elif closed: opens the scope of a
+     * following elif/else and links it into the chain. False when the chain
+     * ends here.
+     */
+    bool parse_if_predicate(const OpenScope& done,
+                            std::vector<OpenScope>& open) {
+        if (const std::optional<Token> elif_ = try_consume(TokenType::elif)) {
+            try_consume(TokenType::openParentheses, "Expected `(`",current_line());
+            const auto elif = m_allocator->emplace<nodeIfPredicateElif>();
+            elif->position = position(elif_.value());
+            if (const auto expression = parseExpression()) {
+                elif->expression = expression.value();
             } else {
-                error_expected("Invalid scope",peek().value().line);
+                error_expected("Expected Expression",current_line());
             }
+            try_consume(TokenType::closeParentheses, "Expected `)`",current_line());
+            const std::optional<Token> curly = try_consume(TokenType::open_curly);
+            if (!curly.has_value()) {
+                error_expected("Expected Scope",current_line());
+            }
+            elif->scope = m_allocator->emplace<nodeScope>();
+            elif->scope->position = position(curly.value());
+            *done.next_predicate = m_allocator->emplace<nodeIfPredicate>(elif);
+            open.push_back({.scope = elif->scope,
+                            .owner = OpenScope::Owner::if_chain,
+                            .statement_if = done.statement_if,
+                            .next_predicate = &elif->ifPredicate,
+                            .position = done.position});
+            return true;
         }
 
-        if (auto if_ = try_consume(TokenType::if_)) {
-            try_consume(TokenType::openParentheses, "Expected `(`",peek().value().line);
-            auto statement_if = m_allocator.alloc<nodeIfStatement>();
-            if (auto expr = parseExpression()) {
-                statement_if->expression = expr.value();
-            } else {
-                error_expected("Invalid Expression",peek().value().line);
-            }
-            try_consume(TokenType::closeParentheses, "Expected `)`",peek().value().line);
-            if (const auto scope = parse_scope()) {
-                statement_if->scope = scope.value();
-            } else {
-                error_expected("Invalid scope",peek().value().line);
+        if (try_consume(TokenType::else_)) {
+            auto else_ = m_allocator->emplace<nodeIfPredicateElse>();
+            const std::optional<Token> curly = try_consume(TokenType::open_curly);
+            if (!curly.has_value()) {
+                error_expected("Expected Scope",current_line());
             }
-            statement_if->ifPredicate = parse_if_predicate();
-            auto statement = m_allocator.alloc<StatementNode>();
-            statement->var = statement_if;
-            return statement;
+            else_->scope = m_allocator->emplace<nodeScope>();
+            else_->scope->position = position(curly.value());
+            *done.next_predicate = m_allocator->emplace<nodeIfPredicate>(else_);
+            open.push_back({.scope = else_->scope,
+                            .owner = OpenScope::Owner::if_chain,
+                            .statement_if = done.statement_if,
+                            .position = done.position});
+            return true;
         }
+        return false;
+    }
 
-        return {};
+    /** the length of an array declaration: a positive literal */
+    static std::size_t array_length(const Token& literal) {
+        const std::string& digits = literal.value.value();
+        // elements live on the stack, which is far smaller than this
+        if (digits.size() > 9 || std::stoul(digits) == 0) {
+            error_expected("Invalid array length " + digits, literal.line);
+        }
+        return std::stoul(digits);
     }
 
-    std::optional<ProgramNode> parseProgram() {
-        ProgramNode program;
-        while (peek().has_value()) {
-            if (std::optional<StatementNode*> stmt = parseStatement()) {
-                program.statements.push_back(stmt.value());
+    /** the type named by identifier in a declaration */
+    static IntType int_type(const Token& identifier) {
+        const std::optional<IntType> type =
+            parse_int_type(identifier.value.value());
+        if (!type.has_value()) {
+            error_expected("Unknown type " + identifier.value.value(),
+                           identifier.line);
+        }
+        return type.value();
+    }
+
+    /** an integer literal or identifier term */
+    TermNode* term(Token token) {
+        if (token.type == TokenType::intLiteral) {
+            return m_allocator->emplace<TermNode>(
+                m_allocator->emplace<TermIntLiteralNode>(std::move(token)));
+        }
+        return m_allocator->emplace<TermNode>(
+            m_allocator->emplace<TermIdentifierNode>(std::move(token)));
+    }
+
+    /** parseTerm() as an expression, shared when hash-consing */
+    std::optional<ExpressionNode*> parseOperand() {
+        if (m_hash_cons == nullptr) {
+            if (std::optional<TermNode*> node = parseTerm()) {
+                return m_allocator->emplace<ExpressionNode>(node.value());
+            }
+            return std::nullopt;
+        }
+        if (!peek().has_value() ||
+            (peek().value().type != TokenType::intLiteral &&
+             peek().value().type != TokenType::identifier)) {
+            return std::nullopt;
+        }
+        const Token token = eat();
+        return m_hash_cons->intern(
+            token.type, token.value.value(), nullptr, nullptr,
+            sizeof(ExpressionNode) + sizeof(TermNode) +
+                sizeof(TermIdentifierNode),
+            [&] { return m_allocator->emplace<ExpressionNode>(term(token)); });
+    }
+
+    /**
+     * The expression wrapping the node make() allocates, or an identical
+     * one built earlier when hash-consing.
+     */
+    template <typename Make>
+    ExpressionNode* intern(const TokenType kind, const std::string_view text,
+                           const ExpressionNode* lhs, const ExpressionNode* rhs,
+                           const std::size_t bytes, Make&& make) {
+        constexpr bool binary =
+            std::is_same_v<decltype(make()), BinaryExpressionNode*>;
+        const auto build = [&] {
+            if constexpr (binary) {
+                return m_allocator->emplace<ExpressionNode>(make());
             } else {
-                error_expected("Invalid statement",peek().value().line);
+                return m_allocator->emplace<ExpressionNode>(
+                    m_allocator->emplace<TermNode>(make()));
             }
+        };
+        if (m_hash_cons == nullptr) {
+            return build();
         }
-        return program;
+        return m_hash_cons->intern(
+            kind, text, lhs, rhs,
+            bytes + sizeof(ExpressionNode) + (binary ? 0 : sizeof(TermNode)),
+            build);
     }
 
-  private:
-    const std::vector<Token> m_tokens;
+    /** folds the top operator and its two operands into one expression */
+    void reduce(std::vector<ExpressionNode*>& operands,
+                std::vector<Token>& operators) {
+        const TokenType op = operators.back().type;
+        operators.pop_back();
+        ExpressionNode* rhs = operands.back();
+        operands.pop_back();
+        ExpressionNode* lhs = operands.back();
+
+        // every operator node holds just the two operand pointers
+        static_assert(sizeof(BinaryExpressionAddition) ==
+                      sizeof(BinaryExpressionDivision));
+        operands.back() = intern(
+            op, {}, lhs, rhs,
+            sizeof(BinaryExpressionNode) + sizeof(BinaryExpressionAddition),
+            [&] {
+                auto* expression = m_allocator->emplace<BinaryExpressionNode>();
+                if (op == TokenType::addition) {
+                    expression->ops =
+                        m_allocator->emplace<BinaryExpressionAddition>(lhs, rhs);
+                } else if (op == TokenType::multiplication) {
+                    expression->ops =
+                        m_allocator->emplace<BinaryExpressionMultiplication>(
+                            lhs, rhs);
+                } else if (op == TokenType::division) {
+                    expression->ops =
+                        m_allocator->emplace<BinaryExpressionDivision>(lhs, rhs);
+                } else if (op == TokenType::substraction) {
+                    expression->ops =
+                        m_allocator->emplace<BinaryExpressionSubtraction>(lhs,
+                                                                          rhs);
+                } else {
+                    assert(false); // unreachable
+                }
+                return expression;
+            });
+    }
 
-    [[nodiscard]] inline std::optional<Token> peek(const int offset = 0) const {
-        if (m_index + offset >= m_tokens.size()) {
-            return {};
-        } else {
-            return m_tokens.at(m_index + offset);
+    std::vector<Token> m_tokens;
+    TokenFeed m_feed;
+    Tokenizer* m_tokenizer = nullptr;
+    int m_last_line = 0;
+    std::size_t m_consumed = 0;
+
+    [[nodiscard]] inline std::optional<Token> peek(const int offset = 0) {
+        if (m_tokenizer != nullptr) {
+            return m_tokenizer->peek(static_cast<std::size_t>(offset));
         }
+        while (m_index + offset >= m_tokens.size()) {
+            if (!m_feed || !refill()) {
+                return {};
+            }
+        }
+        return m_tokens.at(m_index + offset);
+    }
+
+    bool refill() {
+        // drop what has been consumed before appending the next batch
+        if (m_index > 0 && m_index >= m_tokens.size() / 2) {
+            m_tokens.erase(m_tokens.begin(),
+                           m_tokens.begin() + static_cast<long>(m_index));
+            m_index = 0;
+        }
+        return m_feed(m_tokens);
     }
 
     inline Token try_consume(TokenType type, const std::string& err_msg, const int line) {
@@ -422,9 +829,23 @@ class Parser {
         }
     }
 
-    Token eat() { return m_tokens.at(m_index++); }
+    Token eat() {
+        Token token = m_tokenizer != nullptr ? m_tokenizer->next().value()
+                                             : m_tokens.at(m_index++);
+        m_last_line = token.line;
+        m_consumed++;
+        return token;
+    }
+
+    /** line for diagnostics, falling back to the last token at end of input */
+    [[nodiscard]] int current_line() {
+        const std::optional<Token> token = peek();
+        return token.has_value() ? token.value().line : m_last_line;
+    }
 
     size_t m_index = 0;
 
-    ArenaAllocator m_allocator;
+    std::optional<ArenaAllocator> m_owned_allocator;
+    ArenaAllocator* m_allocator;
+    HashCons* m_hash_cons = nullptr;
 };
@@ -0,0 +1,159 @@
+#pragma once
+#include "cGeneration.hpp"
+#include "generation.hpp"
+#include "spscRing.hpp"
+#include <exception>
+#include <ostream>
+#include <thread>
+
+struct StreamingLimits {
+    /** tokens per batch handed from the tokenizer to the parser */
+    std::size_t token_batch = 4096;
+    /** top-level statements per batch handed from the parser onwards */
+    std::size_t statement_batch = 256;
+    /** batches in flight between two stages */
+    std::size_t ring_capacity = 16;
+    /** block size of the per-batch AST arenas */
+    std::size_t arena_block = 64 * 1024;
+};
+
+/**
+ * Streaming compile: tokenizer, parser and generator run concurrently on
+ * their own threads, connected by SPSC rings.
+ *
+ * The tokenizer pushes token batches; the parser pulls them through its
+ * token feed and hands completed top-level statements onwards in batches,
+ * each owning the arena its AST lives in; the generator emits each batch,
+ * writes the output and frees the arena, which destroys the batch's AST
+ * and the token text it owns. Only the batches in flight are
+ * resident, so peak memory for tokens and AST no longer grows with the
+ * input, apart from batches whose statements the generator still holds
+ * back to pack with the next ones. Errors are reported in the same order as the sequential pipeline:
+ * tokenizer, then parser, then generator. isa is passed on to generators
+ * that vectorize and if_conversion to those that lower branches to cmov.
+ */
+template <typename CodeGenerator>
+void compile_streaming(std::string source, std::ostream& out,
+                       const StreamingLimits& limits = {},
+                       const quarks::Isa isa = quarks::Isa::sse2,
+                       const std::size_t if_conversion =
+                           quarks::kIfConversionCost) {
+
+    struct Cancelled {};
+
+    struct ParsedBatch {
+        std::unique_ptr<ArenaAllocator> arena;
+        std::vector<StatementNode*> statements;
+    };
+
+    SpscRing<std::vector<Token>> tokens(limits.ring_capacity);
+    SpscRing<ParsedBatch> statements(limits.ring_capacity);
+    std::exception_ptr token_error;
+    std::exception_ptr parse_error;
+    std::exception_ptr generate_error;
+
+    std::thread lexer([&] {
+        try {
+            Tokenizer tokenizer(std::move(source));
+            std::vector<Token> batch;
+            batch.reserve(limits.token_batch);
+            tokenizer.tokenize([&](Token&& token) {
+                batch.push_back(std::move(token));
+                if (batch.size() == limits.token_batch) {
+                    if (!tokens.push(std::move(batch))) {
+                        throw Cancelled{};
+                    }
+                    batch = {};
+                    batch.reserve(limits.token_batch);
+                }
+            });
+            if (!batch.empty()) {
+                tokens.push(std::move(batch));
+            }
+        } catch (const Cancelled&) {
+        } catch (...) {
+            token_error = std::current_exception();
+        }
+        tokens.close();
+    });
+
+    std::thread parser_thread([&] {
+        try {
+            ParsedBatch batch{
+                .arena = std::make_unique<ArenaAllocator>(limits.arena_block)};
+            Parser parser(
+                [&](std::vector<Token>& buffer) {
+                    std::optional<std::vector<Token>> next = tokens.pop();
+                    if (!next.has_value()) {
+                        return false;
+                    }
+                    buffer.insert(buffer.end(),
+                                  std::make_move_iterator(next->begin()),
+                                  std::make_move_iterator(next->end()));
+                    return true;
+                },
+                *batch.arena);
+
+            while (std::optional<StatementNode*> stmt = parser.parseTopLevel()) {
+                batch.statements.push_back(stmt.value());
+                if (batch.statements.size() == limits.statement_batch) {
+                    auto arena =
+                        std::make_unique<ArenaAllocator>(limits.arena_block);
+                    parser.set_allocator(*arena);
+                    if (!statements.push(std::move(batch))) {
+                        throw Cancelled{};
+                    }
+                    batch = ParsedBatch{.arena = std::move(arena)};
+                }
+            }
+            statements.push(std::move(batch));
+        } catch (const Cancelled&) {
+        } catch (...) {
+            parse_error = std::current_exception();
+        }
+        // stops the tokenizer early if parsing ended before the input did
+        tokens.close();
+        statements.close();
+    });
+
+    try {
+        CodeGenerator generator;
+        if constexpr (requires { generator.set_isa(isa); }) {
+            generator.set_isa(isa);
+        }
+        if constexpr (requires { generator.set_if_conversion(if_conversion); }) {
+            generator.set_if_conversion(if_conversion);
+        }
+        generator.begin_program();
+        // batches with statements the generator holds back for packing
+        std::vector<ParsedBatch> held;
+        while (std::optional<ParsedBatch> batch = statements.pop()) {
+            for (const StatementNode* statement : batch->statements) {
+                generator.generateStatement(statement);
+            }
+            out << generator.take_output();
+            if constexpr (requires { generator.holding(); }) {
+                if (generator.holding()) {
+                    held.push_back(std::move(batch.value()));
+                } else {
+                    held.clear();
+                }
+            }
+        }
+        generator.end_program();
+        out << generator.take_output();
+    } catch (...) {
+        generate_error = std::current_exception();
+        statements.close();
+    }
+
+    parser_thread.join();
+    lexer.join();
+
+    for (const std::exception_ptr& error :
+         {token_error, parse_error, generate_error}) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
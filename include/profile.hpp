@@ -0,0 +1,88 @@
+#pragma once
+#include "compileError.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+/**
+ * Branch profile an --instrument build writes when it exits: for every
+ * if/elif test, numbered in the order the generators meet them, how often
+ * the test ran and how often its arm was taken. On disk it is little-endian
+ * 64-bit words: kMagic, the hash of the source, the number of tests, then
+ * the two counters of every test.
+ */
+struct BranchProfile {
+    /** "QSPROF01" */
+    static constexpr std::uint64_t kMagic = 0x3130464f52505351;
+
+    struct Site {
+        std::uint64_t reached = 0;
+        std::uint64_t taken = 0;
+    };
+
+    std::uint64_t source_hash = 0;
+    std::vector<Site> sites;
+
+    /** FNV-1a, ties a profile to the source it was recorded for */
+    [[nodiscard]] static std::uint64_t hash(const std::string_view source) {
+        std::uint64_t hash = 0xcbf29ce484222325;
+        for (const char c : source) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    [[nodiscard]] static BranchProfile read(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw CompileError("Failed to open profile " + path.string());
+        }
+        const auto word = [&] {
+            std::uint64_t value = 0;
+            file.read(reinterpret_cast<char*>(&value), sizeof value);
+            return value;
+        };
+        BranchProfile profile;
+        const std::uint64_t magic = word();
+        profile.source_hash = word();
+        const std::uint64_t count = word();
+        if (!file || magic != kMagic) {
+            throw CompileError("Not a branch profile: " + path.string());
+        }
+        for (std::uint64_t i = 0; i < count && file; i++) {
+            const std::uint64_t reached = word();
+            profile.sites.push_back({.reached = reached, .taken = word()});
+        }
+        if (!file) {
+            throw CompileError("Truncated branch profile: " + path.string());
+        }
+        return profile;
+    }
+
+    /** the test of site went the same way at least 7 times in 8 */
+    [[nodiscard]] bool biased(const std::size_t site) const {
+        return site < sites.size() &&
+               std::min(sites[site].taken,
+                        sites[site].reached - sites[site].taken) *
+                       8 <=
+                   sites[site].reached;
+    }
+
+    /** the arm of site ran on fewer than half the times its test did */
+    [[nodiscard]] bool cold(const std::size_t site) const {
+        return site < sites.size() &&
+               sites[site].taken * 2 < sites[site].reached;
+    }
+};
+
+/** what the generators add to branches, or take from a recorded profile */
+struct ProfileOptions {
+    /** where the instrumented program writes its profile; empty for none */
+    std::string instrument;
+    std::uint64_t source_hash = 0;
+    /** lays branches out by these counts when set */
+    const BranchProfile* use = nullptr;
+};
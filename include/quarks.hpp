@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * libquarks: the compiler pipeline as a reentrant, in-process API.
+ *
+ * Invalid programs never terminate the host process; every tokenizer, parser
+ * and generator error comes back as a Diagnostic in the Result. Distinct
+ * Compiler objects share no state, so a service can keep one per thread.
+ */
+namespace quarks {
+
+enum class Backend { nasm, c };
+
+/** vector instructions the nasm backend lowers array arithmetic to */
+enum class Isa {
+    /** one element per iteration */
+    scalar,
+    /** two elements per iteration; every x86-64 CPU has SSE2 */
+    sse2,
+    /**
+     * four elements per iteration where CPUID reports AVX2 when the program
+     * starts, SSE2 elsewhere
+     */
+    avx2,
+};
+
+/** the default of Options::if_conversion */
+inline constexpr std::size_t kIfConversionCost = 16;
+
+enum class Emit {
+    /** nasm assembly or C source, produced entirely in-process */
+    code,
+    /** ELF object; runs the external assembler or C compiler */
+    object,
+    /** linked executable; runs the external toolchain */
+    executable,
+    /**
+     * the parsed program as an AST image Compiler::compile_image generates
+     * from without parsing again; no code is generated
+     */
+    ast,
+};
+
+/** a top-level declaration of a module, which importers get a copy of */
+struct Export {
+    std::string name;
+    /** elements of an array, 0 for a scalar */
+    std::size_t length = 0;
+};
+
+/** what importers see of a module */
+struct Interface {
+    std::string module;
+    /** in declaration order */
+    std::vector<Export> exports;
+};
+
+struct Options {
+    Backend backend = Backend::nasm;
+    Emit emit = Emit::code;
+    /** used by the C backend for Emit::object and Emit::executable */
+    std::string c_compiler = "cc";
+    /** the C compiler's optimization flag, as c_compiler */
+    std::string c_optimization = "-O3";
+    /**
+     * Threads for parsing; sources over a few MiB are split at top-level
+     * statements and the pieces parsed concurrently. Output is unchanged.
+     */
+    std::size_t parse_threads = 1;
+    /**
+     * Threads for code generation; programs with many top-level statements
+     * are generated in regions concurrently. Output is unchanged.
+     */
+    std::size_t codegen_threads = 1;
+    /**
+     * Share structurally identical expression subtrees in the AST. Output
+     * and diagnostics are unchanged.
+     */
+    bool hash_cons = false;
+    /**
+     * Time every pass and count tokens, AST nodes and emitted code into
+     * Result::stats. Tokenizing and parsing are then timed as two passes
+     * instead of running fused, unless parse_threads splits the source.
+     */
+    bool collect_stats = false;
+    /**
+     * Instrument every if/elif test with counters the program writes to
+     * this file when it exits; empty for a plain build. Generation then
+     * runs on one thread.
+     */
+    std::string instrument;
+    /**
+     * Profile an instrumented build of the same source wrote: arms taken
+     * less than half the time their test runs are moved out of line.
+     * Generation then runs on one thread.
+     */
+    std::string profile_use;
+    /**
+     * Path of the source file for debug info: line tables mapping the code
+     * to source lines, and symbols for scopes and variables, so perf and
+     * gdb work at the source level. Empty for none. Compiler::compile
+     * only; Document::compile ignores it.
+     */
+    std::string debug_source;
+    /**
+     * Vector width of element-wise array code. The C backend leaves
+     * vectorizing to the C compiler and ignores it.
+     */
+    Isa isa = Isa::sse2;
+    /**
+     * Largest if/elif/else chain the nasm backend lowers to branch-free
+     * cmov code, counted in expression nodes over its tests and right-hand
+     * sides. Only chains whose arms assign scalars and cannot trap qualify.
+     * 0 keeps every branch, as instrumented builds do. The C backend leaves
+     * this to the C compiler and ignores it.
+     */
+    std::size_t if_conversion = kIfConversionCost;
+    /**
+     * Compile the source as the module of this name instead of a program.
+     * Its top-level statements become an init function that runs the first
+     * time an importer calls it; its top-level declarations are its
+     * exports. Emit::executable needs a program. Empty for a program.
+     */
+    std::string module;
+    /**
+     * Interfaces of the modules `import` may name. Compiler::compile only;
+     * Document::compile ignores this and Options::module.
+     */
+    std::vector<Interface> imports;
+};
+
+/** wall and CPU time of one compiler pass */
+struct PassTiming {
+    std::string pass;
+    double wall_seconds = 0;
+    double cpu_seconds = 0;
+};
+
+/** filled in when Options::collect_stats is set */
+struct Stats {
+    /** in the order they ran */
+    std::vector<PassTiming> passes;
+    std::size_t tokens = 0;
+    /** AST nodes by kind, in a fixed order */
+    std::vector<std::pair<std::string, std::size_t>> nodes;
+    /** assembly instructions, or statements of the generated C */
+    std::size_t instructions = 0;
+    std::size_t labels = 0;
+    /** scalar statements the SLP pass packed into vector operations */
+    std::size_t vectorized = 0;
+    /** instructions tail merging left out, jumping to identical code instead */
+    std::size_t merged = 0;
+};
+
+/** AST memory of the last compilation */
+struct AstStats {
+    /** arena bytes the AST took */
+    std::size_t arena_bytes = 0;
+    /** expression nodes in the source; counted when hash-consing */
+    std::size_t expressions = 0;
+    /** expression nodes reused instead of allocated */
+    std::size_t shared = 0;
+    /** arena bytes the reused nodes would have taken */
+    std::size_t bytes_saved = 0;
+};
+
+struct Diagnostic {
+    std::string message;
+    /** source line, or -1 when the error is not tied to one */
+    int line = -1;
+};
+
+struct Result {
+    bool ok = false;
+    /** assembly, C source, object bytes or executable bytes */
+    std::string output;
+    std::vector<Diagnostic> diagnostics;
+    AstStats ast;
+    Stats stats;
+    /** the exports of a module, see Options::module */
+    std::vector<Export> exports;
+
+    explicit operator bool() const { return ok; }
+};
+
+/**
+ * Reusable compilation context. It keeps the AST arena warm between calls,
+ * so one Compiler must not be used by two threads at the same time.
+ */
+class Compiler final {
+  public:
+    explicit Compiler(std::size_t arena_bytes = 4 * 1024 * 1024);
+    ~Compiler();
+
+    Compiler(Compiler&&) noexcept;
+    Compiler& operator=(Compiler&&) noexcept;
+
+    [[nodiscard]] Result compile(std::string_view source,
+                                 const Options& options = {});
+
+    /**
+     * compile() from an image Emit::ast wrote, usually a mapped file: the
+     * nodes are rebuilt in one pass over it instead of tokenizing and
+     * parsing. Output matches compiling the source, and so do diagnostics
+     * unless the image was written with Options::hash_cons. Profiles
+     * recorded for the source apply.
+     */
+    [[nodiscard]] Result compile_image(std::string_view image,
+                                       const Options& options = {});
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/**
+ * An open source file edited in place, for editor integrations. Each edit
+ * re-lexes and re-parses only the top-level statements it touches and
+ * reuses the rest of the AST, so diagnostics stay cheap on large files.
+ */
+class Document final {
+  public:
+    explicit Document(std::string source);
+    ~Document();
+
+    Document(Document&&) noexcept;
+    Document& operator=(Document&&) noexcept;
+
+    /** replaces length bytes at offset with text */
+    void edit(std::size_t offset, std::size_t length, std::string_view text);
+
+    [[nodiscard]] const std::string& source() const;
+
+    /** syntax errors of the current text, as a full compile reports them */
+    [[nodiscard]] std::vector<Diagnostic> diagnostics() const;
+
+    /**
+     * generates code (and builds, per options.emit) from the current AST;
+     * Emit::ast is not supported
+     */
+    [[nodiscard]] Result compile(const Options& options = {}) const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/** one-shot convenience wrapper around a temporary Compiler */
+[[nodiscard]] Result compile(std::string_view source,
+                             const Options& options = {});
+
+} // namespace quarks
@@ -0,0 +1,407 @@
+#pragma once
+#include "driver.hpp"
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * `quarks bench`: compiles one program in several variants (backend, and
+ * the if-conversion limit or the C compiler's optimization level), runs
+ * every executable repeatedly
+ * and compares the variants on wall time and hardware counters.
+ */
+namespace runtime_bench {
+
+/** a counter the kernel may or may not let us open */
+struct Counter {
+    const char* name;
+    std::uint32_t type;
+    std::uint64_t config;
+};
+
+inline constexpr std::array<Counter, 5> kCounters{{
+    {"task-clock ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+}};
+
+/** one run of an executable; counters the kernel refused stay nullopt */
+struct Sample {
+    double wall_seconds = 0;
+    int exit_status = 0;
+    std::array<std::optional<double>, kCounters.size()> counters{};
+};
+
+/**
+ * perf_event_open counters on a forked child that waits on a pipe, armed
+ * with enable_on_exec so only the executable itself is counted. User space
+ * only, which the default perf_event_paranoid level allows.
+ */
+class PerfCounters final {
+  public:
+    explicit PerfCounters(const pid_t pid) {
+        for (std::size_t i = 0; i < kCounters.size(); i++) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = kCounters[i].type;
+            attr.config = kCounters[i].config;
+            attr.disabled = 1;
+            attr.enable_on_exec = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            m_fds[i] = static_cast<int>(
+                syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        for (const int fd : m_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    /** counts scaled for multiplexing, once the child has exited */
+    void read_into(Sample& sample) const {
+        for (std::size_t i = 0; i < kCounters.size(); i++) {
+            std::array<std::uint64_t, 3> value{};
+            if (m_fds[i] < 0 ||
+                ::read(m_fds[i], value.data(), sizeof(value)) !=
+                    static_cast<ssize_t>(sizeof(value)) ||
+                value[2] == 0) {
+                continue;
+            }
+            sample.counters[i] = static_cast<double>(value[0]) *
+                                 static_cast<double>(value[1]) /
+                                 static_cast<double>(value[2]);
+        }
+    }
+
+  private:
+    std::array<int, kCounters.size()> m_fds{};
+};
+
+/**
+ * runs executable once with counters attached. Any exit status is the
+ * program's own, 127 included, and a signal is 128 + its number as in sh;
+ * a failed exec reaches us as the child's errno on a close-on-exec pipe,
+ * which a successful exec closes empty.
+ */
+inline Sample run_once(const std::filesystem::path& executable) {
+    int go[2];
+    int failed[2];
+    if (pipe2(go, O_CLOEXEC) != 0) {
+        throw CompileError("pipe failed");
+    }
+    if (pipe2(failed, O_CLOEXEC) != 0) {
+        close(go[0]);
+        close(go[1]);
+        throw CompileError("pipe failed");
+    }
+    const pid_t child = fork();
+    if (child < 0) {
+        for (const int fd : {go[0], go[1], failed[0], failed[1]}) {
+            close(fd);
+        }
+        throw CompileError("fork failed");
+    }
+    if (child == 0) {
+        close(go[1]);
+        close(failed[0]);
+        char start;
+        if (::read(go[0], &start, 1) == 1) {
+            execl(executable.c_str(), executable.c_str(), nullptr);
+        }
+        const int error = errno;
+        (void)!write(failed[1], &error, sizeof(error));
+        _exit(127);
+    }
+    close(go[0]);
+    close(failed[1]);
+
+    Sample sample;
+    const PerfCounters counters(child);
+    const auto start = std::chrono::steady_clock::now();
+    const bool released = write(go[1], "x", 1) == 1;
+    close(go[1]);
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0 && errno == EINTR) {
+    }
+    sample.wall_seconds = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    int error = 0;
+    const bool exec_failed =
+        ::read(failed[0], &error, sizeof(error)) ==
+        static_cast<ssize_t>(sizeof(error));
+    close(failed[0]);
+    if (!released || exec_failed) {
+        throw CompileError("Failed to run " + executable.string() + ": " +
+                           std::strerror(released ? error : EPIPE));
+    }
+    sample.exit_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                             : WEXITSTATUS(status);
+    counters.read_into(sample);
+    return sample;
+}
+
+struct Summary {
+    std::size_t n = 0;
+    double mean = 0;
+    double median = 0;
+    double stddev = 0;
+};
+
+inline Summary summarize(std::vector<double> values) {
+    Summary summary{.n = values.size()};
+    if (values.empty()) {
+        return summary;
+    }
+    ranges::sort(values);
+    const std::size_t mid = values.size() / 2;
+    summary.median = values.size() % 2 == 1
+                         ? values[mid]
+                         : (values[mid - 1] + values[mid]) / 2;
+    for (const double value : values) {
+        summary.mean += value;
+    }
+    summary.mean /= static_cast<double>(values.size());
+    if (values.size() > 1) {
+        double squares = 0;
+        for (const double value : values) {
+            squares += (value - summary.mean) * (value - summary.mean);
+        }
+        summary.stddev =
+            std::sqrt(squares / static_cast<double>(values.size() - 1));
+    }
+    return summary;
+}
+
+/** two-sided 97.5% quantile of Student's t distribution */
+inline double t_quantile(const double df) {
+    static constexpr std::array<double, 30> kTable{
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+        2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+        2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+        2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1) {
+        return kTable[0];
+    }
+    if (df <= 30) {
+        return kTable[static_cast<std::size_t>(df) - 1];
+    }
+    return df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+}
+
+/**
+ * Relative change of b's mean over a's, with the half-width of its 95%
+ * confidence interval (Welch's t-test, so the variances may differ).
+ */
+struct Comparison {
+    double change = 0;
+    double margin = 0;
+
+    [[nodiscard]] bool significant() const {
+        return std::abs(change) > margin;
+    }
+};
+
+inline Comparison compare(const Summary& a, const Summary& b) {
+    if (a.n < 2 || b.n < 2 || a.mean == 0) {
+        return {.change = a.mean == 0 ? 0 : b.mean / a.mean - 1};
+    }
+    const double va = a.stddev * a.stddev / static_cast<double>(a.n);
+    const double vb = b.stddev * b.stddev / static_cast<double>(b.n);
+    const double se = std::sqrt(va + vb);
+    const double df =
+        se == 0 ? 1e9
+                : (va + vb) * (va + vb) /
+                      (va * va / static_cast<double>(a.n - 1) +
+                       vb * vb / static_cast<double>(b.n - 1));
+    return {.change = b.mean / a.mean - 1,
+            .margin = t_quantile(df) * se / a.mean};
+}
+
+/**
+ * backend plus, for asm, the if-conversion cost limit, and for C, the C
+ * compiler's optimization level: asm, asm:0, c, c:-O1
+ */
+struct Variant {
+    std::string name;
+    CompileOptions options;
+};
+
+inline Variant parse_variant(const std::string& spec,
+                             const std::string& c_compiler) {
+    Variant variant{.name = spec};
+    const std::string backend = spec.substr(0, spec.find(':'));
+    if (backend == "asm" || backend == "nasm") {
+        variant.options.backend = Backend::nasm;
+        if (spec.find(':') != std::string::npos &&
+            !parse_number(spec.substr(spec.find(':') + 1),
+                          variant.options.if_conversion)) {
+            throw CompileError("Unknown variant " + spec);
+        }
+    } else if (backend == "c") {
+        variant.options.backend = Backend::c;
+        variant.options.c_compiler = c_compiler;
+        if (spec.find(':') != std::string::npos) {
+            variant.options.c_optimization = spec.substr(spec.find(':') + 1);
+        }
+    } else {
+        throw CompileError("Unknown variant " + spec);
+    }
+    return variant;
+}
+
+inline void usage() {
+    std::cerr << "quarks bench [--runs=<n>] [--warmup=<n>] [--cc=<compiler>] "
+                 "[--variant=asm|asm:<if-convert cost>|c|c:<-Ox>]... <*.qs>\n";
+}
+
+/** the `quarks bench` subcommand; args exclude the program name */
+inline int main(const std::vector<std::string>& args) {
+    int runs = 10;
+    int warmup = 1;
+    std::string c_compiler = "cc";
+    std::vector<std::string> specs;
+    std::filesystem::path source;
+    for (const std::string& arg : args) {
+        if (arg.starts_with("--runs=") && parse_number(arg.substr(7), runs)) {
+            runs = std::max(1, runs);
+        } else if (arg.starts_with("--warmup=") &&
+                   parse_number(arg.substr(9), warmup)) {
+            warmup = std::max(0, warmup);
+        } else if (arg.starts_with("--cc=")) {
+            c_compiler = arg.substr(5);
+        } else if (arg.starts_with("--variant=")) {
+            specs.push_back(arg.substr(10));
+        } else if (!arg.starts_with("-") && source.empty()) {
+            source = arg;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (source.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (specs.empty()) {
+        specs = {"asm", "c"};
+    }
+
+    const std::filesystem::path dir =
+        std::filesystem::temp_directory_path() /
+        ("quarks-bench-" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+
+    struct Result {
+        Variant variant;
+        std::vector<Sample> samples;
+    };
+    std::vector<Result> results;
+    for (const std::string& spec : specs) {
+        try {
+            Variant variant = parse_variant(spec, c_compiler);
+            const OutputPaths out{.executable =
+                                      dir / std::to_string(results.size())};
+            const CompileReport report =
+                compile_file(source, out, variant.options);
+            if (!report.ok) {
+                std::cerr << spec << ": " << report.diagnostics << "\n";
+                continue;
+            }
+            Result result{.variant = std::move(variant)};
+            for (int i = 0; i < warmup; i++) {
+                run_once(out.executable);
+            }
+            for (int i = 0; i < runs; i++) {
+                result.samples.push_back(run_once(out.executable));
+            }
+            results.push_back(std::move(result));
+        } catch (const std::exception& error) {
+            std::cerr << spec << ": " << error.what() << "\n";
+        }
+    }
+    std::filesystem::remove_all(dir);
+    if (results.empty()) {
+        return EXIT_FAILURE;
+    }
+
+    // wall time, then every counter that every variant could measure
+    std::vector<std::pair<std::string, std::function<double(const Sample&)>>>
+        metrics{{"wall ms", [](const Sample& s) { return s.wall_seconds * 1e3; }}};
+    std::string unavailable;
+    for (std::size_t i = 0; i < kCounters.size(); i++) {
+        const bool measured = ranges::all_of(results, [i](const Result& r) {
+            return ranges::all_of(r.samples, [i](const Sample& s) {
+                return s.counters[i].has_value();
+            });
+        });
+        if (measured) {
+            metrics.emplace_back(kCounters[i].name, [i](const Sample& s) {
+                return s.counters[i].value();
+            });
+        } else {
+            unavailable += std::string(unavailable.empty() ? "" : ", ") +
+                           kCounters[i].name;
+        }
+    }
+    if (!unavailable.empty()) {
+        std::cout << "counters unavailable here: " << unavailable << "\n";
+    }
+
+    std::cout << runs << " runs per variant, mean ± stddev (median)\n";
+    std::vector<std::vector<Summary>> summaries;
+    for (const Result& result : results) {
+        std::cout << result.variant.name << " (exit "
+                  << result.samples.front().exit_status << ")\n";
+        std::vector<Summary>& row = summaries.emplace_back();
+        for (const auto& [name, value] : metrics) {
+            std::vector<double> values;
+            for (const Sample& sample : result.samples) {
+                values.push_back(value(sample));
+            }
+            const Summary summary = row.emplace_back(summarize(values));
+            std::cout << std::setprecision(4) << "  " << std::left
+                      << std::setw(15) << name << std::right << std::setw(12)
+                      << summary.mean << " ± " << std::setw(10)
+                      << summary.stddev << " (" << summary.median << ")\n";
+        }
+    }
+
+    for (std::size_t v = 1; v < results.size(); v++) {
+        std::cout << results[v].variant.name << " vs "
+                  << results[0].variant.name << ", 95% confidence\n";
+        for (std::size_t m = 0; m < metrics.size(); m++) {
+            const Comparison comparison = compare(summaries[0][m], summaries[v][m]);
+            std::cout << std::fixed << std::setprecision(1) << "  " << std::left
+                      << std::setw(15) << metrics[m].first << std::right
+                      << std::showpos << std::setw(8) << comparison.change * 100
+                      << std::noshowpos << "% ± " << comparison.margin * 100
+                      << "%" << (comparison.significant() ? "" : "  (noise)")
+                      << "\n";
+            std::cout << std::defaultfloat;
+        }
+        if (results[v].samples.front().exit_status !=
+            results[0].samples.front().exit_status) {
+            std::cout << "  exit status differs: the variants disagree\n";
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace runtime_bench
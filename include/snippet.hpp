@@ -0,0 +1,980 @@
+#pragma once
+#include "compileError.hpp"
+#include "intType.hpp"
+#include "tokenization.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Compile-time front end for .qs snippets embedded in C++:
+ *
+ *     static_assert(quarks::eval<"assign x = 6; exit(x * 7);">() == 42);
+ *
+ *     using Rule = quarks::Snippet<"exit(limit - used);", "limit", "used">;
+ *     const std::int64_t left = Rule::run(limit, used);
+ *
+ * Tokenizer and Parser build heap ASTs, so a snippet goes through its own
+ * tokenizer and parser here, written for constant evaluation over
+ * fixed-capacity containers sized by the snippet. They accept the same
+ * language and report the same errors, as compile errors of the C++
+ * program. The parser lowers a snippet to stack-machine ops with every
+ * variable resolved to a slot; SnippetProgram::run() is the reference
+ * evaluator over them, and Snippet::run() expands them into one inline
+ * function per snippet, so nothing is parsed at run time.
+ */
+namespace quarks {
+
+/** a string literal as a template argument */
+template <std::size_t N> struct FixedString {
+    char chars[N]{};
+
+    constexpr FixedString(const char (&text)[N]) {
+        std::copy_n(text, N, chars);
+    }
+
+    [[nodiscard]] constexpr std::string_view view() const {
+        return {chars, N - 1};
+    }
+};
+
+/** the part of std::vector the snippet front end uses, without allocating */
+template <typename T, std::size_t Capacity> class FixedVector {
+  public:
+    constexpr void push_back(const T& value) {
+        if (m_size == Capacity) {
+            throw CompileError("Snippet exceeds its fixed capacity");
+        }
+        m_items[m_size++] = value;
+    }
+
+    constexpr void pop_back() { m_size--; }
+
+    [[nodiscard]] constexpr T& back() { return m_items[m_size - 1]; }
+    [[nodiscard]] constexpr const T& back() const { return m_items[m_size - 1]; }
+
+    [[nodiscard]] constexpr T& operator[](const std::size_t index) {
+        return m_items[index];
+    }
+    [[nodiscard]] constexpr const T& operator[](const std::size_t index) const {
+        return m_items[index];
+    }
+
+    [[nodiscard]] constexpr std::size_t size() const { return m_size; }
+    [[nodiscard]] constexpr bool empty() const { return m_size == 0; }
+
+    [[nodiscard]] constexpr const T* begin() const { return m_items.data(); }
+    [[nodiscard]] constexpr const T* end() const {
+        return m_items.data() + m_size;
+    }
+
+  private:
+    std::array<T, Capacity> m_items{};
+    std::size_t m_size = 0;
+};
+
+struct SnippetToken {
+    TokenType type = TokenType::semicolon;
+    /** identifier and literal text, a view into the snippet */
+    std::string_view text;
+    int line = 0;
+};
+
+/** scans source the way Tokenizer does; a snippet has fewer tokens than bytes */
+template <std::size_t Capacity>
+constexpr FixedVector<SnippetToken, Capacity>
+tokenize_snippet(const std::string_view source) {
+    const auto alpha = [](const char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    };
+    const auto digit = [](const char c) { return c >= '0' && c <= '9'; };
+    const auto at = [&](const std::size_t index) {
+        return index < source.size() ? source[index] : '\0';
+    };
+
+    FixedVector<SnippetToken, Capacity> tokens;
+    int line = 0;
+    std::size_t index = 0;
+    while (index < source.size()) {
+        const char c = source[index];
+        const std::size_t begin = index;
+        if (alpha(c)) {
+            while (alpha(at(index)) || digit(at(index))) {
+                index++;
+            }
+            const std::string_view word = source.substr(begin, index - begin);
+            TokenType type = TokenType::identifier;
+            if (word == "exit") {
+                type = TokenType::exit;
+            } else if (word == "assign") {
+                type = TokenType::assign;
+            } else if (word == "if") {
+                type = TokenType::if_;
+            } else if (word == "elif") {
+                type = TokenType::elif;
+            } else if (word == "else") {
+                type = TokenType::else_;
+            } else if (word == "import") {
+                type = TokenType::import;
+            }
+            tokens.push_back({.type = type, .text = word, .line = line});
+            continue;
+        }
+        if (digit(c)) {
+            while (digit(at(index))) {
+                index++;
+            }
+            tokens.push_back({.type = TokenType::intLiteral,
+                              .text = source.substr(begin, index - begin),
+                              .line = line});
+            continue;
+        }
+        index++;
+        if (c == '-' && at(index) == '-') {
+            while (index < source.size() && source[index] != '\n') {
+                index++;
+            }
+            continue;
+        }
+        if (c == '-' && at(index) == '*') {
+            // like Tokenizer: `-*` and the two characters after it
+            index = std::min(index + 3, source.size());
+            continue;
+        }
+        if (c == '\n') {
+            line++;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f') {
+            continue;
+        }
+        TokenType type = TokenType::semicolon;
+        switch (c) {
+        case '(': type = TokenType::openParentheses; break;
+        case ')': type = TokenType::closeParentheses; break;
+        case '[': type = TokenType::open_bracket; break;
+        case ']': type = TokenType::close_bracket; break;
+        case ':': type = TokenType::colon; break;
+        case ';': type = TokenType::semicolon; break;
+        case '=': type = TokenType::equals; break;
+        case '+': type = TokenType::addition; break;
+        case '*': type = TokenType::multiplication; break;
+        case '-': type = TokenType::substraction; break;
+        case '/': type = TokenType::division; break;
+        case '{': type = TokenType::open_curly; break;
+        case '}': type = TokenType::close_curly; break;
+        default: throw CompileError("Invalid token", line);
+        }
+        tokens.push_back({.type = type, .text = {}, .line = line});
+    }
+    return tokens;
+}
+
+/** one instruction of a lowered snippet */
+struct SnippetOp {
+    enum class Kind {
+        /** pushes value */
+        literal,
+        /** pushes the scalar at slot */
+        load,
+        /** pushes the current element of the array at slot */
+        load_lane,
+        /** pops an index, pushes that element of the array at slot */
+        load_element,
+        /** pop rhs, then lhs; push the result */
+        add,
+        subtract,
+        multiply,
+        divide,
+        /** pops into the scalar at slot, which keeps what its type does */
+        store,
+        /** pops a value, then an index, and stores that element */
+        store_element,
+        /**
+         * the ops up to target compute one element of the array at slot;
+         * they run once per element into scratch, which is then copied
+         */
+        elementwise,
+        /** pops the exit value and stops */
+        exit,
+        /** pops; jumps to target when zero */
+        jump_if_zero,
+        jump,
+    };
+
+    Kind kind = Kind::literal;
+    std::int64_t value = 0;
+    std::size_t slot = 0;
+    /** elements of the array at slot */
+    std::size_t length = 0;
+    std::size_t target = 0;
+    std::size_t scratch = 0;
+    /** of the scalar a store writes */
+    IntType type = IntType::i64;
+};
+
+/** slots and value stack of a running snippet */
+template <std::size_t Slots, std::size_t Depth> struct SnippetState {
+    std::array<std::int64_t, Slots> slots{};
+    std::array<std::int64_t, Depth> stack{};
+    std::size_t depth = 0;
+    std::size_t pc = 0;
+    /** the argument of exit(), 0 when the snippet runs off its end */
+    std::int64_t exit_value = 0;
+};
+
+/**
+ * What traps in a compiled program, like dividing by zero or indexing past
+ * the end of an array. It traps at run time like the C backend; reaching it
+ * while folding is a compile error that names the fault.
+ */
+[[noreturn]] inline void snippet_fault([[maybe_unused]] const char* fault) {
+    __builtin_trap();
+}
+
+template <std::size_t Capacity> struct SnippetProgram {
+    FixedVector<SnippetOp, Capacity> ops;
+    /** slots the variables and element-wise scratch need at most */
+    std::size_t slots = 0;
+    /** deepest the value stack gets */
+    std::size_t depth = 0;
+
+    /** the same program in a vector with room for just its ops */
+    template <std::size_t Size>
+    [[nodiscard]] constexpr SnippetProgram<Size> fitted() const {
+        SnippetProgram<Size> program{.ops = {}, .slots = slots, .depth = depth};
+        for (const SnippetOp& op : ops) {
+            program.ops.push_back(op);
+        }
+        return program;
+    }
+
+    /**
+     * Runs the op at pc, which is a Kind, for element lane inside an
+     * elementwise op; the pc after it. With pc a constant it is just that
+     * op's code.
+     */
+    template <SnippetOp::Kind Kind, typename State>
+    constexpr std::size_t step(const std::size_t pc, State& state,
+                               const std::size_t lane = 0) const {
+        using enum SnippetOp::Kind;
+        const SnippetOp& op = ops[pc];
+        const auto pop = [&] { return state.stack[--state.depth]; };
+        const auto push = [&](const std::int64_t value) {
+            state.stack[state.depth++] = value;
+        };
+        const auto element = [&](const std::int64_t index) {
+            if (static_cast<std::uint64_t>(index) >= op.length) {
+                snippet_fault("Array index out of bounds");
+            }
+            return op.slot + static_cast<std::size_t>(index);
+        };
+        if constexpr (Kind == literal) {
+            push(op.value);
+        } else if constexpr (Kind == load) {
+            push(state.slots[op.slot]);
+        } else if constexpr (Kind == load_lane) {
+            push(state.slots[op.slot + lane]);
+        } else if constexpr (Kind == load_element) {
+            push(state.slots[element(pop())]);
+        } else if constexpr (Kind == add || Kind == subtract ||
+                             Kind == multiply || Kind == divide) {
+            // wraps around like the generated code
+            const auto rhs = static_cast<std::uint64_t>(pop());
+            const auto lhs = static_cast<std::uint64_t>(pop());
+            if constexpr (Kind == add) {
+                push(static_cast<std::int64_t>(lhs + rhs));
+            } else if constexpr (Kind == subtract) {
+                push(static_cast<std::int64_t>(lhs - rhs));
+            } else if constexpr (Kind == multiply) {
+                push(static_cast<std::int64_t>(lhs * rhs));
+            } else if (rhs == 0) {
+                snippet_fault("Division by zero");
+            } else if (static_cast<std::int64_t>(lhs) ==
+                           std::numeric_limits<std::int64_t>::min() &&
+                       static_cast<std::int64_t>(rhs) == -1) {
+                snippet_fault("Division overflow");
+            } else {
+                push(static_cast<std::int64_t>(lhs) /
+                     static_cast<std::int64_t>(rhs));
+            }
+        } else if constexpr (Kind == store) {
+            state.slots[op.slot] = wrap(pop(), op.type);
+        } else if constexpr (Kind == store_element) {
+            const std::int64_t value = pop();
+            state.slots[element(pop())] = value;
+        } else if constexpr (Kind == elementwise) {
+            execute_lanes(pc, state);
+            return op.target;
+        } else if constexpr (Kind == exit) {
+            state.exit_value = pop();
+            return std::numeric_limits<std::size_t>::max();
+        } else if constexpr (Kind == jump_if_zero) {
+            return pop() == 0 ? op.target : pc + 1;
+        } else {
+            static_assert(Kind == jump);
+            return op.target;
+        }
+        return pc + 1;
+    }
+
+    /** the body of the elementwise op at pc, once per element */
+    template <typename State>
+    constexpr void execute_lanes(const std::size_t pc, State& state) const {
+        const SnippetOp& op = ops[pc];
+        for (std::size_t index = 0; index < op.length; index++) {
+            for (std::size_t at = pc + 1; at < op.target; at++) {
+                execute(at, state, index);
+            }
+            state.slots[op.scratch + index] = state.stack[--state.depth];
+        }
+        std::copy_n(state.slots.begin() + op.scratch, op.length,
+                    state.slots.begin() + op.slot);
+    }
+
+    /** step() for the Kind of the op at pc */
+    template <typename State>
+    constexpr std::size_t execute(const std::size_t pc, State& state,
+                                  const std::size_t lane = 0) const {
+        using enum SnippetOp::Kind;
+        switch (ops[pc].kind) {
+        case literal: return step<literal>(pc, state, lane);
+        case load: return step<load>(pc, state, lane);
+        case load_lane: return step<load_lane>(pc, state, lane);
+        case load_element: return step<load_element>(pc, state, lane);
+        case add: return step<add>(pc, state, lane);
+        case subtract: return step<subtract>(pc, state, lane);
+        case multiply: return step<multiply>(pc, state, lane);
+        case divide: return step<divide>(pc, state, lane);
+        case store: return step<store>(pc, state, lane);
+        case store_element: return step<store_element>(pc, state, lane);
+        case elementwise: return step<elementwise>(pc, state, lane);
+        case exit: return step<exit>(pc, state, lane);
+        case jump_if_zero: return step<jump_if_zero>(pc, state, lane);
+        case jump: return step<jump>(pc, state, lane);
+        }
+        return pc + 1;
+    }
+
+    /** the reference evaluator: interprets the ops from state.pc on */
+    template <typename State> constexpr std::int64_t run(State& state) const {
+        while (state.pc < ops.size()) {
+            state.pc = execute(state.pc, state);
+        }
+        return state.exit_value;
+    }
+};
+
+/**
+ * Parses a snippet into SnippetProgram ops, checking it like Parser and
+ * Generator do. Nesting is kept on explicit stacks like in Parser. inputs
+ * are scalars declared before the snippet's first statement, in slots
+ * 0, 1, ...
+ */
+template <std::size_t Capacity> class SnippetCompiler {
+  public:
+    /** the most slots a snippet may use; they live on the C++ stack */
+    static constexpr std::size_t kMaxSlots = 1 << 16;
+
+    constexpr SnippetCompiler(const std::string_view source,
+                              const std::initializer_list<std::string_view> inputs)
+        : m_tokens(tokenize_snippet<Capacity>(source)) {
+        for (const std::string_view input : inputs) {
+            declare({.type = TokenType::identifier, .text = input}, 0);
+        }
+    }
+
+    constexpr SnippetProgram<Capacity> compile() {
+        while (m_index < m_tokens.size()) {
+            statement();
+        }
+        if (!m_scopes.empty()) {
+            error("Expected `}`", current_line());
+        }
+        return m_program;
+    }
+
+  private:
+    static constexpr std::size_t kNone = std::numeric_limits<std::size_t>::max();
+
+    struct Variable {
+        std::string_view name;
+        std::size_t slot = 0;
+        /** 0 for a scalar */
+        std::size_t length = 0;
+        IntType type = IntType::i64;
+    };
+
+    /** a scope whose closing `}` has not been reached yet */
+    struct OpenScope {
+        /** variables declared before it */
+        std::size_t variables = 0;
+        bool chain = false;
+        bool else_arm = false;
+        /** the jump_if_zero of an if/elif arm */
+        std::size_t test = kNone;
+        /** the jumps from the ends of earlier arms, linked through target */
+        std::size_t exits = kNone;
+    };
+
+    /** a pending operator; a bracket marker holds the indexed array */
+    struct Operator {
+        TokenType type = TokenType::addition;
+        SnippetToken array;
+    };
+
+    // not constexpr: reaching one while folding is the compile error
+    [[noreturn]] static void error(const char* message, const int line) {
+        throw CompileError(message, line);
+    }
+
+    [[noreturn]] static void error(const char* message,
+                                   const SnippetToken& token) {
+        throw CompileError(std::string(message) + std::string(token.text),
+                           token.line);
+    }
+
+    [[nodiscard]] constexpr bool peek(const TokenType type,
+                                      const std::size_t offset = 0) const {
+        return m_index + offset < m_tokens.size() &&
+               m_tokens[m_index + offset].type == type;
+    }
+
+    constexpr SnippetToken eat() { return m_tokens[m_index++]; }
+
+    constexpr SnippetToken consume(const TokenType type, const char* message) {
+        if (!peek(type)) {
+            error(message, current_line());
+        }
+        return eat();
+    }
+
+    [[nodiscard]] constexpr int current_line() const {
+        if (m_index < m_tokens.size()) {
+            return m_tokens[m_index].line;
+        }
+        return m_tokens.empty() ? 0 : m_tokens.back().line;
+    }
+
+    constexpr std::size_t emit(const SnippetOp& op) {
+        using Kind = SnippetOp::Kind;
+        switch (op.kind) {
+        case Kind::literal:
+        case Kind::load:
+        case Kind::load_lane:
+            m_depth++;
+            break;
+        case Kind::add:
+        case Kind::subtract:
+        case Kind::multiply:
+        case Kind::divide:
+        case Kind::store:
+        case Kind::exit:
+        case Kind::jump_if_zero:
+            m_depth--;
+            break;
+        case Kind::store_element:
+            m_depth -= 2;
+            break;
+        default:
+            break;
+        }
+        m_program.depth = std::max(m_program.depth, m_depth);
+        m_program.ops.push_back(op);
+        return m_program.ops.size() - 1;
+    }
+
+    /** the first free slot */
+    [[nodiscard]] constexpr std::size_t frame() const {
+        return m_variables.empty()
+                   ? 0
+                   : m_variables.back().slot +
+                         std::max<std::size_t>(m_variables.back().length, 1);
+    }
+
+    constexpr void reserve(const std::size_t slots) {
+        if (slots > kMaxSlots) {
+            error("Snippet needs too many stack slots", current_line());
+        }
+        m_program.slots = std::max(m_program.slots, slots);
+    }
+
+    [[nodiscard]] constexpr const Variable* find(const std::string_view name) const {
+        for (const Variable& variable : m_variables) {
+            if (variable.name == name) {
+                return &variable;
+            }
+        }
+        return nullptr;
+    }
+
+    constexpr const Variable& variable(const SnippetToken& identifier) const {
+        const Variable* found = find(identifier.text);
+        if (found == nullptr) {
+            error("Undeclared identifier: ", identifier);
+        }
+        return *found;
+    }
+
+    constexpr const Variable& array(const SnippetToken& identifier) const {
+        const Variable& found = variable(identifier);
+        if (found.length == 0) {
+            error("Not an array: ", identifier);
+        }
+        return found;
+    }
+
+    constexpr void declare(const SnippetToken& identifier,
+                           const std::size_t length,
+                           const IntType type = IntType::i64) {
+        if (find(identifier.text) != nullptr) {
+            error("Identifier already used: ", identifier);
+        }
+        const std::size_t slot = frame();
+        reserve(slot + std::max<std::size_t>(length, 1));
+        m_variables.push_back(
+            {.name = identifier.text, .slot = slot, .length = length, .type = type});
+    }
+
+    /**
+     * Like check_store: no operand of the tokens from first on, which hold
+     * a scalar's new value, is a literal or variable that type cannot hold
+     * every value of. Tokens inside `[]` are indices and not checked.
+     */
+    constexpr void check_store(const std::size_t first,
+                               const IntType type) const {
+        if (type == IntType::i64) {
+            return;
+        }
+        std::size_t depth = 0;
+        for (std::size_t i = first; i < m_index; i++) {
+            const SnippetToken& token = m_tokens[i];
+            if (token.type == TokenType::open_bracket) {
+                depth++;
+            } else if (token.type == TokenType::close_bracket) {
+                depth--;
+            } else if (depth != 0) {
+                continue;
+            } else if (token.type == TokenType::intLiteral &&
+                       !literal_fits(token.text, type)) {
+                throw CompileError("Literal " + std::string(token.text) +
+                                       " does not fit " +
+                                       std::string(type_name(type)),
+                                   token.line);
+            } else if (token.type == TokenType::identifier) {
+                const Variable* variable = find(token.text);
+                const IntType from =
+                    variable == nullptr || variable->length != 0
+                        ? IntType::i64
+                        : variable->type;
+                if (!type_holds(type, from)) {
+                    throw CompileError(
+                        "Type " + std::string(type_name(from)) +
+                            " does not fit " + std::string(type_name(type)) +
+                            ": " + std::string(token.text),
+                        token.line);
+                }
+            }
+        }
+    }
+
+    static constexpr std::int64_t literal(const std::string_view digits) {
+        std::uint64_t value = 0;
+        for (const char digit : digits) {
+            value = value * 10 + static_cast<std::uint64_t>(digit - '0');
+        }
+        return static_cast<std::int64_t>(value);
+    }
+
+    /** an identifier or literal operand, as a scalar or as lane elements */
+    constexpr void operand(const SnippetToken& token, const std::size_t lanes) {
+        if (token.type == TokenType::intLiteral) {
+            emit({.kind = SnippetOp::Kind::literal, .value = literal(token.text)});
+            return;
+        }
+        const Variable& read = variable(token);
+        if (read.length == 0) {
+            emit({.kind = SnippetOp::Kind::load, .slot = read.slot});
+        } else if (lanes == 0) {
+            error("Array used as a scalar: ", token);
+        } else if (read.length != lanes) {
+            throw CompileError(
+                "Array length mismatch: " + std::string(token.text) + " has " +
+                    std::to_string(read.length) + " elements, not " +
+                    std::to_string(lanes),
+                token.line);
+        } else {
+            emit({.kind = SnippetOp::Kind::load_lane, .slot = read.slot});
+        }
+    }
+
+    constexpr void reduce(FixedVector<Operator, Capacity>& operators) {
+        using Kind = SnippetOp::Kind;
+        const TokenType type = operators.back().type;
+        operators.pop_back();
+        emit({.kind = type == TokenType::addition         ? Kind::add
+                      : type == TokenType::substraction   ? Kind::subtract
+                      : type == TokenType::multiplication ? Kind::multiply
+                                                          : Kind::divide});
+    }
+
+    /**
+     * Parser::parseExpression's shunting-yard, emitting ops as it goes.
+     * lanes is the length of the array it is assigned to element by
+     * element, 0 for a scalar; indices are always scalars. False when no
+     * expression starts here.
+     */
+    constexpr bool expression(const std::size_t lanes) {
+        // expressions do not nest, so they share one operator stack
+        FixedVector<Operator, Capacity>& operators = m_operators;
+        std::size_t groups = 0;
+        std::size_t brackets = 0;
+        bool expect_operand = true;
+        while (true) {
+            if (expect_operand) {
+                if (peek(TokenType::identifier) &&
+                    peek(TokenType::open_bracket, 1)) {
+                    const SnippetToken indexed = eat();
+                    eat();
+                    operators.push_back(
+                        {.type = TokenType::open_bracket, .array = indexed});
+                    groups++;
+                    brackets++;
+                } else if (peek(TokenType::identifier) ||
+                           peek(TokenType::intLiteral)) {
+                    operand(eat(), brackets == 0 ? lanes : 0);
+                    expect_operand = false;
+                } else if (peek(TokenType::openParentheses)) {
+                    operators.push_back({.type = eat().type, .array = {}});
+                    groups++;
+                } else if (operators.empty()) {
+                    return false;
+                } else if (operators.back().type == TokenType::openParentheses ||
+                           operators.back().type == TokenType::open_bracket) {
+                    error("Expected expression", current_line());
+                } else {
+                    error("Unable to parse expression", current_line());
+                }
+                continue;
+            }
+
+            if (m_index >= m_tokens.size()) {
+                break;
+            }
+            const TokenType current = m_tokens[m_index].type;
+            if (const std::optional<int> precedence = isBinaryOperator(current)) {
+                while (!operators.empty() &&
+                       isBinaryOperator(operators.back().type) >= precedence) {
+                    reduce(operators);
+                }
+                operators.push_back({.type = eat().type, .array = {}});
+                expect_operand = true;
+            } else if (current == TokenType::closeParentheses && groups > 0 &&
+                       innermost_group(operators) == TokenType::openParentheses) {
+                eat();
+                while (operators.back().type != TokenType::openParentheses) {
+                    reduce(operators);
+                }
+                operators.pop_back();
+                groups--;
+            } else if (current == TokenType::close_bracket && groups > 0 &&
+                       innermost_group(operators) == TokenType::open_bracket) {
+                eat();
+                while (operators.back().type != TokenType::open_bracket) {
+                    reduce(operators);
+                }
+                const Variable& indexed = array(operators.back().array);
+                operators.pop_back();
+                groups--;
+                brackets--;
+                emit({.kind = SnippetOp::Kind::load_element,
+                      .slot = indexed.slot,
+                      .length = indexed.length});
+            } else {
+                break;
+            }
+        }
+
+        if (groups > 0) {
+            error(innermost_group(operators) == TokenType::openParentheses
+                      ? "Expected close parenthesis"
+                      : "Expected `]`",
+                  current_line());
+        }
+        while (!operators.empty()) {
+            reduce(operators);
+        }
+        return true;
+    }
+
+    static constexpr TokenType
+    innermost_group(const FixedVector<Operator, Capacity>& operators) {
+        for (std::size_t i = operators.size(); i > 0; i--) {
+            if (!isBinaryOperator(operators[i - 1].type).has_value()) {
+                return operators[i - 1].type;
+            }
+        }
+        return TokenType::addition;
+    }
+
+    constexpr void required_expression(const std::size_t lanes,
+                                       const char* message) {
+        if (!expression(lanes)) {
+            error(message, current_line());
+        }
+    }
+
+    /** ops computing the elements of array from the expression that follows */
+    constexpr void elementwise(const Variable& array, const std::size_t scratch) {
+        reserve(scratch + array.length);
+        const std::size_t op = emit({.kind = SnippetOp::Kind::elementwise,
+                                     .slot = array.slot,
+                                     .length = array.length,
+                                     .scratch = scratch});
+        required_expression(array.length, "Invalid expression");
+        m_depth--;
+        m_program.ops[op].target = m_program.ops.size();
+    }
+
+    /** the ops of one statement, or the start or end of a scope */
+    constexpr void statement() {
+        using Kind = SnippetOp::Kind;
+        if (peek(TokenType::import)) {
+            error("Snippets cannot import modules", eat().line);
+        }
+        if (peek(TokenType::exit) && peek(TokenType::openParentheses, 1)) {
+            eat();
+            eat();
+            required_expression(0, "Expected Scope");
+            consume(TokenType::closeParentheses, "Expected Scope");
+            consume(TokenType::semicolon, "Expected `;`");
+            emit({.kind = Kind::exit});
+            return;
+        }
+
+        if (peek(TokenType::assign) && peek(TokenType::identifier, 1) &&
+            (peek(TokenType::equals, 2) || peek(TokenType::open_bracket, 2) ||
+             peek(TokenType::colon, 2))) {
+            eat();
+            const SnippetToken name = eat();
+            std::size_t length = 0;
+            if (peek(TokenType::open_bracket)) {
+                eat();
+                const SnippetToken digits =
+                    consume(TokenType::intLiteral, "Expected array length");
+                length = static_cast<std::size_t>(literal(digits.text));
+                if (digits.text.size() > 9 || length == 0) {
+                    error("Invalid array length ", digits);
+                }
+                consume(TokenType::close_bracket, "Expected `]`");
+            }
+            IntType type = IntType::i64;
+            if (peek(TokenType::colon)) {
+                eat();
+                const SnippetToken named =
+                    consume(TokenType::identifier, "Expected type");
+                const std::optional<IntType> parsed = parse_int_type(named.text);
+                if (!parsed.has_value()) {
+                    error("Unknown type ", named);
+                }
+                type = parsed.value();
+                if (length != 0 && type != IntType::i64) {
+                    error("Array elements are i64", name.line);
+                }
+            }
+            consume(TokenType::equals, "Expected `=`");
+            if (find(name.text) != nullptr) {
+                error("Identifier already used: ", name);
+            }
+            if (length == 0) {
+                const std::size_t first = m_index;
+                required_expression(0, "Invalid expression");
+                check_store(first, type);
+                declare(name, 0, type);
+                emit({.kind = Kind::store,
+                      .slot = m_variables.back().slot,
+                      .type = type});
+            } else {
+                const std::size_t slot = frame();
+                elementwise({.name = name.text, .slot = slot, .length = length},
+                            slot + length);
+                declare(name, length);
+            }
+            consume(TokenType::semicolon, "Expected `;`");
+            return;
+        }
+
+        if (peek(TokenType::identifier) &&
+            (peek(TokenType::equals, 1) || peek(TokenType::open_bracket, 1))) {
+            const SnippetToken name = eat();
+            const Variable target = variable(name);
+            if (peek(TokenType::open_bracket)) {
+                eat();
+                const Variable indexed = array(name);
+                required_expression(0, "Expected Expression");
+                consume(TokenType::close_bracket, "Expected `]`");
+                consume(TokenType::equals, "Expected `=`");
+                required_expression(0, "Expected Expression");
+                emit({.kind = Kind::store_element,
+                      .slot = indexed.slot,
+                      .length = indexed.length});
+            } else {
+                consume(TokenType::equals, "Expected `=`");
+                if (target.length == 0) {
+                    const std::size_t first = m_index;
+                    required_expression(0, "Expected Expression");
+                    check_store(first, target.type);
+                    emit({.kind = Kind::store,
+                          .slot = target.slot,
+                          .type = target.type});
+                } else {
+                    elementwise(target, frame());
+                }
+            }
+            consume(TokenType::semicolon, "Expected semicolon");
+            return;
+        }
+
+        if (peek(TokenType::open_curly)) {
+            eat();
+            m_scopes.push_back({.variables = m_variables.size()});
+            return;
+        }
+
+        if (peek(TokenType::if_)) {
+            eat();
+            consume(TokenType::openParentheses, "Expected `(`");
+            required_expression(0, "Invalid Expression");
+            consume(TokenType::closeParentheses, "Expected `)`");
+            const std::size_t test = emit({.kind = Kind::jump_if_zero});
+            consume(TokenType::open_curly, "Invalid scope");
+            m_scopes.push_back({.variables = m_variables.size(),
+                                .chain = true,
+                                .test = test});
+            return;
+        }
+
+        if (m_scopes.empty()) {
+            error("Invalid statement", current_line());
+        }
+        consume(TokenType::close_curly, "Expected `}`");
+        const OpenScope done = m_scopes.back();
+        m_scopes.pop_back();
+        while (m_variables.size() > done.variables) {
+            m_variables.pop_back();
+        }
+        if (done.chain) {
+            next_arm(done);
+        }
+    }
+
+    /** after an arm of an if chain: opens the next elif or else arm, or ends the chain */
+    constexpr void next_arm(const OpenScope& done) {
+        using Kind = SnippetOp::Kind;
+        const bool elif = !done.else_arm && peek(TokenType::elif);
+        const bool otherwise = !done.else_arm && peek(TokenType::else_);
+        std::size_t exits = done.exits;
+        if (elif || otherwise) {
+            exits = emit({.kind = Kind::jump, .target = exits});
+        }
+        if (done.test != kNone) {
+            m_program.ops[done.test].target = m_program.ops.size();
+        }
+        if (elif) {
+            eat();
+            consume(TokenType::openParentheses, "Expected `(`");
+            required_expression(0, "Expected Expression");
+            consume(TokenType::closeParentheses, "Expected `)`");
+            const std::size_t test = emit({.kind = Kind::jump_if_zero});
+            consume(TokenType::open_curly, "Expected Scope");
+            m_scopes.push_back({.variables = m_variables.size(),
+                                .chain = true,
+                                .test = test,
+                                .exits = exits});
+        } else if (otherwise) {
+            eat();
+            consume(TokenType::open_curly, "Expected Scope");
+            m_scopes.push_back({.variables = m_variables.size(),
+                                .chain = true,
+                                .else_arm = true,
+                                .exits = exits});
+        } else {
+            while (exits != kNone) {
+                const std::size_t next = m_program.ops[exits].target;
+                m_program.ops[exits].target = m_program.ops.size();
+                exits = next;
+            }
+        }
+    }
+
+    FixedVector<SnippetToken, Capacity> m_tokens;
+    std::size_t m_index = 0;
+    FixedVector<Variable, Capacity> m_variables;
+    FixedVector<OpenScope, Capacity> m_scopes;
+    FixedVector<Operator, Capacity> m_operators;
+    std::size_t m_depth = 0;
+    SnippetProgram<Capacity> m_program;
+};
+
+/** source lowered at compile time; inputs are its predeclared scalars */
+template <std::size_t Capacity>
+constexpr SnippetProgram<Capacity>
+compile_snippet(const std::string_view source,
+                const std::initializer_list<std::string_view> inputs = {}) {
+    return SnippetCompiler<Capacity>(source, inputs).compile();
+}
+
+template <auto> using SnippetInput = std::int64_t;
+
+/**
+ * A snippet as an inline C++ function: run() takes one value per name in
+ * Inputs and returns the argument of exit(), 0 if the snippet never
+ * calls it. A compiled program's exit status is the low 8 bits of it.
+ */
+template <FixedString Source, FixedString... Inputs> struct Snippet {
+    static constexpr auto program = [] {
+        // compiled twice, which keeps the source-sized vector out of the
+        // object file
+        constexpr auto compile = [] {
+            return compile_snippet<Source.view().size() + 1>(
+                Source.view(), {Inputs.view()...});
+        };
+        return compile().template fitted<compile().ops.size()>();
+    }();
+
+    /**
+     * The ops unrolled, one SnippetProgram::step() per op with a constant
+     * pc, which the optimizer folds down to that op's code. The unrolling
+     * is a fold expression rather than a template per op: those would each
+     * carry the source in their mangled name.
+     */
+    [[nodiscard]] static constexpr std::int64_t
+    run(const SnippetInput<Inputs>... inputs) {
+        SnippetState<program.slots, program.depth> state{.slots = {inputs...}};
+        [&]<std::size_t... Pcs>(std::index_sequence<Pcs...>) {
+            constexpr auto& ops = program.ops;
+            ((state.pc == Pcs
+                  ? void(state.pc =
+                             program.template step<ops[Pcs].kind>(Pcs, state))
+                  : void()),
+             ...);
+        }(std::make_index_sequence<program.ops.size()>{});
+        return state.exit_value;
+    }
+};
+
+/** folds a snippet without inputs to its exit() argument at compile time */
+template <FixedString Source> consteval std::int64_t eval() {
+    constexpr auto program = compile_snippet<Source.view().size() + 1>(
+        Source.view());
+    SnippetState<program.slots, program.depth> state;
+    return program.run(state);
+}
+
+} // namespace quarks
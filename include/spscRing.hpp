@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Bounded lock-free single-producer/single-consumer queue.
+ *
+ * push() and pop() spin (yielding) while the ring is full or empty. The
+ * producer calls close() when it is done; the consumer then drains what is
+ * left and pop() returns nullopt. Either side may close() early to cancel,
+ * which also makes a blocked push() give up.
+ */
+template <typename T> class SpscRing final {
+  public:
+    explicit SpscRing(const std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /** returns false when the ring was closed before the value got in */
+    bool push(T value) {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        while (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+            if (m_closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** blocks until a value is available or the ring is closed and empty */
+    std::optional<T> pop() {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        while (m_tail.load(std::memory_order_acquire) == head) {
+            if (m_closed.load(std::memory_order_acquire)) {
+                // the producer may have pushed right before closing
+                if (m_tail.load(std::memory_order_acquire) != head) {
+                    break;
+                }
+                return std::nullopt;
+            }
+            std::this_thread::yield();
+        }
+        std::optional<T> value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    void close() { m_closed.store(true, std::memory_order_release); }
+
+  private:
+    static constexpr std::size_t kCacheLine = 64;
+
+    std::vector<T> m_slots;
+    std::size_t m_mask = 0;
+    alignas(kCacheLine) std::atomic<std::size_t> m_head = 0;
+    alignas(kCacheLine) std::atomic<std::size_t> m_tail = 0;
+    alignas(kCacheLine) std::atomic<bool> m_closed = false;
+};
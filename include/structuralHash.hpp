@@ -0,0 +1,224 @@
+#pragma once
+#include "parser.hpp"
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Structural hashes of statements: equal for statements that spell the same
+ * code wherever they are, so identical scopes and statement suffixes are
+ * found without comparing trees pairwise. Positions and lines are ignored.
+ * Hashes are memoized per statement, so hashing the arms of nested chains
+ * walks every node once; same() settles collisions.
+ */
+class StructuralHash final {
+  public:
+    [[nodiscard]] std::size_t operator()(const StatementNode* statement) {
+        if (const auto it = m_hashes.find(statement); it != m_hashes.end()) {
+            return it->second;
+        }
+        // statements without a hash yet, parents before children
+        std::vector<const StatementNode*> order{statement};
+        for (std::size_t i = 0; i < order.size(); i++) {
+            walk(order[i], [&](const Piece& piece) {
+                if (piece.nested != nullptr &&
+                    !m_hashes.contains(piece.nested)) {
+                    order.push_back(piece.nested);
+                }
+                return piece.nested == nullptr;
+            });
+        }
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            std::size_t hash = 0;
+            walk(*it, [&](const Piece& piece) {
+                for (const std::size_t part :
+                     {static_cast<std::size_t>(piece.tag),
+                      std::hash<std::string_view>{}(piece.text), piece.number,
+                      piece.nested == nullptr ? 0 : m_hashes.at(piece.nested)}) {
+                    hash ^= part + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+                }
+                return piece.nested == nullptr;
+            });
+            m_hashes.emplace(*it, hash);
+        }
+        return m_hashes.at(statement);
+    }
+
+    /**
+     * forgets every memoized hash, for when the statements may be freed and
+     * their addresses reused
+     */
+    void clear() { m_hashes.clear(); }
+
+    /** a and b spell the same code */
+    [[nodiscard]] static bool same(const StatementNode* a,
+                                   const StatementNode* b) {
+        if (a == b) {
+            return true;
+        }
+        std::vector<Piece> pieces;
+        walk(a, [&](const Piece& piece) {
+            pieces.push_back(piece);
+            return true;
+        });
+        std::size_t next = 0;
+        bool equal = true;
+        walk(b, [&](const Piece& piece) {
+            equal = equal && next < pieces.size() &&
+                    pieces[next].tag == piece.tag &&
+                    pieces[next].text == piece.text &&
+                    pieces[next].number == piece.number;
+            next++;
+            return equal;
+        });
+        return equal && next == pieces.size();
+    }
+
+  private:
+    enum class Tag : std::uint8_t {
+        exit,
+        let,
+        assign,
+        import,
+        scope,
+        if_,
+        elif,
+        else_,
+        literal,
+        identifier,
+        parenthesis,
+        index,
+        binary,
+        /** a statement in a scope, see walk() */
+        statement,
+    };
+
+    struct Piece {
+        Tag tag;
+        std::string_view text;
+        std::size_t number = 0;
+        /** the statement a Tag::statement piece stands for */
+        const StatementNode* nested = nullptr;
+    };
+
+    /**
+     * Calls visit with the pieces of statement in preorder. A statement in
+     * one of its scopes is a Tag::statement piece, followed by its own
+     * pieces only while visit returns true; other pieces ignore the result.
+     */
+    template <typename Visit>
+    static void walk(const StatementNode* statement, Visit&& visit) {
+        using Item = std::variant<const StatementNode*, const nodeScope*,
+                                  const nodeIfPredicate*, const ExpressionNode*>;
+        std::vector<Item> pending{statement};
+        const auto scope = [&](const nodeScope* body) {
+            pending.emplace_back(body);
+        };
+        bool root = true;
+        while (!pending.empty()) {
+            const Item item = pending.back();
+            pending.pop_back();
+            if (const auto* next = std::get_if<const StatementNode*>(&item)) {
+                if (!std::exchange(root, false) &&
+                    !visit(Piece{.tag = Tag::statement, .nested = *next})) {
+                    continue;
+                }
+                std::visit(
+                    [&](const auto* node) {
+                        using Node = std::remove_cvref_t<decltype(*node)>;
+                        if constexpr (std::is_same_v<Node, StatementExitNode>) {
+                            visit(Piece{.tag = Tag::exit});
+                            pending.emplace_back(node->expr);
+                        } else if constexpr (std::is_same_v<Node,
+                                                            LetStatementNode>) {
+                            visit(Piece{.tag = Tag::let,
+                                        .text = node->identifier.value.value(),
+                                        .number = node->length * 8 +
+                                                  static_cast<std::size_t>(
+                                                      node->type)});
+                            pending.emplace_back(node->expression);
+                        } else if constexpr (std::is_same_v<Node,
+                                                            nodeStatementAssign>) {
+                            visit(Piece{.tag = Tag::assign,
+                                        .text = node->identifier.value.value(),
+                                        .number = node->index != nullptr});
+                            pending.emplace_back(node->expression);
+                            if (node->index != nullptr) {
+                                pending.emplace_back(node->index);
+                            }
+                        } else if constexpr (std::is_same_v<Node,
+                                                            ImportStatementNode>) {
+                            visit(Piece{.tag = Tag::import,
+                                        .text = node->module.value.value()});
+                        } else if constexpr (std::is_same_v<Node, nodeScope>) {
+                            scope(node);
+                        } else {
+                            visit(Piece{.tag = Tag::if_,
+                                        .number = node->ifPredicate.has_value()});
+                            if (node->ifPredicate.has_value()) {
+                                pending.emplace_back(node->ifPredicate.value());
+                            }
+                            scope(node->scope);
+                            pending.emplace_back(node->expression);
+                        }
+                    },
+                    (*next)->var);
+            } else if (const auto* body = std::get_if<const nodeScope*>(&item)) {
+                visit(Piece{.tag = Tag::scope,
+                            .number = (*body)->statements.size()});
+                for (auto it = (*body)->statements.rbegin();
+                     it != (*body)->statements.rend(); ++it) {
+                    pending.emplace_back(*it);
+                }
+            } else if (const auto* predicate =
+                           std::get_if<const nodeIfPredicate*>(&item)) {
+                if (const auto* elif = std::get_if<nodeIfPredicateElif*>(
+                        &(*predicate)->predicate)) {
+                    visit(Piece{.tag = Tag::elif,
+                                .number = (*elif)->ifPredicate.has_value()});
+                    if ((*elif)->ifPredicate.has_value()) {
+                        pending.emplace_back((*elif)->ifPredicate.value());
+                    }
+                    scope((*elif)->scope);
+                    pending.emplace_back((*elif)->expression);
+                } else {
+                    visit(Piece{.tag = Tag::else_});
+                    scope(std::get<nodeIfPredicateElse*>((*predicate)->predicate)
+                              ->scope);
+                }
+            } else {
+                const ExpressionNode* expression =
+                    std::get<const ExpressionNode*>(item);
+                if (const auto* binary =
+                        std::get_if<BinaryExpressionNode*>(&expression->var)) {
+                    visit(Piece{.tag = Tag::binary,
+                                .number = (*binary)->ops.index()});
+                    pending.emplace_back(operands(*binary).second);
+                    pending.emplace_back(operands(*binary).first);
+                    continue;
+                }
+                const TermNode* term = std::get<TermNode*>(expression->var);
+                if (const auto* literal =
+                        std::get_if<TermIntLiteralNode*>(&term->vars)) {
+                    visit(Piece{.tag = Tag::literal,
+                                .text = (*literal)->int_literals.value.value()});
+                } else if (const auto* id =
+                               std::get_if<TermIdentifierNode*>(&term->vars)) {
+                    visit(Piece{.tag = Tag::identifier,
+                                .text = (*id)->identifier.value.value()});
+                } else if (const auto* parenthesis =
+                               std::get_if<TermParenthesisNode*>(&term->vars)) {
+                    visit(Piece{.tag = Tag::parenthesis});
+                    pending.emplace_back((*parenthesis)->expression);
+                } else {
+                    const TermIndexNode* element =
+                        std::get<TermIndexNode*>(term->vars);
+                    visit(Piece{.tag = Tag::index,
+                                .text = element->identifier.value.value()});
+                    pending.emplace_back(element->index);
+                }
+            }
+        }
+    }
+
+    std::unordered_map<const StatementNode*, std::size_t> m_hashes;
+};
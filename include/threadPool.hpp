@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing pool: every worker owns a deque, runs its own tasks LIFO
+ * (cache-warm) and steals FIFO from the other workers when it runs dry.
+ * Tasks submitted from outside the pool are dealt out round robin.
+ */
+class ThreadPool final {
+  public:
+    explicit ThreadPool(
+        const std::size_t num_threads = std::thread::hardware_concurrency()) {
+        const std::size_t count = std::max<std::size_t>(num_threads, 1);
+        for (std::size_t i = 0; i < count; i++) {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            m_workers.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_work_cv.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const { return m_workers.size(); }
+
+    void submit(std::function<void()> task) {
+        const std::size_t index = t_worker_index.has_value() &&
+                                          t_worker_pool == this
+                                      ? t_worker_index.value()
+                                      : m_next++ % m_queues.size();
+        {
+            std::lock_guard lock(m_mutex);
+            m_pending++;
+            {
+                std::lock_guard queue_lock(m_queues[index]->mutex);
+                m_queues[index]->tasks.push_back(std::move(task));
+            }
+            m_queued++;
+        }
+        m_work_cv.notify_one();
+    }
+
+    /** blocks until every submitted task has finished running */
+    void wait() {
+        std::unique_lock lock(m_mutex);
+        m_done_cv.wait(lock, [this] { return m_pending == 0; });
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    std::size_t m_pending = 0;
+    std::atomic<std::size_t> m_queued = 0;
+    std::atomic<std::size_t> m_next = 0;
+    bool m_stop = false;
+
+    static inline thread_local std::optional<std::size_t> t_worker_index;
+    static inline thread_local const ThreadPool* t_worker_pool = nullptr;
+
+    bool try_pop(const std::size_t index, std::function<void()>& task) {
+        Queue& queue = *m_queues[index];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        m_queued--;
+        return true;
+    }
+
+    bool try_steal(const std::size_t index, std::function<void()>& task) {
+        for (std::size_t i = 1; i < m_queues.size(); i++) {
+            Queue& victim = *m_queues[(index + i) % m_queues.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                m_queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(const std::size_t index) {
+        t_worker_index = index;
+        t_worker_pool = this;
+        while (true) {
+            std::function<void()> task;
+            if (try_pop(index, task) || try_steal(index, task)) {
+                task();
+                std::lock_guard lock(m_mutex);
+                if (--m_pending == 0) {
+                    m_done_cv.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock lock(m_mutex);
+            m_work_cv.wait(lock, [this] { return m_stop || m_queued > 0; });
+            if (m_stop && m_queued == 0) {
+                return;
+            }
+        }
+    }
+};
@@ -1,4 +1,12 @@
 #pragma once
+#include "compileError.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -20,9 +28,13 @@ enum class TokenType {
     if_,
     elif,
     else_,
+    open_bracket,
+    close_bracket,
+    import,
+    colon,
 };
 
-inline std::optional<int> isBinaryOperator(const TokenType type) {
+constexpr std::optional<int> isBinaryOperator(const TokenType type) {
     switch (type) {
     case TokenType::substraction:
     case TokenType::addition:
@@ -39,120 +51,198 @@ struct Token {
     TokenType type;
     optional<std::string> value;
     int line;
+    /** 0-based like line, saturating at INT_MAX on absurdly long lines */
+    int column = 0;
 };
 
 class Tokenizer {
   public:
-    explicit Tokenizer(std::string source) : m_src(std::move(source)) {}
+    /**
+     * first_line and first_column place a source that is a slice of a file;
+     * first_column only applies to the slice's first line
+     */
+    explicit Tokenizer(std::string source, const int first_line = 0,
+                       const std::size_t first_column = 0)
+        : m_src(std::move(source)), m_line(first_line),
+          m_line_start_column(first_column) {}
 
     vector<Token> tokenize() {
-        string buffer;
         vector<Token> tokens;
-        int line_count = 0;
+        tokenize([&](Token&& token) { tokens.push_back(std::move(token)); });
+        return tokens;
+    }
+
+    /** hands every token to sink as soon as it is recognized */
+    template <typename Sink> void tokenize(Sink&& sink) {
+        while (scan(sink)) {
+        }
+        m_index = 0;
+        m_line = m_first_line;
+        m_line_start = 0;
+        m_line_start_column = m_first_column;
+    }
+
+    /**
+     * Pull interface: the next token, or nullopt at the end of the input.
+     * Tokens are scanned on demand, so only the lookahead window is ever
+     * resident. Do not mix with tokenize() on the same tokenizer.
+     */
+    std::optional<Token> next() {
+        if (!peek(0).has_value()) {
+            return std::nullopt;
+        }
+        Token token = std::move(m_lookahead[m_lookahead_head]);
+        m_lookahead_head = (m_lookahead_head + 1) % kLookahead;
+        m_lookahead_count--;
+        return token;
+    }
+
+    /** the token offset places ahead of next(), without consuming it */
+    [[nodiscard]] std::optional<Token> peek(const std::size_t offset = 0) {
+        assert(offset < kLookahead);
+        while (m_lookahead_count <= offset) {
+            const bool more = scan([this](Token&& token) {
+                m_lookahead[(m_lookahead_head + m_lookahead_count) %
+                            kLookahead] = std::move(token);
+                m_lookahead_count++;
+            });
+            if (!more) {
+                return std::nullopt;
+            }
+        }
+        return m_lookahead[(m_lookahead_head + offset) % kLookahead];
+    }
+
+    /** the parser looks at most three tokens ahead (`assign x =`) */
+    static constexpr std::size_t kLookahead = 3;
+
+  private:
+    /**
+     * Consumes one token's worth of input (or a comment / whitespace) and
+     * hands at most one token to sink. False once the input is exhausted.
+     */
+    template <typename Sink> bool scan(Sink&& sink) {
+        string buffer;
+        int& line_count = m_line;
+        const int column = static_cast<int>(
+            std::min<std::size_t>(m_index - m_line_start + m_line_start_column,
+                                  std::numeric_limits<int>::max()));
 
-        while (peek().has_value()) {
-            if (isalpha(peek().value())) {
-                buffer.push_back(eat());
-                while (peek().has_value() && std::isalnum(peek().value())) {
-                    buffer.push_back(eat());
+        if (peek_char().has_value()) {
+            if (isalpha(peek_char().value())) {
+                buffer.push_back(eat_char());
+                while (peek_char().has_value() && std::isalnum(peek_char().value())) {
+                    buffer.push_back(eat_char());
                 }
                 if (buffer == "exit") {
-                    tokens.push_back(
-                        {.type = TokenType::exit, .value = buffer, .line = line_count});
+                    sink(
+                        {.type = TokenType::exit, .value = buffer, .line = line_count, .column = column});
                     buffer.clear();
                 } else if (buffer == "assign") {
-                    tokens.push_back({.type = TokenType::assign, .line = line_count});
+                    sink({.type = TokenType::assign, .line = line_count, .column = column});
                     buffer.clear();
                 } else if (buffer == "if") {
-                    tokens.push_back({.type = TokenType::if_, .line = line_count});
+                    sink({.type = TokenType::if_, .line = line_count, .column = column});
                     buffer.clear();
                 } else if (buffer == "elif") {
-                    tokens.push_back({.type = TokenType::elif, .line = line_count});
+                    sink({.type = TokenType::elif, .line = line_count, .column = column});
                     buffer.clear();
                 } else if (buffer == "else") {
-                    tokens.push_back({.type = TokenType::else_, .line = line_count});
+                    sink({.type = TokenType::else_, .line = line_count, .column = column});
+                    buffer.clear();
+                } else if (buffer == "import") {
+                    sink({.type = TokenType::import, .line = line_count, .column = column});
                     buffer.clear();
                 } else {
-                    tokens.push_back(
-                        {.type = TokenType::identifier, .value = buffer});
+                    sink(
+                        {.type = TokenType::identifier, .value = buffer, .line = line_count, .column = column});
                     buffer.clear();
                 }
-            } else if (peek().value() == '(') {
-                eat();
-                tokens.push_back({.type = TokenType::openParentheses, .line = line_count});
-            } else if (peek().value() == ')') {
-                eat();
-                tokens.push_back({.type = TokenType::closeParentheses, .line = line_count});
-            } else if (isdigit(peek().value())) {
-                buffer.push_back(eat());
-                while (peek().has_value() && isdigit(peek().value())) {
-                    buffer.push_back(eat());
+            } else if (peek_char().value() == '(') {
+                eat_char();
+                sink({.type = TokenType::openParentheses, .line = line_count, .column = column});
+            } else if (peek_char().value() == ')') {
+                eat_char();
+                sink({.type = TokenType::closeParentheses, .line = line_count, .column = column});
+            } else if (peek_char().value() == '[') {
+                eat_char();
+                sink({.type = TokenType::open_bracket, .line = line_count, .column = column});
+            } else if (peek_char().value() == ']') {
+                eat_char();
+                sink({.type = TokenType::close_bracket, .line = line_count, .column = column});
+            } else if (isdigit(peek_char().value())) {
+                buffer.push_back(eat_char());
+                while (peek_char().has_value() && isdigit(peek_char().value())) {
+                    buffer.push_back(eat_char());
                 }
-                tokens.push_back(
-                    {.type = TokenType::intLiteral, .value = buffer, .line = line_count});
+                sink(
+                    {.type = TokenType::intLiteral, .value = buffer, .line = line_count, .column = column});
                 buffer.clear();
-            } else if (peek().value() == '-' && peek(1).has_value() &&
-                       peek(1).value() == '-') {
-                eat();
-                eat();
-                while (peek().has_value() && peek().value() != '\n') {
-                    eat();
+            } else if (peek_char().value() == '-' && peek_char(1).has_value() &&
+                       peek_char(1).value() == '-') {
+                eat_char();
+                eat_char();
+                while (peek_char().has_value() && peek_char().value() != '\n') {
+                    eat_char();
                 }
-            } else if (peek().value() == '-' && peek(1).has_value() &&
-                       peek(1).value() == '*') {
-                eat();
-                eat();
-                while (peek().has_value() && peek().value() == '*' &&
-                       peek().value() == '-') {
+            } else if (peek_char().value() == '-' && peek_char(1).has_value() &&
+                       peek_char(1).value() == '*') {
+                eat_char();
+                eat_char();
+                while (peek_char().has_value() && peek_char().value() == '*' &&
+                       peek_char().value() == '-') {
                     break;
                 }
-                if (peek().has_value()) {
-                    eat();
+                if (peek_char().has_value()) {
+                    eat_char();
                 }
-                if (peek().has_value()) {
-                    eat();
+                if (peek_char().has_value()) {
+                    eat_char();
                 }
-            } else if (peek().value() == ';') {
-                eat();
-                tokens.push_back({.type = TokenType::semicolon, .line = line_count});
-            } else if (peek().value() == '=') {
-                eat();
-                tokens.push_back({.type = TokenType::equals, .line = line_count});
-            } else if (peek().value() == '+') {
-                eat();
-                tokens.push_back({.type = TokenType::addition, .line = line_count});
-            } else if (peek().value() == '*') {
-                eat();
-                tokens.push_back({.type = TokenType::multiplication, .line = line_count});
-            } else if (peek().value() == '-') {
-                eat();
-                tokens.push_back({.type = TokenType::substraction, .line = line_count});
-            } else if (peek().value() == '/') {
-                eat();
-                tokens.push_back({.type = TokenType::division, .line = line_count});
-            } else if (peek().value() == '{') {
-                eat();
-                tokens.push_back({.type = TokenType::open_curly, .line = line_count});
-            } else if (peek().value() == '}') {
-                eat();
-                tokens.push_back({.type = TokenType::close_curly, .line = line_count});
-            } else if (peek().value() == '\n') {
-                eat();
+            } else if (peek_char().value() == ';') {
+                eat_char();
+                sink({.type = TokenType::semicolon, .line = line_count, .column = column});
+            } else if (peek_char().value() == ':') {
+                eat_char();
+                sink({.type = TokenType::colon, .line = line_count, .column = column});
+            } else if (peek_char().value() == '=') {
+                eat_char();
+                sink({.type = TokenType::equals, .line = line_count, .column = column});
+            } else if (peek_char().value() == '+') {
+                eat_char();
+                sink({.type = TokenType::addition, .line = line_count, .column = column});
+            } else if (peek_char().value() == '*') {
+                eat_char();
+                sink({.type = TokenType::multiplication, .line = line_count, .column = column});
+            } else if (peek_char().value() == '-') {
+                eat_char();
+                sink({.type = TokenType::substraction, .line = line_count, .column = column});
+            } else if (peek_char().value() == '/') {
+                eat_char();
+                sink({.type = TokenType::division, .line = line_count, .column = column});
+            } else if (peek_char().value() == '{') {
+                eat_char();
+                sink({.type = TokenType::open_curly, .line = line_count, .column = column});
+            } else if (peek_char().value() == '}') {
+                eat_char();
+                sink({.type = TokenType::close_curly, .line = line_count, .column = column});
+            } else if (peek_char().value() == '\n') {
+                eat_char();
                 line_count++;
-            } else if (std::isspace(peek().value())) {
-                eat();
+                m_line_start = m_index;
+                m_line_start_column = 0;
+            } else if (std::isspace(peek_char().value())) {
+                eat_char();
             } else {
-                cerr << "Invalid token" << endl;
-                exit(EXIT_FAILURE);
+                throw CompileError("Invalid token", line_count);
             }
+            return true;
         }
-
-        m_index = 0;
-        return tokens;
+        return false;
     }
 
-  private:
-    [[nodiscard]] inline optional<char> peek(const int offset = 0) const {
+    [[nodiscard]] inline optional<char>
+    peek_char(const std::size_t offset = 0) const {
         if (m_index + offset >= m_src.length()) {
             return {};
         } else {
@@ -160,8 +250,18 @@ class Tokenizer {
         }
     }
 
-    char eat() { return m_src.at(m_index++); }
+    char eat_char() { return m_src.at(m_index++); }
 
     const string m_src;
-    int m_index = 0;
+    std::size_t m_index = 0;
+    int m_line;
+    int m_first_line = m_line;
+    /** index the current line starts at, and that index's column */
+    std::size_t m_line_start = 0;
+    std::size_t m_line_start_column;
+    std::size_t m_first_column = m_line_start_column;
+
+    std::array<Token, kLookahead> m_lookahead{};
+    std::size_t m_lookahead_head = 0;
+    std::size_t m_lookahead_count = 0;
 };
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cerrno>
+#include <filesystem>
+#include <iomanip>
+#include <spawn.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * The external assembler, linker and C compiler invocations. Each is an
+ * argument vector that is run without a shell, so paths and the compiler
+ * name reach the tool exactly as given and are never interpreted.
+ */
+namespace toolchain {
+
+/** a program, looked up on PATH unless it contains a '/', and its arguments */
+using Command = std::vector<std::string>;
+
+/** debug keeps the DWARF line table the source's %line directives describe */
+inline Command assemble(const std::filesystem::path& source,
+                        const std::filesystem::path& object,
+                        const bool debug = false) {
+    Command command{"nasm", "-felf64"};
+    if (debug) {
+        command.insert(command.end(), {"-g", "-F", "dwarf"});
+    }
+    command.insert(command.end(), {"-o", object.string(), source.string()});
+    return command;
+}
+
+inline Command link(const std::vector<std::filesystem::path>& objects,
+                    const std::filesystem::path& executable) {
+    Command command{"ld", "-o", executable.string()};
+    for (const std::filesystem::path& object : objects) {
+        command.push_back(object.string());
+    }
+    return command;
+}
+
+inline Command link(const std::filesystem::path& object,
+                    const std::filesystem::path& executable) {
+    return link(std::vector{object}, executable);
+}
+
+/** links objects the C compiler built */
+inline Command link_c(const std::string& compiler,
+                      const std::vector<std::filesystem::path>& objects,
+                      const std::filesystem::path& executable) {
+    Command command{compiler, "-o", executable.string()};
+    for (const std::filesystem::path& object : objects) {
+        command.push_back(object.string());
+    }
+    return command;
+}
+
+inline Command compile_c(const std::string& compiler,
+                         const std::filesystem::path& source,
+                         const std::filesystem::path& output,
+                         const bool object_only,
+                         const std::string& optimization = "-O3",
+                         const bool debug = false) {
+    Command command{compiler};
+    if (!optimization.empty()) {
+        command.push_back(optimization);
+    }
+    if (debug) {
+        command.emplace_back("-g");
+    }
+    if (object_only) {
+        command.emplace_back("-c");
+    }
+    command.insert(command.end(), {"-o", output.string(), source.string()});
+    return command;
+}
+
+/** the command as one line, for diagnostics */
+inline std::string describe(const Command& command) {
+    std::stringstream ss;
+    for (std::size_t i = 0; i < command.size(); i++) {
+        ss << (i > 0 ? " " : "") << std::quoted(command[i]);
+    }
+    return ss.str();
+}
+
+/** runs command and waits for it; true when it exits with status 0 */
+inline bool run(const Command& command) {
+    std::vector<char*> argv;
+    for (const std::string& argument : command) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid = 0;
+    if (command.empty() || ::posix_spawnp(&pid, argv.front(), nullptr,
+                                          nullptr, argv.data(), environ) != 0) {
+        return false;
+    }
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace toolchain
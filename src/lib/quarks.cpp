@@ -0,0 +1,383 @@
+#include "../../include/common.hpp"
+#include "../../include/arenaAllocator.hpp"
+#include "../../include/astImage.hpp"
+#include "../../include/tokenization.hpp"
+#include "../../include/parser.hpp"
+#include "../../include/generation.hpp"
+#include "../../include/cGeneration.hpp"
+#include "../../include/compileStats.hpp"
+#include "../../include/incremental.hpp"
+#include "../../include/modules.hpp"
+#include "../../include/parallelGeneration.hpp"
+#include "../../include/parallelParse.hpp"
+#include "../../include/profile.hpp"
+#include "../../include/toolchain.hpp"
+#include "../../include/quarks.hpp"
+#include <random>
+#include <unistd.h>
+
+namespace quarks {
+
+namespace {
+
+/** private scratch directory for the external toolchain steps */
+class ScratchDir {
+  public:
+    ScratchDir() {
+        thread_local std::mt19937_64 random{std::random_device{}()};
+        std::stringstream name;
+        name << "libquarks-" << ::getpid() << "-" << std::hex << random();
+        m_path = std::filesystem::temp_directory_path() / name.str();
+        std::filesystem::create_directories(m_path);
+    }
+
+    ScratchDir(const ScratchDir&) = delete;
+    ScratchDir& operator=(const ScratchDir&) = delete;
+
+    ~ScratchDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(m_path, ec);
+    }
+
+    [[nodiscard]] std::filesystem::path operator/(const char* name) const {
+        return m_path / name;
+    }
+
+  private:
+    std::filesystem::path m_path;
+};
+
+void run(const toolchain::Command& command, std::vector<PassTiming>* passes,
+         const char* pass) {
+    const PassTimer timer(passes, pass);
+    if (!toolchain::run(command)) {
+        throw CompileError("Command failed: " + toolchain::describe(command));
+    }
+}
+
+std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+/** turns generated code into object or executable bytes */
+std::string build(const std::string& code, const Options& options,
+                  std::vector<PassTiming>* passes) {
+    const ScratchDir scratch;
+    const bool c = options.backend == Backend::c;
+    const std::filesystem::path source = scratch / (c ? "out.c" : "out.asm");
+    const std::filesystem::path object = scratch / "out.o";
+    const std::filesystem::path executable = scratch / "out";
+    {
+        std::ofstream file(source);
+        file << code;
+    }
+    const bool object_only = options.emit == Emit::object;
+    if (c) {
+        run(toolchain::compile_c(options.c_compiler, source,
+                                 object_only ? object : executable,
+                                 object_only, options.c_optimization,
+                                 !options.debug_source.empty()),
+            passes, "cc");
+    } else {
+        run(toolchain::assemble(source, object, !options.debug_source.empty()),
+            passes, "assemble");
+        if (!object_only) {
+            run(toolchain::link(object, executable), passes, "link");
+        }
+    }
+    return read_file(object_only ? object : executable);
+}
+
+/** one generator over the whole program, so branch sites are program-wide */
+template <typename CodeGenerator>
+std::string generate_profiled(const ProgramNode& program,
+                              const ProfileOptions& profile,
+                              const std::string& debug_source,
+                              const Isa isa, const std::size_t if_conversion,
+                              const ModuleOptions& modules) {
+    CodeGenerator generator(program);
+    generator.set_profile(profile);
+    generator.set_debug_source(debug_source);
+    if constexpr (requires { generator.set_isa(isa); }) {
+        generator.set_isa(isa);
+    }
+    if constexpr (requires { generator.set_if_conversion(if_conversion); }) {
+        generator.set_if_conversion(if_conversion);
+    }
+    generator.set_modules(modules);
+    return generator.generateProgram();
+}
+
+/** what the generators link the source to, see Options::module */
+ModuleOptions module_options(const Options& options) {
+    if (!options.module.empty() &&
+        (!options.instrument.empty() || !options.profile_use.empty())) {
+        throw CompileError("Profiles cover whole programs, not modules");
+    }
+    if (!options.module.empty() && options.emit == Emit::executable) {
+        throw CompileError("Module " + options.module +
+                           " is not a program; emit an object");
+    }
+    return {.name = options.module, .imports = options.imports};
+}
+
+/** instrumentation and recorded profile for the source of this hash */
+ProfileOptions profile_options(const std::uint64_t source_hash,
+                               const Options& options,
+                               std::optional<BranchProfile>& profile) {
+    ProfileOptions profiling{.instrument = options.instrument,
+                             .source_hash = source_hash};
+    if (!options.profile_use.empty()) {
+        profile = BranchProfile::read(options.profile_use);
+        if (profile->source_hash != profiling.source_hash) {
+            throw CompileError("Profile " + options.profile_use +
+                               " was recorded for a different source");
+        }
+        profiling.use = &profile.value();
+    }
+    return profiling;
+}
+
+/** runs body, turning every failure into a diagnostic on the result */
+template <typename Body> Result guarded(Body&& body) {
+    Result result;
+    try {
+        result.output = body();
+        result.ok = true;
+    } catch (const CompileError& error) {
+        result.output.clear();
+        result.diagnostics.push_back(
+            {.message = error.what(), .line = error.line()});
+    } catch (const std::bad_alloc&) {
+        result.output.clear();
+        result.diagnostics.push_back(
+            {.message = "Out of memory"});
+    } catch (const std::exception& error) {
+        result.output.clear();
+        result.diagnostics.push_back({.message = error.what()});
+    }
+    return result;
+}
+
+/**
+ * What follows parsing: the image of program for Emit::ast, otherwise its
+ * code, built per options.emit. source_hash is BranchProfile::hash of the
+ * source it was parsed from.
+ */
+std::string generate(const ProgramNode& program,
+                     const std::uint64_t source_hash, const Options& options,
+                     const ModuleOptions& modules, Stats& stats,
+                     std::vector<Export>& exports) {
+    std::vector<PassTiming>* passes =
+        options.collect_stats ? &stats.passes : nullptr;
+    if (options.collect_stats) {
+        stats.nodes = count_nodes(program);
+    }
+    if (options.emit == Emit::ast) {
+        const PassTimer timer(passes, "serialize");
+        return AstImage::write(program, source_hash);
+    }
+    if (!modules.name.empty()) {
+        exports = module_exports(program);
+    }
+    std::string code;
+    std::optional<BranchProfile> profile;
+    const ProfileOptions profiling =
+        profile_options(source_hash, options, profile);
+    {
+        const PassTimer timer(passes, "generate");
+        if (!profiling.instrument.empty() || profiling.use != nullptr) {
+            code = options.backend == Backend::c
+                       ? generate_profiled<CGenerator>(
+                             program, profiling, options.debug_source,
+                             options.isa, options.if_conversion, modules)
+                       : generate_profiled<Generator>(
+                             program, profiling, options.debug_source,
+                             options.isa, options.if_conversion, modules);
+        } else {
+            code = options.backend == Backend::c
+                       ? generate_parallel<CGenerator>(
+                             program, options.codegen_threads,
+                             options.debug_source, options.isa,
+                             options.if_conversion, modules)
+                       : generate_parallel<Generator>(
+                             program, options.codegen_threads,
+                             options.debug_source, options.isa,
+                             options.if_conversion, modules);
+        }
+    }
+    if (options.collect_stats) {
+        count_code(code, stats);
+    }
+    if (options.emit != Emit::code) {
+        code = build(code, options, passes);
+    }
+    return code;
+}
+
+} // namespace
+
+struct Compiler::Impl {
+    ArenaAllocator arena;
+};
+
+Compiler::Compiler(const std::size_t arena_bytes)
+    : m_impl(std::make_unique<Impl>(Impl{ArenaAllocator(arena_bytes)})) {}
+
+Compiler::~Compiler() = default;
+Compiler::Compiler(Compiler&&) noexcept = default;
+Compiler& Compiler::operator=(Compiler&&) noexcept = default;
+
+Result Compiler::compile(const std::string_view source,
+                         const Options& options) {
+    AstStats ast;
+    Stats stats;
+    std::vector<Export> exports;
+    std::vector<PassTiming>* passes =
+        options.collect_stats ? &stats.passes : nullptr;
+    Result result = guarded([&] {
+        const ModuleOptions modules = module_options(options);
+        m_impl->arena.reset();
+        std::optional<ProgramNode> program;
+        std::optional<ParallelParse> parallel;
+        HashCons table;
+        if (options.parse_threads > 1) {
+            const PassTimer timer(passes, "tokenize+parse");
+            parallel = parse_parallel(source, options.parse_threads, 1 << 20,
+                                      options.hash_cons);
+            program = std::move(parallel->program);
+            stats.tokens = parallel->tokens;
+        } else {
+            Tokenizer tokenizer{std::string(source)};
+            std::optional<Parser> parser;
+            if (options.collect_stats) {
+                std::vector<Token> tokens;
+                {
+                    const PassTimer timer(passes, "tokenize");
+                    tokens = tokenizer.tokenize();
+                }
+                parser.emplace(std::move(tokens), m_impl->arena);
+            } else {
+                parser.emplace(tokenizer, m_impl->arena);
+            }
+            if (options.hash_cons) {
+                parser->set_hash_cons(table);
+            }
+            const PassTimer timer(passes, "parse");
+            program = parser->parseProgram();
+            stats.tokens = parser->tokens_consumed();
+        }
+        const HashCons::Stats shared =
+            parallel.has_value() ? parallel->hash_cons : table.stats();
+        ast = {.arena_bytes = parallel.has_value() ? parallel->arena_bytes()
+                                                   : m_impl->arena.used(),
+               .expressions = shared.expressions,
+               .shared = shared.shared,
+               .bytes_saved = shared.bytes_saved};
+        if (!program.has_value()) {
+            throw CompileError("Invalid program");
+        }
+        return generate(program.value(), BranchProfile::hash(source), options,
+                        modules, stats, exports);
+    });
+    // the AST's own heap memory goes now, the arena's buffer stays warm
+    m_impl->arena.reset();
+    if (!result.ok && ast.shared > 0 && result.diagnostics.front().line >= 0) {
+        // a shared node reports the line of its first occurrence, so
+        // errors are redone unshared for exact diagnostics
+        Options unshared = options;
+        unshared.hash_cons = false;
+        return compile(source, unshared);
+    }
+    result.ast = ast;
+    result.stats = std::move(stats);
+    if (result.ok) {
+        result.exports = std::move(exports);
+    }
+    return result;
+}
+
+Result Compiler::compile_image(const std::string_view image,
+                               const Options& options) {
+    AstStats ast;
+    Stats stats;
+    std::vector<Export> exports;
+    Result result = guarded([&] {
+        const ModuleOptions modules = module_options(options);
+        m_impl->arena.reset();
+        const AstImage view(image);
+        ProgramNode program;
+        {
+            const PassTimer timer(options.collect_stats ? &stats.passes
+                                                        : nullptr,
+                                  "load");
+            program = view.load(m_impl->arena);
+        }
+        ast.arena_bytes = m_impl->arena.used();
+        return generate(program, view.source_hash(), options, modules, stats,
+                        exports);
+    });
+    result.ast = ast;
+    result.stats = std::move(stats);
+    if (result.ok) {
+        result.exports = std::move(exports);
+    }
+    return result;
+}
+
+Result compile(const std::string_view source, const Options& options) {
+    Compiler compiler;
+    return compiler.compile(source, options);
+}
+
+struct Document::Impl {
+    IncrementalParse parse;
+};
+
+Document::Document(std::string source)
+    : m_impl(std::make_unique<Impl>(Impl{IncrementalParse(std::move(source))})) {}
+
+Document::~Document() = default;
+Document::Document(Document&&) noexcept = default;
+Document& Document::operator=(Document&&) noexcept = default;
+
+void Document::edit(const std::size_t offset, const std::size_t length,
+                    const std::string_view text) {
+    m_impl->parse.edit(offset, length, text);
+}
+
+const std::string& Document::source() const { return m_impl->parse.source(); }
+
+std::vector<Diagnostic> Document::diagnostics() const {
+    if (const std::optional<CompileError> error = m_impl->parse.diagnostic()) {
+        return {{.message = error->what(), .line = error->line()}};
+    }
+    return {};
+}
+
+Result Document::compile(const Options& options) const {
+    return guarded([&] {
+        if (options.emit == Emit::ast) {
+            throw CompileError("Documents do not write AST images");
+        }
+        std::optional<BranchProfile> profile;
+        const ProfileOptions profiling = profile_options(
+            BranchProfile::hash(m_impl->parse.source()), options, profile);
+        std::string code = options.backend == Backend::c
+                               ? m_impl->parse.generate<CGenerator>(
+                                     profiling, options.isa,
+                                     options.if_conversion)
+                               : m_impl->parse.generate<Generator>(
+                                     profiling, options.isa,
+                                     options.if_conversion);
+        if (options.emit != Emit::code) {
+            code = build(code, options, nullptr);
+        }
+        return code;
+    });
+}
+
+} // namespace quarks
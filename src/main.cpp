@@ -3,53 +3,351 @@
 #include "../include/tokenization.hpp"
 #include "../include/parser.hpp"
 #include "../include/generation.hpp"
+#include "../include/cGeneration.hpp"
+#include "../include/driver.hpp"
+#include "../include/compileServer.hpp"
+#include "../include/moduleBuild.hpp"
+#include "../include/runtimeBench.hpp"
+#include <sys/resource.h>
+
+static void usage() {
+    std::cerr << "Incorrect usage. Correct usage is ..\n";
+    std::cerr << "quarks [--backend=asm|c] [--cc=<compiler>] [--stream] "
+                 "[--parse-jobs=<threads>] [--codegen-jobs=<threads>] "
+                 "[--hash-cons] [-g] [--isa=scalar|sse2|avx2] "
+                 "[--if-convert=<cost>] [-o <out>] <*.qs|*.ast>\n";
+    std::cerr << "AST image: --emit-ast writes <out>.ast to compile later "
+                 "without parsing\n";
+    std::cerr << "profile-guided: [--instrument[=<profile>]] "
+                 "[--profile-use[=<profile>]] (default <out>.profile)\n";
+    std::cerr << "instrumentation: [--time-passes] [--stats] "
+                 "[--stats-json=<file>]\n";
+    runtime_bench::usage();
+    std::cerr << "quarks --batch [-j <threads>] [--out-dir=<dir>] "
+                 "[--in-memory] <*.qs|dir|@manifest>...\n";
+    std::cerr << "cache: [--cache] [--cache-dir=<dir>] "
+                 "[--cache-max-size=<MiB>] [--cache-stats]\n";
+    std::cerr << "quarks --modules [-j <threads>] [-o <out>] <*.qs> "
+                 "(modules next to it, objects in <out>.modules)\n";
+    std::cerr << "quarks --server [--socket=<path>] [-j <threads>]\n";
+    std::cerr << "quarks --client [--socket=<path>] [--send-source] "
+                 "[-o <out>] <*.qs>\n";
+    std::cerr << "quarks --client [--socket=<path>] "
+                 "--server-stats|--server-shutdown\n";
+}
+
+static long peak_rss_kib() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void print_time_passes(const CompileReport& report) {
+    double wall = 0;
+    double cpu = 0;
+    std::cerr << std::fixed << std::setprecision(3) << "pass timings for "
+              << report.source << "\n"
+              << std::right << std::setw(12) << "wall ms" << std::setw(12)
+              << "cpu ms" << "  pass\n";
+    for (const quarks::PassTiming& pass : report.stats.passes) {
+        std::cerr << std::setw(12) << pass.wall_seconds * 1e3 << std::setw(12)
+                  << pass.cpu_seconds * 1e3 << "  " << pass.pass << "\n";
+        wall += pass.wall_seconds;
+        cpu += pass.cpu_seconds;
+    }
+    std::cerr << std::setw(12) << wall * 1e3 << std::setw(12) << cpu * 1e3
+              << "  total\n";
+}
+
+static void print_stats(const CompileReport& report) {
+    const quarks::Stats& stats = report.stats;
+    const quarks::AstStats& ast = report.ast;
+    std::cerr << std::fixed << std::setprecision(1) << "source "
+              << report.source_bytes << " bytes, " << stats.tokens
+              << " tokens\nAST nodes:";
+    for (const auto& [kind, count] : stats.nodes) {
+        if (count > 0) {
+            std::cerr << " " << kind << " " << count;
+        }
+    }
+    std::cerr << "\nAST arena " << ast.arena_bytes / 1024.0 << " KiB";
+    if (ast.expressions > 0) {
+        std::cerr << "; " << ast.shared << " of " << ast.expressions
+                  << " expression nodes shared ("
+                  << 100.0 * ast.shared / ast.expressions << "%), "
+                  << ast.bytes_saved / 1024.0 << " KiB saved";
+    }
+    std::cerr << "\n"
+              << stats.instructions << " instructions, " << stats.labels
+              << " labels emitted, " << stats.vectorized
+              << " statements vectorized, " << stats.merged
+              << " instructions merged\npeak RSS " << peak_rss_kib() / 1024.0
+              << " MiB\n";
+}
+
+static std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+/** one object per compile, for dashboards that track regressions */
+static void write_stats_json(const CompileReport& report,
+                             const std::filesystem::path& path) {
+    const quarks::Stats& stats = report.stats;
+    std::ofstream out(path);
+    out << std::setprecision(9) << "{\n  \"source\": "
+        << json_string(report.source)
+        << ",\n  \"source_bytes\": " << report.source_bytes
+        << ",\n  \"passes\": [";
+    for (std::size_t i = 0; i < stats.passes.size(); i++) {
+        out << (i == 0 ? "\n" : ",\n") << "    {\"pass\": "
+            << json_string(stats.passes[i].pass)
+            << ", \"wall_seconds\": " << stats.passes[i].wall_seconds
+            << ", \"cpu_seconds\": " << stats.passes[i].cpu_seconds << "}";
+    }
+    out << "\n  ],\n  \"tokens\": " << stats.tokens
+        << ",\n  \"ast_nodes\": {";
+    for (std::size_t i = 0; i < stats.nodes.size(); i++) {
+        out << (i == 0 ? "" : ", ") << json_string(stats.nodes[i].first)
+            << ": " << stats.nodes[i].second;
+    }
+    out << "},\n  \"arena_bytes\": " << report.ast.arena_bytes
+        << ",\n  \"shared_expressions\": " << report.ast.shared
+        << ",\n  \"instructions\": " << stats.instructions
+        << ",\n  \"labels\": " << stats.labels
+        << ",\n  \"vectorized_statements\": " << stats.vectorized
+        << ",\n  \"merged_instructions\": " << stats.merged
+        << ",\n  \"peak_rss_kib\": " << peak_rss_kib() << "\n}\n";
+    if (!out) {
+        std::cerr << "Failed to write " << path.string() << std::endl;
+    }
+}
+
+static void print_cache_stats(CompileCache& cache) {
+    const CompileCache::Stats run = cache.stats();
+    const CompileCache::Stats total = cache.flush_stats();
+    const auto rate = [](const CompileCache::Stats& stats) {
+        const std::uint64_t lookups = stats.hits + stats.misses;
+        return lookups == 0 ? 0.0 : 100.0 * stats.hits / lookups;
+    };
+    std::cerr << std::fixed << std::setprecision(1) << "cache "
+              << cache.root().string() << ": " << run.hits << " hits, "
+              << run.misses << " misses (" << rate(run) << "%), "
+              << run.evictions << " evictions; all time " << total.hits
+              << " hits, " << total.misses << " misses (" << rate(total)
+              << "%), " << total.evictions << " evictions\n";
+}
 
 int main(int argc, char* argv[]) {
 
-    if (argc != 2) {
-        std::cerr << "Incorrect usage. Correct usage is ..\n";
-        std::cerr << "quarks <*.qs>\n";
-        return EXIT_FAILURE;
+    if (argc > 1 && std::string_view(argv[1]) == "bench") {
+        return runtime_bench::main({argv + 2, argv + argc});
     }
 
-    std::string content;
-    /** inner scope to close the file once read is completed */
-    {
-        const char* filepath = "/home/darkknight/cpp/quarks/sample/test.qs";
-        std::ifstream fileIn(filepath);
-        if (!fileIn) {
-            std::cerr << "Failed to open file \n";
+    CompileOptions options;
+    bool batch = false;
+    bool modules = false;
+    std::size_t jobs = std::thread::hardware_concurrency();
+    std::filesystem::path out_dir = "out";
+    std::filesystem::path output = "../out";
+    std::vector<std::string> inputs;
+    bool use_cache = std::getenv("QUARKS_CACHE_DIR") != nullptr;
+    bool cache_stats = false;
+    bool time_passes = false;
+    bool stats = false;
+    std::filesystem::path stats_json;
+    std::filesystem::path cache_dir = CompileCache::default_root();
+    std::uintmax_t cache_max_mib = 1024;
+    bool server = false;
+    std::optional<wire::Kind> client;
+    bool send_source = false;
+    std::filesystem::path socket_path = wire::default_socket();
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        bool valid = true;
+        if (arg == "--backend=asm" || arg == "--backend=nasm") {
+            options.backend = Backend::nasm;
+        } else if (arg == "--backend=c") {
+            options.backend = Backend::c;
+        } else if (arg.starts_with("--cc=")) {
+            options.c_compiler = arg.substr(5);
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--modules") {
+            modules = true;
+        } else if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg.starts_with("--parse-jobs=")) {
+            valid = parse_number(arg.substr(13), options.parse_jobs);
+        } else if (arg.starts_with("--codegen-jobs=")) {
+            valid = parse_number(arg.substr(15), options.codegen_jobs);
+        } else if (arg == "--hash-cons") {
+            options.hash_cons = true;
+        } else if (arg == "-g") {
+            options.debug_info = true;
+        } else if (arg == "--isa=scalar") {
+            options.isa = quarks::Isa::scalar;
+        } else if (arg == "--isa=sse2") {
+            options.isa = quarks::Isa::sse2;
+        } else if (arg == "--isa=avx2") {
+            options.isa = quarks::Isa::avx2;
+        } else if (arg.starts_with("--if-convert=")) {
+            valid = parse_number(arg.substr(13), options.if_conversion);
+        } else if (arg == "--instrument" || arg.starts_with("--instrument=")) {
+            options.instrument = true;
+            options.profile = arg.size() > 12 ? arg.substr(13) : "";
+        } else if (arg == "--profile-use" ||
+                   arg.starts_with("--profile-use=")) {
+            options.profile_use = true;
+            options.profile = arg.size() > 13 ? arg.substr(14) : "";
+        } else if (arg == "--time-passes") {
+            time_passes = true;
+            options.collect_stats = true;
+        } else if (arg == "--stats") {
+            stats = true;
+            options.collect_stats = true;
+        } else if (arg.starts_with("--stats-json=")) {
+            stats_json = arg.substr(13);
+            options.collect_stats = true;
+        } else if (arg == "--emit-ast") {
+            options.emit_ast = true;
+        } else if (arg == "--in-memory") {
+            options.in_memory = true;
+        } else if (arg.starts_with("--out-dir=")) {
+            out_dir = arg.substr(10);
+        } else if (arg == "--cache") {
+            use_cache = true;
+        } else if (arg.starts_with("--cache-dir=")) {
+            use_cache = true;
+            cache_dir = arg.substr(12);
+        } else if (arg.starts_with("--cache-max-size=")) {
+            valid = parse_number(arg.substr(17), cache_max_mib);
+        } else if (arg == "--cache-stats") {
+            cache_stats = true;
+        } else if (arg == "--server") {
+            server = true;
+        } else if (arg == "--client") {
+            client = client.value_or(wire::Kind::compile_path);
+        } else if (arg == "--send-source") {
+            send_source = true;
+        } else if (arg == "--server-stats") {
+            client = wire::Kind::stats;
+        } else if (arg == "--server-shutdown") {
+            client = wire::Kind::shutdown;
+        } else if (arg.starts_with("--socket=")) {
+            socket_path = arg.substr(9);
+        } else if (arg == "-j" && i + 1 < argc) {
+            valid = parse_number(argv[++i], jobs);
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!arg.starts_with("-")) {
+            inputs.push_back(arg);
+        } else {
+            usage();
             return EXIT_FAILURE;
         }
+        if (!valid) {
+            std::cerr << "Invalid number: "
+                      << (arg == argv[i] ? arg : arg + " " + argv[i]) << "\n";
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
 
-        std::stringstream buffer;
-        buffer << fileIn.rdbuf();
-        content = buffer.str();
+    if (client.has_value()) {
+        const bool compile = client == wire::Kind::compile_path;
+        if (compile && inputs.size() != 1) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        if (compile && send_source) {
+            client = wire::Kind::compile_source;
+        }
+        return run_client(socket_path, client.value(), options.backend,
+                          compile ? inputs.front() : "", output);
     }
-    Tokenizer tokenizer(std::move(content));
 
-    std::vector<Token> things = tokenizer.tokenize();
-    Parser parser(std::move(things));
+    if ((!batch && !server && inputs.size() != 1) ||
+        (server && options.in_memory)) {
+        usage();
+        return EXIT_FAILURE;
+    }
 
-    std::optional<ProgramNode> program = parser.parseProgram();
+    std::optional<CompileCache> cache;
+    if (use_cache) {
+        try {
+            cache.emplace(cache_dir, cache_max_mib << 20);
+            options.cache = &cache.value();
+        } catch (const std::exception& error) {
+            std::cerr << "cache disabled: " << error.what() << std::endl;
+        }
+    }
 
-    if (!program.has_value()) {
-        std::cerr << "Invalid program \n";
-        exit(EXIT_FAILURE);
+    if (server) {
+        try {
+            CompileServer compile_server(socket_path, options, jobs);
+            return compile_server.run();
+        } catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            return EXIT_FAILURE;
+        }
     }
 
-    {
-        Generator generator(std::move(program.value()));
-        std::ofstream file("../out.asm");
-        file << generator.generateProgram();
+    if (batch) {
+        int status = EXIT_FAILURE;
+        try {
+            status = run_batch(inputs, out_dir, jobs, options);
+        } catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+        }
+        if (cache.has_value() && cache_stats) {
+            print_cache_stats(cache.value());
+        }
+        return status;
     }
 
-    std::system("nasm -felf64 ../out.asm");
-    std::system("ld -o ../out ../out.o");
+    if (modules) {
+        const ModuleBuildReport report =
+            build_modules(inputs.front(), {.executable = output}, options, jobs);
+        if (!report.ok) {
+            std::cerr << report.diagnostics << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << report.modules << " modules, " << report.rebuilt
+                  << " rebuilt" << (report.linked ? ", linked" : "") << " in "
+                  << std::fixed << std::setprecision(1)
+                  << report.seconds * 1000 << " ms" << std::endl;
+        return EXIT_SUCCESS;
+    }
 
-    std::cout << argc << std::endl;
-    std::cout << argv[0] << std::endl;
-    std::cout << argv[1] << std::endl;
+    const CompileReport report =
+        compile_file(inputs.front(), {.executable = output}, options);
+    if (cache.has_value() && cache_stats) {
+        print_cache_stats(cache.value());
+    }
+    if (report.ok && time_passes) {
+        print_time_passes(report);
+    }
+    if (report.ok && stats) {
+        print_stats(report);
+    }
+    if (report.ok && !stats_json.empty()) {
+        write_stats_json(report, stats_json);
+    }
+    if (!report.ok) {
+        std::cerr << report.diagnostics << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (options.in_memory) {
+        std::cout << report.code;
+    }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
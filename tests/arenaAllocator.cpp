@@ -0,0 +1,49 @@
+#include "../include/arenaAllocator.hpp"
+#include "testing.hpp"
+#include <string>
+
+namespace {
+
+/** records the order objects are destroyed in */
+std::vector<int> destroyed;
+
+struct Tracked {
+    int id;
+    ~Tracked() { destroyed.push_back(id); }
+};
+
+} // namespace
+
+/** ArenaAllocator: what emplace() made is destroyed by reset() and the arena */
+int main() {
+    {
+        ArenaAllocator arena(64);
+        for (int id = 0; id < 100; id++) {
+            const Tracked* tracked = arena.emplace<Tracked>(id);
+            CHECK(tracked->id == id);
+            [[maybe_unused]] const int* plain = arena.emplace<int>(id);
+        }
+        CHECK(destroyed.empty());
+        arena.reset();
+        // newest first, across every block the arena chained on
+        CHECK(destroyed.size() == 100);
+        CHECK(destroyed.front() == 99 && destroyed.back() == 0);
+        CHECK(arena.used() == 0);
+
+        destroyed.clear();
+        [[maybe_unused]] const Tracked* kept = arena.emplace<Tracked>(7);
+        ArenaAllocator moved(std::move(arena));
+        arena.reset();
+        CHECK(destroyed.empty());
+        moved.reset();
+        CHECK(destroyed == std::vector<int>{7});
+
+        destroyed.clear();
+        [[maybe_unused]] const auto* owner =
+            moved.emplace<std::string>(std::string(1000, 'x'));
+        [[maybe_unused]] const Tracked* last = moved.emplace<Tracked>(8);
+    }
+    // the destructor runs them too
+    CHECK(destroyed == std::vector<int>{8});
+    return testing::failures();
+}
@@ -0,0 +1,125 @@
+#include "testing.hpp"
+#include <csignal>
+
+namespace {
+
+/**
+ * Element-wise arithmetic on arrays of length elements: broadcasts,
+ * products past 64 bits, division of negative values and stores through
+ * index expressions, folded into the exit status element by element.
+ */
+std::string program(const int length) {
+    const std::string n = std::to_string(length);
+    std::string source = "assign n = " + n + ";\n"
+                         "assign k = 100000;\n"
+                         "assign a[" + n + "] = 7;\n"
+                         "a[0] = 0 - 5;\n"
+                         "a[n - 1] = k * k;\n"
+                         "a[(n - 1) / 2] = 0 - k * 3;\n"
+                         "assign b[" + n + "] = a * 3 + n;\n"
+                         "assign c[" + n + "] = (b - a) * a * k;\n"
+                         "assign d[" + n + "] = c / 7 - b / (0 - 3);\n"
+                         "a = a + d * 2;\n"
+                         "b = 0 - a;\n"
+                         "c = a * (b + 1) - (c - k) / n;\n"
+                         "assign r = 0;\n";
+    for (int i = 0; i < length; i++) {
+        const std::string index =
+            i % 2 == 0 ? std::to_string(i)
+                       : "n - " + std::to_string(length - i);
+        source += "r = r * 31 + c[" + index + "] + b[" + index + "] / 1000;\n";
+    }
+    return source + "exit(r + r / 65536 + r / 4294967296);\n";
+}
+
+/** the first diagnostic of compiling source with backend */
+std::string error_of(const std::string& source, const quarks::Backend backend) {
+    const quarks::Result result = quarks::compile(source, {.backend = backend});
+    return result.ok ? "" : result.diagnostics.front().message;
+}
+
+} // namespace
+
+/**
+ * Arrays: the scalar, SSE2 and AVX2 loops of the nasm backend agree with
+ * the C backend on every tail length, out-of-range indices trap, and
+ * misused arrays are compile errors.
+ */
+int main() {
+    const std::vector<int> lengths = {1, 2, 3, 4, 5, 6, 7, 8, 9, 15, 16, 17};
+    const bool can_run =
+        testing::have("nasm") && testing::have("ld") && testing::have("cc");
+
+    for (const int length : lengths) {
+        const std::string source = program(length);
+        const quarks::Result scalar =
+            quarks::compile(source, {.isa = quarks::Isa::scalar});
+        const quarks::Result sse2 =
+            quarks::compile(source, {.isa = quarks::Isa::sse2});
+        const quarks::Result avx2 =
+            quarks::compile(source, {.isa = quarks::Isa::avx2});
+        CHECK(scalar.ok && sse2.ok && avx2.ok);
+        CHECK(scalar.output.find("xmm") == std::string::npos);
+        if (length >= 2) {
+            CHECK(sse2.output.find("paddq") != std::string::npos);
+            CHECK(sse2.output.find("ymm") == std::string::npos);
+        }
+        if (length >= 4) {
+            CHECK(avx2.output.find("cpuid") != std::string::npos);
+            CHECK(avx2.output.find("vpaddq") != std::string::npos);
+        }
+        if (!can_run) {
+            continue;
+        }
+        const int expected =
+            testing::run_program(source, {.backend = quarks::Backend::c});
+        CHECK(expected >= 0);
+        for (const quarks::Isa isa :
+             {quarks::Isa::scalar, quarks::Isa::sse2, quarks::Isa::avx2}) {
+            if (!CHECK(testing::run_program(source, {.isa = isa}) ==
+                       expected)) {
+                std::cerr << "  length " << length << ", isa "
+                          << static_cast<int>(isa) << "\n";
+            }
+        }
+    }
+
+    // reads and stores out of range trap on both backends
+    if (can_run) {
+        for (const std::string& source :
+             {std::string("assign n = 3;\nassign a[3] = 1;\nexit(a[n]);\n"),
+              std::string("assign a[3] = 1;\na[0 - 1] = 2;\nexit(0);\n")}) {
+            for (const quarks::Backend backend :
+                 {quarks::Backend::nasm, quarks::Backend::c}) {
+                CHECK(testing::run_program(source, {.backend = backend}) ==
+                      128 + SIGILL);
+            }
+        }
+    }
+
+    // operands of the wrong type or length
+    const std::vector<std::pair<std::string, std::string>> errors = {
+        {"assign a[3] = 1;\nassign b[4] = a;\nexit(0);",
+         "Array length mismatch: a has 3 elements, not 4"},
+        {"assign a[3] = 1;\nassign b[4] = 2;\nb = b + a;\nexit(0);",
+         "Array length mismatch: a has 3 elements, not 4"},
+        {"assign a[3] = 1;\nexit(a);", "Array used as a scalar: a"},
+        {"assign a[3] = 1;\nassign x = 2;\nx = a * 2;\nexit(0);",
+         "Array used as a scalar: a"},
+        {"assign a[3] = 1;\nexit(a[a]);", "Array used as a scalar: a"},
+        {"assign a[3] = 1;\nif (a) {\n    exit(1);\n}\nexit(0);",
+         "Array used as a scalar: a"},
+        {"assign x = 1;\nexit(x[0]);", "Not an array: x"},
+        {"assign x = 1;\nx[0] = 2;\nexit(x);", "Not an array: x"},
+        {"assign a[0] = 1;\nexit(0);", "Invalid array length 0"},
+    };
+    for (const auto& [source, message] : errors) {
+        for (const quarks::Backend backend :
+             {quarks::Backend::nasm, quarks::Backend::c}) {
+            if (!CHECK(error_of(source, backend).starts_with(message))) {
+                std::cerr << "  " << error_of(source, backend) << "\n";
+            }
+        }
+    }
+    return testing::failures();
+}
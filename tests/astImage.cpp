@@ -0,0 +1,71 @@
+#include "testing.hpp"
+
+namespace {
+
+const std::string kSource = "assign small: u8 = 200;\n"
+                            "assign total = 0;\n"
+                            "assign values[4] = 3;\n"
+                            "values[1] = values[0] * 7 - 1;\n"
+                            "if (total) {\n"
+                            "    total = 1;\n"
+                            "} elif (values[1] - 20) {\n"
+                            "    total = (small + 1) / 2;\n"
+                            "} else {\n"
+                            "    total = 2;\n"
+                            "}\n"
+                            "{\n"
+                            "    assign inner = total + total;\n"
+                            "    total = inner + values[1];\n"
+                            "}\n"
+                            "exit(total);\n";
+
+} // namespace
+
+/**
+ * AST images: compiling one is compiling the source, for every backend and
+ * with shared subtrees, and damaged images fail with a diagnostic.
+ */
+int main() {
+    quarks::Compiler compiler;
+    for (const bool hash_cons : {false, true}) {
+        const quarks::Result image = compiler.compile(
+            kSource, {.emit = quarks::Emit::ast, .hash_cons = hash_cons});
+        CHECK(image.ok && !image.output.empty());
+        for (const quarks::Backend backend :
+             {quarks::Backend::nasm, quarks::Backend::c}) {
+            const quarks::Result loaded =
+                compiler.compile_image(image.output, {.backend = backend});
+            const quarks::Result parsed =
+                compiler.compile(kSource, {.backend = backend});
+            CHECK(loaded.ok && parsed.ok);
+            CHECK(loaded.output == parsed.output);
+        }
+    }
+
+    // diagnostics point at the same line as parsing the source does
+    const std::string undeclared = "assign a = 1;\n\nexit(b);\n";
+    const quarks::Result image =
+        compiler.compile(undeclared, {.emit = quarks::Emit::ast});
+    CHECK(image.ok);
+    const quarks::Result failed = compiler.compile_image(image.output);
+    const quarks::Result parsed = compiler.compile(undeclared);
+    CHECK(!failed.ok && !parsed.ok);
+    CHECK(failed.diagnostics.front().line == parsed.diagnostics.front().line);
+
+    const std::string bytes =
+        compiler.compile(kSource, {.emit = quarks::Emit::ast}).output;
+    CHECK(!compiler.compile_image("not an image").ok);
+    for (std::size_t size = 0; size < bytes.size(); size += 7) {
+        CHECK(!compiler.compile_image(bytes.substr(0, size)).ok);
+    }
+    // flipped bytes either load as some program or are rejected, never crash
+    std::uint32_t state = 12345;
+    for (int i = 0; i < 2000; i++) {
+        std::string damaged = bytes;
+        state = state * 1103515245 + 12345;
+        damaged[state % damaged.size()] ^= static_cast<char>(1 << (i % 8));
+        const quarks::Result result = compiler.compile_image(damaged);
+        CHECK(result.ok || !result.diagnostics.empty());
+    }
+    return testing::failures();
+}
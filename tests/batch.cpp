@@ -0,0 +1,65 @@
+#include "testing.hpp"
+
+namespace {
+
+/** runs the executable at path */
+int run_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return -1;
+    }
+    return testing::run(std::string(std::istreambuf_iterator<char>(file),
+                                    std::istreambuf_iterator<char>()));
+}
+
+} // namespace
+
+/**
+ * --batch over a directory and over a manifest: one executable per source
+ * under --out-dir, a broken source failing only its own entry, and the
+ * exit status reporting that something failed.
+ */
+int main() {
+    if (!testing::have("cc")) {
+        return testing::kSkipped;
+    }
+    const std::filesystem::path directory = testing::scratch("batch");
+    std::filesystem::create_directories(directory / "src" / "nested");
+    std::filesystem::create_directories(directory / "other");
+    std::ofstream(directory / "src" / "a.qs") << "exit(3);";
+    std::ofstream(directory / "src" / "broken.qs") << "exit(;";
+    std::ofstream(directory / "src" / "nested" / "c.qs") << "exit(4);";
+    std::ofstream(directory / "src" / "notes.txt") << "not a source";
+    std::ofstream(directory / "other" / "a.qs") << "exit(5);";
+
+    // the broken file is compiled alongside the others, and reported
+    CHECK(testing::quarks("--batch --backend=c -j 4 --out-dir=out src "
+                          "other/a.qs >/dev/null",
+                          directory) != 0);
+    const std::filesystem::path out = directory / "out";
+    CHECK(run_file(out / "a") == 3);
+    CHECK(run_file(out / "c") == 4);
+    // same file name, its own executable
+    CHECK(run_file(out / "a-1") == 5);
+    CHECK(!std::filesystem::exists(out / "broken"));
+    CHECK(!std::filesystem::exists(out / "notes"));
+
+    std::ofstream(directory / "list") << "src/nested/c.qs\r\n\nother/a.qs\n";
+    CHECK(testing::quarks("--batch --backend=c --out-dir=listed @list "
+                          ">/dev/null",
+                          directory) == 0);
+    CHECK(run_file(directory / "listed" / "c") == 4);
+    CHECK(run_file(directory / "listed" / "a") == 5);
+    CHECK(testing::quarks("--batch --out-dir=listed @missing 2>/dev/null",
+                          directory) != 0);
+    // a malformed number is a usage error, not an uncaught exception
+    for (const char* flag : {"-j abc", "-j ''", "-j 4x",
+                             "--cache-max-size=-1"}) {
+        CHECK(testing::quarks("--batch " + std::string(flag) +
+                                  " src 2>/dev/null",
+                              directory) == EXIT_FAILURE);
+    }
+
+    std::filesystem::remove_all(directory);
+    return testing::failures();
+}
@@ -0,0 +1,41 @@
+#include "testing.hpp"
+
+/**
+ * The C backend against the nasm one: literals and division, where C's own
+ * rules (octal constants, undefined division) would tell them apart.
+ */
+int main() {
+    if (!testing::have("cc")) {
+        return testing::kSkipped;
+    }
+    const quarks::Options c{.backend = quarks::Backend::c};
+
+    // decimal, whatever C makes of a leading 0
+    CHECK(testing::run_program("exit(010);", c) == 10);
+    CHECK(testing::run_program("exit(09);", c) == 9);
+    CHECK(quarks::compile("exit(010);", c).output.find("INT64_C(10)") !=
+          std::string::npos);
+    // 2^64 - 1 is -1, as in a register
+    CHECK(testing::run_program("exit(18446744073709551615 + 3);", c) == 2);
+
+    // idiv raises SIGFPE for a zero divisor and for INT64_MIN / -1
+    const std::string min_by_minus_one = "assign m = 9223372036854775807 + 1;\n"
+                                         "assign n = 0 - 1;\n"
+                                         "exit(m / n);";
+    const std::string by_zero = "assign z = 0;\nexit(1 / z);";
+    CHECK(testing::run_program(min_by_minus_one, c) == 128 + SIGFPE);
+    CHECK(testing::run_program(by_zero, c) == 128 + SIGFPE);
+    // truncated towards zero: -7 / 2 is -3
+    const std::string negative = "assign a = 0 - 7;\nexit(a / 2 + 10);";
+    CHECK(testing::run_program(negative, c) == 7);
+
+    if (testing::have("nasm") && testing::have("ld")) {
+        for (const std::string& source :
+             {std::string("exit(010 + 0100);"), min_by_minus_one, by_zero,
+              negative}) {
+            CHECK(testing::run_program(source, {}) ==
+                  testing::run_program(source, c));
+        }
+    }
+    return testing::failures();
+}
@@ -0,0 +1,63 @@
+#include "../include/compileCache.hpp"
+#include "testing.hpp"
+
+/** CompileCache: lookups, LRU eviction past the size limit, and stats */
+int main() {
+    const std::filesystem::path root = testing::scratch("cache");
+    const std::filesystem::path artifact = testing::scratch("artifact");
+    const auto write = [&](const std::string& bytes) {
+        std::ofstream(artifact, std::ios::binary) << bytes;
+    };
+    const auto has = [&](const std::string& key) {
+        return std::filesystem::exists(root / "objects" / key);
+    };
+    const auto age = [&](const std::string& key, const int hours) {
+        std::filesystem::last_write_time(
+            root / "objects" / key,
+            std::filesystem::file_time_type::clock::now() -
+                std::chrono::hours(hours));
+    };
+    {
+        CompileCache cache(root, 3000);
+        for (const std::string key : {"a", "b", "c"}) {
+            write(std::string(1000, key[0]));
+            cache.store(key, {{"out", artifact}});
+        }
+        CHECK(has("a") && has("b") && has("c"));
+        age("a", 3);
+        age("b", 2);
+        age("c", 1);
+
+        // a hit copies the artifact out and makes the entry the newest
+        const std::filesystem::path copy = testing::scratch("copy");
+        CHECK(cache.lookup("a", {{"out", copy}}));
+        CHECK(std::filesystem::file_size(copy) == 1000);
+        CHECK(!cache.lookup("missing", {{"out", copy}}));
+        std::filesystem::remove(copy);
+
+        // over the limit: b is now the least recently used
+        write(std::string(1000, 'd'));
+        cache.store("d", {{"out", artifact}});
+        CHECK(has("a") && !has("b") && has("c") && has("d"));
+
+        const CompileCache::Stats stats = cache.stats();
+        CHECK(stats.hits == 1);
+        CHECK(stats.misses == 1);
+        CHECK(stats.evictions == 1);
+        CHECK(cache.flush_stats().evictions == 1);
+        CHECK(cache.stats().hits == 0);
+    }
+    {
+        // totals accumulate across processes in the stats file
+        CompileCache cache(root, 3000);
+        write("e");
+        cache.store("e", {{"out", artifact}});
+        CHECK(cache.lookup("e", {{"out", artifact}}));
+        const CompileCache::Stats totals = cache.flush_stats();
+        CHECK(totals.hits == 2);
+        CHECK(totals.evictions == 2);
+    }
+    std::filesystem::remove_all(root);
+    std::filesystem::remove(artifact);
+    return testing::failures();
+}
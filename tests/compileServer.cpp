@@ -0,0 +1,111 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/compileServer.hpp"
+#include "testing.hpp"
+#include <thread>
+
+namespace {
+
+struct Response {
+    bool ok = false;
+    wire::Status status = wire::Status::error;
+    std::string payload;
+};
+
+int connect_to(const std::filesystem::path& socket_path) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const sockaddr_un addr = wire::address(socket_path);
+    // a server that stopped answering fails the test instead of hanging it
+    const timeval timeout{.tv_sec = 10, .tv_usec = 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                  sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/** one request; length overrides the payload's size in the header */
+Response request(const std::filesystem::path& socket_path, const wire::Kind kind,
+                 const std::string& payload,
+                 std::optional<std::uint32_t> length = std::nullopt) {
+    Response response;
+    const int fd = connect_to(socket_path);
+    if (fd < 0) {
+        return response;
+    }
+    const std::uint8_t head[2] = {static_cast<std::uint8_t>(kind), 'c'};
+    const std::uint32_t size =
+        length.value_or(static_cast<std::uint32_t>(payload.size()));
+    std::uint8_t status = 0;
+    std::uint32_t response_length = 0;
+    response.ok =
+        wire::write_all(fd, head, sizeof(head)) &&
+        wire::write_all(fd, &size, sizeof(size)) &&
+        wire::write_all(fd, payload.data(), payload.size()) &&
+        wire::read_all(fd, &status, 1) &&
+        wire::read_all(fd, &response_length, sizeof(response_length)) &&
+        (response.payload.resize(response_length),
+         wire::read_all(fd, response.payload.data(), response.payload.size()));
+    response.status = static_cast<wire::Status>(status);
+    ::close(fd);
+    return response;
+}
+
+} // namespace
+
+/**
+ * CompileServer over its socket: compiles, diagnostics, oversized and idle
+ * clients, stats and shutdown.
+ */
+int main() {
+    const std::filesystem::path socket_path = testing::scratch("server.sock");
+    // clients get executables even from a server told to keep code in memory
+    CompileServer server(socket_path, {.in_memory = true}, 1);
+    server.set_receive_timeout(std::chrono::milliseconds(200));
+    int status = EXIT_FAILURE;
+    std::thread serving([&] { status = server.run(); });
+    for (int i = 0; i < 500 && !std::filesystem::exists(socket_path); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    const Response invalid =
+        request(socket_path, wire::Kind::compile_source, "exit(;");
+    CHECK(invalid.ok && invalid.status == wire::Status::error);
+    CHECK(!invalid.payload.empty());
+
+    if (testing::have("cc")) {
+        const Response built =
+            request(socket_path, wire::Kind::compile_source, "exit(7);");
+        CHECK(built.ok && built.status == wire::Status::ok);
+        CHECK(built.payload.starts_with("\x7f"
+                                        "ELF"));
+        CHECK(testing::run(built.payload) == 7);
+    }
+
+    // a 4 GiB header is refused without reading, and the server carries on
+    const Response oversized =
+        request(socket_path, wire::Kind::compile_source, "", 0xffffffff);
+    CHECK(oversized.ok && oversized.status == wire::Status::error);
+
+    // an idle client is dropped, so it cannot hold the only worker
+    const int idle = connect_to(socket_path);
+    CHECK(idle >= 0);
+    const Response stats = request(socket_path, wire::Kind::stats, "");
+    CHECK(stats.ok && stats.status == wire::Status::ok);
+    CHECK(stats.payload.find(" 2 failed") != std::string::npos);
+    ::close(idle);
+
+    const Response shutdown = request(socket_path, wire::Kind::shutdown, "");
+    CHECK(shutdown.ok && shutdown.status == wire::Status::ok);
+    serving.join();
+    CHECK(status == EXIT_SUCCESS);
+    CHECK(!std::filesystem::exists(socket_path));
+
+    CHECK(testing::quarks("--server --in-memory 2>/dev/null",
+                          std::filesystem::temp_directory_path()) ==
+          EXIT_FAILURE);
+    return testing::failures();
+}
@@ -0,0 +1,78 @@
+#include "testing.hpp"
+#include <sys/resource.h>
+
+namespace {
+
+long peak_rss_kib() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+} // namespace
+
+/**
+ * quarks::Compiler reused across compiles, as the server does: memory stays
+ * flat, and the C compiler runs with the configured optimization level.
+ */
+int main() {
+    std::string source = "assign x = 0;\n";
+    for (int i = 0; i < 2000; i++) {
+        const std::string name = "y" + std::to_string(i);
+        source += "{\n    assign " + name + " = x + " + std::to_string(i) +
+                  ";\n    x = " + name + ";\n}\n";
+    }
+    source += "exit(x);\n";
+
+    quarks::Compiler compiler;
+    for (int i = 0; i < 20; i++) {
+        CHECK(compiler.compile(source).ok);
+    }
+    const long warm = peak_rss_kib();
+    for (int i = 0; i < 300; i++) {
+        CHECK(compiler.compile(source).ok);
+    }
+    // the AST of one compile is well over 100 KiB of strings and vectors
+    CHECK(peak_rss_kib() - warm < 4 * 1024);
+
+    if (testing::have("cc")) {
+        const std::filesystem::path log = testing::scratch("cc.log");
+        const std::filesystem::path wrapper = testing::scratch("cc.sh");
+        std::ofstream(wrapper) << "#!/bin/sh\necho \"$@\" > " << log
+                               << "\nexec cc \"$@\"\n";
+        std::filesystem::permissions(wrapper,
+                                     std::filesystem::perms::owner_all);
+        const quarks::Options options{.backend = quarks::Backend::c,
+                                      .c_compiler = wrapper.string(),
+                                      .c_optimization = "-O1"};
+        CHECK(testing::run_program("exit(3);", options) == 3);
+        std::ifstream args(log);
+        std::string flags;
+        std::getline(args, flags);
+        CHECK(flags.starts_with("-O1 "));
+        std::filesystem::remove(log);
+        std::filesystem::remove(wrapper);
+
+        // no shell sees the compiler name or the paths
+        const std::filesystem::path directory = testing::scratch("spawn");
+        std::filesystem::create_directories(directory);
+        const std::string inject = "$(touch pwned)`touch pwned`";
+        std::ofstream(directory / (inject + ".qs")) << "exit(4);";
+        CHECK(testing::quarks("--backend=c -o 'out " + inject + "' '" +
+                                  inject + ".qs'",
+                              directory) == 0);
+        std::ifstream built(directory / ("out " + inject), std::ios::binary);
+        CHECK(testing::run(std::string(std::istreambuf_iterator<char>(built),
+                                       std::istreambuf_iterator<char>())) ==
+              4);
+        const quarks::Options injected{.backend = quarks::Backend::c,
+                                       .emit = quarks::Emit::executable,
+                                       .c_compiler = "cc; touch " +
+                                                     (directory / "pwned")
+                                                         .string()};
+        CHECK(!quarks::compile("exit(4);", injected).ok);
+        CHECK(!std::filesystem::exists(directory / "pwned"));
+        std::filesystem::remove_all(directory);
+    }
+    return testing::failures();
+}
@@ -0,0 +1,121 @@
+#include "testing.hpp"
+#include <sstream>
+
+namespace {
+
+const std::string kSource = "assign x = 3;\n"
+                            "{\n"
+                            "    assign y = x * 2;\n"
+                            "    x = y;\n"
+                            "}\n"
+                            "if (x - 6) {\n"
+                            "    x = 40;\n"
+                            "} elif (x) {\n"
+                            "    assign z = 1;\n"
+                            "    x = x + z;\n"
+                            "} else {\n"
+                            "    x = 7;\n"
+                            "}\n"
+                            "exit(x);\n";
+
+/** 1-based lines of the statements and the elif test of kSource */
+const std::vector<int> kStatementLines = {1, 2, 3, 4, 6, 7, 8, 9, 10, 12, 14};
+
+/** the lines of code for which keep is true, and the others apart */
+std::pair<std::vector<std::string>, std::string>
+split(const std::string& code, const auto& keep) {
+    std::vector<std::string> kept;
+    std::string rest;
+    std::istringstream lines(code);
+    for (std::string line; std::getline(lines, line);) {
+        if (keep(line)) {
+            kept.push_back(line);
+        } else {
+            rest += line + "\n";
+        }
+    }
+    return {kept, rest};
+}
+
+} // namespace
+
+/**
+ * -g: a line directive for every statement, a symbol for every variable
+ * and scope, and otherwise the code and the program's behaviour of a build
+ * without it.
+ */
+int main() {
+    const std::string path = "/src/program.qs";
+    const quarks::Result plain = quarks::compile(kSource);
+    const quarks::Result debug =
+        quarks::compile(kSource, {.debug_source = path});
+    CHECK(plain.ok && debug.ok);
+
+    const auto [directives, rest] = split(debug.output, [](const auto& line) {
+        return line.starts_with("%line ") ||
+               line.find('@') != std::string::npos;
+    });
+    CHECK(rest == plain.output);
+
+    std::vector<std::string> expected;
+    for (const int line : kStatementLines) {
+        expected.push_back("%line " + std::to_string(line) + "+0 " + path);
+    }
+    const auto lines =
+        split(debug.output, [](const auto& line) {
+            return line.starts_with("%line ");
+        }).first;
+    CHECK(lines == expected);
+
+    // name@line.column of each declaration, and of each scope's brace
+    const auto symbols = split(debug.output, [](const auto& line) {
+                             return line.find('@') != std::string::npos;
+                         }).first;
+    CHECK(symbols == std::vector<std::string>(
+                         {"x@1.8 equ -8", "scope@2.1:", "y@3.12 equ -16",
+                          "scope@6.12:", "scope@8.12:", "z@9.12 equ -16",
+                          "scope@11.8:"}));
+
+    // the C backend: a #line per statement, the same code around them
+    const quarks::Result c = quarks::compile(
+        kSource, {.backend = quarks::Backend::c, .debug_source = path});
+    const auto [c_lines, c_rest] = split(c.output, [](const auto& line) {
+        return line.starts_with("#line ");
+    });
+    CHECK(c_rest == quarks::compile(kSource, {.backend = quarks::Backend::c})
+                        .output);
+    CHECK(c_lines.size() == kStatementLines.size() - 1);
+    CHECK(c_lines.front() == "#line 1 \"" + path + "\"");
+
+    // the same exit status, built with line tables
+    std::vector<quarks::Backend> backends;
+    if (testing::have("nasm") && testing::have("ld")) {
+        backends.push_back(quarks::Backend::nasm);
+    }
+    if (testing::have("cc")) {
+        backends.push_back(quarks::Backend::c);
+    }
+    for (const quarks::Backend backend : backends) {
+        CHECK(testing::run_program(kSource,
+                                   {.backend = backend, .debug_source = path}) ==
+              7);
+        CHECK(testing::run_program(kSource, {.backend = backend}) == 7);
+    }
+
+    // the CLI names the source by its absolute path
+    const std::filesystem::path directory = testing::scratch("debug");
+    std::filesystem::create_directories(directory);
+    std::ofstream(directory / "program.qs") << kSource;
+    CHECK(testing::quarks("-g --in-memory program.qs > program.asm",
+                          directory) == 0);
+    std::ifstream code(directory / "program.asm");
+    std::string first;
+    std::getline(code, first);
+    std::getline(code, first);
+    std::getline(code, first);
+    CHECK(first == "%line 1+0 " +
+                       std::filesystem::canonical(directory / "program.qs")
+                           .string());
+    std::filesystem::remove_all(directory);
+    return testing::failures();
+}
@@ -0,0 +1,87 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parallelGeneration.hpp"
+#include "../include/parallelParse.hpp"
+#include "../include/pipeline.hpp"
+#include "testing.hpp"
+
+namespace {
+
+constexpr int kDepth = 100000;
+
+std::string repeat(const std::string& text, const int count) {
+    std::string out;
+    out.reserve(text.size() * static_cast<std::size_t>(count));
+    for (int i = 0; i < count; i++) {
+        out += text;
+    }
+    return out;
+}
+
+/**
+ * source generated sequentially, streamed, parsed in chunks and generated
+ * in regions; every mode must agree, and none may run out of stack
+ */
+template <typename CodeGenerator> void check_modes(const std::string& source) {
+    std::string expected;
+    {
+        ArenaAllocator arena(1024 * 1024);
+        Tokenizer tokenizer(source);
+        Parser parser(tokenizer, arena);
+        const ProgramNode program = parser.parseProgram().value();
+        expected = CodeGenerator(program).generateProgram();
+        CHECK(generate_parallel<CodeGenerator>(program, 4, {},
+                                               quarks::Isa::sse2,
+                                               quarks::kIfConversionCost, {},
+                                               1) == expected);
+    }
+    CHECK(!expected.empty());
+
+    std::ostringstream streamed;
+    compile_streaming<CodeGenerator>(source, streamed);
+    CHECK(streamed.str() == expected);
+
+    ParallelParse chunks = parse_parallel(source, 4, 1);
+    CHECK(CodeGenerator(std::move(chunks.program)).generateProgram() ==
+          expected);
+}
+
+} // namespace
+
+/**
+ * 100k levels of parentheses, scopes and if statements: the parser and the
+ * generators keep their own stacks, so no mode recurses on the depth.
+ */
+int main() {
+    const std::vector<std::string> sources = {
+        "assign x = 1;\nexit(" + repeat("(x + ", kDepth) + "1" +
+            repeat(")", kDepth) + ");\n",
+        "assign x = 1;\n" + repeat("{\n", kDepth) + "x = x + 1;\n" +
+            repeat("}\n", kDepth) + "exit(x);\n",
+        "assign x = 1;\n" + repeat("if (x) {\n", kDepth) + "x = 2;\n" +
+            repeat("} else {\nx = 3;\n}\n", kDepth) + "exit(x);\n",
+    };
+    for (const std::string& source : sources) {
+        check_modes<Generator>(source);
+        check_modes<CGenerator>(source);
+        for (const std::size_t threads : {1, 4}) {
+            for (const quarks::Backend backend :
+                 {quarks::Backend::nasm, quarks::Backend::c}) {
+                CHECK(quarks::compile(source, {.backend = backend,
+                                               .parse_threads = threads,
+                                               .codegen_threads = threads})
+                          .ok);
+            }
+        }
+    }
+
+    // an unclosed scope at the bottom is still an error, not a crash
+    CHECK(!quarks::compile(repeat("{\n", kDepth)).ok);
+    const quarks::Result unclosed =
+        quarks::compile("exit(" + repeat("(", kDepth) + "1);");
+    CHECK(!unclosed.ok);
+    CHECK(unclosed.diagnostics.front().message.starts_with(
+        "Expected close parenthesis"));
+    return testing::failures();
+}
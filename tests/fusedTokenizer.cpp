@@ -0,0 +1,110 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parser.hpp"
+#include "../include/generation.hpp"
+#include "../include/parallelParse.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/** every token next() pulls, until the end of the input */
+std::vector<Token> pull(const std::string& source) {
+    Tokenizer tokenizer(source);
+    std::vector<Token> tokens;
+    while (std::optional<Token> token = tokenizer.next()) {
+        tokens.push_back(std::move(token.value()));
+    }
+    return tokens;
+}
+
+bool same(const std::vector<Token>& a, const std::vector<Token>& b) {
+    return ranges::equal(a, b, [](const Token& x, const Token& y) {
+        return x.type == y.type && x.value == y.value && x.line == y.line &&
+               x.column == y.column;
+    });
+}
+
+/** the assembly, or the error, of parsing from a token vector */
+std::string two_pass(const std::string& source) {
+    try {
+        ArenaAllocator arena(1024 * 1024);
+        Parser parser(Tokenizer(source).tokenize(), arena);
+        Generator generator(parser.parseProgram().value());
+        return generator.generateProgram();
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+}
+
+/** the assembly, or the error, of parsing straight from the tokenizer */
+std::string fused(const std::string& source) {
+    try {
+        ArenaAllocator arena(1024 * 1024);
+        Tokenizer tokenizer(source);
+        Parser parser(tokenizer, arena);
+        Generator generator(parser.parseProgram().value());
+        return generator.generateProgram();
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+}
+
+} // namespace
+
+/**
+ * The fused pull tokenizer against the two-pass path: the same tokens with
+ * the same lines and columns, the same program, and errors at the same
+ * lines.
+ */
+int main() {
+    std::string source = "-- a comment before anything\nassign x = 007;\n";
+    for (int i = 0; i < 200; i++) {
+        const std::string name = "v" + std::to_string(i);
+        source += "assign " + name + " = (x + " + std::to_string(i) +
+                  ") * 2 - x / 3;\n\n";
+        source += "if (" + name + " - 10) {\n    x = x + " + name +
+                  "; -- trailing\n} elif (x) {\n    assign y = 1;\n"
+                  "} else {\n    x = 0;\n}\n";
+    }
+    source += "exit(x);";
+
+    const std::vector<Token> tokens = Tokenizer(source).tokenize();
+    CHECK(tokens.size() > 200 * 30);
+    CHECK(tokens.back().line == 9 * 200 + 2);
+    CHECK(same(pull(source), tokens));
+    // `    x = x + v0; -- trailing` on line 5: x, =, x, +, v0, ;
+    CHECK(tokens[27].line == 5 && tokens[27].column == 4);
+    CHECK(tokens[31].value == "v0" && tokens[31].column == 12);
+    CHECK(tokens.back().column == 7);
+
+    // chunks that start mid-line keep absolute columns
+    const std::string packed = "assign a = 1; assign b = a;\n  exit(b);";
+    std::vector<Token> chunked;
+    for (const SourceChunk& chunk : split_top_level(packed, 1)) {
+        for (Token& token : Tokenizer(std::string(chunk.text), chunk.first_line,
+                                      chunk.first_column)
+                                .tokenize()) {
+            chunked.push_back(std::move(token));
+        }
+    }
+    CHECK(split_top_level(packed, 1).size() == 3);
+    CHECK(same(chunked, Tokenizer(packed).tokenize()));
+    CHECK(chunked[6].value == "b" && chunked[6].column == 21);
+    CHECK(chunked[10].line == 1 && chunked[10].column == 2);
+
+    const std::string assembly = two_pass(source);
+    CHECK(assembly.starts_with("global _start"));
+    CHECK(fused(source) == assembly);
+
+    // a syntax error, one at the very end, and a lexical error
+    for (const std::string& broken : {source + "\nexit(x;", source + "\nexit(",
+                                      source + "\n\nexit(x) $;"}) {
+        CHECK(fused(broken) == two_pass(broken));
+    }
+    CHECK(fused(source + "\nexit(x;")
+              .ends_with(" at line " + std::to_string(9 * 200 + 3)));
+    CHECK(fused(source + "\n\nexit(x) $;") ==
+          "Invalid token at line " + std::to_string(9 * 200 + 4));
+    return testing::failures();
+}
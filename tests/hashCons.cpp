@@ -0,0 +1,83 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parallelParse.hpp"
+#include "../include/generation.hpp"
+#include "testing.hpp"
+
+namespace {
+
+std::string read(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+}
+
+} // namespace
+
+/**
+ * --hash-cons: repeated subexpressions are shared and counted, and the
+ * generated code and the diagnostics are those of an unshared compile.
+ */
+int main() {
+    std::string source = "assign x = 5;\nassign y = x * 3 + 7;\n";
+    for (int i = 0; i < 200; i++) {
+        source += "assign v" + std::to_string(i) +
+                  " = (x * 3 + 7) * (x * 3 + 7) - y / (x + 1);\n"
+                  "if (x * 3 + 7) {\n    y = y + (x * 3 + 7);\n}\n";
+    }
+    source += "exit(y);\n";
+
+    for (const quarks::Backend backend :
+         {quarks::Backend::nasm, quarks::Backend::c}) {
+        for (const std::size_t threads : {1, 4}) {
+            const quarks::Result plain = quarks::compile(
+                source, {.backend = backend, .parse_threads = threads});
+            const quarks::Result shared =
+                quarks::compile(source, {.backend = backend,
+                                         .parse_threads = threads,
+                                         .hash_cons = true});
+            CHECK(plain.ok && shared.ok);
+            CHECK(shared.output == plain.output);
+            CHECK(plain.ast.shared == 0);
+            CHECK(shared.ast.expressions > 200 * 20);
+            // all but the first (x * 3 + 7) and y / (x + 1) are reused
+            CHECK(shared.ast.shared > shared.ast.expressions / 2);
+            CHECK(shared.ast.bytes_saved > 0);
+            CHECK(shared.ast.arena_bytes < plain.ast.arena_bytes);
+        }
+    }
+
+    // chunks hash-consed on their own still generate the same program
+    ParallelParse chunks = parse_parallel(source, 4, 64, true);
+    CHECK(chunks.hash_cons.shared > 0);
+    CHECK(Generator(std::move(chunks.program)).generateProgram() ==
+          quarks::compile(source).output);
+
+    // a shared node keeps its first line, yet errors report their own
+    const std::string broken = source + "exit(z * (x * 3 + 7));\n";
+    const quarks::Result plain_error = quarks::compile(broken);
+    const quarks::Result shared_error =
+        quarks::compile(broken, {.hash_cons = true});
+    CHECK(!plain_error.ok && !shared_error.ok);
+    CHECK(shared_error.diagnostics.front().message ==
+          plain_error.diagnostics.front().message);
+    CHECK(shared_error.diagnostics.front().line ==
+          plain_error.diagnostics.front().line);
+
+    // the CLI: byte-identical code, and --stats reports the sharing
+    const std::filesystem::path directory = testing::scratch("hashcons");
+    std::filesystem::create_directories(directory);
+    std::ofstream(directory / "program.qs") << source;
+    CHECK(testing::quarks("--in-memory program.qs > plain.asm", directory) ==
+          0);
+    CHECK(testing::quarks("--in-memory --hash-cons --stats program.qs "
+                          "> shared.asm 2> stats.txt",
+                          directory) == 0);
+    CHECK(!read(directory / "plain.asm").empty());
+    CHECK(read(directory / "shared.asm") == read(directory / "plain.asm"));
+    CHECK(read(directory / "stats.txt").find(" expression nodes shared") !=
+          std::string::npos);
+    std::filesystem::remove_all(directory);
+    return testing::failures();
+}
@@ -0,0 +1,54 @@
+#include "testing.hpp"
+
+namespace {
+
+bool contains(const std::string& code, const std::string& text) {
+    return code.find(text) != std::string::npos;
+}
+
+/** a chain over a, b and c whose exit code tells every arm apart */
+std::string chain(const int a, const int b, const int c) {
+    return "assign a = " + std::to_string(a) + ";\nassign b = " +
+           std::to_string(b) + ";\nassign c = " + std::to_string(c) +
+           ";\nassign x = 1;\nassign y = 2;\n"
+           "if (a) {\n    x = b + 10;\n} elif (b) {\n    y = x + 20;\n"
+           "    x = 3;\n} elif (c) {\n    y = 4;\n} else {\n"
+           "    x = y + 30;\n}\nexit(x * 10 + y);\n";
+}
+
+} // namespace
+
+/**
+ * If-conversion: qualifying chains lower to cmov without branches, the rest
+ * keep them, and converted chains compute what the branches would.
+ */
+int main() {
+    const std::string source = chain(0, 1, 0);
+    const std::string converted = quarks::compile(source).output;
+    CHECK(contains(converted, "cmovnz rax, rbx"));
+    CHECK(!contains(converted, "    jz "));
+
+    const quarks::Options branches{.if_conversion = 0};
+    const std::string kept = quarks::compile(source, branches).output;
+    CHECK(!contains(kept, "cmovnz"));
+    CHECK(contains(kept, "    jz "));
+
+    // an arm that could trap when it does not run keeps its branch
+    const std::string divides = quarks::compile(
+        "assign a = 0;\nassign x = 1;\nif (a) {\n    x = 10 / a;\n}\n"
+        "exit(x);\n").output;
+    CHECK(!contains(divides, "cmovnz"));
+    // as does a chain over the cost limit
+    CHECK(!contains(quarks::compile(source, {.if_conversion = 3}).output,
+                    "cmovnz"));
+
+    if (testing::have("nasm") && testing::have("ld")) {
+        for (int bits = 0; bits < 8; bits++) {
+            const std::string program =
+                chain(bits & 1, (bits >> 1) & 1, (bits >> 2) & 1);
+            CHECK(testing::run_program(program, {}) ==
+                  testing::run_program(program, branches));
+        }
+    }
+    return testing::failures();
+}
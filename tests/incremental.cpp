@@ -0,0 +1,78 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/incremental.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/** the diagnostics a full compile of source reports */
+std::vector<quarks::Diagnostic> full_diagnostics(const std::string& source) {
+    return quarks::compile(source).diagnostics;
+}
+
+bool same(const std::vector<quarks::Diagnostic>& a,
+          const std::vector<quarks::Diagnostic>& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](auto& x, auto& y) {
+               return x.message == y.message && x.line == y.line;
+           });
+}
+
+} // namespace
+
+/**
+ * Incremental reparsing: an edit reparses only the statements it touches,
+ * and diagnostics and output match a full compile of the edited text.
+ */
+int main() {
+    std::string source = "assign x = 0;\n";
+    for (int i = 0; i < 200; i++) {
+        source += "x = x + " + std::to_string(i) + ";\n";
+    }
+    source += "exit(x);\n";
+
+    IncrementalParse parse(source);
+    const std::size_t units = parse.unit_count();
+    const std::size_t middle = source.find("x = x + 100;");
+    parse.edit(middle + 8, 3, "7");
+    CHECK(parse.last_edit().units_reparsed <= 2);
+    CHECK(parse.unit_count() == units);
+
+    quarks::Document document(source);
+    const auto edit = [&](const std::size_t offset, const std::size_t length,
+                          const std::string& text) {
+        document.edit(offset, length, text);
+        source.replace(offset, length, text);
+        CHECK(document.source() == source);
+        CHECK(same(document.diagnostics(), full_diagnostics(source)));
+    };
+
+    // a syntax error late in the file, then one earlier that shifts it
+    edit(source.find("x = x + 150;") + 6, 0, "*");
+    CHECK(!document.diagnostics().empty());
+    edit(middle, 0, "assign y = 1;\n\n");
+    edit(source.find("x = x *+ 150;") + 6, 1, "");
+    CHECK(document.diagnostics().empty());
+
+    // a block opened and closed across edits
+    edit(middle, 0, "{\n");
+    CHECK(!document.diagnostics().empty());
+    edit(source.find("exit(x);"), 0, "}\n");
+    CHECK(document.diagnostics().empty());
+
+    const quarks::Result compiled = document.compile();
+    const quarks::Result full = quarks::compile(source);
+    CHECK(compiled.ok && full.ok);
+    CHECK(compiled.output == full.output);
+
+    // semantic errors only come from compile(), on the right line
+    const std::size_t end = source.find("exit(x);");
+    document.edit(end, 6, "exit(z");
+    source.replace(end, 6, "exit(z");
+    CHECK(document.diagnostics().empty());
+    const quarks::Result undeclared = document.compile();
+    CHECK(!undeclared.ok);
+    CHECK(same(undeclared.diagnostics, full_diagnostics(source)));
+    return testing::failures();
+}
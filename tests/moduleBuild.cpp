@@ -0,0 +1,77 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/moduleBuild.hpp"
+#include "testing.hpp"
+
+/**
+ * Modules: an import is checked against the interface it is given, and
+ * build_modules recompiles importers exactly when that interface changes.
+ */
+int main() {
+    // the interface, not the module's source, decides what an import declares
+    quarks::Options options{.imports = {{.module = "lib",
+                                         .exports = {{.name = "answer"}}}}};
+    CHECK(quarks::compile("import lib;\nexit(answer);", options).ok);
+    const quarks::Result missing =
+        quarks::compile("import lib;\nexit(other);", options);
+    CHECK(!missing.ok);
+    CHECK(missing.diagnostics.front().message.starts_with(
+        "Undeclared identifier: other"));
+    const quarks::Result unknown =
+        quarks::compile("import other;\nexit(0);", options);
+    CHECK(!unknown.ok);
+    CHECK(unknown.diagnostics.front().message.starts_with("Unknown module"));
+
+    options.module = "lib";
+    const quarks::Result exported =
+        quarks::compile("assign answer = 42;\nassign values[3] = 1;", options);
+    CHECK(exported.ok && exported.exports.size() == 2 &&
+          exported.exports[1].name == "values" &&
+          exported.exports[1].length == 3);
+
+    if (!testing::have("cc")) {
+        return testing::failures();
+    }
+    const std::filesystem::path directory = testing::scratch("modules");
+    std::filesystem::create_directories(directory);
+    const auto write = [&](const std::string& name, const std::string& text) {
+        std::ofstream(directory / (name + ".qs")) << text;
+    };
+    const OutputPaths out{.executable = directory / "main"};
+    const CompileOptions build{.backend = Backend::c};
+    const auto exit_code = [&] {
+        std::ifstream file(out.executable, std::ios::binary);
+        return testing::run(std::string(std::istreambuf_iterator<char>(file),
+                                        std::istreambuf_iterator<char>()));
+    };
+
+    write("lib", "assign answer = 40 + 2;\n");
+    write("main", "import lib;\nexit(answer);\n");
+    ModuleBuildReport report =
+        build_modules(directory / "main.qs", out, build, 2);
+    CHECK(report.ok && report.modules == 2 && report.rebuilt == 2);
+    CHECK(exit_code() == 42);
+
+    // same exports: the importer keeps its object
+    write("lib", "assign answer = 40 + 3;\n");
+    report = build_modules(directory / "main.qs", out, build, 2);
+    CHECK(report.ok && report.rebuilt == 1);
+    CHECK(exit_code() == 43);
+
+    // new exports shift the words the importer reads, so it is recompiled
+    write("lib", "assign first = 1;\nassign answer = 44;\n");
+    report = build_modules(directory / "main.qs", out, build, 2);
+    CHECK(report.ok && report.rebuilt == 2);
+    CHECK(exit_code() == 44);
+
+    // an export the importer uses is gone: its build fails
+    write("lib", "assign first = 1;\n");
+    report = build_modules(directory / "main.qs", out, build, 2);
+    CHECK(!report.ok);
+    CHECK(report.diagnostics.find("Undeclared identifier: answer") !=
+          std::string::npos);
+
+    std::filesystem::remove_all(directory);
+    return testing::failures();
+}
@@ -0,0 +1,82 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parser.hpp"
+#include "../include/parallelGeneration.hpp"
+#include "testing.hpp"
+
+/**
+ * Parallel code generation against a single generator: byte-identical
+ * output, and only label tokens are relocated, not text that happens to
+ * spell one.
+ */
+int main() {
+    CHECK(Generator::relocate_labels("label0:\n    jz label12\n", 5) ==
+          "label5:\n    jz label17\n");
+    CHECK(Generator::relocate_labels("    mov rax, label3x\n", 5) ==
+          "    mov rax, label3x\n");
+    CHECK(Generator::relocate_labels("; label3@1.5\n", 5) == "; label3@1.5\n");
+    CHECK(Generator::relocate_labels("    jmp mylabel3\n", 5) ==
+          "    jmp mylabel3\n");
+    CHECK(Generator::relocate_labels("label\nlabel7", 5) == "label\nlabel12");
+    CHECK(Generator::relocate_labels("%line 3+0 /my label2\nlabel2:\n", 5) ==
+          "%line 3+0 /my label2\nlabel7:\n");
+
+    std::string source = "assign label3 = 0;\n";
+    for (int i = 0; i < 600; i++) {
+        const std::string name = "label" + std::to_string(i % 7 + 1) + "x" +
+                                 std::to_string(i);
+        source += "assign " + name + " = label3 + " + std::to_string(i) +
+                  ";\nif (" + name + " - 3) {\n    label3 = " + name +
+                  ";\n} elif (label3) {\n    label3 = " +
+                  (i % 2 == 0 ? "1" : "label3 / 2") +
+                  ";\n} else {\n    label3 = 2;\n}\n";
+    }
+    source += "exit(label3);\n";
+
+    ArenaAllocator arena(1024 * 1024);
+    Tokenizer tokenizer(source);
+    Parser parser(tokenizer, arena);
+    const ProgramNode program = parser.parseProgram().value();
+    const std::string expected = Generator(program).generateProgram();
+    // half the chains divide and keep their branches, half are cmov
+    CHECK(expected.find("label899:") != std::string::npos);
+    CHECK(expected.find("label900:") == std::string::npos);
+    CHECK(expected.find("cmovnz") != std::string::npos);
+    for (const std::size_t region : {1, 7, 100}) {
+        CHECK(generate_parallel<Generator>(program, 4, {}, quarks::Isa::sse2,
+                                           quarks::kIfConversionCost, {},
+                                           region) == expected);
+        CHECK(generate_parallel<CGenerator>(program, 4, {}, quarks::Isa::sse2,
+                                            quarks::kIfConversionCost, {},
+                                            region) ==
+              CGenerator(program).generateProgram());
+    }
+
+    // -g: %line file names and label-like symbols are not labels
+    for (const std::string path : {"/src/label2/label5.qs", "/src/my label5"}) {
+        Generator generator(program);
+        generator.set_debug_source(path);
+        const std::string debug = generator.generateProgram();
+        CHECK(debug.find("%line 2+0 " + path + "\n") != std::string::npos);
+        CHECK(debug.find("\nlabel3@1.8 equ -8\n") != std::string::npos);
+        CHECK(debug.find("\nlabel5x599@") != std::string::npos);
+        for (const std::size_t region : {1, 7, 100}) {
+            CHECK(generate_parallel<Generator>(program, 4, path,
+                                               quarks::Isa::sse2,
+                                               quarks::kIfConversionCost, {},
+                                               region) == debug);
+        }
+    }
+
+    // through the library, where regions are at least 4096 statements
+    std::string large = "assign x = 0;\n";
+    for (int i = 0; i < 12000; i++) {
+        large += "if (x - " + std::to_string(i % 5) + ") {\n    x = x + 1;\n}\n";
+    }
+    large += "exit(x);\n";
+    const quarks::Result one = quarks::compile(large);
+    const quarks::Result four = quarks::compile(large, {.codegen_threads = 4});
+    CHECK(one.ok && four.ok && one.output == four.output);
+    return testing::failures();
+}
@@ -0,0 +1,109 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parallelParse.hpp"
+#include "../include/generation.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/** the assembly, or the error, of a sequential parse */
+std::string sequential(const std::string& source) {
+    try {
+        ArenaAllocator arena(1024 * 1024);
+        Tokenizer tokenizer(source);
+        Parser parser(tokenizer, arena);
+        Generator generator(parser.parseProgram().value());
+        return generator.generateProgram();
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+}
+
+/** the assembly, or the error, of parsing chunks of min_chunk_bytes on jobs */
+std::string parallel(const std::string& source, const std::size_t jobs,
+                     const std::size_t min_chunk_bytes) {
+    try {
+        ParallelParse parse = parse_parallel(source, jobs, min_chunk_bytes);
+        Generator generator(std::move(parse.program));
+        return generator.generateProgram();
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+}
+
+} // namespace
+
+/**
+ * parse_parallel against the sequential parser: the same program, and the
+ * same diagnostics with the same absolute lines, whatever the chunk size.
+ */
+int main() {
+    // 300 statement groups of nine lines, declaring prefix0 to prefix299
+    const auto groups = [](const std::string& prefix) {
+        std::string text;
+        for (int i = 0; i < 300; i++) {
+            const std::string name = prefix + std::to_string(i);
+            text += "assign " + name + " = x * " + std::to_string(i % 7) +
+                    ";\nif (" + name + ") {\n    x = x + " + name +
+                    ";\n}\nelif (x - 3) { x = 1; } else {\n    {\n        x = "
+                    "x - 1;\n    }\n}\n";
+        }
+        return text;
+    };
+    const std::string source =
+        "assign x = 1; -- two statements on a line\n" + groups("v");
+    const std::string program = source + "exit(x);\n";
+    const int last_line = 9 * 300 + 1;
+    CHECK(split_top_level(program, 1).size() > 600);
+
+    const std::string expected = sequential(program);
+    CHECK(expected.starts_with("global _start"));
+    for (const std::size_t chunk : {1, 7, 100, 5000}) {
+        for (const std::size_t jobs : {2, 4}) {
+            CHECK(parallel(program, jobs, chunk) == expected);
+        }
+    }
+
+    // errors in a later chunk, with their line numbers
+    const std::vector<std::string> broken = {
+        source + "exit(x;\n",
+        source + "\n\nassign = 3;\nexit(x);\n",
+        source + "exit(x) $;\n",
+        // unbalanced braces: one left open, one closed too many
+        source + "{\n    assign y = 1;\nexit(y);\n",
+        source + "}\nexit(x);\n",
+        "{\n" + program,
+    };
+    for (const std::string& input : broken) {
+        const std::string error = sequential(input);
+        CHECK(!error.starts_with("global _start"));
+        for (const std::size_t chunk : {1, 100}) {
+            CHECK(parallel(input, 4, chunk) == error);
+        }
+    }
+    CHECK(sequential(broken[0]) ==
+          sequential("exit(x;").substr(0, sequential("exit(x;").find(" at ")) +
+              " at line " + std::to_string(last_line));
+    CHECK(sequential(broken[2]) ==
+          "Invalid token at line " + std::to_string(last_line));
+
+    // through the library, where chunks are at least 1 MiB
+    std::string large = source;
+    for (int i = 0; large.size() < (5 << 19); i++) {
+        large += groups("w" + std::to_string(i) + "x");
+    }
+    large += "exit(x);\n";
+    const quarks::Result one = quarks::compile(large);
+    const quarks::Result four = quarks::compile(large, {.parse_threads = 4});
+    CHECK(one.ok && four.ok && one.output == four.output);
+    const quarks::Result failed = quarks::compile(large + "exit(;\n");
+    const quarks::Result failed_parallel =
+        quarks::compile(large + "exit(;\n", {.parse_threads = 4});
+    CHECK(!failed.ok && !failed_parallel.ok);
+    CHECK(failed.diagnostics.front().message ==
+          failed_parallel.diagnostics.front().message);
+    CHECK(failed.diagnostics.front().line ==
+          failed_parallel.diagnostics.front().line);
+    return testing::failures();
+}
@@ -0,0 +1,58 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/pipeline.hpp"
+#include "testing.hpp"
+#include <sys/resource.h>
+
+namespace {
+
+long peak_rss_kib() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+std::string stream(const std::string& source, const StreamingLimits& limits) {
+    std::ostringstream out;
+    compile_streaming<Generator>(source, out, limits);
+    return out.str();
+}
+
+} // namespace
+
+/**
+ * compile_streaming: the output of the sequential pipeline, and every batch
+ * arena frees its AST, so repeated streaming compiles stay flat.
+ */
+int main() {
+    std::string source = "assign x = 0;\n";
+    for (int i = 0; i < 6000; i++) {
+        const std::string name = "y" + std::to_string(i);
+        source += "{\n    assign " + name + " = x + " + std::to_string(i) +
+                  ";\n    x = " + name + ";\n}\n";
+    }
+    source += "exit(x);\n";
+    const StreamingLimits limits{.token_batch = 512, .statement_batch = 32};
+
+    CHECK(stream(source, limits) == quarks::compile(source).output);
+    for (int i = 0; i < 10; i++) {
+        stream(source, limits);
+    }
+    const long warm = peak_rss_kib();
+    for (int i = 0; i < 100; i++) {
+        stream(source, limits);
+    }
+    CHECK(peak_rss_kib() - warm < 4 * 1024);
+
+    // errors still surface in pipeline order
+    std::ostringstream out;
+    try {
+        compile_streaming<Generator>("assign a = 1;\nexit(b);\n", out, limits);
+        CHECK(false);
+    } catch (const CompileError& error) {
+        CHECK(std::string_view(error.what())
+                  .starts_with("Undeclared identifier"));
+    }
+    return testing::failures();
+}
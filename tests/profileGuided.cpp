@@ -0,0 +1,135 @@
+#include "../include/profile.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/** the first arm is never taken, the elif always, the else never tested */
+const std::string kSource = "assign x = 3;\n"
+                            "if (x - 3) {\n"
+                            "    x = 40;\n"
+                            "} elif (x) {\n"
+                            "    x = x + 1;\n"
+                            "} else {\n"
+                            "    x = 7;\n"
+                            "}\n"
+                            "exit(x);\n";
+
+void write_words(const std::filesystem::path& path,
+                 const std::vector<std::uint64_t>& words) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(words.data()),
+               static_cast<std::streamsize>(words.size() * sizeof(words[0])));
+}
+
+/** the first diagnostic of compiling kSource with options */
+std::string error_of(const quarks::Options& options) {
+    const quarks::Result result = quarks::compile(kSource, options);
+    return result.ok ? "" : result.diagnostics.front().message;
+}
+
+} // namespace
+
+/**
+ * --instrument and --profile-use: the instrumented program writes the
+ * counts it saw, a recorded profile moves the cold arm after the final
+ * exit without changing what the program does, and a missing, malformed
+ * or foreign profile is an error.
+ */
+int main() {
+    const std::filesystem::path recorded = testing::scratch("recorded");
+    const std::uint64_t hash = BranchProfile::hash(kSource);
+    write_words(recorded, {BranchProfile::kMagic, hash, 2, 1, 0, 1, 1});
+
+    // the asm backend: the x = 40 arm is out of line, after the final exit
+    const std::string final_exit =
+        "    mov rax, 60\n    mov rdi, 0\n    syscall\n";
+    const quarks::Result plain = quarks::compile(kSource);
+    const quarks::Result laid_out =
+        quarks::compile(kSource, {.profile_use = recorded.string()});
+    CHECK(plain.ok && laid_out.ok);
+    CHECK(plain.output.ends_with(final_exit));
+    CHECK(plain.output.find("mov eax, 40") < plain.output.find(final_exit));
+    CHECK(laid_out.output.find("mov eax, 40") != std::string::npos);
+    CHECK(laid_out.output.find("mov eax, 40") >
+          laid_out.output.find(final_exit));
+    // the hot elif arm stays on the straight-line path
+    CHECK(laid_out.output.find("mov eax, 7") <
+          laid_out.output.find(final_exit));
+    // biased tests keep their branches; others are left to if-conversion
+    CHECK(plain.output.find("cmovnz") != std::string::npos);
+    CHECK(laid_out.output.find("cmovnz") == std::string::npos);
+    const std::filesystem::path unbiased = testing::scratch("unbiased");
+    write_words(unbiased, {BranchProfile::kMagic, hash, 2, 4, 2, 2, 1});
+    CHECK(quarks::compile(kSource, {.profile_use = unbiased.string()})
+              .output == plain.output);
+    std::filesystem::remove(unbiased);
+
+    // the C backend hints instead
+    const quarks::Result hinted =
+        quarks::compile(kSource, {.backend = quarks::Backend::c,
+                                  .profile_use = recorded.string()});
+    CHECK(hinted.ok);
+    CHECK(hinted.output.find("__builtin_expect(!!(qs_sub(v_x, INT64_C(3))), "
+                             "0)") != std::string::npos);
+    CHECK(hinted.output.find("__builtin_expect(!!(v_x), 1)") !=
+          std::string::npos);
+
+    std::vector<quarks::Backend> backends;
+    if (testing::have("nasm") && testing::have("ld")) {
+        backends.push_back(quarks::Backend::nasm);
+    }
+    if (testing::have("cc")) {
+        backends.push_back(quarks::Backend::c);
+    }
+    for (const quarks::Backend backend : backends) {
+        // the instrumented build writes what it counted, when it exits
+        const std::filesystem::path written = testing::scratch("written");
+        CHECK(testing::run_program(kSource, {.backend = backend,
+                                             .instrument = written.string()}) ==
+              4);
+        const BranchProfile profile = BranchProfile::read(written);
+        CHECK(profile.source_hash == hash);
+        CHECK(profile.sites.size() == 2 && profile.sites[0].reached == 1 &&
+              profile.sites[0].taken == 0 && profile.sites[1].reached == 1 &&
+              profile.sites[1].taken == 1);
+        CHECK(profile.cold(0) && !profile.cold(1));
+
+        // and the build laid out by it exits the same
+        CHECK(testing::run_program(kSource, {.backend = backend,
+                                             .profile_use = written.string()}) ==
+              testing::run_program(kSource, {.backend = backend}));
+        std::filesystem::remove(written);
+    }
+
+    // profiles that cannot be used
+    const std::filesystem::path missing = testing::scratch("missing");
+    CHECK(error_of({.profile_use = missing.string()})
+              .starts_with("Failed to open profile"));
+    const std::filesystem::path bad = testing::scratch("bad");
+    std::ofstream(bad) << "not a profile at all\n";
+    CHECK(error_of({.profile_use = bad.string()})
+              .starts_with("Not a branch profile"));
+    write_words(bad, {BranchProfile::kMagic, hash, 5, 1, 0});
+    CHECK(error_of({.profile_use = bad.string()})
+              .starts_with("Truncated branch profile"));
+    write_words(bad, {BranchProfile::kMagic, hash + 1, 2, 1, 0, 1, 1});
+    CHECK(error_of({.profile_use = bad.string()})
+              .ends_with("was recorded for a different source"));
+
+    // and the CLI fails on them
+    const std::filesystem::path directory = testing::scratch("profile");
+    std::filesystem::create_directories(directory);
+    std::ofstream(directory / "program.qs") << kSource;
+    std::ofstream(directory / "bad.profile") << "garbage\n";
+    CHECK(testing::quarks("--profile-use=bad.profile -o program program.qs "
+                          "2> /dev/null",
+                          directory) == EXIT_FAILURE);
+    CHECK(testing::quarks("--profile-use -o program program.qs 2> /dev/null",
+                          directory) == EXIT_FAILURE);
+    CHECK(!std::filesystem::exists(directory / "program"));
+
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove(recorded);
+    std::filesystem::remove(bad);
+    return testing::failures();
+}
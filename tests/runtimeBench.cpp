@@ -0,0 +1,117 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/parser.hpp"
+#include "../include/generation.hpp"
+#include "../include/cGeneration.hpp"
+#include "../include/runtimeBench.hpp"
+#include "testing.hpp"
+
+namespace {
+
+bool near(const double a, const double b) { return std::abs(a - b) < 1e-9; }
+
+/** an executable shell script with body */
+std::filesystem::path script(const std::string& body) {
+    const std::filesystem::path path = testing::scratch("script");
+    std::ofstream(path) << "#!/bin/sh\n" << body << "\n";
+    std::filesystem::permissions(path, std::filesystem::perms::owner_all);
+    return path;
+}
+
+/** the message run_once throws for path, or empty when it runs */
+std::string run_error(const std::filesystem::path& path) {
+    try {
+        runtime_bench::run_once(path);
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+    return "";
+}
+
+} // namespace
+
+/**
+ * quarks bench: the summary and Welch interval arithmetic against values
+ * worked by hand, and run_once's exit statuses and exec failures.
+ */
+int main() {
+    using runtime_bench::Summary;
+
+    const Summary summary = runtime_bench::summarize({9, 2, 4, 4, 7, 4, 5, 5});
+    CHECK(summary.n == 8);
+    CHECK(near(summary.mean, 5));
+    CHECK(near(summary.median, 4.5));
+    CHECK(near(summary.stddev, std::sqrt(32.0 / 7)));
+    CHECK(near(runtime_bench::summarize({3, 1, 2}).median, 2));
+    CHECK(runtime_bench::summarize({}).n == 0);
+    CHECK(runtime_bench::summarize({4}).stddev == 0);
+
+    CHECK(runtime_bench::t_quantile(1) == 12.706);
+    CHECK(runtime_bench::t_quantile(22.9) == 2.074);
+    CHECK(runtime_bench::t_quantile(30) == 2.042);
+    CHECK(runtime_bench::t_quantile(45) == 2.000);
+    CHECK(runtime_bench::t_quantile(1e9) == 1.960);
+
+    // equal variances: se = sqrt(20), df = 18
+    const Summary a{.n = 10, .mean = 100, .stddev = 10};
+    const runtime_bench::Comparison slower =
+        runtime_bench::compare(a, {.n = 10, .mean = 110, .stddev = 10});
+    CHECK(near(slower.change, 0.10));
+    CHECK(near(slower.margin, 2.101 * std::sqrt(20.0) / 100));
+    CHECK(slower.significant());
+    CHECK(!runtime_bench::compare(a, {.n = 10, .mean = 105, .stddev = 10})
+               .significant());
+
+    // unequal variances: se = 1, df = 1 / (0.2^2 / 4 + 0.8^2 / 19) = 22.9
+    const runtime_bench::Comparison welch = runtime_bench::compare(
+        {.n = 5, .mean = 50, .stddev = 1}, {.n = 20, .mean = 49, .stddev = 4});
+    CHECK(near(welch.change, -0.02));
+    CHECK(near(welch.margin, 2.074 / 50));
+    CHECK(!welch.significant());
+
+    // no spread to measure, or nothing to compare against
+    CHECK(!runtime_bench::compare(a, a).significant());
+    const runtime_bench::Comparison exact = runtime_bench::compare(
+        {.n = 5, .mean = 10}, {.n = 5, .mean = 11});
+    CHECK(exact.margin == 0 && exact.significant());
+    CHECK(runtime_bench::compare({.n = 1, .mean = 100}, {.n = 1, .mean = 90})
+              .margin == 0);
+    CHECK(runtime_bench::compare({.n = 5}, {.n = 5, .mean = 1}).change == 0);
+
+    // every exit status is the program's, 127 included
+    for (const int status : {0, 3, 127, 255}) {
+        const std::filesystem::path path =
+            script("exit " + std::to_string(status));
+        CHECK(runtime_bench::run_once(path).exit_status == status);
+        std::filesystem::remove(path);
+    }
+    const std::filesystem::path killed = script("kill -9 $$");
+    CHECK(runtime_bench::run_once(killed).exit_status == 128 + 9);
+    std::filesystem::remove(killed);
+
+    // an exec failure is an error with its cause, not a status
+    CHECK(run_error(testing::scratch("missing"))
+              .ends_with(std::strerror(ENOENT)));
+    const std::filesystem::path text = testing::scratch("text");
+    std::ofstream(text) << "exit 0\n";
+    CHECK(run_error(text).ends_with(std::strerror(EACCES)));
+    std::filesystem::remove(text);
+
+    // a malformed count is a usage error, not an uncaught exception
+    for (const char* flag : {"--runs=abc", "--warmup=", "--runs=2x"}) {
+        CHECK(runtime_bench::main({flag, "program.qs"}) == EXIT_FAILURE);
+    }
+    CHECK(runtime_bench::parse_variant("asm:3", "cc").options.if_conversion ==
+          3);
+    for (const char* spec : {"asm:", "asm:abc", "asm:-1"}) {
+        bool rejected = false;
+        try {
+            runtime_bench::parse_variant(spec, "cc");
+        } catch (const CompileError&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+    return testing::failures();
+}
@@ -0,0 +1,87 @@
+#include "../include/snippet.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/** the first diagnostic of source, empty when it compiles */
+std::string diagnostic(const std::string& source,
+                       const quarks::Backend backend) {
+    const quarks::Result result = quarks::compile(source, {.backend = backend});
+    return result.ok ? "" : result.diagnostics.front().message;
+}
+
+std::string snippet_diagnostic(const std::string& source) {
+    try {
+        (void)quarks::compile_snippet<256>(source);
+        return "";
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+}
+
+} // namespace
+
+static_assert(quarks::eval<"assign c: u8 = 250; c = c + 10; exit(c);">() == 4);
+static_assert(quarks::eval<"assign c: i8 = 127; c = c + 1; exit(c);">() ==
+              -128);
+
+/**
+ * Sized integers: stores wrap to the variable's width, and a store that
+ * could lose an operand's value (a literal too large, a wider variable or
+ * an array element) is an error in every front end.
+ */
+int main() {
+    // the values programs exit with, low 8 bits included
+    const std::pair<std::string, int> wraps[] = {
+        {"assign c: u8 = 250;\nc = c + 10;\nexit(c);", 4},
+        {"assign c: i8 = 127;\nc = c + 1;\nexit(c + 200);", 72},
+        {"assign c: u16 = 0 - 1;\nexit(c / 256);", 255},
+        {"assign c: i32 = 2147483647;\nc = c + 1;\nexit(c / 16777216 + 200);",
+         72},
+        {"assign c: u32 = 0 - 1;\nexit(c / 16777216);", 255},
+        {"assign a: u8 = 200;\nassign b: i16 = a;\nb = b * a;\n"
+         "exit(b / 256 + 100);",
+         100 + static_cast<std::int16_t>(40000) / 256},
+    };
+    const quarks::Options c{.backend = quarks::Backend::c};
+    for (const auto& [source, expected] : wraps) {
+        if (testing::have("cc")) {
+            CHECK(testing::run_program(source, c) == expected);
+        }
+        if (testing::have("nasm") && testing::have("ld")) {
+            CHECK(testing::run_program(source, {}) == expected);
+        }
+    }
+
+    const std::pair<std::string, std::string> stores[] = {
+        {"assign c: u8 = 255;\nexit(c);", ""},
+        {"assign c: u8 = 256;\nexit(c);", "Literal 256 does not fit u8"},
+        {"assign c: u8 = 1;\nc = c + 300;\nexit(c);",
+         "Literal 300 does not fit u8"},
+        {"assign x = 5;\nassign c: u8 = x;\nexit(c);",
+         "Type i64 does not fit u8: x"},
+        {"assign x: i8 = 5;\nassign c: u8 = 1;\nc = (c + x) * 2;\nexit(c);",
+         "Type i8 does not fit u8: x"},
+        {"assign x: u16 = 5;\nassign c: i16 = x;\nexit(c);",
+         "Type u16 does not fit i16: x"},
+        {"assign x: u16 = 5;\nassign c: i32 = x;\nassign d: u32 = x;\n"
+         "exit(c + d);",
+         ""},
+        {"assign a[4] = 1;\nassign i: u8 = 0;\nassign c: u8 = a[i] * 0;\n"
+         "exit(c);",
+         "Type i64 does not fit u8: a"},
+        {"assign i = 2;\nassign c: u8 = 3;\nassign a[4] = c;\na[i] = c;\n"
+         "exit(a[i]);",
+         ""},
+    };
+    for (const auto& [source, expected] : stores) {
+        for (const quarks::Backend backend :
+             {quarks::Backend::nasm, quarks::Backend::c}) {
+            CHECK(diagnostic(source, backend).starts_with(expected));
+            CHECK(diagnostic(source, backend).empty() == expected.empty());
+        }
+        CHECK(snippet_diagnostic(source).starts_with(expected));
+        CHECK(snippet_diagnostic(source).empty() == expected.empty());
+    }
+    return testing::failures();
+}
@@ -0,0 +1,94 @@
+#include "testing.hpp"
+
+namespace {
+
+/** eight scalars in consecutive slots, body, then all of them folded */
+std::string program(const std::string& body) {
+    return "assign a = 1;\nassign b = 0 - 2;\nassign c = 3000000000;\n"
+           "assign d = 4;\nassign e = 5;\nassign f = 6000000007;\n"
+           "assign g = 0 - 7;\nassign h = 8;\n" +
+           body +
+           "assign r = ((((((a * 31 + b) * 31 + c) * 31 + d) * 31 + e) * 31 + "
+           "f) * 31 + g) * 31 + h;\n"
+           "exit(r + r / 256 + r / 65536 + r / 4294967296);\n";
+}
+
+/** statements the SLP pass packed, as --stats counts them */
+std::size_t packed(const std::string& source, const quarks::Isa isa) {
+    const quarks::Result result =
+        quarks::compile(source, {.collect_stats = true, .isa = isa});
+    CHECK(result.ok);
+    return result.stats.vectorized;
+}
+
+} // namespace
+
+/**
+ * The SLP pass packs runs of isomorphic statements, and only those, and
+ * packed programs exit as the scalar and C builds of them do.
+ */
+int main() {
+    // isomorphic runs: shared literals (however spelled), shared variables
+    // and variables in consecutive slots
+    const std::vector<std::string> isomorphic = {
+        "a = a + 3;\nb = b + 03;\nc = c + 3;\nd = d + 003;\n",
+        "a = a - h;\nb = b - h;\nc = c - h;\nd = d - h;\n",
+        "a = e * a;\nb = f * b;\nc = g * c;\nd = h * d;\n",
+        "e = a + e;\nf = b + f;\ng = c + g;\nh = d + h;\n",
+    };
+    // a statement reading another's result, mixed operators, differing
+    // literals, and division, which has no vector instruction
+    const std::vector<std::string> unpackable = {
+        "a = b + 1;\nb = c + 1;\nc = d + 1;\nd = a + 1;\n",
+        "a = a + 1;\nb = a + 1;\nc = b + 1;\nd = c + 1;\n",
+        "a = a + 1;\nb = b * 1;\nc = c + 1;\nd = d * 1;\n",
+        "a = a - 1;\nb = b + 1;\nc = c - 1;\nd = d + 1;\n",
+        "a = a + 1;\nb = b + 2;\nc = c + 3;\nd = d + 4;\n",
+        "a = a / 3;\nb = b / 3;\nc = c / 3;\nd = d / 3;\n",
+    };
+
+    for (const std::string& body : isomorphic) {
+        const std::string source = program(body);
+        CHECK(packed(source, quarks::Isa::sse2) == 4);
+        CHECK(packed(source, quarks::Isa::avx2) == 4);
+        CHECK(packed(source, quarks::Isa::scalar) == 0);
+        const std::string sse2 =
+            quarks::compile(source, {.isa = quarks::Isa::sse2}).output;
+        const std::string avx2 =
+            quarks::compile(source, {.isa = quarks::Isa::avx2}).output;
+        CHECK(sse2.find("    ; packed 2 statements\n") != std::string::npos);
+        CHECK(sse2.find("ymm") == std::string::npos);
+        CHECK(avx2.find("    ; packed 4 statements\n") != std::string::npos);
+    }
+    for (const std::string& body : unpackable) {
+        const std::string source = program(body);
+        CHECK(packed(source, quarks::Isa::sse2) == 0);
+        CHECK(packed(source, quarks::Isa::avx2) == 0);
+        CHECK(quarks::compile(source).output.find("xmm") == std::string::npos);
+    }
+    // a run is cut where it stops being isomorphic
+    CHECK(packed(program("a = a + 1;\nb = b + 1;\nc = c * 1;\nd = d * 1;\n"),
+                 quarks::Isa::avx2) == 4);
+
+    if (!testing::have("nasm") || !testing::have("ld") ||
+        !testing::have("cc")) {
+        return testing::failures();
+    }
+    std::vector<std::string> bodies = isomorphic;
+    bodies.insert(bodies.end(), unpackable.begin(), unpackable.end());
+    for (const std::string& body : bodies) {
+        const std::string source = program(body);
+        const int expected =
+            testing::run_program(source, {.backend = quarks::Backend::c});
+        CHECK(expected >= 0);
+        for (const quarks::Isa isa :
+             {quarks::Isa::scalar, quarks::Isa::sse2, quarks::Isa::avx2}) {
+            if (!CHECK(testing::run_program(source, {.isa = isa}) ==
+                       expected)) {
+                std::cerr << "  isa " << static_cast<int>(isa) << " on\n"
+                          << body;
+            }
+        }
+    }
+    return testing::failures();
+}
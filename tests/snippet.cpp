@@ -0,0 +1,145 @@
+#include "../include/snippet.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/**
+ * whether source folds to a constant; eval<Source>() is a hard error where
+ * it does not, so this folds compile_snippet and run directly
+ */
+template <quarks::FixedString Source>
+constexpr bool folds = requires {
+    typename std::integral_constant<std::int64_t, [] {
+        constexpr std::size_t capacity = Source.view().size() + 1;
+        const auto program = quarks::compile_snippet<capacity>(Source.view());
+        quarks::SnippetState<capacity, capacity> state;
+        return program.run(state);
+    }()>;
+};
+
+// nested if/elif/else, taking every arm
+static_assert(quarks::eval<"assign x = 2;\n"
+                           "if (x - 2) {\n"
+                           "    x = 10;\n"
+                           "} elif (x) {\n"
+                           "    if (x - 1) {\n"
+                           "        if (0) {\n"
+                           "            x = 20;\n"
+                           "        } elif (0) {\n"
+                           "            x = 21;\n"
+                           "        } else {\n"
+                           "            x = x * 11;\n"
+                           "        }\n"
+                           "    } else {\n"
+                           "        x = 30;\n"
+                           "    }\n"
+                           "} else {\n"
+                           "    x = 40;\n"
+                           "}\n"
+                           "exit(x);">() == 22);
+static_assert(quarks::eval<"assign x = 0;\n"
+                           "if (x) { x = 1; } elif (x) { x = 2; }\n"
+                           "else { if (x) { x = 3; } else { x = 4; } }\n"
+                           "exit(x);">() == 4);
+
+// scopes: inner names end with their scope, and may not shadow outer ones
+static_assert(quarks::eval<"assign x = 1;\n"
+                           "{\n"
+                           "    assign y = 2;\n"
+                           "    {\n"
+                           "        assign z = y * 3;\n"
+                           "        x = x + z;\n"
+                           "    }\n"
+                           "    assign z = 100;\n"
+                           "    x = x + z;\n"
+                           "}\n"
+                           "assign y = 1000;\n"
+                           "exit(x + y);">() == 1107);
+static_assert(!folds<"assign x = 1;\n{\n    assign x = 2;\n}\nexit(x);">);
+static_assert(!folds<"{\n    assign y = 2;\n}\nexit(y);">);
+
+// division truncates toward zero, and precedence is the parser's
+static_assert(quarks::eval<"exit(7 / 2);">() == 3);
+static_assert(quarks::eval<"exit((0 - 7) / 2);">() == -3);
+static_assert(quarks::eval<"exit(7 / (0 - 2));">() == -3);
+static_assert(quarks::eval<"exit(1 + 2 * 3 - 8 / 4 / 2);">() == 6);
+static_assert(quarks::eval<"exit(9223372036854775807 + 1);">() ==
+              std::numeric_limits<std::int64_t>::min());
+
+// compile errors, and faults reached while folding, fail to evaluate
+static_assert(folds<"exit(1);">);
+static_assert(!folds<"exit(y);">);
+static_assert(!folds<"exit(1;">);
+static_assert(!folds<"assign x = 1;\nassign x = 2;\nexit(x);">);
+static_assert(!folds<"assign a[3] = 1;\nexit(a);">);
+static_assert(!folds<"exit(1 / 0);">);
+static_assert(!folds<"assign a[3] = 1;\nexit(a[3]);">);
+
+// arrays fold too
+static_assert(quarks::eval<"assign a[5] = 2;\n"
+                           "a[1] = 7;\n"
+                           "assign b[5] = a * a + 1;\n"
+                           "exit(b[0] + b[1] + b[4]);">() == 60);
+
+using Rule = quarks::Snippet<"assign left = limit - used;\n"
+                             "if (left) {\n"
+                             "    exit(left * 2 / (used + 1));\n"
+                             "} else {\n"
+                             "    exit(0 - 1);\n"
+                             "}",
+                             "limit", "used">;
+static_assert(Rule::run(10, 4) == 2);
+static_assert(Rule::run(4, 4) == -1);
+
+/** Rule's ops through the reference evaluator */
+std::int64_t interpret(const std::int64_t limit, const std::int64_t used) {
+    quarks::SnippetState<Rule::program.slots, Rule::program.depth> state{
+        .slots = {limit, used}};
+    return Rule::program.run(state);
+}
+
+/** the message Parser or Generator gives source, or empty */
+std::string compiler_error(const std::string& source) {
+    const quarks::Result result = quarks::compile(source);
+    return result.ok ? "" : result.diagnostics.front().message;
+}
+
+/** the message the snippet front end gives source, or empty */
+std::string snippet_error(const std::string_view source) {
+    try {
+        quarks::compile_snippet<64>(source);
+    } catch (const CompileError& error) {
+        return error.what();
+    }
+    return "";
+}
+
+} // namespace
+
+/**
+ * quarks::eval and quarks::Snippet: the static_asserts above fold at
+ * compile time; here Snippet::run is checked against the interpreter and
+ * the snippet front end's errors against the compiler's.
+ */
+int main() {
+    for (std::int64_t limit = -3; limit <= 12; limit++) {
+        for (std::int64_t used = -3; used <= 12; used++) {
+            if (used == -1) {
+                continue;
+            }
+            CHECK(Rule::run(limit, used) == interpret(limit, used));
+        }
+    }
+
+    for (const std::string source :
+         {"exit(y);", "exit(1;", "assign x = 1;\nassign x = 2;\nexit(x);",
+          "assign x = 1;\n{\n    assign x = 2;\n}\nexit(x);",
+          "assign a[3] = 1;\nexit(a);", "assign x = 1;\nexit(x[0]);",
+          "exit(1) $;", "{\n    exit(1);\n"}) {
+        if (!CHECK(snippet_error(source) == compiler_error(source))) {
+            std::cerr << "  " << snippet_error(source) << " / "
+                      << compiler_error(source) << "\n";
+        }
+    }
+    return testing::failures();
+}
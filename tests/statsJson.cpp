@@ -0,0 +1,237 @@
+#include "../include/common.hpp"
+#include "../include/tokenization.hpp"
+#include "testing.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+/** a parsed JSON value: objects keep their keys in order beside items */
+struct Json {
+    enum class Kind { null, boolean, number, string, array, object };
+    Kind kind = Kind::null;
+    double number = 0;
+    std::string text;
+    std::vector<std::string> keys;
+    std::vector<Json> items;
+
+    [[nodiscard]] const Json& operator[](const std::string& key) const {
+        const auto found = std::find(keys.begin(), keys.end(), key);
+        if (kind != Kind::object || found == keys.end()) {
+            throw std::runtime_error("no member " + key);
+        }
+        return items[static_cast<std::size_t>(found - keys.begin())];
+    }
+};
+
+/** just enough of RFC 8259 for the stats file; throws on anything else */
+class JsonReader {
+  public:
+    explicit JsonReader(std::string text) : m_text(std::move(text)) {}
+
+    Json document() {
+        Json value = read();
+        skip_space();
+        if (m_index != m_text.size()) {
+            fail();
+        }
+        return value;
+    }
+
+  private:
+    std::string m_text;
+    std::size_t m_index = 0;
+
+    [[noreturn]] void fail() const {
+        throw std::runtime_error("bad JSON at byte " + std::to_string(m_index));
+    }
+
+    void skip_space() {
+        while (m_index < m_text.size() &&
+               std::isspace(static_cast<unsigned char>(m_text[m_index]))) {
+            m_index++;
+        }
+    }
+
+    bool consume(const char c) {
+        skip_space();
+        if (m_index < m_text.size() && m_text[m_index] == c) {
+            m_index++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(const char c) {
+        if (!consume(c)) {
+            fail();
+        }
+    }
+
+    std::string string() {
+        expect('"');
+        std::string out;
+        while (m_index < m_text.size() && m_text[m_index] != '"') {
+            if (m_text[m_index] == '\\') {
+                m_index++;
+            }
+            out += m_text.at(m_index++);
+        }
+        expect('"');
+        return out;
+    }
+
+    Json read() {
+        Json value;
+        skip_space();
+        if (m_index >= m_text.size()) {
+            fail();
+        }
+        const char c = m_text[m_index];
+        if (c == '{') {
+            value.kind = Json::Kind::object;
+            m_index++;
+            if (!consume('}')) {
+                do {
+                    value.keys.push_back(string());
+                    expect(':');
+                    value.items.push_back(read());
+                } while (consume(','));
+                expect('}');
+            }
+        } else if (c == '[') {
+            value.kind = Json::Kind::array;
+            m_index++;
+            if (!consume(']')) {
+                do {
+                    value.items.push_back(read());
+                } while (consume(','));
+                expect(']');
+            }
+        } else if (c == '"') {
+            value.kind = Json::Kind::string;
+            value.text = string();
+        } else if (m_text.compare(m_index, 4, "true") == 0 ||
+                   m_text.compare(m_index, 5, "false") == 0) {
+            value.kind = Json::Kind::boolean;
+            value.number = c == 't' ? 1 : 0;
+            m_index += c == 't' ? 4 : 5;
+        } else if (m_text.compare(m_index, 4, "null") == 0) {
+            m_index += 4;
+        } else {
+            const char* begin = m_text.c_str() + m_index;
+            char* end = nullptr;
+            value.kind = Json::Kind::number;
+            value.number = std::strtod(begin, &end);
+            if (end == begin) {
+                fail();
+            }
+            m_index += static_cast<std::size_t>(end - begin);
+        }
+        return value;
+    }
+};
+
+std::string read(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+}
+
+/** the stats file of compiling program.qs in directory with args */
+Json stats_of(const std::string& args, const std::filesystem::path& directory) {
+    std::filesystem::remove(directory / "stats.json");
+    CHECK(testing::quarks(args + " --stats-json=stats.json program.qs",
+                          directory) == 0);
+    return JsonReader(read(directory / "stats.json")).document();
+}
+
+std::vector<std::string> pass_names(const Json& stats) {
+    std::vector<std::string> names;
+    for (const Json& pass : stats["passes"].items) {
+        CHECK(pass["wall_seconds"].number >= 0);
+        CHECK(pass["cpu_seconds"].number >= 0);
+        names.push_back(pass["pass"].text);
+    }
+    return names;
+}
+
+} // namespace
+
+/**
+ * --stats-json on a fixed program: the file is JSON, the passes are named
+ * in order, and the counters are those of the source.
+ */
+int main() {
+    const std::string source = "assign x = 7;\n"
+                               "assign y = (x + 2) * 3;\n"
+                               "if (y - 27) {\n"
+                               "    x = y / 3;\n"
+                               "} elif (x) {\n"
+                               "    x = 1;\n"
+                               "} else {\n"
+                               "    x = x - 1;\n"
+                               "}\n"
+                               "{\n"
+                               "    assign z = x;\n"
+                               "    x = z;\n"
+                               "}\n"
+                               "exit(x);\n";
+    const std::vector<std::pair<std::string, double>> nodes = {
+        {"exit", 1},           {"declaration", 3},    {"assignment", 4},
+        {"scope", 1},          {"if", 1},             {"elif", 1},
+        {"else", 1},           {"int_literal", 7},    {"identifier", 8},
+        {"parenthesis", 1},    {"addition", 1},       {"subtraction", 2},
+        {"multiplication", 1}, {"division", 1},       {"index", 0},
+        {"import", 0}};
+
+    const std::filesystem::path directory = testing::scratch("statsjson");
+    std::filesystem::create_directories(directory);
+    std::ofstream(directory / "program.qs") << source;
+
+    try {
+        const Json stats = stats_of("--in-memory > /dev/null", directory);
+        CHECK(stats["source"].text == "program.qs");
+        CHECK(stats["source_bytes"].number ==
+              static_cast<double>(source.size()));
+        CHECK(pass_names(stats) == std::vector<std::string>(
+                                       {"read", "tokenize", "parse",
+                                        "generate", "write"}));
+        CHECK(stats["tokens"].number ==
+              static_cast<double>(Tokenizer(source).tokenize().size()));
+        const Json& counted = stats["ast_nodes"];
+        CHECK(counted.keys.size() == nodes.size());
+        for (const auto& [kind, count] : nodes) {
+            CHECK(counted[kind].number == count);
+        }
+        CHECK(stats["arena_bytes"].number > 0);
+        CHECK(stats["shared_expressions"].number == 0);
+        CHECK(stats["instructions"].number > 0);
+        // one label each for the elif, the else and the end of the chain
+        CHECK(stats["labels"].number == 3);
+        CHECK(stats["peak_rss_kib"].number > 0);
+
+        // shared subtrees are counted wherever they occur
+        const Json shared = stats_of("--in-memory --hash-cons > /dev/null",
+                                     directory);
+        CHECK(shared["ast_nodes"]["identifier"].number == 8);
+
+        if (testing::have("nasm") && testing::have("ld")) {
+            CHECK(pass_names(stats_of("-o program", directory)) ==
+                  std::vector<std::string>({"read", "tokenize", "parse",
+                                            "generate", "write", "assemble",
+                                            "link"}));
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n";
+        CHECK(false);
+    }
+
+    // an unwritable stats file is reported, the compile still succeeds
+    CHECK(testing::quarks("--in-memory --stats-json=missing/stats.json "
+                          "program.qs > /dev/null 2> error.txt",
+                          directory) == 0);
+    CHECK(read(directory / "error.txt").starts_with("Failed to write"));
+    std::filesystem::remove_all(directory);
+    return testing::failures();
+}
@@ -0,0 +1,69 @@
+#include "../include/common.hpp"
+#include "../include/arenaAllocator.hpp"
+#include "../include/tokenization.hpp"
+#include "../include/pipeline.hpp"
+#include "testing.hpp"
+
+namespace {
+
+/** a chain whose arms end alike; a, b pick the arm, the exit code tells */
+std::string chain(const int a, const int b) {
+    return "assign a = " + std::to_string(a) + ";\nassign b = " +
+           std::to_string(b) + ";\nassign x = 5;\nassign y = 3;\n"
+           "if (a) {\n    x = x + 1;\n    y = y * 2;\n} elif (b) {\n"
+           "    x = x - 1;\n    y = y * 2;\n} else {\n    x = x + 1;\n"
+           "    y = y * 2;\n}\nexit(x * 10 + y);\n";
+}
+
+} // namespace
+
+/**
+ * Tail merging: shared endings of chain arms are compiled once and counted,
+ * merged code runs like the branches it replaces, and streamed batches,
+ * whose freed nodes reuse addresses, merge exactly as a single compile.
+ */
+int main() {
+    const quarks::Options stats{.collect_stats = true, .if_conversion = 0};
+    const quarks::Result merged = quarks::compile(chain(0, 1), stats);
+    CHECK(merged.ok);
+    CHECK(merged.output.find("; merged") != std::string::npos);
+    CHECK(merged.stats.merged > 0);
+
+    // -g keeps every arm with its own line info
+    quarks::Options debug = stats;
+    debug.debug_source = "chain.qs";
+    const quarks::Result kept = quarks::compile(chain(0, 1), debug);
+    CHECK(kept.ok && kept.stats.merged == 0);
+
+    if (testing::have("nasm") && testing::have("ld") && testing::have("cc")) {
+        const quarks::Options c{.backend = quarks::Backend::c};
+        for (const auto& [a, b] : {std::pair{0, 0}, {0, 1}, {1, 0}, {1, 1}}) {
+            CHECK(testing::run_program(chain(a, b), {.if_conversion = 0}) ==
+                  testing::run_program(chain(a, b), c));
+        }
+    }
+
+    // chains of different shapes, so reused addresses hold other statements
+    std::string source = "assign x = 0;\n";
+    for (int i = 0; i < 3000; i++) {
+        const std::string n = std::to_string(i * 7 % 13);
+        if (i % 3 == 0) {
+            source += "if (x - " + n + ") {\n    x = x + " + n +
+                      ";\n    x = x * 3;\n} else {\n    x = x - 1;\n"
+                      "    x = x * 3;\n}\n";
+        } else if (i % 3 == 1) {
+            source += "if (x) {\n    x = x * " + n +
+                      ";\n} elif (x - 1) {\n    x = x + 2;\n    x = x * " + n +
+                      ";\n} else {\n    x = x * " + n + ";\n}\n";
+        } else {
+            source += "x = x + " + n + ";\n";
+        }
+    }
+    source += "exit(x);\n";
+    std::ostringstream streamed;
+    compile_streaming<Generator>(
+        source, streamed,
+        StreamingLimits{.token_batch = 256, .statement_batch = 8});
+    CHECK(streamed.str() == quarks::compile(source).output);
+    return testing::failures();
+}
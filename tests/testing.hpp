@@ -0,0 +1,112 @@
+#pragma once
+#include "../include/quarks.hpp"
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * What the regression tests share. Each file in tests/ is one executable
+ * ctest runs: CHECK reports a failed condition and carries on, so a run
+ * lists every broken case, and main returns failures().
+ */
+namespace testing {
+
+/** ctest counts a test that exits with this as skipped, not failed */
+inline constexpr int kSkipped = 77;
+
+inline int& failure_count() {
+    static int count = 0;
+    return count;
+}
+
+inline bool check(const bool ok, const char* condition, const char* file,
+                  const int line) {
+    if (!ok) {
+        std::cerr << file << ":" << line << ": CHECK(" << condition
+                  << ") failed\n";
+        failure_count()++;
+    }
+    return ok;
+}
+
+/** the exit status of main */
+inline int failures() { return failure_count() == 0 ? 0 : 1; }
+
+/** tool is on PATH, so tests needing it can run */
+inline bool have(const std::string& tool) {
+    return std::system(("command -v " + tool + " >/dev/null 2>&1").c_str()) ==
+           0;
+}
+
+/** a path in the temp directory no other test process uses */
+inline std::filesystem::path scratch(const std::string& name) {
+    static int next = 0;
+    return std::filesystem::temp_directory_path() /
+           ("quarks-test-" + std::to_string(::getpid()) + "-" +
+            std::to_string(next++) + "-" + name);
+}
+
+/**
+ * runs the quarks executable under test, which CMake names in QUARKS, with
+ * args in directory; its exit status
+ */
+inline int quarks(const std::string& args,
+                  const std::filesystem::path& directory) {
+    const std::string command =
+        "cd '" + directory.string() + "' && '" QUARKS "' " + args;
+    const int status = std::system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * runs executable bytes: the exit status, or 128 + the signal as in sh,
+ * or -1 when it could not run
+ */
+inline int run(const std::string& executable) {
+    const std::filesystem::path path = scratch("a.out");
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << executable;
+    }
+    std::filesystem::permissions(path, std::filesystem::perms::owner_all);
+    // spawned directly, so no shell reports the signal on stderr
+    pid_t pid = 0;
+    char* const argv[] = {const_cast<char*>(path.c_str()), nullptr};
+    int status = 0;
+    if (::posix_spawn(&pid, path.c_str(), nullptr, nullptr, argv, environ) !=
+            0 ||
+        ::waitpid(pid, &status, 0) != pid) {
+        status = -1;
+    }
+    std::filesystem::remove(path);
+    if (status == -1) {
+        return -1;
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/** builds source and runs it; -1 when it does not compile */
+inline int run_program(const std::string& source, quarks::Options options) {
+    options.emit = quarks::Emit::executable;
+    const quarks::Result result = quarks::compile(source, options);
+    if (!result.ok) {
+        std::cerr << "does not compile: " << result.diagnostics.front().message
+                  << "\n";
+        return -1;
+    }
+    return run(result.output);
+}
+
+} // namespace testing
+
+#define CHECK(condition)                                                       \
+    testing::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)